@@ -6,8 +6,11 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternAnalyzer.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixTester.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/NTupleMaker.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternBankConverter.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/StubCacheConverter.h"
 
 #include "boost/program_options.hpp"
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 
@@ -27,6 +30,8 @@ int main(int argc, char **argv) {
 
     // Create a struct that holds all input arguments
     ProgramOption option;
+    long long skipEvents = 0;
+    std::string shard;
 
     // Declare a group of options that will be allowed only on command line
     namespace po = boost::program_options;
@@ -38,10 +43,13 @@ int main(int argc, char **argv) {
         ("bankGeneration,B"    , "Generate associative memory pattern bank")
         ("patternRecognition,R", "Run associative memory pattern recognition")
         ("matrixBuilding,M"    , "Calculate matrix constants for PCA track fitting")
-        ("trackFitting,T"      , "Perform track fitting")
+        ("trackFitting,T"      , "Perform track fitting (with -R: fit the roads in memory, write them only if '--roads' is given)")
         ("bankAnalysis,A"      , "Analyze associative memory pattern bank")
         ("matrixTesting,U"     , "Test matrix constants for PCA track fitting")
         ("write,W"             , "Write full ntuple")
+        ("bankConversion,K"    , "Convert associative memory pattern bank into memory-mappable binary format (.bin)")
+        ("stubConversion,S"    , "Convert stubs into memory-mappable columnar stub cache (.stubcache), usable as input of '-B', '-M', '-A' and '-U'")
+        ("merge"               , "With '-B' or '-M': merge the outputs of the runs over the shards of the events, listed in the input .txt file")
         ("no-color"            , "Turn off colored text")
         ("timing"              , "Show timing information")
         ;
@@ -50,16 +58,22 @@ int main(int argc, char **argv) {
     // and in config file
     po::options_description config("Configuration");
     config.add_options()
-        ("input,i"      , po::value<std::string>(&option.input)->required(), "Specify input files")
+        ("input,i"      , po::value<std::string>(&option.input)->required(), "Specify input files (.root, .txt or .stubcache)")
         ("output,o"     , po::value<std::string>(&option.output)->required(), "Specify output file")
-        ("bank,b"       , po::value<std::string>(&option.bankfile), "Specify pattern bank file")
-        ("matrix,m"     , po::value<std::string>(&option.matrixfile), "Specify matrix constants file")
-        ("roads"        , po::value<std::string>(&option.roadfile), "Specify file containing the roads")
+        ("bank,b"       , po::value<std::string>(&option.bankfile), "Specify pattern bank file (.root or binary .bin)")
+        ("banks"        , po::value<std::vector<std::string> >(&option.bankfiles)->multitoken(), "Specify one pattern bank file per trigger tower given in --towers")
+        ("matrix,m"     , po::value<std::string>(&option.matrixfile), "Specify matrix constants file (with '-M' over a shard: the merged statistics of the previous passes)")
+        ("roads"        , po::value<std::string>(&option.roadfile), "Specify file containing the roads (with -RT: file to write the roads into)")
         ("tracks"       , po::value<std::string>(&option.trackfile), "Specify file containing the tracks")
 
         ("verbosity,v"  , po::value<int>(&option.verbose)->default_value(1), "Verbosity level (-1 = very quiet; 0 = quiet, 1 = verbose, 2+ = debug)")
         ("speedup"      , po::value<int>(&option.speedup)->default_value(0), "Speed-up level")
         ("maxEvents,n"  , po::value<long long>(&option.maxEvents)->default_value(-1), "Specfiy max number of events")
+        ("firstEvent"   , po::value<long long>(&option.firstEvent)->default_value(0), "Specify the first event to read")
+        ("skipEvents"   , po::value<long long>(&skipEvents)->default_value(0), "Specify # of events to skip after the first event")
+        ("shard"        , po::value<std::string>(&shard)->default_value("0/1"), "Specify the shard i/N of the events to read, the events are split into N contiguous ranges (the roads and tracks given to '-W' must be made from the same shard)")
+        ("threads"      , po::value<unsigned>(&option.nThreads)->default_value(1), "Specify number of worker threads")
+        ("readAhead"    , po::value<unsigned>(&option.readAhead)->default_value(0), "Specify number of events to read ahead in a background thread (0 = no read-ahead)")
 
         ("nLayers"      , po::value<unsigned>(&option.nLayers)->default_value(6), "Specify # of layers")
         ("nFakers"      , po::value<unsigned>(&option.nFakers)->default_value(0), "Specify # of fake superstrips")
@@ -67,6 +81,7 @@ int main(int argc, char **argv) {
 
         // Trigger tower selection
         ("tower,t"      , po::value<unsigned>(&option.tower)->default_value(27), "Specify the trigger tower")
+        ("towers"       , po::value<std::vector<unsigned> >(&option.towers)->multitoken(), "Specify a list of trigger towers to be processed in a single pass (only for pattern recognition)")
 
         // Superstrip definition
         ("superstrip,s" , po::value<std::string>(&option.superstrip)->default_value("ss256_nz2"), "Specify the superstrip definition (default: ss256_nz2)")
@@ -94,12 +109,19 @@ int main(int argc, char **argv) {
 
         // Only for bank generation
         ("minFrequency" , po::value<int>(&option.minFrequency)->default_value(1), "Specify min frequency of a pattern to be stored or read")
+        ("maxMemory"    , po::value<long int>(&option.maxMemory)->default_value(999999999), "Specify max memory (MB) used by the patterns before they are written out to temporary files next to the output")
+        ("targetCoverage", po::value<float>(&option.targetCoverage)->default_value(0.), "Specify target coverage to stop reading events once reached (0: read all events)")
+        ("coverageWindow", po::value<long int>(&option.coverageWindow)->default_value(100000), "Specify # of tracks in a window used to measure the coverage")
+        ("stableWindows", po::value<int>(&option.stableWindows)->default_value(3), "Specify # of consecutive windows that must reach the target coverage")
 
         // Only for pattern matching
         ("maxPatterns"  , po::value<long int>(&option.maxPatterns)->default_value(999999999), "Specfiy max number of patterns")
         ("maxMisses"    , po::value<int>(&option.maxMisses)->default_value(0), "Specify max number of allowed misses")
         ("maxStubs"     , po::value<int>(&option.maxStubs)->default_value(999999999), "Specfiy max number of stubs per superstrip")
         ("maxRoads"     , po::value<int>(&option.maxRoads)->default_value(999999999), "Specfiy max number of roads per event")
+        ("lookup"       , po::value<std::string>(&option.lookup)->default_value("scan"), "Select associative memory lookup -- scan: loop over all patterns; index: loop over patterns that contain fired superstrips; bitslice: bitwise majority logic on per-layer hit bitvectors (default: scan)")
+        ("flatRoads"    , po::bool_switch(&option.flatRoads)->default_value(false), "Write the roads as flat arrays with offsets instead of nested vectors")
+        ("dedupRoads"   , po::bool_switch(&option.dedupRoads)->default_value(false), "Write the roads as flat arrays, with the superstrips shared by several roads written once (implies --flatRoads)")
 
         // Only for matrix building
         ("view"         , po::value<std::string>(&option.view)->default_value("XYZ"), "Specify fit view (e.g. XYZ, XY, RZ)")
@@ -110,6 +132,7 @@ int main(int argc, char **argv) {
         ("minNdof"      , po::value<int>(&option.minNdof)->default_value(1), "Specify minimum degree of freedom")
         ("maxCombs"     , po::value<int>(&option.maxCombs)->default_value(999999999), "Specfiy max number of combinations per road")
         ("maxTracks"    , po::value<int>(&option.maxTracks)->default_value(999999999), "Specfiy max number of tracks per event")
+        ("batchFit"     , po::bool_switch(&option.batchFit)->default_value(false), "Fit the combinations of a road as a block with fixed-size matrices (only PCA4 and PCA5 with view XYZ)")
 
 	// Only for Duplicate Flag
         ("rmDuplicate", po::value<int>(&option.rmDuplicate)->default_value(-1), "Duplicate removal option. The argument is the number of max stubs allowed to be shared between AM tracks")
@@ -173,6 +196,14 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    if (option.towers.size() != option.bankfiles.size()) {
+        std::cerr << "ERROR: Must specify one pattern bank in '--banks' for each trigger tower in '--towers'" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Pattern recognition and track fitting can be combined
+    bool pipeline = vm.count("patternRecognition") && vm.count("trackFitting");
+
     // Exactly one of these options must be selected
     int vmcount = vm.count("stubCleaning")       +
                   vm.count("bankGeneration")     +
@@ -181,13 +212,32 @@ int main(int argc, char **argv) {
                   vm.count("trackFitting")       +
                   vm.count("bankAnalysis")       +
                   vm.count("matrixTesting")      +
-                  vm.count("write")              ;
+                  vm.count("write")              +
+                  vm.count("bankConversion")     +
+                  vm.count("stubConversion")     -
+                  pipeline                       ;
     if (vmcount != 1) {
-        std::cerr << "ERROR: Must select exactly one of '-C', '-B', '-R', '-M', '-T', '-A', '-U', or 'W'" << std::endl;
+        std::cerr << "ERROR: Must select exactly one of '-C', '-B', '-R', '-M', '-T', '-RT', '-A', '-U', '-W', '-K', or '-S'" << std::endl;
         //std::cout << visible << std::endl;
         return EXIT_FAILURE;
     }
 
+    if (vm.count("merge") && !vm.count("bankGeneration") && !vm.count("matrixBuilding")) {
+        std::cerr << "ERROR: '--merge' can only be used with '-B' or '-M'" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (option.batchFit && !((option.algo == "PCA4" || option.algo == "PCA5") && option.view == "XYZ")) {
+        std::cerr << "ERROR: '--batchFit' can only be used with PCA4 or PCA5 and view XYZ" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    char shardEnd = 0;
+    if (std::sscanf(shard.c_str(), "%u/%u%c", &option.iShard, &option.nShards, &shardEnd) != 2 || option.nShards == 0 || option.iShard >= option.nShards) {
+        std::cerr << "ERROR: '--shard' must be i/N with 0 <= i < N" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     if (vm.count("no-color")) {
         slhcl1tt::NoColor();
     }
@@ -200,6 +250,12 @@ int main(int argc, char **argv) {
     if (option.maxEvents < 0)
         option.maxEvents = std::numeric_limits<long long>::max();
 
+    option.firstEvent = std::max(0LL, option.firstEvent) + std::max(0LL, skipEvents);
+    option.merge = vm.count("merge");
+
+    option.nThreads = std::max(1u, option.nThreads);
+    option.coverageWindow = std::max(1L, option.coverageWindow);
+    option.stableWindows = std::max(1, option.stableWindows);
     option.nLayers = std::min(std::max(3u, option.nLayers), 8u);
     option.nFakers = std::min(std::max(0u, option.nFakers), 3u);
     option.nDCBits = std::min(std::max(0u, option.nDCBits), 4u);
@@ -237,6 +293,18 @@ int main(int argc, char **argv) {
         }
         std::cout << "Pattern bank generation " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
 
+    } else if (pipeline) {
+        std::cout << Color("magenta") << "Start pattern recognition and track fitting..." << EndColor() << std::endl;
+
+        PatternMatcher matcher(option);
+        TrackFitter fitter(option);
+        int exitcode = matcher.run(fitter);
+        if (exitcode) {
+            std::cerr << "An error occurred during pattern recognition and track fitting. Exiting." << std::endl;
+            return exitcode;
+        }
+        std::cout << "Pattern recognition and track fitting " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
+
     } else if (vm.count("patternRecognition")) {
         std::cout << Color("magenta") << "Start pattern recognition..." << EndColor() << std::endl;
 
@@ -303,6 +371,28 @@ int main(int argc, char **argv) {
         }
         std::cout << "Writing full ntuple " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
 
+    } else if (vm.count("bankConversion")) {
+        std::cout << Color("magenta") << "Start pattern bank conversion..." << EndColor() << std::endl;
+
+        PatternBankConverter converter(option);
+        int exitcode = converter.run();
+        if (exitcode) {
+            std::cerr << "An error occurred during pattern bank conversion. Exiting." << std::endl;
+            return exitcode;
+        }
+        std::cout << "Pattern bank conversion " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
+
+    } else if (vm.count("stubConversion")) {
+        std::cout << Color("magenta") << "Start stub conversion..." << EndColor() << std::endl;
+
+        StubCacheConverter converter(option);
+        int exitcode = converter.run();
+        if (exitcode) {
+            std::cerr << "An error occurred during stub conversion. Exiting." << std::endl;
+            return exitcode;
+        }
+        std::cout << "Stub conversion " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
+
     }
 
     return EXIT_SUCCESS;
@@ -3,43 +3,127 @@
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/HitBuffer.h"
+#include <stdint.h>
 #include <vector>
 
 namespace slhcl1tt {
 
+  enum AssociativeMemoryEngine {AMSCAN, AMINDEX, AMBITSLICE};
+
+// Working memory used by the lookup. Each thread that performs lookups on the
+// same bank needs its own workspace.
+struct AssociativeMemoryWorkspace {
+    // Per-pattern layer-hit counters, and the patterns touched in the current event
+    std::vector<uint8_t>      patternCounters;
+    std::vector<unsigned>     touchedPatterns;
+
+    // (nLayers + 1) bitvectors of nWords 64-bit words each. Bit i of layer j is set
+    // if pattern i is hit in layer j. The last bitvector holds the patterns that are fired.
+    std::vector<uint64_t>     bitsliceWords;
+
+    // With DC bits: coarse superstrip --> bitmask of the low bits that are hit, and the
+    // coarse superstrips that are hit in the current event
+    std::vector<superstrip_bit_type> coarseMasks;
+    std::vector<superstrip_type>     coarseHits;
+};
+
 class AssociativeMemory {
   public:
     // Constructor
-    AssociativeMemory() : frozen_(false) {}
+    AssociativeMemory() : mappedPatterns_(0), mappedPatternBits_(0), mappedInvPts_(0), npatterns_(0), mapped_(false),
+                          engine_(AssociativeMemoryEngine::AMSCAN), nLayers_(0), nDCBits_(0), nWords_(0), useAVX2_(false), frozen_(false) {}
 
     // Destructor
     ~AssociativeMemory() {}
 
     // Functions
     // Initialize
-    int init(unsigned npatterns);
+    int init(unsigned npatterns, AssociativeMemoryEngine engine=AssociativeMemoryEngine::AMSCAN);
 
     // Insert patterns
     void insert(std::vector<superstrip_type>::const_iterator begin, std::vector<superstrip_type>::const_iterator end, const float invPt);
     void insert(const pattern_type& patt, const float invPt);
 
-    void freeze();
+    // Insert patterns made of coarse superstrips and their DC bits
+    void insert(const pattern_type& patt, const pattern_bit_type& pattBits, const float invPt);
 
-    unsigned size() const { return patternBank_.size(); }
+    // Use patterns stored outside, e.g. in a memory-mapped bank, instead of inserting them
+    // The arrays are not copied, so they must outlive the associative memory
+    // pattBits can be null if there are no DC bits
+    void map(const pattern_type * patterns, const pattern_bit_type * pattBits, const float * invPts, unsigned npatterns);
+
+    // Freeze the bank, build the lookup index if needed
+    // With nDCBits > 0, the patterns contain coarse superstrips and a layer is hit
+    // if a hit superstrip has the same coarse superstrip (superstrip >> nDCBits)
+    // and low bits that are accepted by the DC bits (TCAM matching)
+    void freeze(unsigned nLayers, unsigned nDCBits=0);
+
+    unsigned size() const { return mapped_ ? npatterns_ : patternBank_.size(); }
 
     // Perform direct pattern lookup, return a list of patterns that are fired
     std::vector<unsigned> lookup(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses);
 
+    // Same as above, but thread-safe as long as every thread provides its own workspace
+    std::vector<unsigned> lookup(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const;
+
     // Retrieve superstripIds and attributes
-    void retrieve(const unsigned patternRef, pattern_type& superstripIds, float& invPt);
+    void retrieve(const unsigned patternRef, pattern_type& superstripIds, float& invPt) const;
+    void retrieve(const unsigned patternRef, pattern_type& superstripIds, pattern_bit_type& superstripBits, float& invPt) const;
 
     // Debug
     void print();
 
   private:
+    // Member functions
+    // Loop over all patterns, check every layer in the hit buffer
+    std::vector<unsigned> lookupScan(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const;
+
+    // Loop over the patterns that contain a fired superstrip, count the layers that are hit
+    std::vector<unsigned> lookupIndex(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const;
+
+    // Build one hit bitvector per layer, apply the majority logic with bitwise operations
+    std::vector<unsigned> lookupBitslice(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const;
+
+    // With DC bits, collect the low bits that are hit for each coarse superstrip
+    void fillCoarseMasks(const HitBuffer& hitBuffer, AssociativeMemoryWorkspace& workspace) const;
+    void resetCoarseMasks(AssociativeMemoryWorkspace& workspace) const;
+
+    // The pattern arrays, either owned or mapped
+    const pattern_type     * patternData()     const { return mapped_ ? mappedPatterns_    : patternBank_.data(); }
+    const pattern_bit_type * patternBitsData() const { return mapped_ ? mappedPatternBits_ : patternBits_.data(); }
+    const float            * invPtData()       const { return mapped_ ? mappedInvPts_      : patternAttributes_invPt_.data(); }
+
     // Member data
     std::vector<pattern_type> patternBank_;
     std::vector<float>        patternAttributes_invPt_;
+
+    // DC bits, and the bitmasks of the low bits they accept (only with DC bits)
+    std::vector<pattern_bit_type> patternBits_;
+    std::vector<pattern_bit_type> patternMasks_;
+
+    // Mapped patterns, used instead of the vectors above if mapped_ is set
+    const pattern_type     * mappedPatterns_;
+    const pattern_bit_type * mappedPatternBits_;
+    const float            * mappedInvPts_;
+    unsigned npatterns_;
+    bool mapped_;
+
+    // Inverted index: superstrip --> patternRefs, stored as offsets and a flat array
+    // The patternRefs of superstrip ss are indexPatternRefs_[indexOffsets_[ss]] .. indexPatternRefs_[indexOffsets_[ss+1]-1]
+    std::vector<unsigned>     indexOffsets_;
+    std::vector<unsigned>     indexPatternRefs_;
+
+    // Bit-sliced bank: the layer of each superstrip
+    std::vector<uint8_t>      indexLayers_;
+
+    // Workspace used by the single-threaded lookup
+    AssociativeMemoryWorkspace workspace_;
+
+    AssociativeMemoryEngine engine_;
+    unsigned nLayers_;
+    unsigned nDCBits_;
+    unsigned nWords_;
+    bool useAVX2_;
     bool frozen_;
 };
 
@@ -13,7 +13,7 @@ class CombinationBuilderFactory
 {
  public:
   // Constructor
-  CombinationBuilderFactory(const bool advancedCombinationBuilder) : verbose_(true)
+  CombinationBuilderFactory(const bool advancedCombinationBuilder) : verbose_(true), icomb_(0), ncombs_(0)
   {
     // bool advancedCombinationBuilder = false;
     if (advancedCombinationBuilder) combinationBuilder_ = std::make_shared<AdvancedCombinationBuilder>(true);
@@ -59,6 +59,32 @@ class CombinationBuilderFactory
     return combinations;
   }
 
+  // Return the combinations one at a time, in the same order as combine()
+  // begin() starts with a new road
+  void begin(const std::vector<std::vector<unsigned> >& stubRefs)
+  {
+    // The road is kept alive while its combinations are read
+    road_ = std::make_shared<Road>(stubRefs);
+    combinationBuilder_->initialize(*road_);
+    icomb_ = 0;
+    ncombs_ = combinationBuilder_->totalCombinations();
+  }
+
+  // Write the next combination into a reusable buffer, returns false if there
+  // is no more combination
+  bool next(std::vector<unsigned>& combination)
+  {
+    if (icomb_ >= ncombs_) return false;
+    ++icomb_;
+
+    StubsCombination stubsCombination(combinationBuilder_->nextCombination());
+    combination.clear();
+    for (auto s : stubsCombination) {
+      combination.push_back(s.stubRef());
+    }
+    return true;
+  }
+
   // Debug
   void print();
 
@@ -66,6 +92,11 @@ class CombinationBuilderFactory
   // Member data
   int verbose_;
   std::shared_ptr<CombinationBuilderBase> combinationBuilder_;
+
+  // State of the combinations returned one at a time
+  std::shared_ptr<Road> road_;
+  int icomb_;
+  int ncombs_;
 };
 
 }
@@ -8,7 +8,7 @@ namespace slhcl1tt {
 class CombinationFactory {
   public:
     // Constructor
-    CombinationFactory() : verbose_(true) {}
+    CombinationFactory() : verbose_(true), groups_(0), done_(true) {}
 
     // Destructor
     ~CombinationFactory() {}
@@ -19,38 +19,17 @@ class CombinationFactory {
     // Arrange combinations
     // groups[i][j] is the j-th element in the i-th group
     // combinations[i][j] is the j-th element in the i-th combination
-    template<typename T>
-    std::vector<std::vector<T> > combine(const std::vector<std::vector<T> >& groups) {
-        std::vector<T> combination;
-        std::vector<std::vector<T> > combinations;
+    // It calls begin() and next(), so it ends the combinations of the previous
+    // groups
+    std::vector<std::vector<unsigned> > combine(const std::vector<std::vector<unsigned> >& groups);
 
-        const int ngroups = groups.size();
-        std::vector<unsigned> indices(ngroups, 0);  // init to zeroes
+    // Arrange combinations one at a time, in the same order as combine()
+    // begin() starts with new groups, which must outlive the calls to next()
+    void begin(const std::vector<std::vector<unsigned> >& groups);
 
-        int i=0, j=0;
-        while (true) {
-            combination.clear();
-            for (i=0; i<ngroups; ++i) {
-                if (groups.at(i).size())
-                    combination.push_back(groups.at(i).at(indices.at(i)));
-                else  // empty group
-                    combination.push_back(CombinationFactory::BAD);
-            }
-            combinations.push_back(combination);
-
-            for (i=ngroups-1; i>=0; --i)
-                if (groups.at(i).size())
-                    if (indices.at(i) != groups.at(i).size() - 1)
-                        break;  // take the last index that has not reached the end
-            if (i == -1)  break;
-
-            indices[i] += 1;  // increment that index
-            for (j=i+1; j<ngroups; ++j)
-                indices[j] = 0;  // set indices behind that index to zeroes
-        }
-
-        return combinations;
-    }
+    // Write the next combination into a reusable buffer, returns false if
+    // there is no more combination
+    bool next(std::vector<unsigned>& combination);
 
     // Debug
     void print();
@@ -59,6 +38,11 @@ class CombinationFactory {
   private:
     // Member data
     int verbose_;
+
+    // State of the combinations produced one at a time
+    const std::vector<std::vector<unsigned> > * groups_;
+    std::vector<unsigned> indices_;
+    bool done_;
 };
 
 }
@@ -1,6 +1,8 @@
 #ifndef AMSimulation_GhostBuster_h_
 #define AMSimulation_GhostBuster_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include <unordered_map>
 #include <vector>
 
 namespace slhcl1tt {
@@ -22,12 +24,24 @@ class GhostBuster {
     // Is track 2 a ghost of track 1?
     bool isGhostTrack(const std::vector<unsigned>& stubRefs1, const std::vector<unsigned>& stubRefs2, const unsigned threshold=2) const;
 
+    // Flag the tracks that are ghosts of an earlier track that is not a ghost,
+    // as when calling isGhostTrack() on every pair. The tracks that are kept
+    // are indexed by their stubs, so a track is only compared with the tracks
+    // that share a stub with it
+    void findGhostTracks(std::vector<TTTrack2>& tracks, const unsigned threshold=2);
+
     // Debug
     void print();
 
   private:
     // Member data
     int verbose_;
+
+    // Buffers of findGhostTracks()
+    std::vector<std::vector<unsigned> > stubRefs_;  // stubRefs of each track
+    std::vector<std::unordered_map<unsigned, std::vector<unsigned> > > layerTracks_;  // stubRef -> kept tracks, per layer
+    std::vector<unsigned> layerMasks_;  // distinct sets of the layers with a stub of the kept tracks
+    std::vector<unsigned> lastCompared_;  // last track compared with each kept track
 };
 
 }
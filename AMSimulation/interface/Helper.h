@@ -59,6 +59,30 @@ inline unsigned compressLayer(const unsigned& lay) {
     return 255;
 }
 
+// Join 'layer' and 'superstrip' into one number
+inline unsigned simpleHash(unsigned layer, unsigned nss, unsigned ss) {
+    return layer * nss + ss;
+}
+
+inline unsigned simpleHashUndo(unsigned layer, unsigned nss, unsigned ssh) {
+    return ssh % nss;
+}
+
+inline unsigned simpleHashNbins(unsigned nlayers, unsigned nss) {
+    return simpleHash(nlayers, nss, 0);
+}
+
+// With DC bits, join 'layer' and the coarse superstrip into one number, then
+// append the low bits of the superstrip. Same as simpleHash if nDCBits = 0.
+inline unsigned dcHash(unsigned layer, unsigned nssCoarse, unsigned ss, unsigned nDCBits) {
+    return (simpleHash(layer, nssCoarse, ss >> nDCBits) << nDCBits) | (ss & ((1u << nDCBits) - 1));
+}
+
+// Number of coarse superstrips per layer
+inline unsigned dcNsuperstrips(unsigned nss, unsigned nDCBits) {
+    return (nss + (1u << nDCBits) - 1) >> nDCBits;
+}
+
 }  // namespace slhcl1tt
 
 #endif
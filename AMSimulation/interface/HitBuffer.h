@@ -2,11 +2,32 @@
 #define AMSimulation_HitBuffer_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
-#include <map>
+#include <algorithm>
+#include <cassert>
+#include <utility>
 #include <vector>
 
 namespace slhcl1tt {
 
+// A view of the stubRefs of one superstrip, valid until the next reset()
+class StubRefSpan {
+  public:
+    typedef const unsigned * const_iterator;
+
+    StubRefSpan() : begin_(0), end_(0) {}
+    StubRefSpan(const unsigned * begin, const unsigned * end) : begin_(begin), end_(end) {}
+
+    const_iterator begin() const { return begin_; }
+    const_iterator end()   const { return end_; }
+    unsigned size()  const { return end_ - begin_; }
+    bool     empty() const { return begin_ == end_; }
+    unsigned operator[](unsigned i) const { return begin_[i]; }
+
+  private:
+    const unsigned * begin_;
+    const unsigned * end_;
+};
+
 class HitBuffer {
   public:
     // Constructor
@@ -19,26 +40,97 @@ class HitBuffer {
     // Initialize
     int init(unsigned maxBins);
 
+    // Only clears the superstrips that were hit in the previous event
     void reset();
 
     void insert(superstrip_type ss, unsigned stubRef);
 
+    // Keep at most maxStubs stubs per superstrip, and build the flat stubRef array
     void freeze(unsigned maxStubs);
 
-    bool isHit(superstrip_type ss) const { return superstripBools_.at(ss); }
+    bool isHit(superstrip_type ss) const { return ss < superstripCounts_.size() && superstripCounts_[ss] != 0; }
+
+    StubRefSpan getHits(superstrip_type ss) const {
+        if (!isHit(ss))
+            return StubRefSpan();
+        const std::pair<unsigned, unsigned>& range = superstripRanges_[ss];
+        return StubRefSpan(stubRefs_.data() + range.first, stubRefs_.data() + range.second);
+    }
 
-    std::vector<unsigned> getHits(superstrip_type ss) const { return superstripHits_.at(ss); }
+    // Superstrips that are hit in this event, in order of first insertion
+    const std::vector<superstrip_type>& getHitSuperstrips() const { return superstripsHit_; }
 
     // Debug
     void print();
 
   private:
     // Member data
-    std::map<superstrip_type, std::vector<unsigned> > superstripHits_;   // superstrip --> stubRefs (std::map)
-    std::vector<bool>                                 superstripBools_;  // superstrip --> hit or empty (hash table)
+    // The stubRefs of superstrip ss are stubRefs_[superstripRanges_[ss].first] .. stubRefs_[superstripRanges_[ss].second - 1]
+    std::vector<unsigned>                              superstripCounts_;  // superstrip --> number of stubs, 0 if empty (hash table)
+    std::vector<std::pair<unsigned, unsigned> >        superstripRanges_;  // superstrip --> range in stubRefs_ (hash table, only valid if hit)
+    std::vector<unsigned>                              stubRefs_;          // flat array of stubRefs, grouped by superstrip
+    std::vector<std::pair<superstrip_type, unsigned> > insertedHits_;      // (superstrip, stubRef) in order of insertion
+    std::vector<superstrip_type>                       superstripsHit_;    // list of superstrips that are hit
     bool frozen_;
 };
 
+
+// Index of the superstrips of the roads of an event in their TTSuperstripTable,
+// addressed by the hit buffer bin of the (coarse) superstrip, so that finding
+// a superstrip needs no hashing. The entries of a bin are told apart by a key,
+// e.g. the fine superstrips that are hit with DC bits
+class SuperstripTableIndex {
+  public:
+    // Constructor
+    SuperstripTableIndex() {}
+
+    // Destructor
+    ~SuperstripTableIndex() {}
+
+    // Functions
+    // Only clears the bins that were used in the previous event
+    void reset() {
+        for (std::vector<unsigned>::const_iterator it = binsUsed_.begin(); it != binsUsed_.end(); ++it)
+            heads_[*it] = NONE;
+        binsUsed_.clear();
+        next_.clear();
+        keys_.clear();
+    }
+
+    // Entry of (bin, key) in the table, NONE if not found
+    unsigned find(unsigned bin, unsigned key) const {
+        if (bin >= heads_.size())
+            return NONE;
+        for (unsigned entry = heads_[bin]; entry != NONE; entry = next_[entry]) {
+            if (keys_[entry] == key)
+                return entry;
+        }
+        return NONE;
+    }
+
+    // Entries must be inserted in the order of the table
+    void insert(unsigned bin, unsigned key, unsigned entry) {
+        assert(entry == keys_.size());
+        if (bin >= heads_.size())
+            heads_.resize(bin + 1, unsigned(NONE));
+        if (heads_[bin] == NONE)
+            binsUsed_.push_back(bin);
+
+        next_.push_back(heads_[bin]);
+        keys_.push_back(key);
+        heads_[bin] = entry;
+    }
+
+    static const unsigned NONE = 0xffffffff;
+
+  private:
+    // Member data
+    std::vector<unsigned> heads_;     // bin --> latest entry, NONE if empty
+    std::vector<unsigned> binsUsed_;  // bins that are not empty
+    std::vector<unsigned> next_;      // entry --> previous entry of the same bin
+    std::vector<unsigned> keys_;      // entry --> key
+};
+
 }
 
 #endif
@@ -2,6 +2,7 @@
 #define AMSimulation_MatrixBuilder_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Moments.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
@@ -19,7 +20,7 @@ class MatrixBuilder {
     // Constructor
     MatrixBuilder(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose),
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose),
       view_(XYZ), nvariables_(12), nparameters_(4) {
 
         // Determine # of variables and # of parameters
@@ -75,25 +76,57 @@ class MatrixBuilder {
     int setRotationToZero(Eigen::MatrixXd& rotation, const unsigned nvariables, const unsigned hitBits);
     int setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsigned nvariables, const unsigned hitBits);
 
-    // Build matrices
+    // Build matrices. With more than one shard, only the next pass is done
     int buildMatrices(TString src);
 
-    int loopEventsAndFilter(TTStubReader& reader);
+    // Merge the statistics of the shards
+    int mergeStatistics(TString src);
 
-    int loopEventsAndSolveCT(TTStubReader& reader);
+    // Stub coordinates and sim parameters of a track
+    struct MatrixTrack {
+        Eigen::VectorXd variables1;  // phi
+        Eigen::VectorXd variables2;  // z
+        Eigen::VectorXd variables3;  // deltaR
+        double simChargeOverPt, simCotTheta, simPhi, simVz;
+    };
 
-    int loopEventsAndSolveEigenvectors(TTStubReader& reader);
+    // Get the track of the event, returns false if it fails the invPt or
+    // trigger tower requirements
+    bool getTrack(const TTStubReader& reader, MatrixTrack& trk) const;
 
-    int loopEventsAndSolveD(TTStubReader& reader);
+    bool isOutlier(const MatrixTrack& trk) const;
+
+    Eigen::VectorXd getFilterVariables(const MatrixTrack& trk) const;
+
+    Eigen::VectorXd getCorrectedVariables(const MatrixTrack& trk);
+
+    Eigen::VectorXd getParameters(const MatrixTrack& trk) const;
+
+    // Loop over all events and fill the moments of a pass
+    int loopEventsAndFill(TTStubReader& reader, unsigned ipass, Moments& moments);
+
+    // Solve for the matrices of a pass, given its moments
+    int solvePass(unsigned ipass, const Moments& moments);
+
+    int solveFilter(const Moments& moments);
+
+    int solveCT(const Moments& moments);
+
+    int solveEigenvectorsAndD(const Moments& moments);
 
     int loopEventsAndEval(TTStubReader& reader);
 
+    // Read and write the statistics of the passes
+    int readStatistics(TString src, std::vector<Moments>& stats);
+    int writeStatistics(TString out);
+
     // Write matrices
     int writeMatrices(TString out);
     int writeHistograms(TString out);
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
@@ -109,8 +142,13 @@ class MatrixBuilder {
     Eigen::VectorXd meansR_;
     PCAMatrix mat_;
 
-    // Event filter decisions
-    std::vector<bool> keepEvents_;
+    // Event filter: principal components of the cheating version
+    Eigen::VectorXd filterMeans_;
+    Eigen::MatrixXd filterV_;
+    Eigen::VectorXd filterSqrtEigenvalues_;
+
+    // Moments of the passes done so far
+    std::vector<Moments> stats_;
 
     // Histograms
     std::map<TString, TH1F *>  histograms_;
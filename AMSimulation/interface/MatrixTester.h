@@ -13,7 +13,7 @@ class MatrixTester {
     // Constructor
     MatrixTester(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose) {
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose) {
 
         // Initialize
         ttmap_ = new TriggerTowerMap();
@@ -42,6 +42,7 @@ class MatrixTester {
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
@@ -0,0 +1,80 @@
+#ifndef AMSimulation_ModuleIndex_h_
+#define AMSimulation_ModuleIndex_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include <stdint.h>
+#include <vector>
+
+
+namespace slhcl1tt {
+
+// Dense index of the modules, with flat lookup tables of their trigger towers,
+// layers and compressed module codes. Every lookup is an array load.
+// The module ID is 10000*layer + 100*ladder + module, so it is first mapped
+// directly into (16 layers x 100 ladders x 100 modules) slots, then into a
+// dense index over the modules that are known.
+class ModuleIndex {
+  public:
+    static const unsigned NSLOTS  = 16 * 100 * 100;
+    static const unsigned NTOWERS = 64;  // number of bits in the tower mask
+    static const unsigned INVALID = 0xffff;
+
+    // Constructor
+    ModuleIndex();
+
+    // Destructor
+    ~ModuleIndex() {}
+
+    // Functions
+    // Slot of a module ID in the direct-indexed tables, or NSLOTS if the layer
+    // is not a tracker layer
+    static unsigned slot(unsigned moduleId) {
+        const unsigned lay16 = compressLayer(decodeLayer(moduleId));
+        return (lay16 < 16) ? (lay16 * 10000 + moduleId % 10000) : NSLOTS;
+    }
+
+    // Set the modules of a trigger tower (tt < NTOWERS), sorted by module ID
+    void setTowerModules(unsigned tt, const std::vector<unsigned>& moduleIds);
+
+    // Remove everything
+    void clear();
+
+    // Dense index of a module, or INVALID if the module is unknown
+    unsigned index(unsigned moduleId) const {
+        const unsigned s = slot(moduleId);
+        return (s < NSLOTS) ? slotIndices_[s] : INVALID;
+    }
+
+    // Number of modules
+    unsigned size() const { return moduleIds_.size(); }
+
+    // Module ID and layer (0-15) of a dense index
+    unsigned moduleId(unsigned i) const { return moduleIds_[i]; }
+    unsigned layer(unsigned i) const { return layers_[i]; }
+
+    // Bitmask of the trigger towers that contain the module
+    uint64_t towerMask(unsigned i) const { return (i < size()) ? towerMasks_[i] : 0; }
+
+    bool isInTower(unsigned i, unsigned tt) const { return tt < NTOWERS && ((towerMask(i) >> tt) & 1); }
+
+    // Position of the module among the modules of the same layer in a trigger
+    // tower, or INVALID if the module is not in the trigger tower
+    unsigned moduleCode(unsigned i, unsigned tt) const {
+        return (i < size() && tt < moduleCodes_.size()) ? moduleCodes_[tt][i] : INVALID;
+    }
+
+  private:
+    // Member functions
+    unsigned insert(unsigned moduleId);
+
+    // Member data
+    std::vector<uint16_t> slotIndices_;  // dense index of each slot
+    std::vector<unsigned> moduleIds_;
+    std::vector<uint8_t>  layers_;
+    std::vector<uint64_t> towerMasks_;
+    std::vector<std::vector<uint16_t> > moduleCodes_;  // [tower][module]
+};
+
+}  // namespace slhcl1tt
+
+#endif
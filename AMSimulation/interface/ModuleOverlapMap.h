@@ -2,6 +2,7 @@
 #define AMSimulation_ModuleOverlapMap_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleIndex.h"
 #include <map>
 #include <string>
 #include <vector>
@@ -46,10 +47,24 @@ public:
   // Read overlap modules map root file
   void readModuleOverlapMap(TString datadir);
 
+  // Find the overlap region of a module, or 0 if it has none. This is a
+  // direct-indexed lookup, meant for the per-stub loops
+  const ModuleOverlap* find(unsigned moduleId) const {
+      const unsigned s = ModuleIndex::slot(moduleId);
+      if (s >= overlapSlots_.size() || overlapSlots_[s] == ModuleIndex::INVALID)
+          return 0;
+      return &overlaps_[overlapSlots_[s]];
+  }
+
 //private:
   // Module overlap data
   std::map<unsigned, ModuleOverlap>                moduleOverlap_map_;
 
+  // Flat copy of the module overlap data, with the position of each module
+  // indexed by ModuleIndex::slot()
+  std::vector<ModuleOverlap>                       overlaps_;
+  std::vector<uint16_t>                            overlapSlots_;
+
 };
 
 }  // namespace slhcl1tt
@@ -0,0 +1,52 @@
+#ifndef AMSimulation_Moments_h_
+#define AMSimulation_Moments_h_
+
+#include "Eigen/Core"
+#include <iosfwd>
+
+namespace slhcl1tt {
+
+// Mean vector and covariance matrix of a set of vectors, updated one vector at
+// a time. The moments of two sets can be merged, so that the moments of the
+// events can be computed in several jobs and merged afterwards.
+class Moments {
+  public:
+    // Constructor
+    Moments(unsigned dim=0);
+
+    // Destructor
+    ~Moments() {}
+
+    // Functions
+    void fill(const Eigen::VectorXd& x);
+
+    // Add the entries of another Moments of the same dimension
+    void merge(const Moments& other);
+
+    long int getEntries() const { return n_; }
+
+    unsigned getDimension() const { return means_.size(); }
+
+    const Eigen::VectorXd& getMeans() const { return means_; }
+
+    // Sample covariance matrix
+    Eigen::MatrixXd getCovariances() const;
+
+    bool operator==(const Moments& rhs) const {
+        return n_ == rhs.n_ && means_ == rhs.means_ && m2_ == rhs.m2_;
+    }
+
+    // Read and write as text, without loss of precision
+    int read(std::istream& is);
+    void write(std::ostream& os) const;
+
+  private:
+    // Member data
+    long int n_;
+    Eigen::VectorXd means_;
+    Eigen::MatrixXd m2_;  // sum of the products of the deviations from the means
+};
+
+}  // namespace slhcl1tt
+
+#endif
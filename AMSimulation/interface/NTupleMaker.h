@@ -32,7 +32,7 @@ class NTupleMaker {
     // Constructor
     NTupleMaker(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose),
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose),
       trim_(!po.no_trim) {
 
         makeLeafMap();
@@ -81,6 +81,7 @@ class NTupleMaker {
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
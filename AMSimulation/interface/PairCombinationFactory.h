@@ -10,14 +10,20 @@ namespace slhcl1tt{
 
 class PairCombinationFactory{
   public:
-    PairCombinationFactory() : verbose_(true) {}
+    PairCombinationFactory() : verbose_(true), l0_(0), l2_(0), l4_(0), i_(0), j_(0), k_(0) {}
     
     ~PairCombinationFactory() {}
     
     // Enum
     enum Flag { BAD=999999999 };
     
-    std::vector<std::vector<unsigned> > combine(const std::vector<std::vector<unsigned> >& groups, std::vector<std::vector<float> > DeltaS, bool FiveOfSix);
+    std::vector<std::vector<unsigned> > combine(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix);
+
+    // Return the combinations one at a time, in the same order as combine()
+    // begin() makes the pairs of a new road, next() writes the next surviving
+    // combination into a reusable buffer and returns false if there is none
+    void begin(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix);
+    bool next(std::vector<unsigned>& combination);
     
     //debug
     void print();
@@ -29,8 +35,15 @@ class PairCombinationFactory{
     float Coarsener(float DeltaS, int precision, int layer);
 
     //central functions
-    std::vector<PairAssignment> Stage1Pair(std::vector<std::pair<unsigned, float> > first, std::vector<std::pair<unsigned, float> > second, float cut);
-    std::vector<std::vector<unsigned> > CombinationBuilder(std::vector<PairAssignment> Layer10, std::vector<PairAssignment> Layer12, std::vector<PairAssignment> Layer32, std::vector<PairAssignment> Layer34, std::vector<PairAssignment> Layer54, unsigned l0, unsigned l2, unsigned l4);
+    std::vector<PairAssignment> Stage1Pair(const std::vector<std::pair<unsigned, float> >& first, const std::vector<std::pair<unsigned, float> >& second, float cut);
+
+    //stubs and coarsened DeltaS values of the layers of the current road, dummies included
+    std::vector<std::pair<unsigned, float> > Layer_[6];
+
+    //layer pairs of the current road and position of the next permutation
+    std::vector<PairAssignment> Layer10_, Layer12_, Layer32_, Layer34_, Layer54_;
+    unsigned l0_, l2_, l4_;
+    unsigned i_, j_, k_;
 };
 
     
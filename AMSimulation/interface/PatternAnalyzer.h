@@ -19,7 +19,7 @@ class PatternAnalyzer {
     // Constructor
     PatternAnalyzer(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose) {
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose) {
 
         // Initialize
         ttmap_ = new TriggerTowerMap();
@@ -53,6 +53,7 @@ class PatternAnalyzer {
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
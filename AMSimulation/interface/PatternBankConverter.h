@@ -0,0 +1,50 @@
+#ifndef AMSimulation_PatternBankConverter_h_
+#define AMSimulation_PatternBankConverter_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/SuperstripArbiter.h"
+using namespace slhcl1tt;
+
+
+class PatternBankConverter {
+  public:
+    // Constructor
+    PatternBankConverter(const ProgramOption& po)
+    : po_(po),
+      verbose_(po.verbose) {
+
+        // Initialize
+        ttmap_ = new TriggerTowerMap();
+        ttmap_->read(po_.datadir);
+
+        arbiter_ = new SuperstripArbiter();
+    }
+
+    // Destructor
+    ~PatternBankConverter() {
+        if (ttmap_)     delete ttmap_;
+        if (arbiter_)   delete arbiter_;
+    }
+
+    // Main driver
+    int run();
+
+
+  private:
+    // Member functions
+    // Convert a ROOT pattern bank into the memory-mappable binary format
+    int convertBank(TString src, TString out);
+
+    // Program options
+    const ProgramOption po_;
+    int verbose_;
+
+    // Operators
+    TriggerTowerMap   * ttmap_;
+    SuperstripArbiter * arbiter_;
+};
+
+#endif
@@ -6,7 +6,7 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/SuperstripArbiter.h"
-#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Attributes.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternTable.h"
 using namespace slhcl1tt;
 
 
@@ -15,7 +15,8 @@ class PatternGenerator {
     // Constructor
     PatternGenerator(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose) {
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose),
+      mergedRecords_(0), mergedSize_(0) {
 
         // Initialize
         ttmap_ = new TriggerTowerMap();
@@ -29,15 +30,7 @@ class PatternGenerator {
     ~PatternGenerator() {
         if (ttmap_)     delete ttmap_;
         if (arbiter_)   delete arbiter_;
-
-        for (std::map<pattern_type, Attributes *>::iterator it=patternAttributes_map_.begin();
-             it != patternAttributes_map_.end(); ++it) {
-            if (it->second)  delete it->second;
-        }
-        for (std::map<pattern_type, ShortAttributes *>::iterator it=patternShortAttributes_map_.begin();
-             it != patternShortAttributes_map_.end(); ++it) {
-            if (it->second)  delete it->second;
-        }
+        unmapMergedPatterns();
     }
 
     // Main driver
@@ -50,11 +43,23 @@ class PatternGenerator {
     // Generate pattern bank
     int makePatterns(TString src);
 
+    // Merge the pattern banks generated from the shards of the events
+    int mergeBanks(TString src);
+
     // Write pattern bank
     int writePatterns(TString out);
 
+    // Number of patterns, and the i-th pattern after sorting by frequency
+    long long getNumPatterns() const;
+    void getPattern(long long ipatt, PatternRecord& rec) const;
+
+    // Merge the sorted temporary files into one file of records, and sort it by frequency
+    int mergePatterns(const std::vector<TString>& runFiles, TString mergedFile);
+    void unmapMergedPatterns();
+
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
@@ -62,16 +67,22 @@ class PatternGenerator {
     TriggerTowerMap   * ttmap_;
     SuperstripArbiter * arbiter_;
 
-    // Pattern bank data
-    std::map<pattern_type, unsigned>                patternBank_map_;
-    std::vector<std::pair<pattern_type, unsigned> > patternBank_pairs_;
+    // Pattern bank data: one table per shard, with the frequency, DC bits and
+    // attributes stored next to the pattern, and the records sorted by frequency
+    std::vector<PatternTable>                        patternTables_;
+    std::vector<const PatternRecord *>               patternOrder_;
 
-    std::map<pattern_type,      Attributes *>            patternAttributes_map_;
-    std::map<pattern_type, ShortAttributes *>            patternShortAttributes_map_;
+    // Pattern bank data, if the patterns did not fit in memory: the merged records,
+    // mapped from a temporary file, and their (frequency, index) sorted by frequency
+    TString                                          mergedFile_;
+    const PatternRecord *                            mergedRecords_;
+    size_t                                           mergedSize_;
+    std::vector<std::pair<unsigned, size_t> >        mergedOrder_;
 
     // Bookkeepers
     float coverage_;
     unsigned coverage_count_;
+    unsigned coverage_events_;
 };
 
 #endif
@@ -9,23 +9,59 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/AssociativeMemory.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/HitBuffer.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleOverlapMap.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoad.h"
 using namespace slhcl1tt;
 
+namespace slhcl1tt {
+class TTStubPlusTPReader;
+class PatternBankBinaryReader;
+}
+
+class TrackFitter;
+
 
 class PatternMatcher {
   public:
     // Constructor
     PatternMatcher(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose), removeOverlap_(po.removeOverlap),
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose), removeOverlap_(po.removeOverlap),
       prefixRoad_("AMTTRoads_"), suffix_("") {
 
+        // Decide the trigger towers to process, each with its own pattern bank
+        if (po_.towers.empty()) {
+            towers_   .push_back(po_.tower);
+            bankfiles_.push_back(po_.bankfile);
+        } else {
+            towers_    = po_.towers;
+            bankfiles_ = po_.bankfiles;
+        }
+        assert(towers_.size() == bankfiles_.size());
+
         // Initialize
         ttmap_ = new TriggerTowerMap();
         ttmap_->read(po_.datadir);
 
-        arbiter_ = new SuperstripArbiter();
-        arbiter_->setDefinition(po_.superstrip, po_.tower, ttmap_);
+        for (unsigned itower=0; itower<towers_.size(); ++itower) {
+            SuperstripArbiter * arbiter = new SuperstripArbiter();
+            arbiter->setDefinition(po_.superstrip, towers_.at(itower), ttmap_);
+            arbiters_.push_back(arbiter);
+        }
+
+        // Decide the associative memory lookup to use
+        if (po_.lookup == "scan") {
+            amEngine_ = AssociativeMemoryEngine::AMSCAN;
+        } else if (po_.lookup == "index") {
+            amEngine_ = AssociativeMemoryEngine::AMINDEX;
+        } else if (po_.lookup == "bitslice") {
+            amEngine_ = AssociativeMemoryEngine::AMBITSLICE;
+        } else {
+            throw std::invalid_argument("unknown associative memory lookup.");
+        }
+
+        associativeMemories_.resize(towers_.size());
+        hitBuffers_         .resize(towers_.size());
+        bankBinaries_       .resize(towers_.size(), 0);
 
         if (removeOverlap_) {
         	momap_   = new ModuleOverlapMap();
@@ -34,26 +70,44 @@ class PatternMatcher {
 }
 
     // Destructor
-    ~PatternMatcher() {
-        if (ttmap_)     delete ttmap_;
-        if (arbiter_)   delete arbiter_;
-    }
+    ~PatternMatcher();
 
     // Main driver
     int run();
 
+    // Main driver for the combined pattern recognition and track fitting.
+    // The roads are handed over to the track fitter in memory, and are only
+    // written if a road file is given
+    int run(TrackFitter& fitter);
+
 
   private:
     // Member functions
 
-    // Load pattern bank
-    int loadPatterns(TString bank);
+    // Load pattern bank of the i-th trigger tower
+    int loadPatterns(unsigned itower, TString bank);
+
+    // Same as above, from a memory-mapped binary pattern bank
+    int loadPatternsBinary(unsigned itower, TString bank);
+
+    // Do pattern recognition, write roads (patterns that fired) and/or fit them
+    int makeRoads(TString src, TString out, TrackFitter* fitter=0);
 
-    // Do pattern recognition, write roads (patterns that fired)
-    int makeRoads(TString src, TString out);
+    // Null the stubs and particles that are not used, find the superstrips of the remaining stubs
+    // in every trigger tower that contains them
+    void prepareEvent(TTStubPlusTPReader& reader, long long ievt, const std::vector<uint64_t>& moduleTowers,
+                      std::vector<std::vector<std::pair<unsigned, unsigned> > >& superstripHits) const;
+
+    // Fill the hit buffer, perform associative memory lookup and create roads in the i-th trigger tower,
+    // with the superstrips of the roads in one table.
+    // Safe to call concurrently with different hitBuffer, workspace, tableIndex, roads and table
+    void matchEvent(unsigned itower, const std::vector<std::pair<unsigned, unsigned> >& superstripHits,
+                    HitBuffer& hitBuffer, AssociativeMemoryWorkspace& workspace, SuperstripTableIndex& tableIndex,
+                    std::vector<TTRoad>& roads, TTSuperstripTable& table) const;
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
     bool removeOverlap_;
@@ -62,16 +116,24 @@ class PatternMatcher {
     const TString prefixRoad_;
     const TString suffix_;
 
+    // Trigger towers and their pattern banks
+    std::vector<unsigned>    towers_;
+    std::vector<std::string> bankfiles_;
+
     // Operators
     TriggerTowerMap   * ttmap_;
-    SuperstripArbiter * arbiter_;
+    std::vector<SuperstripArbiter *> arbiters_;  // one per trigger tower
     ModuleOverlapMap  * momap_;
 
-    // Associative memory
-    AssociativeMemory associativeMemory_;
+    // Associative memory, one per trigger tower
+    AssociativeMemoryEngine amEngine_;
+    std::vector<AssociativeMemory> associativeMemories_;
+
+    // Binary pattern banks, kept open while the associative memory uses them
+    std::vector<PatternBankBinaryReader *> bankBinaries_;
 
-    // Hit buffer
-    HitBuffer hitBuffer_;
+    // Hit buffer, one per trigger tower
+    std::vector<HitBuffer> hitBuffers_;
 };
 
 #endif
@@ -0,0 +1,101 @@
+#ifndef AMSimulation_PatternTable_h_
+#define AMSimulation_PatternTable_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Statistics.h"
+#include <stdint.h>
+#include <vector>
+
+namespace slhcl1tt {
+
+// A pattern with its frequency, DC bits and attributes
+struct PatternRecord {
+    pattern_type     patt;
+    pattern_bit_type bits;
+    unsigned         freq;
+    long int         n;
+    Statistics       invPt;
+    Statistics       cotTheta;
+    Statistics       phi;
+    Statistics       z0;
+};
+
+// Hash table of PatternRecords keyed by pattern, with open addressing (linear
+// probing). The slots only hold a record index and a hash tag, the records
+// themselves are stored inline in chunks, so they never move. The chunks
+// grow from 1024 to 65536 records, so that small tables stay small.
+class PatternTable {
+  public:
+    // Constructor
+    PatternTable() : size_(0) {}
+
+    // Destructor
+    ~PatternTable() {}
+
+    // Functions
+    // Find the record of a pattern, or create an empty one
+    PatternRecord& insert(const pattern_type& patt, bool& inserted);
+
+    // Records in order of insertion
+    PatternRecord&       at(size_t i)       { size_t ichunk, ioffset; locate(i, ichunk, ioffset); return chunks_[ichunk][ioffset]; }
+    const PatternRecord& at(size_t i) const { size_t ichunk, ioffset; locate(i, ichunk, ioffset); return chunks_[ichunk][ioffset]; }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    // Bytes allocated for the slots and the records
+    size_t memoryUsage() const;
+
+    // Remove all records and release the memory
+    void clear();
+
+    // Hash of a pattern, used for the slots and the tags
+    static uint64_t hash(const pattern_type& patt) { return hash(patt, 0x9e3779b97f4a7c15ULL); }
+
+    // Shard of a pattern, from a hash with another seed, so that the patterns
+    // of a shard are spread over all the slots and tags of its table
+    static unsigned shard(const pattern_type& patt, unsigned nShards) { return hash(patt, 0xc2b2ae3d27d4eb4fULL) % nShards; }
+
+  private:
+    // Member functions
+    static uint64_t hash(const pattern_type& patt, uint64_t seed);
+
+    void rehash(size_t nslots);
+
+    // Chunk k < GROWING_CHUNKS holds 2^(FIRST_CHUNK_BITS+k) records, and the
+    // next chunks hold 2^CHUNK_BITS records
+    static void locate(size_t i, size_t& ichunk, size_t& ioffset) {
+        if (i < GROWING_SIZE) {
+            ichunk  = 63 - __builtin_clzll((i >> FIRST_CHUNK_BITS) + 1);
+            ioffset = i - (((size_t(1) << ichunk) - 1) << FIRST_CHUNK_BITS);
+        } else {
+            ichunk  = GROWING_CHUNKS + ((i - GROWING_SIZE) >> CHUNK_BITS);
+            ioffset = (i - GROWING_SIZE) & CHUNK_MASK;
+        }
+    }
+
+    static size_t chunkSize(size_t ichunk) {
+        return size_t(1) << (ichunk < GROWING_CHUNKS ? FIRST_CHUNK_BITS + ichunk : CHUNK_BITS);
+    }
+
+    struct Slot {
+        uint32_t ref;  // record index + 1, 0 if empty
+        uint32_t tag;  // high bits of the hash
+    };
+
+    static const unsigned FIRST_CHUNK_BITS = 10;
+    static const unsigned CHUNK_BITS       = 16;
+    static const size_t   CHUNK_MASK       = (size_t(1) << CHUNK_BITS) - 1;
+    static const unsigned GROWING_CHUNKS   = CHUNK_BITS - FIRST_CHUNK_BITS;
+    static const size_t   GROWING_SIZE     = (size_t(1) << CHUNK_BITS) - (size_t(1) << FIRST_CHUNK_BITS);
+
+    // Member data
+    std::vector<Slot>                        slots_;
+    std::vector<std::vector<PatternRecord> > chunks_;
+    size_t size_;
+};
+
+}
+
+#endif
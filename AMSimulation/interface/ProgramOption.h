@@ -11,6 +11,7 @@ struct ProgramOption {
     std::string input;
     std::string output;
     std::string bankfile;
+    std::vector<std::string> bankfiles;
     std::string matrixfile;
     std::string roadfile;
     std::string trackfile;
@@ -18,12 +19,19 @@ struct ProgramOption {
     int         verbose;
     int         speedup;
     long long   maxEvents;
+    long long   firstEvent;
+    unsigned    iShard;
+    unsigned    nShards;
+    bool        merge;
+    unsigned    nThreads;
+    unsigned    readAhead;
 
     unsigned    nLayers;
     unsigned    nFakers;
     unsigned    nDCBits;
 
     unsigned    tower;
+    std::vector<unsigned> towers;
     std::string superstrip;
     std::string algo;
 
@@ -40,10 +48,17 @@ struct ProgramOption {
 
     int         picky;
     int         minFrequency;
+    long int    maxMemory;
+    float       targetCoverage;
+    long int    coverageWindow;
+    int         stableWindows;
     long int    maxPatterns;
     int         maxMisses;
     int         maxStubs;
     int         maxRoads;
+    std::string lookup;
+    bool        flatRoads;
+    bool        dedupRoads;
 
     std::string view;
     unsigned    hitBits;
@@ -52,6 +67,7 @@ struct ProgramOption {
     int         minNdof;
     int         maxCombs;
     int         maxTracks;
+    bool        batchFit;
 
     int 	rmDuplicate;
     bool        rmParDuplicate;
@@ -68,6 +84,16 @@ struct ProgramOption {
 
 std::ostream& operator<<(std::ostream& o, const ProgramOption& po);
 
+// Get the range [firstEvent, firstEvent + nEvents) of the input entries to be
+// read: maxEvents entries starting at firstEvent, split into nShards shards of
+// contiguous entries. The number of entries nentries is only used to split the
+// events, it can be -1 if there is only one shard.
+void getEventRange(const ProgramOption& po, long long nentries, long long& firstEvent, long long& nEvents);
+
+// Get the files listed in a .txt file, one per line. Empty lines and lines
+// starting with '#' are skipped. Returns 1 if the file cannot be read.
+int getInputFiles(const std::string& src, std::vector<std::string>& files);
+
 }  // namespace slhcl1tt
 
 #endif
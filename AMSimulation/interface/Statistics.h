@@ -17,13 +17,21 @@ class Statistics {
   public:
     long int n_;
     double mean_;
-    double variance_;
+    double m2_;  // sum of the squared deviations from the mean
 
     Statistics();
+
+    // Statistics of n entries with the given mean and sigma, such as those
+    // stored in a pattern bank
+    Statistics(long int n, double mean, double sigma);
+
     ~Statistics() {}
 
     void fill(double x);
 
+    // Add the entries of another Statistics
+    void merge(const Statistics& other);
+
     long int getEntries()   const;
     double   getMean()      const;
     double   getVariance()  const;
@@ -0,0 +1,35 @@
+#ifndef AMSimulation_StubCacheConverter_h_
+#define AMSimulation_StubCacheConverter_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
+using namespace slhcl1tt;
+
+
+class StubCacheConverter {
+  public:
+    // Constructor
+    StubCacheConverter(const ProgramOption& po)
+    : po_(po),
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose) {}
+
+    // Destructor
+    ~StubCacheConverter() {}
+
+    // Main driver
+    int run();
+
+
+  private:
+    // Member functions
+    // Convert a stub ntuple into the memory-mappable columnar stub cache
+    int convertStubs(TString src, TString out);
+
+    // Program options
+    const ProgramOption po_;
+    long long firstEvent_;
+    long long nEvents_;
+    int verbose_;
+};
+
+#endif
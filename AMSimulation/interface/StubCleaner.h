@@ -14,7 +14,7 @@ class StubCleaner {
     // Constructor
     StubCleaner(const ProgramOption& po)
     : po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose), removeOverlap_(po.removeOverlap) {
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose), removeOverlap_(po.removeOverlap) {
 
         momap_   = new ModuleOverlapMap();
         momap_->readModuleOverlapMap(po_.datadir);
@@ -40,6 +40,7 @@ class StubCleaner {
 
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
     bool removeOverlap_;
@@ -2,7 +2,9 @@
 #define AMSimulation_SuperstripArbiter_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/SuperstripPolicy.h"
 
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "TString.h"
@@ -24,6 +26,35 @@ class SuperstripArbiter {
     unsigned superstripLocal(unsigned moduleId, float strip, float segment) const;
     unsigned superstripGlobal(unsigned moduleId, float r, float phi, float z, float ds) const;
 
+    // Batch operators, for n stubs given as arrays. The superstrip IDs are
+    // written into ssIds. Only the coordinates of the superstrip type in use
+    // are read, the others may be null.
+    void superstrips(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments,
+                     const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const;
+    void superstripsLocal(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments, unsigned* ssIds) const;
+    void superstripsGlobal(unsigned n, const unsigned* moduleIds, const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const;
+
+    // Call f(policy) with the superstrip policy of the definition, so that the
+    // loops in f are instantiated once per superstrip type
+    template<typename F>
+    void visit(F& f) const {
+        switch (sstype_) {
+        case SuperstripType::FIXEDWIDTH:
+            f(fixedwidth_);
+            break;
+
+        case SuperstripType::PROJECTIVE:
+        case SuperstripType::FOUNTAIN:
+        case SuperstripType::FOUNTAINOPT:
+            f(binned_);
+            break;
+
+        default:
+            throw std::logic_error("Incompatible superstrip type.");
+            break;
+        }
+    }
+
     // Functions
     void setDefinition(TString definition, unsigned tt, const TriggerTowerMap* ttmap);
 
@@ -36,13 +67,6 @@ class SuperstripArbiter {
 
 
   private:
-    // Member functions
-    unsigned compressModuleId(unsigned moduleId) const;
-
-    unsigned superstripFixedwidth(unsigned moduleId, float strip, float segment) const;
-    unsigned superstripProjective(unsigned moduleId, float r, float phi, float z, float ds) const;
-    unsigned superstripFountain(unsigned moduleId, float r, float phi, float z, float ds) const;
-
     // Member data
     SuperstripType     sstype_;
     unsigned           nsuperstripsPerLayer_;
@@ -67,9 +91,6 @@ class SuperstripArbiter {
     float              fountainopt_pt_;
 
     // Trigger tower geometry
-    // modules_[i][j] is the module ID of the i-th layer, j-th module
-    std::vector<std::vector<unsigned> > towerModules_;
-
     // phiMins_[i] is the phiMin boundary of the i-th layer
     // phiMaxs_[i] is the phiMax boundary of the i-th layer
     // zMins_[i] is the zMin boundary of the i-th layer
@@ -80,6 +101,10 @@ class SuperstripArbiter {
     std::vector<float> zMaxs_;
     std::vector<float> fountain_xfactor_;
 
+    // Superstrip policies, only the one of the superstrip type is set
+    FixedwidthSuperstrip fixedwidth_;
+    BinnedSuperstrip     binned_;
+
 
     // phiWidths[i] is the phiWidth of the i-th layer
     std::vector<float> phiWidths_;
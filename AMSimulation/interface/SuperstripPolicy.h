@@ -0,0 +1,169 @@
+#ifndef AMSimulation_SuperstripPolicy_h_
+#define AMSimulation_SuperstripPolicy_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+
+namespace slhcl1tt {
+
+// Superstrip policies. Each one implements one kind of superstrip definition,
+// with its parameters fixed at construction, and finds the superstrip IDs of
+// single stubs or of arrays of stubs. The functions are inline, so that a loop
+// instantiated with a policy has no dispatch on the superstrip type.
+// Policies are built by SuperstripArbiter::setDefinition().
+
+// _____________________________________________________________________________
+// Fixedwidth superstrip, in local coordinates. The superstrip ID is an unsigned
+// integer with 3 fields: moduleCode|segment|strip
+class FixedwidthSuperstrip {
+  public:
+    // Constructor
+    FixedwidthSuperstrip()
+    : rshift1_(0), rshift2_(0), lshift1_(0), lshift2_(0), maxNSegments_(0), moduleIndex_(0), tt_(0) {}
+
+    // The module index must outlive the policy
+    FixedwidthSuperstrip(unsigned rshift1, unsigned rshift2, unsigned lshift1, unsigned lshift2, unsigned maxNSegments,
+                         const ModuleIndex* moduleIndex, unsigned tt)
+    : rshift1_(rshift1), rshift2_(rshift2), lshift1_(lshift1), lshift2_(lshift2), maxNSegments_(maxNSegments),
+      moduleIndex_(moduleIndex), tt_(tt) {}
+
+    // Operators
+    unsigned superstrip(unsigned moduleId, float strip, float segment, float r, float phi, float z, float ds) const {
+        return encode(compressModuleId(moduleId), moduleId, strip, segment);
+    }
+
+    void superstrips(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments,
+                     const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const {
+        for (unsigned i=0; i<n; ++i)
+            ssIds[i] = encode(compressModuleId(moduleIds[i]), moduleIds[i], strips[i], segments[i]);
+    }
+
+  private:
+    static unsigned round_to_uint(float x) {
+        return std::floor(x + 0.5);
+    }
+
+    unsigned compressModuleId(unsigned moduleId) const {
+        if (ModuleIndex::slot(moduleId) >= ModuleIndex::NSLOTS)
+            throw std::out_of_range("Unexpected module ID.");
+
+        unsigned moduleCode = moduleIndex_->moduleCode(moduleIndex_->index(moduleId), tt_);
+        if (moduleCode == ModuleIndex::INVALID)
+            throw std::logic_error("Unexpected module ID.");
+        return moduleCode;
+    }
+
+    unsigned encode(unsigned moduleCode, unsigned moduleId, float strip, float segment) const {
+        strip    -= 0.25;  // round down the half int precision
+        segment  -= 0.25;  // round down the half int precision
+
+        // Use strip in the least significant field
+        unsigned ss = round_to_uint(strip) >> rshift1_;
+
+        // Use segment in the 2nd most sig field
+        if (isPSModule(moduleId))
+            ss |= ((round_to_uint(segment) >> rshift2_) << lshift1_);
+        else
+            ss |= (((round_to_uint(segment)*maxNSegments_/2) >> rshift2_) << lshift1_);
+
+        // Use module ID in the most sig field
+        ss |= (moduleCode << (lshift1_ + lshift2_));
+        return ss;
+    }
+
+    // Member data
+    unsigned rshift1_;
+    unsigned rshift2_;
+    unsigned lshift1_;
+    unsigned lshift2_;
+    unsigned maxNSegments_;
+
+    // The module code is the position of the module in its layer of the tower
+    const ModuleIndex* moduleIndex_;
+    unsigned           tt_;
+};
+
+
+// _____________________________________________________________________________
+// Superstrip made of phi and z bins, in global coordinates. The projective,
+// fountain and optimized fountain superstrips only differ by their bin widths.
+class BinnedSuperstrip {
+  public:
+    // Constructor
+    BinnedSuperstrip()
+    : nphi_(0), nz_(0) {
+        std::fill(phiMins_, phiMins_ + 16, 0.);
+        std::fill(zMins_, zMins_ + 16, 0.);
+        std::fill(phiInvBins_, phiInvBins_ + 16, 0.);
+        std::fill(zInvBins_, zInvBins_ + 16, 0.);
+    }
+
+    BinnedSuperstrip(const std::vector<float>& phiMins, const std::vector<float>& zMins,
+                     const std::vector<float>& phiBins, const std::vector<float>& zBins,
+                     unsigned nphi, unsigned nz)
+    : nphi_(nphi), nz_(nz) {
+        // Precompute the inverse bin widths, so that finding the superstrips
+        // only takes multiplications
+        for (unsigned i=0; i<16; ++i) {
+            phiMins_[i]    = (i < phiMins.size()) ? phiMins[i] : 0.;
+            zMins_[i]      = (i < zMins.size())   ? zMins[i]   : 0.;
+            phiInvBins_[i] = (i < phiBins.size() && phiBins[i] > 0.) ? 1.0 / phiBins[i] : 0.;
+            zInvBins_[i]   = (i < zBins.size()   && zBins[i]   > 0.) ? 1.0 / zBins[i]   : 0.;
+        }
+    }
+
+    // Operators
+    unsigned superstrip(unsigned moduleId, float strip, float segment, float r, float phi, float z, float ds) const {
+        return encode(compressModuleLayer(moduleId), phi, z);
+    }
+
+    void superstrips(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments,
+                     const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const {
+        // Decode the layers first, the superstrip IDs are used as scratch space
+        for (unsigned i=0; i<n; ++i)
+            ssIds[i] = compressModuleLayer(moduleIds[i]);
+
+        // No branches and no bounds checks, so that the loop can be vectorized
+        for (unsigned i=0; i<n; ++i)
+            ssIds[i] = encode(ssIds[i], phis[i], zs[i]);
+    }
+
+  private:
+    static unsigned compressModuleLayer(unsigned moduleId) {
+        unsigned lay16 = compressLayer(decodeLayer(moduleId));
+        if (lay16 >= 16)
+            throw std::out_of_range("Unexpected module ID.");
+        return lay16;
+    }
+
+    unsigned encode(unsigned lay16, float phi, float z) const {
+        int i_phi = std::floor((phi - phiMins_[lay16]) * phiInvBins_[lay16]);
+        int i_z   = std::floor((z   - zMins_[lay16]  ) * zInvBins_[lay16]);
+
+        i_phi     = std::min(std::max(i_phi, 0), nphi_ - 1);  // proper range
+        i_z       = std::min(std::max(i_z  , 0), nz_   - 1);  // proper range
+
+        return i_z * nphi_ + i_phi;
+    }
+
+    // Member data
+    int   nphi_;
+    int   nz_;
+
+    // phiMins_[i] and zMins_[i] are the lower boundaries of the i-th layer,
+    // phiInvBins_[i] and zInvBins_[i] are its inverse bin widths
+    float phiMins_[16];
+    float zMins_[16];
+    float phiInvBins_[16];
+    float zInvBins_[16];
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -4,6 +4,7 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCAFixed.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoATF.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoLTF.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CombinationFactory.h"
@@ -13,8 +14,16 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/DuplicateRemoval.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParameterDuplicateRemoval.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MCTruthAssociator.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoad.h"
 using namespace slhcl1tt;
 
+class TChain;
+
+namespace slhcl1tt {
+class TTStubPlusTPReader;
+class TTTrackWriter;
+}
+
 
 class TrackFitter {
 
@@ -22,40 +31,93 @@ class TrackFitter {
     // Constructor
     TrackFitter(const ProgramOption& po) :
       po_(po),
-      nEvents_(po.maxEvents), verbose_(po.verbose),
+      firstEvent_(po.firstEvent), nEvents_(po.maxEvents), verbose_(po.verbose),
       prefixRoad_("AMTTRoads_"), prefixTrack_("AMTTTracks_"), suffix_(""),
-      combinationBuilderFactory_(std::make_shared<CombinationBuilderFactory>(po_.FiveOfSix)) {
-
-        // Decide the track fitter to use
-        fitter_ = 0;
-        if (po.algo == "PCA4" || po.algo == "PCA5") {
-            fitter_ = new TrackFitterAlgoPCA(po);
-        } else if (po.algo == "ATF4") {
-            fitter_ = new TrackFitterAlgoATF(false);
-        } else if (po.algo == "ATF5") {
-            fitter_ = new TrackFitterAlgoATF(true);
-        } else if (po.algo == "LTF") {
-            fitter_ = new TrackFitterAlgoLTF(po);
-        } else {
-            throw std::invalid_argument("unknown track fitter algo.");
-        }
+      pipelineWriter_(0), nPipelineRead_(0), nPipelineKept_(0) {
+
+        // The first worker fits the events when running in a single thread
+        workers_.push_back(new Worker(po_));
     }
 
     // Destructor
-    ~TrackFitter() {
-        if (fitter_)  delete fitter_;
-    }
+    ~TrackFitter();
 
     // Main driver
     int run();
 
+    // Fit the roads of the pattern recognition in memory, without a road file.
+    // beginFit() opens the output, fitRoads() is called once per event with
+    // the reader that holds the stubs of the event and the roads that refer to
+    // the superstrip table of their trigger tower, endFit() writes the output
+    int beginFit(TChain* tchain, TString out);
+    void fitRoads(const TTStubPlusTPReader& reader, long long ievt, const std::vector<std::vector<TTRoad> >& roadsPerTower,
+                  const std::vector<TTSuperstripTable>& tablesPerTower);
+    int endFit();
+
 
   private:
+    // Everything needed to fit the roads of an event. Each worker thread has
+    // its own, as the track fitters and the combination factories keep state
+    struct Worker {
+        Worker(const ProgramOption& po);
+        ~Worker();
+
+        // Track fitter
+        TrackFitterAlgoBase * fitter;
+
+        // Combination factory
+        CombinationFactory combinationFactory;
+
+        // pair combination factory
+        PairCombinationFactory pairCombinationFactory;
+
+        // SCB and ACB combination factory
+        std::shared_ptr<CombinationBuilderFactory> combinationBuilderFactory;
+
+        // Ghost buster
+        GhostBuster ghostBuster;
+
+        // MC truth associator
+        MCTruthAssociator truthAssociator;
+
+        // Number of combinations fitted, and of combinations that reused the
+        // fit of the same combination in another road of the event
+        long int nFits;
+        long int nFitsReused;
+    };
+
     // Member functions
     int makeTracks(TString src, TString out);
 
+    // Fit the roads of an event, then flag the ghosts and the duplicates and
+    // associate the tracks with the tracking particles. Returns true if any
+    // track is found. The stubs and the tracking particles are read from
+    // the members of the stub source named as in TTStubPlusTPReader
+    template<typename StubSource, typename RoadSource>
+    bool fitEvent(Worker& worker, const StubSource& stubs, long long ievt, const RoadSource& roads,
+                  std::vector<TTTrack2>& tracks);
+
+    // Fit the roads in [beginRoad, endRoad) and append their tracks in the
+    // order of the roads
+    template<typename StubSource, typename RoadSource>
+    void fitRoadRange(Worker& worker, const StubSource& stubs, const RoadSource& roads,
+                      unsigned beginRoad, unsigned endRoad, std::vector<TTTrack2>& tracks);
+
+    // Sort the tracks of an event, flag the ghosts and the duplicates, and
+    // associate the tracks with the tracking particles
+    template<typename StubSource>
+    bool finishEvent(Worker& worker, const StubSource& stubs, long long ievt, std::vector<TTTrack2>& tracks);
+
+    // Get the next combination of the road given to the combination factory
+    // selected by the program options, returns false if there is none
+    bool nextCombination(Worker& worker, std::vector<unsigned>& combination);
+
+    // Write the tracks and the histograms
+    int writeTracks(TTTrackWriter& writer, long int nRead, long int nKept);
+
     // Program options
     const ProgramOption po_;
+    long long firstEvent_;
     long long nEvents_;
     int verbose_;
 
@@ -64,23 +126,16 @@ class TrackFitter {
     const TString prefixTrack_;
     const TString suffix_;
 
-    // Track fitter
-    TrackFitterAlgoBase * fitter_;
-
-    // Combination factory
-    CombinationFactory combinationFactory_;
-    
-    // pair combination factory
-    PairCombinationFactory pairCombinationFactory_;
-
-    // SCB and ACB combination factory
-    std::shared_ptr<CombinationBuilderFactory> combinationBuilderFactory_;
-
-    // Ghost buster
-    GhostBuster ghostBuster_;
+    // Workers, one per thread
+    std::vector<Worker *> workers_;
 
-    // MC truth associator
-    MCTruthAssociator truthAssociator_;
+    // Track fitting in memory
+    TTTrackWriter * pipelineWriter_;
+    std::vector<TTRoad> pipelineRoads_;     // roads of all the trigger towers
+    TTSuperstripTable pipelineTable_;
+    std::vector<TTTrack2> pipelineTracks_;
+    long int nPipelineRead_;
+    long int nPipelineKept_;
 };
 
 #endif
@@ -25,6 +25,22 @@ class TrackFitterAlgoBase {
 
     virtual int fit(const TTRoadComb& acomb, TTTrack2& atrack) = 0;
 
+    // Fit a block of combinations, atracks[i] is the track of acombs[i]. It
+    // must not depend on the other combinations of the block. By default, the
+    // combinations are fitted one at a time. Returns the first non-zero fit
+    // status
+    virtual int fitBlock(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+        int fitstatus = 0;
+        atracks.clear();
+        atracks.resize(acombs.size());
+        for (unsigned icomb=0; icomb<acombs.size(); ++icomb) {
+            int status = fit(acombs.at(icomb), atracks.at(icomb));
+            if (fitstatus == 0)
+                fitstatus = status;
+        }
+        return fitstatus;
+    }
+
     // Histograms
     std::map<TString, TH1F *>  histograms_;
 };
@@ -0,0 +1,238 @@
+#ifndef AMSimulation_TrackFitterAlgoPCAFixed_h_
+#define AMSimulation_TrackFitterAlgoPCAFixed_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
+
+#include "Eigen/StdVector"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+
+namespace slhcl1tt {
+
+// PCA track fitter with the number of variables and of parameters known at
+// compile time. The matrices are stored in fixed-size Eigen types, so a fit
+// does not allocate. A block of combinations is fitted with one matrix-matrix
+// product per (ptSegment, hitBits) matrix instead of one matrix-vector product
+// per combination. It gives the same tracks as TrackFitterAlgoPCA, up to the
+// rounding of the products.
+template<unsigned NVAR, unsigned NPAR>
+class TrackFitterAlgoPCAFixed : public TrackFitterAlgoBase {
+  public:
+    typedef Eigen::Matrix<double, NVAR/2, 1>              HalfVector;
+    typedef Eigen::Matrix<double, 1, NVAR/2>              HalfRowVector;
+    typedef Eigen::Matrix<double, NVAR, 1>                VarVector;
+    typedef Eigen::Matrix<double, NPAR, 1>                ParVector;
+    typedef Eigen::Matrix<double, NVAR, NVAR>             VarMatrix;
+    typedef Eigen::Matrix<double, NPAR, NVAR>             ParVarMatrix;
+    typedef Eigen::Matrix<double, NVAR/2, Eigen::Dynamic> HalfBlock;
+    typedef Eigen::Matrix<double, NVAR, Eigen::Dynamic>   VarBlock;
+    typedef Eigen::Matrix<double, NPAR, Eigen::Dynamic>   ParBlock;
+
+    // Matrices of one (ptSegment, hitBits)
+    struct Matrices {
+        HalfVector    meansR;
+        HalfRowVector solutionsC;
+        HalfRowVector solutionsT;
+        VarVector     sqrtEigenvalues;
+        VarVector     meansV;
+        ParVector     meansP;
+        VarMatrix     V;
+        ParVarMatrix  DV;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    TrackFitterAlgoPCAFixed(const slhcl1tt::ProgramOption& po)
+    : TrackFitterAlgoBase(), datadir_(po.datadir), tower_(po.tower), verbose_(po.verbose) {
+
+        loadConstants();
+    }
+
+    ~TrackFitterAlgoPCAFixed() {}
+
+    int fit(const TTRoadComb& acomb, TTTrack2& atrack) {
+        const Matrices& mat = matrices_.at(getMatrixIndex(acomb));
+
+        VarVector variables;
+        getVariables(acomb, mat, variables);
+
+        const VarVector principals = mat.V * variables - mat.meansV;
+        const ParVector parameters_fit = mat.DV * variables - mat.meansP;
+
+        setTrack(acomb, mat, principals, parameters_fit, atrack);
+        return 0;
+    }
+
+    int fitBlock(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+        const unsigned ncombs = acombs.size();
+        atracks.clear();
+        atracks.resize(ncombs);
+
+        // Group the combinations by matrix, keeping their order within a group
+        order_.resize(ncombs);
+        for (unsigned icomb=0; icomb<ncombs; ++icomb)
+            order_.at(icomb) = std::make_pair(getMatrixIndex(acombs.at(icomb)), icomb);
+        std::stable_sort(order_.begin(), order_.end());
+
+        // The buffers only grow, they are reused by the next blocks
+        if ((unsigned) variables_.cols() < ncombs) {
+            deltaR_        .resize(Eigen::NoChange, ncombs);
+            variables_     .resize(Eigen::NoChange, ncombs);
+            principals_    .resize(Eigen::NoChange, ncombs);
+            parameters_fit_.resize(Eigen::NoChange, ncombs);
+        }
+
+        for (unsigned begin=0, end=0; begin<ncombs; begin=end) {
+            const unsigned imat = order_.at(begin).first;
+            for (end=begin; end<ncombs && order_.at(end).first == imat; ++end) {}
+
+            const Matrices& mat = matrices_.at(imat);
+            const unsigned n = end - begin;
+
+            // Stub coordinates, one column per combination
+            variables_.leftCols(n).setZero();
+            deltaR_.leftCols(n).setZero();
+            for (unsigned k=0; k<n; ++k) {
+                const TTRoadComb& acomb = acombs.at(order_.at(begin+k).second);
+                for (unsigned istub=0; istub<acomb.stubs_phi.size(); ++istub) {
+                    variables_(istub, k)        = acomb.stubs_phi.at(istub);
+                    variables_(NVAR/2+istub, k) = acomb.stubs_z.at(istub);
+                    deltaR_(istub, k)           = mat.meansR(istub) - acomb.stubs_r.at(istub);
+                }
+            }
+
+            // Apply DeltaR correction
+            corrC_.noalias() = mat.solutionsC * variables_.topLeftCorner(NVAR/2, n);
+            corrT_.noalias() = mat.solutionsT * variables_.bottomLeftCorner(NVAR/2, n);
+            variables_.topLeftCorner(NVAR/2, n).array()    += deltaR_.leftCols(n).array().rowwise() * corrC_.array();
+            variables_.bottomLeftCorner(NVAR/2, n).array() += deltaR_.leftCols(n).array().rowwise() * corrT_.array();
+
+            // Transform coordinates to principal components and to parameters
+            principals_.leftCols(n).noalias() = mat.V * variables_.leftCols(n);
+            principals_.leftCols(n).colwise() -= mat.meansV;
+
+            parameters_fit_.leftCols(n).noalias() = mat.DV * variables_.leftCols(n);
+            parameters_fit_.leftCols(n).colwise() -= mat.meansP;
+
+            for (unsigned k=0; k<n; ++k) {
+                const unsigned icomb = order_.at(begin+k).second;
+                setTrack(acombs.at(icomb), mat, principals_.col(k), parameters_fit_.col(k), atracks.at(icomb));
+            }
+        }
+        return 0;
+    }
+
+    unsigned nvariables()   const { return NVAR; }
+    unsigned nparameters()  const { return NPAR; }
+
+  private:
+    int loadConstants() {
+        for (unsigned i=0; i<PCA_NSEGMENTS; ++i) {
+            for (unsigned j=0; j<PCA_NHITBITS; ++j) {
+                std::string filename = Form("matrix/matrices_tt%i_pt%i_hb%i.txt", tower_, i, j);
+
+                PCAMatrix mat;
+                mat.read(datadir_ + filename);
+                assert(mat.nvariables == NVAR && mat.nparameters == NPAR);
+
+                Matrices fixed;
+                fixed.meansR          = mat.meansR;
+                fixed.solutionsC      = mat.solutionsC;
+                fixed.solutionsT      = mat.solutionsT;
+                fixed.sqrtEigenvalues = mat.sqrtEigenvalues;
+                fixed.meansV          = mat.meansV;
+                fixed.meansP          = mat.meansP;
+                fixed.V               = mat.V;
+                fixed.DV              = mat.DV;
+                matrices_.push_back(fixed);
+
+                if (verbose_>2) {
+                    std::cout << "** matrix " << matrices_.size() - 1 << std::endl;
+                    mat.print();
+                }
+            }
+        }
+        return 0;
+    }
+
+    unsigned getMatrixIndex(const TTRoadComb& acomb) const {
+        return acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+    }
+
+    // Get the stub coordinates after the DeltaR correction
+    void getVariables(const TTRoadComb& acomb, const Matrices& mat, VarVector& variables) const {
+        HalfVector variables1 = HalfVector::Zero();
+        HalfVector variables2 = HalfVector::Zero();
+        HalfVector variables3 = HalfVector::Zero();
+
+        for (unsigned istub=0; istub<acomb.stubs_phi.size(); ++istub) {
+            variables1(istub) = acomb.stubs_phi.at(istub);
+            variables2(istub) = acomb.stubs_z.at(istub);
+            variables3(istub) = mat.meansR(istub) - acomb.stubs_r.at(istub);
+        }
+
+        variables1 += ((mat.solutionsC * variables1)(0,0)) * variables3;
+        variables2 += ((mat.solutionsT * variables2)(0,0)) * variables3;
+
+        variables << variables1, variables2;
+    }
+
+    // Set the track from its principal components and parameters
+    template<typename PrincipalsT, typename ParametersT>
+    void setTrack(const TTRoadComb& acomb, const Matrices& mat, const PrincipalsT& principals,
+                  const ParametersT& parameters_fit, TTTrack2& atrack) {
+        unsigned begin_ivar = 0;
+        if (1 <= acomb.hitBits && acomb.hitBits <= 6) {
+            if (NVAR == 6 * 2)
+                begin_ivar = 2;
+            else if (NVAR == 6)
+                begin_ivar = 1;
+        }
+
+        double chi2 = 0.;
+        unsigned ndof = 0;
+        for (unsigned ivar=begin_ivar; ivar<(NVAR - NPAR); ++ivar) {
+            assert(mat.sqrtEigenvalues(ivar) > 0.);
+            chi2 += (principals(ivar)/mat.sqrtEigenvalues(ivar))*(principals(ivar)/mat.sqrtEigenvalues(ivar));
+            ndof += 1;
+        }
+        assert(ndof == 3 || ndof == 4 || ndof == 6 || ndof == 8);
+
+        atrack.setTrackParams(0.003 * 3.8 * parameters_fit(3), parameters_fit(0), parameters_fit(1), parameters_fit(2), 0.,
+                              chi2, ndof, 0., 0.);
+
+        // The track gets a copy, the buffer is reused by the next tracks
+        principals_vec_.assign(NVAR, 0.);
+        for (unsigned ivar=0; ivar<NVAR; ++ivar) {
+            if (mat.sqrtEigenvalues(ivar) > 0.)
+                principals_vec_[ivar] = principals(ivar)/mat.sqrtEigenvalues(ivar);
+        }
+        atrack.setPrincipals(principals_vec_);
+    }
+
+    // Settings
+    std::string datadir_;
+    unsigned    tower_;
+    int         verbose_;
+
+    // Matrices
+    std::vector<Matrices, Eigen::aligned_allocator<Matrices> > matrices_;
+
+    // Buffers of the block fit
+    std::vector<std::pair<unsigned, unsigned> > order_;  // (matrix index, combination index)
+    HalfBlock   deltaR_;
+    Eigen::Matrix<double, 1, Eigen::Dynamic> corrC_;
+    Eigen::Matrix<double, 1, Eigen::Dynamic> corrT_;
+    VarBlock    variables_;
+    VarBlock    principals_;
+    ParBlock    parameters_fit_;
+
+    // Buffer of the normalized principal components of a track
+    std::vector<float> principals_vec_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef AMSimulation_TriggerTowerMap_h_
 #define AMSimulation_TriggerTowerMap_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleIndex.h"
 #include <map>
 #include <string>
 #include <vector>
@@ -57,6 +58,9 @@ class TriggerTowerMap {
     // Get a vector of LayerBounds=(layer,4 boundaries) for a particular tower
     std::vector<LayerBounds> getTriggerTowerBoundaries(unsigned tt) const;
 
+    // Get the module index, for O(1) lookups of the towers of a module
+    const ModuleIndex& getModuleIndex() const { return moduleIndex_; }
+
     // Debug
     void print();
 
@@ -69,6 +73,9 @@ class TriggerTowerMap {
 
     // Mapping of {tower -> [(layer, boundaries)]}
     std::map<unsigned, std::vector<LayerBounds> > ttboundaries_;
+
+    // Dense module index with the flat {module -> towers} tables
+    ModuleIndex moduleIndex_;
 };
 
 }  // namespace slhcl1tt
@@ -0,0 +1,63 @@
+#ifndef AMSimulation_WorkerPool_h_
+#define AMSimulation_WorkerPool_h_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace slhcl1tt {
+
+// A pool of worker threads that run a job in the background, while the
+// calling thread does something else (e.g. reads the next events).
+// A job is a list of steps. A step is a set of tasks f(i), i in [0, n), that
+// run in any order on any thread. A step starts once all the tasks of the
+// previous step are done. With no worker thread, start() runs the job inline.
+class WorkerPool {
+  public:
+    typedef std::function<void(unsigned)> Task;
+    typedef std::pair<unsigned, Task>     Step;
+
+    // Constructor
+    explicit WorkerPool(unsigned nThreads);
+
+    // Destructor, waits for the job in flight
+    ~WorkerPool();
+
+    // Start a job, after the previous one is done
+    void start(const std::vector<Step>& steps);
+
+    // Wait until the job is done
+    void wait();
+
+    unsigned size() const { return threads_.size(); }
+
+    // Index in [0, size()) of the worker thread that runs the calling task,
+    // e.g. to pick the per-thread state of the task. It is 0 for the tasks
+    // run inline
+    static unsigned threadIndex();
+
+  private:
+    void work(unsigned ithread);
+
+    // Skip the steps without task, mark the job as done after the last one
+    void advance();
+
+    std::vector<std::thread> threads_;
+    std::mutex               mutex_;
+    std::condition_variable  workCondition_;
+    std::condition_variable  doneCondition_;
+
+    std::vector<Step> steps_;
+    unsigned          step_;     // current step
+    unsigned          next_;     // next task of the current step
+    unsigned          running_;  // tasks of the current step being run
+    bool              busy_;
+    bool              stop_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
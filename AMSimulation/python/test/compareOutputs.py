@@ -0,0 +1,108 @@
+import argparse
+import sys
+from itertools import izip
+from ROOT import TFile, TTree, gROOT, gSystem
+
+
+def is_sequence(x):
+    if isinstance(x, (str, unicode)):
+        return False
+    try:
+        iter(x)
+        return True
+    except TypeError:
+        return False
+
+
+def compare_values(a, b, tolerance, abs_tolerance=0.):
+    """Compare two numbers, or two (nested) vectors of numbers, within a relative
+    tolerance, or within an absolute tolerance for the numbers close to zero"""
+    if is_sequence(a) or is_sequence(b):
+        if not (is_sequence(a) and is_sequence(b)):
+            return False
+        a, b = list(a), list(b)
+        if len(a) != len(b):
+            return False
+        return all(compare_values(x, y, tolerance, abs_tolerance) for x, y in izip(a, b))
+
+    if a == b:
+        return True
+    try:
+        a, b = float(a), float(b)
+    except (TypeError, ValueError):
+        return False
+    return abs(a - b) <= max(tolerance * max(abs(a), abs(b)), abs_tolerance)
+
+
+def compare_trees(file1, file2, treename, prefix, tolerance, abs_tolerance):
+    tree1 = file1.Get(treename)
+    tree2 = file2.Get(treename)
+    if not tree1 or not tree2:
+        print "Tree %s is missing" % treename
+        return 1
+
+    nentries = tree1.GetEntries()
+    if nentries != tree2.GetEntries():
+        print "Tree %s: # entries: %i vs %i" % (treename, nentries, tree2.GetEntries())
+        return 1
+
+    branches = [b.GetName() for b in tree1.GetListOfBranches() if b.GetName().startswith(prefix)]
+    if not branches:
+        print "Tree %s: no branch starting with '%s'" % (treename, prefix)
+        return 1
+    for name in branches:
+        if not tree2.GetBranch(name):
+            print "Tree %s: branch %s is missing" % (treename, name)
+            return 1
+
+    for ientry in xrange(nentries):
+        tree1.GetEntry(ientry)
+        tree2.GetEntry(ientry)
+        for name in branches:
+            if not compare_values(getattr(tree1, name), getattr(tree2, name), tolerance, abs_tolerance):
+                print "Tree %s: branch %s differs at entry %i" % (treename, name, ientry)
+                return 1
+    return 0
+
+
+def compare_texts(filename1, filename2, tolerance, abs_tolerance):
+    """Compare two text files token by token, numbers within a relative tolerance"""
+    with open(filename1) as f1, open(filename2) as f2:
+        tokens1, tokens2 = f1.read().split(), f2.read().split()
+    if len(tokens1) != len(tokens2):
+        print "# tokens: %i vs %i" % (len(tokens1), len(tokens2))
+        return 1
+    for i, (a, b) in enumerate(izip(tokens1, tokens2)):
+        if not compare_values(a, b, tolerance, abs_tolerance):
+            print "Token %i differs: %s vs %s" % (i, a, b)
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Check that two outputs of amsim are the same, entry by entry.")
+    parser.add_argument("file1")
+    parser.add_argument("file2")
+    parser.add_argument("--tree", action="append", default=[], help="tree to compare (default: ntupler/tree), can be repeated")
+    parser.add_argument("--prefix", default="", help="only compare the branches starting with this prefix")
+    parser.add_argument("--tolerance", type=float, default=0., help="relative tolerance on the numbers")
+    parser.add_argument("--abs-tolerance", type=float, default=0., help="absolute tolerance on the numbers close to zero")
+    args = parser.parse_args()
+
+    if args.file1.endswith(".txt"):
+        sys.exit(compare_texts(args.file1, args.file2, args.tolerance, args.abs_tolerance))
+
+    gROOT.SetBatch(True)
+    gROOT.SetMacroPath(gSystem.Getenv("CMSSW_BASE")+"/src/SLHCL1TrackTriggerSimulations/AMSimulation")
+    gROOT.LoadMacro("python/test/loader.h+")
+
+    file1 = TFile.Open(args.file1)
+    file2 = TFile.Open(args.file2)
+    if not file1 or not file2:
+        print "Failed to open %s or %s" % (args.file1, args.file2)
+        sys.exit(1)
+
+    status = 0
+    for treename in (args.tree or ["ntupler/tree"]):
+        status |= compare_trees(file1, file2, treename, args.prefix, args.tolerance, args.abs_tolerance)
+    sys.exit(status)
@@ -1,19 +1,91 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/AssociativeMemory.h"
 using namespace slhcl1tt;
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <stdexcept>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AM_HAVE_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+static const unsigned BITSLICE_WORDS_PER_BLOCK = 4;  // 4 x 64 bits = 256 bits
+
+namespace {
+// Majority logic on bit-sliced layer hits. For each pattern bit, count the
+// missing layers with a saturating bitwise counter: atLeast[j] has the bit set
+// if at least (j+1) layers are missing. A pattern fires if atLeast[maxMisses]
+// is not set.
+void bitsliceMajorityScalar(const uint64_t * layerWords, unsigned nLayers, unsigned maxMisses,
+                            unsigned nWords, uint64_t * firedWords) {
+    uint64_t atLeast[8];
+
+    for (unsigned iword=0; iword<nWords; ++iword) {
+        for (unsigned j=0; j<=maxMisses; ++j)
+            atLeast[j] = 0;
+
+        for (unsigned layer=0; layer<nLayers; ++layer) {
+            const uint64_t miss = ~layerWords[layer * nWords + iword];
+            for (unsigned j=maxMisses; j>0; --j)
+                atLeast[j] |= atLeast[j-1] & miss;
+            atLeast[0] |= miss;
+        }
+        firedWords[iword] = ~atLeast[maxMisses];
+    }
+}
+
+#ifdef AM_HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+void bitsliceMajorityAVX2(const uint64_t * layerWords, unsigned nLayers, unsigned maxMisses,
+                          unsigned nWords, uint64_t * firedWords) {
+    __m256i atLeast[8];
+    const __m256i ones = _mm256_set1_epi64x(-1);
+
+    for (unsigned iword=0; iword<nWords; iword+=BITSLICE_WORDS_PER_BLOCK) {
+        for (unsigned j=0; j<=maxMisses; ++j)
+            atLeast[j] = _mm256_setzero_si256();
+
+        for (unsigned layer=0; layer<nLayers; ++layer) {
+            const __m256i hit  = _mm256_loadu_si256((const __m256i *) &layerWords[layer * nWords + iword]);
+            const __m256i miss = _mm256_andnot_si256(hit, ones);
+            for (unsigned j=maxMisses; j>0; --j)
+                atLeast[j] = _mm256_or_si256(atLeast[j], _mm256_and_si256(atLeast[j-1], miss));
+            atLeast[0] = _mm256_or_si256(atLeast[0], miss);
+        }
+        _mm256_storeu_si256((__m256i *) &firedWords[iword], _mm256_andnot_si256(atLeast[maxMisses], ones));
+    }
+}
+#endif
+}
+
 
 // _____________________________________________________________________________
-int AssociativeMemory::init(unsigned npatterns) {
+int AssociativeMemory::init(unsigned npatterns, AssociativeMemoryEngine engine) {
     patternBank_.clear();
     patternBank_.reserve(npatterns);
 
     patternAttributes_invPt_.clear();
     patternAttributes_invPt_.reserve(npatterns);
 
+    patternBits_.clear();
+    patternMasks_.clear();
+
+    indexOffsets_.clear();
+    indexPatternRefs_.clear();
+    indexLayers_.clear();
+    workspace_ = AssociativeMemoryWorkspace();
+
+    mappedPatterns_ = 0;
+    mappedPatternBits_ = 0;
+    mappedInvPts_ = 0;
+    npatterns_ = 0;
+    mapped_ = false;
+
+    engine_ = engine;
+    frozen_ = false;
+
     return 0;
 }
 
@@ -35,18 +107,196 @@ void AssociativeMemory::insert(const pattern_type& patt, const float invPt) {
     patternAttributes_invPt_.push_back(invPt);
 }
 
+void AssociativeMemory::insert(const pattern_type& patt, const pattern_bit_type& pattBits, const float invPt) {
+    patternBank_.push_back(patt);
+    patternAttributes_invPt_.push_back(invPt);
+    patternBits_.push_back(pattBits);
+}
+
+void AssociativeMemory::map(const pattern_type * patterns, const pattern_bit_type * pattBits, const float * invPts, unsigned npatterns) {
+    assert(patternBank_.empty());
+
+    mappedPatterns_ = patterns;
+    mappedPatternBits_ = pattBits;
+    mappedInvPts_ = invPts;
+    npatterns_ = npatterns;
+    mapped_ = true;
+}
+
 // _____________________________________________________________________________
-void AssociativeMemory::freeze() {
-    assert(patternBank_.size() == patternAttributes_invPt_.size());
+void AssociativeMemory::freeze(unsigned nLayers, unsigned nDCBits) {
+    assert(nLayers <= pattern_type().size());
+    assert(nDCBits <= 4);  // the accepted low bits must fit in a superstrip_bit_type
+    nLayers_ = nLayers;
+    nDCBits_ = nDCBits;
+
+    if (!mapped_) {
+        assert(patternBank_.size() == patternAttributes_invPt_.size());
+        npatterns_ = patternBank_.size();
+    }
+    const pattern_type * patternData = this->patternData();
+
+    if (nDCBits_ > 0) {
+        const pattern_bit_type * patternBitsData = this->patternBitsData();
+        assert(npatterns_ == 0 || patternBitsData != 0);
+        assert(mapped_ || patternBits_.size() == patternBank_.size());
+
+        patternMasks_.clear();
+        patternMasks_.resize(npatterns_);
+        for (unsigned i=0; i<npatterns_; ++i) {
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                patternMasks_[i][layer] = expandDCBits(patternBitsData[i][layer], nDCBits_);
+            }
+        }
+    }
+
+    if (engine_ == AssociativeMemoryEngine::AMINDEX || engine_ == AssociativeMemoryEngine::AMBITSLICE) {
+        // Count the patterns that use each superstrip
+        superstrip_type maxSuperstrip = 0;
+        for (const pattern_type * itpatt = patternData; itpatt != patternData + npatterns_; ++itpatt) {
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                maxSuperstrip = std::max(maxSuperstrip, itpatt->at(layer));
+            }
+        }
+
+        indexOffsets_.clear();
+        indexOffsets_.resize(maxSuperstrip + 2, 0);
+
+        for (const pattern_type * itpatt = patternData; itpatt != patternData + npatterns_; ++itpatt) {
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                ++indexOffsets_[itpatt->at(layer) + 1];
+            }
+        }
+
+        // Convert the counts into offsets
+        for (unsigned i=1; i<indexOffsets_.size(); ++i) {
+            indexOffsets_[i] += indexOffsets_[i-1];
+        }
+
+        // Fill the patternRefs, which come out sorted for each superstrip
+        indexPatternRefs_.clear();
+        indexPatternRefs_.resize(indexOffsets_.back());
+
+        std::vector<unsigned> cursors(indexOffsets_.begin(), indexOffsets_.end() - 1);
+        for (const pattern_type * itpatt = patternData; itpatt != patternData + npatterns_; ++itpatt) {
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                indexPatternRefs_[cursors[itpatt->at(layer)]++] = itpatt - patternData;
+            }
+        }
+
+        // Remember the layer of each superstrip (a hashed superstrip belongs to one layer only)
+        indexLayers_.clear();
+        indexLayers_.resize(maxSuperstrip + 1, 0);
+        for (const pattern_type * itpatt = patternData; itpatt != patternData + npatterns_; ++itpatt) {
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                indexLayers_[itpatt->at(layer)] = layer;
+            }
+        }
+
+    }
+
+    if (engine_ == AssociativeMemoryEngine::AMBITSLICE) {
+        // Round up to a whole number of 256-bit blocks
+        const unsigned nBlocks = (npatterns_ + 64 * BITSLICE_WORDS_PER_BLOCK - 1) / (64 * BITSLICE_WORDS_PER_BLOCK);
+        nWords_ = nBlocks * BITSLICE_WORDS_PER_BLOCK;
+
+#ifdef AM_HAVE_AVX2_KERNEL
+        useAVX2_ = __builtin_cpu_supports("avx2");
+#else
+        useAVX2_ = false;
+#endif
+    }
+
     frozen_ = true;
 }
 
 // _____________________________________________________________________________
 std::vector<unsigned> AssociativeMemory::lookup(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses) {
+    return lookup(hitBuffer, nLayers, maxMisses, workspace_);
+}
+
+std::vector<unsigned> AssociativeMemory::lookup(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const {
+    assert(frozen_);
+
+    if (nDCBits_ > 0)
+        fillCoarseMasks(hitBuffer, workspace);
+
+    // The index only visits patterns with at least one hit layer, so use the
+    // full scan if a pattern can fire with all layers missing
+    std::vector<unsigned> firedPatterns;
+    if (engine_ == AssociativeMemoryEngine::AMINDEX && maxMisses < nLayers) {
+        assert(nLayers == nLayers_);
+        firedPatterns = lookupIndex(hitBuffer, nLayers, maxMisses, workspace);
+    } else if (engine_ == AssociativeMemoryEngine::AMBITSLICE && maxMisses < nLayers) {
+        assert(nLayers == nLayers_);
+        firedPatterns = lookupBitslice(hitBuffer, nLayers, maxMisses, workspace);
+    } else {
+        firedPatterns = lookupScan(hitBuffer, nLayers, maxMisses, workspace);
+    }
+
+    if (nDCBits_ > 0)
+        resetCoarseMasks(workspace);
+    return firedPatterns;
+}
+
+// _____________________________________________________________________________
+void AssociativeMemory::fillCoarseMasks(const HitBuffer& hitBuffer, AssociativeMemoryWorkspace& workspace) const {
+    std::vector<superstrip_bit_type>& coarseMasks = workspace.coarseMasks;
+    std::vector<superstrip_type>&     coarseHits  = workspace.coarseHits;
+
+    const std::vector<superstrip_type>& hitSuperstrips = hitBuffer.getHitSuperstrips();
+    const superstrip_type lowBitsMask = (1u << nDCBits_) - 1;
+
+    coarseHits.clear();
+    for (std::vector<superstrip_type>::const_iterator itss = hitSuperstrips.begin();
+         itss != hitSuperstrips.end(); ++itss) {
+        const superstrip_type coarse = (*itss) >> nDCBits_;
+        if (coarse >= coarseMasks.size())
+            coarseMasks.resize(coarse + 1, 0);
+
+        if (coarseMasks[coarse] == 0)
+            coarseHits.push_back(coarse);
+        coarseMasks[coarse] |= (1u << ((*itss) & lowBitsMask));
+    }
+}
+
+void AssociativeMemory::resetCoarseMasks(AssociativeMemoryWorkspace& workspace) const {
+    for (std::vector<superstrip_type>::const_iterator itss = workspace.coarseHits.begin();
+         itss != workspace.coarseHits.end(); ++itss) {
+        workspace.coarseMasks[*itss] = 0;
+    }
+    workspace.coarseHits.clear();
+}
+
+// _____________________________________________________________________________
+std::vector<unsigned> AssociativeMemory::lookupScan(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const {
     std::vector<unsigned> firedPatterns;
+    const pattern_type * patternData = this->patternData();
+
+    if (nDCBits_ > 0) {
+        const std::vector<superstrip_bit_type>& coarseMasks = workspace.coarseMasks;
+
+        for (unsigned ipatt=0; ipatt<npatterns_; ++ipatt) {
+            const pattern_type&     patt      = patternData[ipatt];
+            const pattern_bit_type& pattMasks = patternMasks_[ipatt];
+            unsigned nMisses = 0;
+
+            for (unsigned layer=0; layer<nLayers; ++layer) {
+                const superstrip_type ss = patt[layer];
+                if (ss >= coarseMasks.size() || !(coarseMasks[ss] & pattMasks[layer]))
+                    ++nMisses;
+
+                // Skip if more misses than allowed
+                if (nMisses > maxMisses)
+                    break;
+            }
+            if (nMisses <= maxMisses)
+                firedPatterns.push_back(ipatt);
+        }
+        return firedPatterns;
+    }
 
-    for (std::vector<pattern_type>::const_iterator itpatt = patternBank_.begin();
-         itpatt != patternBank_.end(); ++itpatt) {
+    for (const pattern_type * itpatt = patternData; itpatt != patternData + npatterns_; ++itpatt) {
         unsigned nMisses = 0;
 
         for (pattern_type::const_reverse_iterator itlayer = itpatt->rend() - nLayers;
@@ -61,18 +311,137 @@ std::vector<unsigned> AssociativeMemory::lookup(const HitBuffer& hitBuffer, cons
                 break;
         }
         if (nMisses <= maxMisses)
-            firedPatterns.push_back(itpatt - patternBank_.begin());
+            firedPatterns.push_back(itpatt - patternData);
+    }
+    return firedPatterns;
+}
+
+// _____________________________________________________________________________
+std::vector<unsigned> AssociativeMemory::lookupIndex(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const {
+    std::vector<unsigned> firedPatterns;
+
+    // The counters are left at zero after every lookup, so they only need to be allocated once
+    std::vector<uint8_t>&  patternCounters = workspace.patternCounters;
+    std::vector<unsigned>& touchedPatterns = workspace.touchedPatterns;
+    if (patternCounters.size() != npatterns_)
+        patternCounters.assign(npatterns_, 0);
+
+    // With DC bits, the index is keyed by the coarse superstrips
+    const bool useDCBits = (nDCBits_ > 0);
+    const unsigned nSuperstrips = indexOffsets_.size() - 1;
+    const std::vector<superstrip_type>& hitSuperstrips = useDCBits ? workspace.coarseHits : hitBuffer.getHitSuperstrips();
+
+    // Increment the layer-hit counter of every pattern that contains a fired superstrip
+    touchedPatterns.clear();
+    for (std::vector<superstrip_type>::const_iterator itss = hitSuperstrips.begin();
+         itss != hitSuperstrips.end(); ++itss) {
+        const superstrip_type ss = *itss;
+        if (ss >= nSuperstrips)  // not used by any pattern
+            continue;
+
+        for (unsigned i=indexOffsets_[ss]; i<indexOffsets_[ss+1]; ++i) {
+            const unsigned patternRef = indexPatternRefs_[i];
+            if (useDCBits && !(workspace.coarseMasks[ss] & patternMasks_[patternRef][indexLayers_[ss]]))
+                continue;
+            if (patternCounters[patternRef]++ == 0)
+                touchedPatterns.push_back(patternRef);
+        }
+    }
+
+    // Apply the majority logic, then reset the counters
+    const unsigned minHits = nLayers - maxMisses;
+    for (std::vector<unsigned>::const_iterator it = touchedPatterns.begin();
+         it != touchedPatterns.end(); ++it) {
+        if (patternCounters[*it] >= minHits)
+            firedPatterns.push_back(*it);
+        patternCounters[*it] = 0;
+    }
+
+    // Keep the same order as the full scan
+    std::sort(firedPatterns.begin(), firedPatterns.end());
+    return firedPatterns;
+}
+
+// _____________________________________________________________________________
+std::vector<unsigned> AssociativeMemory::lookupBitslice(const HitBuffer& hitBuffer, const unsigned nLayers, const unsigned maxMisses, AssociativeMemoryWorkspace& workspace) const {
+    std::vector<unsigned> firedPatterns;
+    if (nWords_ == 0)
+        return firedPatterns;
+
+    std::vector<uint64_t>& bitsliceWords = workspace.bitsliceWords;
+    if (bitsliceWords.size() != (nLayers_ + 1) * nWords_)
+        bitsliceWords.assign((nLayers_ + 1) * nWords_, 0);
+
+    // With DC bits, the index is keyed by the coarse superstrips
+    const bool useDCBits = (nDCBits_ > 0);
+    const unsigned nSuperstrips = indexOffsets_.size() - 1;
+    const std::vector<superstrip_type>& hitSuperstrips = useDCBits ? workspace.coarseHits : hitBuffer.getHitSuperstrips();
+
+    uint64_t * layerWords = &bitsliceWords[0];
+    uint64_t * firedWords = &bitsliceWords[nLayers * nWords_];
+
+    // OR the fired superstrips into the layer hit bitvectors
+    std::fill(bitsliceWords.begin(), bitsliceWords.begin() + nLayers * nWords_, 0);
+
+    for (std::vector<superstrip_type>::const_iterator itss = hitSuperstrips.begin();
+         itss != hitSuperstrips.end(); ++itss) {
+        const superstrip_type ss = *itss;
+        if (ss >= nSuperstrips)  // not used by any pattern
+            continue;
+
+        const unsigned layer = indexLayers_[ss];
+        uint64_t * words = layerWords + layer * nWords_;
+        for (unsigned i=indexOffsets_[ss]; i<indexOffsets_[ss+1]; ++i) {
+            const unsigned patternRef = indexPatternRefs_[i];
+            if (useDCBits && !(workspace.coarseMasks[ss] & patternMasks_[patternRef][layer]))
+                continue;
+            words[patternRef >> 6] |= (uint64_t(1) << (patternRef & 63));
+        }
+    }
+
+    // Apply the majority logic
+    assert(maxMisses < 8);
+#ifdef AM_HAVE_AVX2_KERNEL
+    if (useAVX2_)
+        bitsliceMajorityAVX2(layerWords, nLayers, maxMisses, nWords_, firedWords);
+    else
+#endif
+        bitsliceMajorityScalar(layerWords, nLayers, maxMisses, nWords_, firedWords);
+
+    // Collect the fired patterns, in increasing order
+    for (unsigned iword=0; iword<nWords_; ++iword) {
+        uint64_t word = firedWords[iword];
+        while (word) {
+            firedPatterns.push_back((iword << 6) + __builtin_ctzll(word));
+            word &= word - 1;  // clear the lowest set bit
+        }
     }
     return firedPatterns;
 }
 
 // _____________________________________________________________________________
-void AssociativeMemory::retrieve(const unsigned patternRef, pattern_type& superstripIds, float& invPt) {
-    superstripIds = patternBank_            .at(patternRef);
-    invPt         = patternAttributes_invPt_.at(patternRef);
+void AssociativeMemory::retrieve(const unsigned patternRef, pattern_type& superstripIds, float& invPt) const {
+    if (patternRef >= npatterns_)
+        throw std::out_of_range("AssociativeMemory::retrieve");
+
+    superstripIds = patternData()[patternRef];
+    invPt         = invPtData()  [patternRef];
+}
+
+void AssociativeMemory::retrieve(const unsigned patternRef, pattern_type& superstripIds, pattern_bit_type& superstripBits, float& invPt) const {
+    if (patternRef >= npatterns_ || (mapped_ ? mappedPatternBits_ == 0 : patternBits_.size() != npatterns_))
+        throw std::out_of_range("AssociativeMemory::retrieve");
+
+    superstripIds  = patternData()    [patternRef];
+    superstripBits = patternBitsData()[patternRef];
+    invPt          = invPtData()      [patternRef];
 }
 
 // _____________________________________________________________________________
 void AssociativeMemory::print() {
-    std::cout << "npatterns: " << patternBank_.size() << std::endl;
+    std::cout << "npatterns: " << npatterns_ << " mapped: " << mapped_ << " nDCBits: " << nDCBits_ << std::endl;
+    if (engine_ == AssociativeMemoryEngine::AMINDEX || engine_ == AssociativeMemoryEngine::AMBITSLICE)
+        std::cout << "nsuperstrips: " << (indexOffsets_.empty() ? 0 : indexOffsets_.size() - 1) << " nrefs: " << indexPatternRefs_.size() << std::endl;
+    if (engine_ == AssociativeMemoryEngine::AMBITSLICE)
+        std::cout << "nwords: " << nWords_ << " avx2: " << useAVX2_ << std::endl;
 }
@@ -4,6 +4,52 @@ using namespace slhcl1tt;
 #include <iostream>
 
 
+// _____________________________________________________________________________
+std::vector<std::vector<unsigned> > CombinationFactory::combine(const std::vector<std::vector<unsigned> >& groups) {
+    std::vector<unsigned> combination;
+    std::vector<std::vector<unsigned> > combinations;
+
+    begin(groups);
+    while (next(combination))
+        combinations.push_back(combination);
+    return combinations;
+}
+
+void CombinationFactory::begin(const std::vector<std::vector<unsigned> >& groups) {
+    groups_ = &groups;
+    indices_.assign(groups.size(), 0);  // init to zeroes
+    done_ = false;
+}
+
+bool CombinationFactory::next(std::vector<unsigned>& combination) {
+    if (done_)  return false;
+
+    const std::vector<std::vector<unsigned> >& groups = *groups_;
+    const int ngroups = groups.size();
+
+    combination.clear();
+    for (int i=0; i<ngroups; ++i) {
+        if (groups.at(i).size())
+            combination.push_back(groups.at(i).at(indices_.at(i)));
+        else  // empty group
+            combination.push_back(CombinationFactory::BAD);
+    }
+
+    int i=0, j=0;
+    for (i=ngroups-1; i>=0; --i)
+        if (groups.at(i).size())
+            if (indices_.at(i) != groups.at(i).size() - 1)
+                break;  // take the last index that has not reached the end
+    if (i == -1) {
+        done_ = true;
+    } else {
+        indices_[i] += 1;  // increment that index
+        for (j=i+1; j<ngroups; ++j)
+            indices_[j] = 0;  // set indices behind that index to zeroes
+    }
+    return true;
+}
+
 // _____________________________________________________________________________
 void CombinationFactory::print() {
     std::cout << std::endl;
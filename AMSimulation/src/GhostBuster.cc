@@ -1,6 +1,8 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/GhostBuster.h"
 using namespace slhcl1tt;
 
+#include <algorithm>
+#include <bitset>
 #include <cassert>
 #include <iostream>
 
@@ -43,6 +45,77 @@ bool GhostBuster::isGhostTrack(const std::vector<unsigned>& stubRefs1, const std
     return true;
 }
 
+// _____________________________________________________________________________
+void GhostBuster::findGhostTracks(std::vector<TTTrack2>& tracks, const unsigned threshold) {
+    const unsigned ntracks = tracks.size();
+    if (ntracks == 0)
+        return;
+
+    const unsigned nlayers = tracks.front().stubRefs().size();
+    assert(nlayers <= 32);
+
+    stubRefs_.resize(ntracks);
+    layerTracks_.resize(nlayers);
+    for (unsigned ilayer=0; ilayer<nlayers; ++ilayer)
+        layerTracks_.at(ilayer).clear();
+    layerMasks_.clear();
+    lastCompared_.assign(ntracks, ntracks);
+
+    for (unsigned itrack=0; itrack<ntracks; ++itrack) {  // all tracks
+        std::vector<unsigned>& stubRefs = stubRefs_.at(itrack);
+        stubRefs = tracks.at(itrack).stubRefs();
+        assert(stubRefs.size() == nlayers);
+
+        unsigned layerMask = 0;
+        for (unsigned ilayer=0; ilayer<nlayers; ++ilayer) {
+            if (stubRefs.at(ilayer) != GhostBuster::BAD)
+                layerMask |= (1u << ilayer);
+        }
+
+        // A track that shares no stub with a kept track is its ghost only if
+        // they have a stub in fewer than threshold common layers (at least one
+        // differing layer is needed to tell them apart)
+        bool isGhost = false;
+        for (unsigned imask=0; imask<layerMasks_.size() && !isGhost; ++imask) {
+            if (std::bitset<32>(layerMasks_.at(imask) & layerMask).count() < std::max(threshold, 1u))
+                isGhost = true;
+        }
+
+        // Otherwise compare with the kept tracks that share a stub
+        for (unsigned ilayer=0; ilayer<nlayers && !isGhost; ++ilayer) {
+            if (stubRefs.at(ilayer) == GhostBuster::BAD)
+                continue;
+
+            std::unordered_map<unsigned, std::vector<unsigned> >::const_iterator found = layerTracks_.at(ilayer).find(stubRefs.at(ilayer));
+            if (found == layerTracks_.at(ilayer).end())
+                continue;
+
+            const std::vector<unsigned>& jtracks = found->second;
+            for (unsigned k=0; k<jtracks.size() && !isGhost; ++k) {
+                const unsigned jtrack = jtracks.at(k);
+                if (lastCompared_.at(jtrack) == itrack)
+                    continue;
+                lastCompared_.at(jtrack) = itrack;
+
+                isGhost = isGhostTrack(stubRefs_.at(jtrack), stubRefs, threshold);
+            }
+        }
+
+        if (isGhost)
+            tracks.at(itrack).setAsGhost();
+
+        // Keep the track
+        if (!tracks.at(itrack).isGhost()) {
+            for (unsigned ilayer=0; ilayer<nlayers; ++ilayer) {
+                if (stubRefs.at(ilayer) != GhostBuster::BAD)
+                    layerTracks_.at(ilayer)[stubRefs.at(ilayer)].push_back(itrack);
+            }
+            if (std::find(layerMasks_.begin(), layerMasks_.end(), layerMask) == layerMasks_.end())
+                layerMasks_.push_back(layerMask);
+        }
+    }
+}
+
 // _____________________________________________________________________________
 void GhostBuster::print() {
     std::cout << std::endl;
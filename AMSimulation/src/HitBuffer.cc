@@ -8,41 +8,70 @@ using namespace slhcl1tt;
 
 // _____________________________________________________________________________
 int HitBuffer::init(unsigned maxBins) {
-    superstripHits_.clear();
+    superstripCounts_.clear();
+    superstripCounts_.resize(maxBins, 0);
 
-    superstripBools_.clear();
-    superstripBools_.resize(maxBins);
+    superstripRanges_.clear();
+    superstripRanges_.resize(maxBins, std::make_pair(0u, 0u));
 
+    stubRefs_.clear();
+    insertedHits_.clear();
+    superstripsHit_.clear();
+
+    frozen_ = false;
     return 0;
 }
 
 // _____________________________________________________________________________
 void HitBuffer::reset() {
-    superstripHits_.clear();
+    for (std::vector<superstrip_type>::const_iterator it = superstripsHit_.begin();
+         it != superstripsHit_.end(); ++it) {
+        superstripCounts_[*it] = 0;
+    }
 
-    std::fill(superstripBools_.begin(), superstripBools_.end(), false);
+    // clear() keeps the capacity, so there is no allocation after the first events
+    stubRefs_.clear();
+    insertedHits_.clear();
+    superstripsHit_.clear();
+
+    frozen_ = false;
 }
 
 // _____________________________________________________________________________
 void HitBuffer::insert(superstrip_type ss, unsigned stubRef) {
-    superstripHits_[ss].push_back(stubRef);
+    assert(ss < superstripCounts_.size());
+
+    if (superstripCounts_[ss]++ == 0)
+        superstripsHit_.push_back(ss);
 
-    superstripBools_[ss] = true;
+    insertedHits_.push_back(std::make_pair(ss, stubRef));
 }
 
 // _____________________________________________________________________________
 void HitBuffer::freeze(unsigned maxStubs) {
-    for (std::map<superstrip_type, std::vector<unsigned> >::iterator it=superstripHits_.begin();
-         it!=superstripHits_.end(); ++it) {
-        if (it->second.size() > maxStubs)
-            it->second.resize(maxStubs);
+    assert(superstripCounts_.size() != 0);
+
+    // Assign the ranges, superstrips are laid out in order of first insertion
+    unsigned offset = 0;
+    for (std::vector<superstrip_type>::const_iterator it = superstripsHit_.begin();
+         it != superstripsHit_.end(); ++it) {
+        superstripRanges_[*it] = std::make_pair(offset, offset);  // the end is used as cursor
+        offset += std::min(superstripCounts_[*it], maxStubs);
+    }
+    stubRefs_.resize(offset);
+
+    // Scatter the stubRefs, keeping the first maxStubs of each superstrip
+    for (std::vector<std::pair<superstrip_type, unsigned> >::const_iterator it = insertedHits_.begin();
+         it != insertedHits_.end(); ++it) {
+        std::pair<unsigned, unsigned>& range = superstripRanges_[it->first];
+        if (range.second - range.first < maxStubs)
+            stubRefs_[range.second++] = it->second;
     }
 
-    assert(superstripBools_.size() != 0);
     frozen_ = true;
 }
 
 // _____________________________________________________________________________
 void HitBuffer::print() {
-    std::cout << "nbins: " << superstripBools_.size() << std::endl;
+    std::cout << "nbins: " << superstripCounts_.size() << " nhits: " << superstripsHit_.size() << " nstubs: " << stubRefs_.size() << std::endl;
 }
@@ -6,6 +6,16 @@
 #include <iomanip>
 #include <fstream>
 
+namespace {
+// Passes over the events: find the outliers, solve for C & T, then solve for
+// the eigenvectors and for D
+const unsigned NPASSES = 3;
+const char * const PASS_NAMES[NPASSES] = {"outliers", "C & T", "eigenvectors & D"};
+
+// Reject the outliers beyond this number of sigmas
+const float OUTLIER_SIGMA = 5.;
+}
+
 
 // _____________________________________________________________________________
 int MatrixBuilder::bookHistograms() {
@@ -139,47 +149,55 @@ int MatrixBuilder::buildMatrices(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
-    if (reader.init(src, false)) {
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
     }
 
-    // _________________________________________________________________________
-    // Loop over all events and filter them
-
-    if (verbose_)  std::cout << Info() << "Begin event filtering (two loops)" << std::endl;
-
-    if (loopEventsAndFilter(reader))
-        return 1;
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
 
     // _________________________________________________________________________
-    // Loop over all events and solve for C & T (first loop)
+    // With more than one shard, each job only does the next pass on its shard,
+    // given the merged statistics of the previous passes
+    const bool sharded = (po_.nShards > 1);
 
-    if (verbose_)  std::cout << Info() << "Begin first loop on tracks" << std::endl;
+    stats_.clear();
+    if (sharded && po_.matrixfile != "") {
+        if (readStatistics(po_.matrixfile, stats_))
+            return 1;
 
-    if (loopEventsAndSolveCT(reader))
-        return 1;
+        if (stats_.size() >= NPASSES) {
+            std::cout << Error() << "All the passes are already done in " << po_.matrixfile << std::endl;
+            return 1;
+        }
+    }
 
     // _________________________________________________________________________
-    // Loop over all events and solve for eigenvectors (second loop)
+    // Loop over all events, once per pass, and solve for the matrices
 
-    if (verbose_)  std::cout << Info() << "Begin second loop on tracks" << std::endl;
+    for (unsigned ipass=0; ipass<NPASSES; ++ipass) {
+        if (ipass == stats_.size()) {
+            if (verbose_)  std::cout << Info() << "Begin pass " << ipass << ": " << PASS_NAMES[ipass] << std::endl;
 
-    if (loopEventsAndSolveEigenvectors(reader))
-        return 1;
+            Moments moments(ipass == 0 ? nvariables_ : (ipass == 1 ? nvariables_ + 2 : nvariables_ + nparameters_));
+            if (loopEventsAndFill(reader, ipass, moments))
+                return 1;
+            stats_.push_back(moments);
 
-    // _________________________________________________________________________
-    // Loop over all events and solve for D (third loop)
-
-    if (verbose_)  std::cout << Info() << "Begin third loop on tracks" << std::endl;
+            if (sharded)
+                return 0;
+        }
 
-    if (loopEventsAndSolveD(reader))
-        return 1;
+        if (solvePass(ipass, stats_.at(ipass)))
+            return 1;
+    }
 
     // _________________________________________________________________________
-    // Loop over all events and evaluate biases and resolutions (fourth loop)
+    // Loop over all events and evaluate biases and resolutions
 
-    if (verbose_)  std::cout << Info() << "Begin fourth loop on tracks" << std::endl;
+    if (verbose_)  std::cout << Info() << "Begin evaluation loop on tracks" << std::endl;
 
     if (loopEventsAndEval(reader))
         return 1;
@@ -188,193 +206,223 @@ int MatrixBuilder::buildMatrices(TString src) {
 }
 
 // _____________________________________________________________________________
-// Loop over all events and filter them
-int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
-
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
-
-    if (verbose_)  std::cout << Info() << "Filter events." << std::endl;
-
-    // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+// Merge the statistics of the shards
+int MatrixBuilder::mergeStatistics(TString src) {
+    std::vector<std::string> files;
+    if (!src.EndsWith(".txt") || getInputFiles(src.Data(), files) || files.empty()) {
+        std::cout << Error() << "Input source must be a .txt file listing the statistics to merge" << std::endl;
+        return 1;
+    }
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+    if (verbose_)  std::cout << Info() << "Merging the statistics of " << files.size() << " shards." << std::endl;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
+    // The shards must have done the same passes, and only the last one differs
+    stats_.clear();
+    for (unsigned ifile=0; ifile<files.size(); ++ifile) {
+        std::vector<Moments> stats;
+        if (readStatistics(files.at(ifile), stats))
+            return 1;
 
-        // Apply track invPt requirement
-        assert(reader.vp_pt->size() == 1);
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        if (simChargeOverPt < po_.minInvPt || po_.maxInvPt < simChargeOverPt) {
-            ++nRead;
-            keepEvents_.push_back(false);
+        if (ifile == 0) {
+            stats_ = stats;
             continue;
         }
 
-        // Apply trigger tower acceptance
-        unsigned ngoodstubs = 0;
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            if (ttrmap.find(moduleId) != ttrmap.end()) {
-                ++ngoodstubs;
-            }
-        }
-        if (ngoodstubs != po_.nLayers) {
-            ++nRead;
-            keepEvents_.push_back(false);
-            continue;
-        }
-        assert(nstubs == po_.nLayers);
+        bool compatible = (stats.size() == stats_.size());
+        for (unsigned ipass=0; compatible && ipass+1<stats.size(); ++ipass)
+            compatible = (stats.at(ipass) == stats_.at(ipass));
 
-        // _____________________________________________________________________
-        // Calculate means and covariances for V (cheating version)
+        if (!compatible) {
+            std::cout << Error() << "The statistics in " << files.at(ifile) << " were not made from the same previous passes as in " << files.front() << std::endl;
+            return 1;
+        }
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+        stats_.back().merge(stats.back());
+    }
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+    const unsigned npasses = stats_.size();
+    if (verbose_)  std::cout << Info() << "Merged pass " << npasses-1 << ": " << PASS_NAMES[npasses-1] << ", # tracks: " << stats_.back().getEntries() << std::endl;
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        //setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+    if (npasses < NPASSES) {
+        if (verbose_)  std::cout << Info() << "Give the merged statistics with '--matrix' to do the next pass." << std::endl;
+        return 0;
+    }
 
-        // Apply DeltaR correction (cheating version)
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        variables1 += simC * variables3;
-        variables2 += simT * variables3;
+    // Solve for the matrices
+    for (unsigned ipass=0; ipass<NPASSES; ++ipass) {
+        if (solvePass(ipass, stats_.at(ipass)))
+            return 1;
+    }
+    return 0;
+}
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+// _____________________________________________________________________________
+// Get the track of the event
+bool MatrixBuilder::getTrack(const TTStubReader& reader, MatrixTrack& trk) const {
+
+    // Get module index
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
+
+    const unsigned nstubs = reader.vb_modId->size();
+
+    // Apply track invPt requirement
+    assert(reader.vp_pt->size() == 1);
+    trk.simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
+    trk.simCotTheta     = std::sinh(reader.vp_eta->front());
+    trk.simPhi          = reader.vp_phi->front();
+    trk.simVz           = reader.vp_vz->front();
+    if (trk.simChargeOverPt < po_.minInvPt || po_.maxInvPt < trk.simChargeOverPt) {
+        return false;
+    }
 
-        // Update mean vector
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
+    // Apply trigger tower acceptance
+    unsigned ngoodstubs = 0;
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+        unsigned moduleId = reader.vb_modId   ->at(istub);
+        if (moduleIndex.isInTower(moduleIndex.index(moduleId), po_.tower)) {
+            ++ngoodstubs;
         }
+    }
+    if (ngoodstubs != po_.nLayers) {
+        return false;
+    }
+    assert(nstubs == po_.nLayers);
 
-        // Update covariance matrix
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
-        }
+    trk.variables1 = Eigen::VectorXd::Zero(nvariables_/2);
+    trk.variables2 = Eigen::VectorXd::Zero(nvariables_/2);
+    trk.variables3 = Eigen::VectorXd::Zero(nvariables_/2);
 
-        ++nKept;
-        ++nRead;
-        keepEvents_.push_back(true);
-    }
+    // Loop over reconstructed stubs
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+        float    stub_r   = reader.vb_r       ->at(istub);
+        float    stub_phi = reader.vb_phi     ->at(istub);
+        float    stub_z   = reader.vb_z       ->at(istub);
 
-    if (nRead == 0) {
-        std::cout << Error() << "Failed to read any event." << std::endl;
-        return 1;
+        trk.variables1(istub) = stub_phi;
+        trk.variables2(istub) = stub_z;
+        trk.variables3(istub) = meansR_(istub) - stub_r;
     }
+    return true;
+}
 
-    if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", nRead, nKept) << std::endl;
+// Reject the outliers of the principal components (cheating version)
+bool MatrixBuilder::isOutlier(const MatrixTrack& trk) const {
+    if (OUTLIER_SIGMA >= 10.)
+        return false;
+
+    // Transform coordinates to principal components (cheating version)
+    Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
+    principals = filterV_ * (getFilterVariables(trk) - filterMeans_);
 
-     // Find eigenvectors of covariance matrix (cheating version)
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(covariances);
-    Eigen::VectorXd sqrtEigenvalues = Eigen::VectorXd::Zero(nvariables_);
     for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-        sqrtEigenvalues(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
+        assert(filterSqrtEigenvalues_(ivar) > 0.);
+        if (principals(ivar)/filterSqrtEigenvalues_(ivar) > OUTLIER_SIGMA) {
+            return true;
+        }
     }
+    return false;
+}
 
-    // Find matrix V (cheating version)
-    // V is the orthogonal transformation from coordinates space to principal components space
-    // The principal components are constraints + rotated track parameters
-    Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
-    V = (eigensolver.eigenvectors()).transpose();
+// Get the variables with the DeltaR correction (cheating version)
+Eigen::VectorXd MatrixBuilder::getFilterVariables(const MatrixTrack& trk) const {
+    const double simC = -0.5 * (0.003 * 3.8 * trk.simChargeOverPt);  // 1/(2 x radius of curvature)
+    const double simT = trk.simCotTheta;
 
-    // _________________________________________________________________________
-    // Loop again to reject outliers
+    Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
+    variables << trk.variables1 + simC * trk.variables3, trk.variables2 + simT * trk.variables3;
+    return variables;
+}
 
-    const float sigma = 5.;
-    if (sigma >= 10.)
-        return 0;
+// Get the variables with the DeltaR correction
+Eigen::VectorXd MatrixBuilder::getCorrectedVariables(const MatrixTrack& trk) {
+    Eigen::VectorXd variables1 = trk.variables1;
+    Eigen::VectorXd variables2 = trk.variables2;
+    Eigen::VectorXd variables3 = trk.variables3;
+    setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+
+    // Apply DeltaR correction
+    variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
+    variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
+
+    Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
+    variables << variables1, variables2;
+    return variables;
+}
+
+// Get the sim track parameters
+Eigen::VectorXd MatrixBuilder::getParameters(const MatrixTrack& trk) const {
+    Eigen::VectorXd parameters = Eigen::VectorXd::Zero(nparameters_);
+    {
+        unsigned ipar = 0;
+        parameters(ipar++) = trk.simPhi;
+        parameters(ipar++) = trk.simCotTheta;
+        parameters(ipar++) = trk.simVz;
+        parameters(ipar++) = trk.simChargeOverPt;
+    }
+    return parameters;
+}
+
+// _____________________________________________________________________________
+// Loop over all events and fill the moments of a pass
+//   pass 0: variables after the DeltaR correction (cheating version), to find
+//           the outliers
+//   pass 1: variables, C and T, to solve for C & T
+//   pass 2: variables after the DeltaR correction and track parameters, to
+//           solve for the eigenvectors and for D
+int MatrixBuilder::loopEventsAndFill(TTStubReader& reader, unsigned ipass, Moments& moments) {
 
-    if (verbose_)  std::cout << Info() << "Reject outlier events. sigma=" << sigma << std::endl;
+    MatrixTrack trk;
 
     // Bookkeepers
-    nRead = 0, nKept = 0;
+    long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
         const unsigned nstubs = reader.vb_modId->size();
         if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
+        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
 
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
+        ++nRead;
+        if (!getTrack(reader, trk))
             continue;
-        }
 
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
+        // The outliers are only known after the first pass
+        if (ipass > 0 && isOutlier(trk))
+            continue;
 
         // _____________________________________________________________________
-        // Reject outliers
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        //setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+        // Update means and covariances
 
-        // Apply DeltaR correction (cheating version)
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        variables1 += simC * variables3;
-        variables2 += simT * variables3;
+        if (ipass == 0) {
+            moments.fill(getFilterVariables(trk));
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+        } else if (ipass == 1) {
+            Eigen::VectorXd variables1 = trk.variables1;
+            Eigen::VectorXd variables2 = trk.variables2;
+            Eigen::VectorXd variables3 = trk.variables3;
+            setVariableToZero(variables1, variables2, variables3, po_.hitBits);
 
-        // Transform coordinates to principal components (cheating version)
-        Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
-        principals = V * (variables - means);
+            const double simC = -0.5 * (0.003 * 3.8 * trk.simChargeOverPt);  // 1/(2 x radius of curvature)
+            const double simT = trk.simCotTheta;
 
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            assert(sqrtEigenvalues(ivar) > 0.);
-            if (principals(ivar)/sqrtEigenvalues(ivar) > sigma) {
-                keepEvents_.at(ievt) = false;
+            Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_ + 2);
+            variables << variables1, variables2, simC, simT;
+            moments.fill(variables);
 
-                //std::cout << ievt << " " << ivar << " " << principals(ivar) << " " << sqrtEigenvalues(ivar) << " " << principals(ivar)/sqrtEigenvalues(ivar) << std::endl;
-            }
+        } else {
+            Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_ + nparameters_);
+            variables << getCorrectedVariables(trk), getParameters(trk);
+            moments.fill(variables);
         }
 
-        if (keepEvents_.at(ievt))
-            ++nKept;
-        ++nRead;
+        ++nKept;
+    }
+
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
     }
 
     if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", nRead, nKept) << std::endl;
@@ -382,93 +430,53 @@ int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
 }
 
 // _____________________________________________________________________________
-// Loop over all events and solve for C & T
-int MatrixBuilder::loopEventsAndSolveCT(TTStubReader& reader) {
-
-    // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
-
-    Eigen::VectorXd meansC = Eigen::VectorXd::Zero(1);
-    Eigen::MatrixXd covariancesC = Eigen::MatrixXd::Zero(1, nvariables_/2);
-
-    Eigen::VectorXd meansT = Eigen::VectorXd::Zero(1);
-    Eigen::MatrixXd covariancesT = Eigen::MatrixXd::Zero(1, nvariables_/2);
-
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
-
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
-
-        // _____________________________________________________________________
-        // Calculate means and covariances for C&T
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+// Solve for the matrices of a pass
+int MatrixBuilder::solvePass(unsigned ipass, const Moments& moments) {
+    if (ipass == 0)
+        return solveFilter(moments);
+    if (ipass == 1)
+        return solveCT(moments);
+    return solveEigenvectorsAndD(moments);
+}
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+// Find the principal components used to reject outliers
+int MatrixBuilder::solveFilter(const Moments& moments) {
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+     // Find eigenvectors of covariance matrix (cheating version)
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(moments.getCovariances());
+    Eigen::VectorXd sqrtEigenvalues = Eigen::VectorXd::Zero(nvariables_);
+    for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+        sqrtEigenvalues(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
+    }
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+    // Find matrix V (cheating version)
+    // V is the orthogonal transformation from coordinates space to principal components space
+    // The principal components are constraints + rotated track parameters
+    Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    V = (eigensolver.eigenvectors()).transpose();
 
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
+    filterMeans_ = moments.getMeans();
+    filterV_ = V;
+    filterSqrtEigenvalues_ = sqrtEigenvalues;
 
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
-        }
+    if (verbose_)  std::cout << Info() << "Reject outlier events. sigma=" << OUTLIER_SIGMA << std::endl;
+    return 0;
+}
 
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        meansC(0) += (simC - meansC(0))/nTracks;
-        meansT(0) += (simT - meansT(0))/nTracks;
-
-        // Update covariance matrices
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
+// Solve for C & T
+int MatrixBuilder::solveCT(const Moments& moments) {
 
-            for (unsigned ipar=0; ipar<1; ++ipar) {
-                for (unsigned jvar=0; jvar<nvariables_/2; ++jvar) {
-                    unsigned kvar = jvar;
-                    covariancesC(ipar, jvar) += (simC - meansC(ipar)) * (variables(kvar) - means(kvar)) / (nTracks-1) - covariancesC(ipar, jvar)/nTracks;
+    // Mean vector and covariance matrix
+    Eigen::VectorXd means = moments.getMeans().head(nvariables_);
+    Eigen::MatrixXd covariances = moments.getCovariances().topLeftCorner(nvariables_, nvariables_);
 
-                    kvar = jvar + nvariables_/2;
-                    covariancesT(ipar, jvar) += (simT - meansT(ipar)) * (variables(kvar) - means(kvar)) / (nTracks-1) - covariancesT(ipar, jvar)/nTracks;
-                }
-            }
-        }
+    Eigen::VectorXd meansC = Eigen::VectorXd::Zero(1);
+    meansC(0) = moments.getMeans()(nvariables_);
+    Eigen::MatrixXd covariancesC = moments.getCovariances().block(nvariables_, 0, 1, nvariables_/2);
 
-        ++nKept;
-        ++nRead;
-    }
+    Eigen::VectorXd meansT = Eigen::VectorXd::Zero(1);
+    meansT(0) = moments.getMeans()(nvariables_ + 1);
+    Eigen::MatrixXd covariancesT = moments.getCovariances().block(nvariables_ + 1, nvariables_/2, 1, nvariables_/2);
 
     if (verbose_>1) {
         std::cout << Info() << "means: " << std::endl;
@@ -526,73 +534,17 @@ int MatrixBuilder::loopEventsAndSolveCT(TTStubReader& reader) {
     return 0;
 }
 
-// _____________________________________________________________________________
-// Loop over all events and solve for eigenvectors
-int MatrixBuilder::loopEventsAndSolveEigenvectors(TTStubReader& reader) {
+// Solve for eigenvectors and for D. The principal components are a linear
+// transformation of the variables, so their moments are found from the moments
+// of the variables and of the track parameters
+int MatrixBuilder::solveEigenvectorsAndD(const Moments& moments) {
 
     // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    Eigen::VectorXd means = moments.getMeans().head(nvariables_);
+    Eigen::MatrixXd covariances = moments.getCovariances().topLeftCorner(nvariables_, nvariables_);
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
-
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
-
-        // _____________________________________________________________________
-        // Calculate means and covariances for V
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
-
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
-
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
-
-        // Update mean vector
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
-        }
-
-        // Update covariance matrix
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
-        }
-
-        ++nKept;
-        ++nRead;
-    }
+    Eigen::VectorXd meansP = moments.getMeans().tail(nparameters_);
+    Eigen::MatrixXd covariancesPX = moments.getCovariances().bottomLeftCorner(nparameters_, nvariables_);
 
     if (verbose_>1) {
         std::cout << Info() << "means: " << std::endl;
@@ -626,108 +578,12 @@ int MatrixBuilder::loopEventsAndSolveEigenvectors(TTStubReader& reader) {
         std::cout << Info() << "eigenvectors^T: " << std::endl;
         std::cout << mat_.V << std::endl << std::endl;
     }
-    return 0;
-}
-
-// _____________________________________________________________________________
-// Loop over all events and solve for D
-int MatrixBuilder::loopEventsAndSolveD(TTStubReader& reader) {
 
     // Mean vector and covariance matrix for principal components and track parameters
-    Eigen::VectorXd meansV = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariancesV = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
-
-    Eigen::VectorXd meansP = Eigen::VectorXd::Zero(nparameters_);
-    Eigen::MatrixXd covariancesPV = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
-
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
-
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
-
-        // _____________________________________________________________________
-        // Calculate V covariance matrix and PV covariance matrix
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
-
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
-
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
-
-        Eigen::VectorXd parameters = Eigen::VectorXd::Zero(nparameters_);
-
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        double simPhi          = reader.vp_phi->front();
-        double simVz           = reader.vp_vz->front();
-        {
-            unsigned ipar = 0;
-            parameters(ipar++) = simPhi;
-            parameters(ipar++) = simCotTheta;
-            parameters(ipar++) = simVz;
-            parameters(ipar++) = simChargeOverPt;
-        }
-
-        // Transform coordinates to principal components
-        Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
-        principals = mat_.V * variables;  // not using deltas of variables here!
-
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansV(ivar) += (principals(ivar) - meansV(ivar))/nTracks;
-        }
-
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            meansP(ipar) += (parameters(ipar) - meansP(ipar))/nTracks;
-        }
-
-        // Update covariance matrices
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariancesV(ivar, jvar) += (principals(ivar) - meansV(ivar)) * (principals(jvar) - meansV(jvar)) / (nTracks-1) - covariancesV(ivar, jvar)/nTracks;
-                }
-            }
-
-            for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariancesPV(ipar, jvar) += (parameters(ipar) - meansP(ipar)) * (principals(jvar) - meansV(jvar)) / (nTracks-1) - covariancesPV(ipar, jvar)/nTracks;
-                }
-            }
-        }
-
-        ++nKept;
-        ++nRead;
-    }
+    // The principal components are not using deltas of variables here!
+    Eigen::VectorXd meansV = mat_.V * means;
+    Eigen::MatrixXd covariancesV = mat_.V * covariances * mat_.V.transpose();
+    Eigen::MatrixXd covariancesPV = covariancesPX * mat_.V.transpose();
 
     setCovarianceToUnit(covariancesV, nvariables_, po_.hitBits);
 
@@ -761,6 +617,20 @@ int MatrixBuilder::loopEventsAndSolveD(TTStubReader& reader) {
         std::cout << Info() << "covariancesPV * covariancesV^{-1} * eigenvectors^T: " << std::endl;
         std::cout << mat_.DV << std::endl << std::endl;
     }
+
+    // Set PCAMatrix
+    mat_.meansX = means;  // after DeltaR correction
+    mat_.meansV = meansV;
+    mat_.meansP = mat_.DV * means - meansP;  // mean of the fitted minus the sim track parameters
+
+    if (verbose_>1) {
+        std::cout << Info() << "meansX: " << std::endl;
+        std::cout << mat_.meansX << std::endl << std::endl;
+        std::cout << Info() << "meansV: " << std::endl;
+        std::cout << mat_.meansV << std::endl << std::endl;
+        std::cout << Info() << "meansP: " << std::endl;
+        std::cout << mat_.meansP << std::endl << std::endl;
+    }
     return 0;
 }
 
@@ -768,11 +638,6 @@ int MatrixBuilder::loopEventsAndSolveD(TTStubReader& reader) {
 // Loop over all events and evaluate biases and resolutions
 int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
 
-    // Get mean values
-    Eigen::VectorXd meansX = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::VectorXd meansV = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::VectorXd meansP = Eigen::VectorXd::Zero(nparameters_);
-
     // Statistics
     std::vector<Statistics> statCT(2);
     std::vector<Statistics> statX(nvariables_);
@@ -780,17 +645,18 @@ int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
     std::vector<Statistics> statP(nparameters_);
     std::vector<Statistics> statP100GeV(nparameters_);
 
+    MatrixTrack trk;
+
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
-        const unsigned nstubs = reader.vb_modId->size();
         if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
 
-        if (!keepEvents_.at(ievt)) {
+        if (!getTrack(reader, trk) || isOutlier(trk)) {
             ++nRead;
             continue;
         }
@@ -798,43 +664,11 @@ int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
         // _____________________________________________________________________
         // Start collecting statistics
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+        Eigen::VectorXd variables = getCorrectedVariables(trk);
+        Eigen::VectorXd variables1 = variables.head(nvariables_/2);
+        Eigen::VectorXd variables2 = variables.tail(nvariables_/2);
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
-
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
-
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
-
-        Eigen::VectorXd parameters = Eigen::VectorXd::Zero(nparameters_);
-
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        double simPhi          = reader.vp_phi->front();
-        double simVz           = reader.vp_vz->front();
-        {
-            unsigned ipar = 0;
-            parameters(ipar++) = simPhi;
-            parameters(ipar++) = simCotTheta;
-            parameters(ipar++) = simVz;
-            parameters(ipar++) = simChargeOverPt;
-        }
+        Eigen::VectorXd parameters = getParameters(trk);
 
         // Transform coordinates to principal components
         Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
@@ -844,23 +678,9 @@ int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
         Eigen::VectorXd parameters_fit = Eigen::VectorXd::Zero(nparameters_);
         parameters_fit = mat_.DV * variables;  // not using deltas of variables here!
 
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansX(ivar) += (variables(ivar) - meansX(ivar))/nTracks;
-        }
-
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansV(ivar) += (principals(ivar) - meansV(ivar))/nTracks;
-        }
-
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            meansP(ipar) += (parameters_fit(ipar) - parameters(ipar) - meansP(ipar))/nTracks;
-        }
-
         // Collect statistics and fill histograms
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
+        const double simC = -0.5 * (0.003 * 3.8 * trk.simChargeOverPt);  // 1/(2 x radius of curvature)
+        const double simT = trk.simCotTheta;
         statCT.at(0).fill(((mat_.solutionsC * variables1)(0,0)) - simC);
         statCT.at(1).fill(((mat_.solutionsT * variables2)(0,0)) - simT);
 
@@ -878,14 +698,14 @@ int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
 
                 hname = Form("npc%i", ivar);
                 //assert(mat_.sqrtEigenvalues(ivar) > 0.);
-                histograms_[hname]->Fill((principals(ivar)- meansV(ivar)) / mat_.sqrtEigenvalues(ivar));
+                histograms_[hname]->Fill((principals(ivar)- mat_.meansV(ivar)) / mat_.sqrtEigenvalues(ivar));
             }
         }
 
         for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
             statP.at(ipar).fill(parameters_fit(ipar) - parameters(ipar));
 
-            if (std::abs(simChargeOverPt) < 1.0/100.) {
+            if (std::abs(trk.simChargeOverPt) < 1.0/100.) {
                 statP100GeV.at(ipar).fill(parameters_fit(ipar) - parameters(ipar));
             }
 
@@ -930,20 +750,54 @@ int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
         }
         std::cout.flags(flags);
     }
+    return 0;
+}
 
-    // Set PCAMatrix
-    mat_.meansX = meansX;  // after DeltaR correction
-    mat_.meansV = meansV;
-    mat_.meansP = meansP;
+// _____________________________________________________________________________
+// Read the statistics of the passes
+int MatrixBuilder::readStatistics(TString src, std::vector<Moments>& stats) {
+    std::ifstream infile(src.Data());
+    if (!infile) {
+        std::cout << Error() << "Failed to open " << src << std::endl;
+        return 1;
+    }
 
-    if (verbose_>1) {
-        std::cout << Info() << "meansX: " << std::endl;
-        std::cout << mat_.meansX << std::endl << std::endl;
-        std::cout << Info() << "meansV: " << std::endl;
-        std::cout << mat_.meansV << std::endl << std::endl;
-        std::cout << Info() << "meansP: " << std::endl;
-        std::cout << mat_.meansP << std::endl << std::endl;
+    unsigned nvariables = 0, nparameters = 0, hitBits = 0, npasses = 0;
+    infile >> nvariables >> nparameters >> hitBits >> npasses;
+    if (!infile || nvariables != nvariables_ || nparameters != nparameters_ || hitBits != po_.hitBits || npasses == 0 || npasses > NPASSES) {
+        std::cout << Error() << "Statistics in " << src << " were not made with the same view, algo and hit bits." << std::endl;
+        return 1;
+    }
+
+    stats.assign(npasses, Moments());
+    for (unsigned ipass=0; ipass<npasses; ++ipass) {
+        if (stats.at(ipass).read(infile)) {
+            std::cout << Error() << "Failed to read " << src << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Write the statistics of the passes
+int MatrixBuilder::writeStatistics(TString out) {
+    std::ofstream outfile(out.Data());
+    if (!outfile) {
+        std::cout << Error() << "Failed to open " << out << std::endl;
+        return 1;
     }
+
+    outfile << nvariables_ << " " << nparameters_ << " " << po_.hitBits << " " << stats_.size() << std::endl;
+    for (unsigned ipass=0; ipass<stats_.size(); ++ipass) {
+        outfile << std::endl;
+        stats_.at(ipass).write(outfile);
+    }
+
+    if (!outfile) {
+        std::cout << Error() << "Failed to write " << out << std::endl;
+        return 1;
+    }
+    if (verbose_)  std::cout << Info() << "Wrote the statistics of " << stats_.size() << " passes to " << out << std::endl;
     return 0;
 }
 
@@ -980,21 +834,38 @@ int MatrixBuilder::run() {
     int exitcode = 0;
     Timing(1);
 
-    exitcode = bookHistograms();
-    if (exitcode)  return exitcode;
-    Timing();
+    if (po_.merge) {
+        exitcode = mergeStatistics(po_.input);
+        if (exitcode)  return exitcode;
+        Timing();
 
-    exitcode = buildMatrices(po_.input);
-    if (exitcode)  return exitcode;
-    Timing();
+    } else {
+        exitcode = bookHistograms();
+        if (exitcode)  return exitcode;
+        Timing();
+
+        exitcode = buildMatrices(po_.input);
+        if (exitcode)  return exitcode;
+        Timing();
+    }
+
+    // Until all the passes are done, write the statistics to be merged
+    if (stats_.size() < NPASSES) {
+        exitcode = writeStatistics(po_.output);
+        if (exitcode)  return exitcode;
+        Timing();
+        return exitcode;
+    }
 
     exitcode = writeMatrices(po_.output);
     if (exitcode)  return exitcode;
     Timing();
 
-    exitcode = writeHistograms(po_.output);
-    if (exitcode)  return exitcode;
-    Timing();
+    if (!po_.merge) {
+        exitcode = writeHistograms(po_.output);
+        if (exitcode)  return exitcode;
+        Timing();
+    }
 
     return exitcode;
 }
@@ -14,14 +14,18 @@ int MatrixTester::testMatrices(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
-    if (reader.init(src, false)) {
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
     }
 
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
     // _________________________________________________________________________
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
+    // Get module index
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
 
     // _________________________________________________________________________
     // Loop over all events (filter)
@@ -34,7 +38,7 @@ int MatrixTester::testMatrices(TString src) {
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
@@ -56,7 +60,7 @@ int MatrixTester::testMatrices(TString src) {
         unsigned ngoodstubs = 0;
         for (unsigned istub=0; istub<nstubs; ++istub) {
             unsigned moduleId = reader.vb_modId   ->at(istub);
-            if (ttrmap.find(moduleId) != ttrmap.end()) {
+            if (moduleIndex.isInTower(moduleIndex.index(moduleId), po_.tower)) {
                 ++ngoodstubs;
             }
         }
@@ -96,14 +100,14 @@ int MatrixTester::testMatrices(TString src) {
     // Bookkeepers
     nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
         const unsigned nstubs = reader.vb_modId->size();
         if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
 
-        if (!keepEvents.at(ievt)) {
+        if (!keepEvents.at(ievt - firstEvent_)) {
             ++nRead;
             continue;
         }
@@ -0,0 +1,68 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleIndex.h"
+using namespace slhcl1tt;
+
+#include <cassert>
+#include <stdexcept>
+
+
+// _____________________________________________________________________________
+ModuleIndex::ModuleIndex() {
+    clear();
+}
+
+// _____________________________________________________________________________
+void ModuleIndex::clear() {
+    slotIndices_.assign(NSLOTS, INVALID);
+    moduleIds_.clear();
+    layers_.clear();
+    towerMasks_.clear();
+    moduleCodes_.clear();
+}
+
+// _____________________________________________________________________________
+unsigned ModuleIndex::insert(unsigned moduleId) {
+    const unsigned s = slot(moduleId);
+    if (s >= NSLOTS)
+        throw std::invalid_argument("Incorrect module ID.");
+
+    if (slotIndices_[s] != INVALID)
+        return slotIndices_[s];
+
+    const unsigned i = moduleIds_.size();
+    assert(i < INVALID);  // make sure number of bits is enough
+
+    slotIndices_[s] = i;
+    moduleIds_.push_back(moduleId);
+    layers_.push_back(s / 10000);
+    towerMasks_.push_back(0);
+    for (unsigned tt=0; tt<moduleCodes_.size(); ++tt)
+        moduleCodes_[tt].push_back(INVALID);
+    return i;
+}
+
+// _____________________________________________________________________________
+void ModuleIndex::setTowerModules(unsigned tt, const std::vector<unsigned>& moduleIds) {
+    if (tt >= NTOWERS)
+        throw std::invalid_argument("Incorrect trigger tower.");
+
+    for (unsigned i=0; i<moduleIds.size(); ++i)
+        insert(moduleIds.at(i));
+
+    if (moduleCodes_.size() <= tt)
+        moduleCodes_.resize(tt+1, std::vector<uint16_t>(size(), INVALID));
+
+    // Forget the previous modules of the trigger tower
+    std::vector<uint16_t>& codes = moduleCodes_[tt];
+    codes.assign(size(), INVALID);
+    for (unsigned j=0; j<size(); ++j)
+        towerMasks_[j] &= ~(uint64_t(1) << tt);
+
+    // Count the modules of each layer, in the order of the module IDs
+    unsigned counts[16] = {0};
+
+    for (unsigned i=0; i<moduleIds.size(); ++i) {
+        const unsigned j = index(moduleIds.at(i));
+        towerMasks_[j] |= (uint64_t(1) << tt);
+        codes[j] = counts[layers_[j]]++;
+    }
+}
@@ -45,5 +45,18 @@ void ModuleOverlapMap::readModuleOverlapMap(TString datadir) {
     }
 
     assert(iLine-1==nModules);
+
+    // Make the flat lookup table
+    overlaps_.clear();
+    overlapSlots_.assign(ModuleIndex::NSLOTS, ModuleIndex::INVALID);
+    for (std::map<unsigned, ModuleOverlap>::const_iterator it = moduleOverlap_map_.begin();
+         it != moduleOverlap_map_.end(); ++it) {
+        const unsigned s = ModuleIndex::slot(it->first);
+        if (s >= ModuleIndex::NSLOTS)
+            continue;
+        assert(overlaps_.size() < ModuleIndex::INVALID);  // make sure number of bits is enough
+        overlapSlots_[s] = overlaps_.size();
+        overlaps_.push_back(it->second);
+    }
     std::cout << Info() << "Read " << nModules << " module overlap regions." << std::endl;
 }
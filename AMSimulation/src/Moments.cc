@@ -0,0 +1,78 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Moments.h"
+using namespace slhcl1tt;
+
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+
+// _____________________________________________________________________________
+Moments::Moments(unsigned dim)
+: n_(0),
+  means_(Eigen::VectorXd::Zero(dim)),
+  m2_(Eigen::MatrixXd::Zero(dim, dim)) {}
+
+void Moments::fill(const Eigen::VectorXd& x) {
+    ++ n_;
+    const Eigen::VectorXd delta = x - means_;
+    means_ += delta / n_;
+    m2_ += delta * (x - means_).transpose();
+}
+
+void Moments::merge(const Moments& other) {
+    if (other.n_ == 0)  return;
+    if (n_ == 0) {
+        *this = other;
+        return;
+    }
+
+    // Combine the sums of the products of the deviations
+    const long int n = n_ + other.n_;
+    const Eigen::VectorXd delta = other.means_ - means_;
+    m2_ += other.m2_ + (delta * delta.transpose()) * (double(n_) * other.n_ / n);
+    means_ += delta * (double(other.n_) / n);
+    n_ = n;
+}
+
+Eigen::MatrixXd Moments::getCovariances() const {
+    if (n_ < 2)
+        return Eigen::MatrixXd::Zero(m2_.rows(), m2_.cols());
+    return m2_ / (n_ - 1);
+}
+
+int Moments::read(std::istream& is) {
+    unsigned dim = 0;
+    is >> n_ >> dim;
+    if (!is)
+        return 1;
+
+    means_ = Eigen::VectorXd::Zero(dim);
+    for (unsigned i=0; i<dim; ++i)
+        is >> means_(i);
+
+    m2_ = Eigen::MatrixXd::Zero(dim, dim);
+    for (unsigned i=0; i<dim; ++i)
+        for (unsigned j=0; j<dim; ++j)
+            is >> m2_(i, j);
+
+    return is ? 0 : 1;
+}
+
+void Moments::write(std::ostream& os) const {
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision(std::numeric_limits<double>::max_digits10);
+
+    const unsigned dim = means_.size();
+    os << n_ << " " << dim << std::endl;
+    for (unsigned i=0; i<dim; ++i)
+        os << means_(i) << (i+1 < dim ? " " : "");
+    os << std::endl;
+    for (unsigned i=0; i<dim; ++i) {
+        for (unsigned j=0; j<dim; ++j)
+            os << m2_(i, j) << (j+1 < dim ? " " : "");
+        os << std::endl;
+    }
+
+    os.precision(precision);
+    os.flags(flags);
+}
@@ -123,22 +123,28 @@ int NTupleMaker::writeTree(TString out) {
         connectors.back()->connect(chain_tracks_);
     }
 
+    // Get the range of the events to be read. The roads and the tracks were
+    // made from the same range, their entries start at 0
+    const long long nentries = (po_.nShards > 1) ? chain_->GetEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
     // _________________________________________________________________________
     // Loop over all events
 
     // Bookkeepers
     long int nRead = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         Long64_t local_entry = chain_->LoadTree(ievt);  // for TChain
         if (local_entry < 0)  break;
         chain_->GetEntry(ievt);
 
-        assert(chain_roads_->LoadTree(ievt) >= 0);
-        chain_roads_->GetEntry(ievt);
+        const long long jevt = ievt - firstEvent_;
+        assert(chain_roads_->LoadTree(jevt) >= 0);
+        chain_roads_->GetEntry(jevt);
 
-        assert(chain_tracks_->LoadTree(ievt) >= 0);
-        chain_tracks_->GetEntry(ievt);
+        assert(chain_tracks_->LoadTree(jevt) >= 0);
+        chain_tracks_->GetEntry(jevt);
 
         if (verbose_>1 && ievt%50000==0)  std::cout << Debug() << Form("... Writing event: %7lld", ievt) << std::endl;
 
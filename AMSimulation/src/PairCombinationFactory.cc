@@ -10,7 +10,7 @@ float PairCombinationFactory::Coarsener(float DeltaS, int precision, int layer){
   return Coarsed;
 }
 
-std::vector<PairAssignment> PairCombinationFactory::Stage1Pair(std::vector<std::pair<unsigned, float> > first, std::vector<std::pair<unsigned, float> > second, float cut)
+std::vector<PairAssignment> PairCombinationFactory::Stage1Pair(const std::vector<std::pair<unsigned, float> >& first, const std::vector<std::pair<unsigned, float> >& second, float cut)
 {  
   //initialize pair assignment struct, loop and filter pairs
   std::vector<PairAssignment> PairedOnes;
@@ -26,70 +26,69 @@ std::vector<PairAssignment> PairCombinationFactory::Stage1Pair(std::vector<std::
   return PairedOnes;
 }
 
-//combination(stubAddresses,pass)
-std::vector<std::vector<unsigned> > PairCombinationFactory::CombinationBuilder(std::vector<PairAssignment> Layer10, std::vector<PairAssignment> Layer12, std::vector<PairAssignment> Layer32, std::vector<PairAssignment> Layer34, std::vector<PairAssignment> Layer54, unsigned l0, unsigned l2, unsigned l4)
+//combination(stubAddresses,pass), continues the loop over the permutations where the previous call stopped
+bool PairCombinationFactory::next(std::vector<unsigned>& combination)
 {
-  //initialize return object
-  std::vector<std::vector<unsigned> >  Combinations;
-  //loop over all permutations
-  for(unsigned i=0; i<Layer10.size(); ++i){
-    for(unsigned j=0; j<Layer32.size(); ++j){
-      for(unsigned k=0; k<Layer54.size(); ++k){
-	if(!(Layer10[i].SurvivingPair * Layer32[j].SurvivingPair * Layer54[k].SurvivingPair)) continue; //3-logic part
+  //loop over the remaining permutations
+  for(; i_<Layer10_.size(); ++i_, j_=0){
+    for(; j_<Layer32_.size(); ++j_, k_=0){
+      while(k_<Layer54_.size()){
+	const unsigned i=i_, j=j_, k=k_++;
+	if(!(Layer10_[i].SurvivingPair * Layer32_[j].SurvivingPair * Layer54_[k].SurvivingPair)) continue; //3-logic part
 	//5-logic stub position lookup
-	int pos12=i/l0*l2+j%l2;
-	int pos34=j/l2*l4+k%l4;
-	if(!(Layer12[pos12].SurvivingPair * Layer34[pos34].SurvivingPair)) continue; //5-logic extension
-	std::vector<unsigned> layers={Layer10[i].Stub2Address, Layer10[i].Stub1Address, Layer32[j].Stub2Address, Layer32[j].Stub1Address, Layer54[k].Stub2Address, Layer54[k].Stub1Address};
+	int pos12=i/l0_*l2_+j%l2_;
+	int pos34=j/l2_*l4_+k%l4_;
+	if(!(Layer12_[pos12].SurvivingPair * Layer34_[pos34].SurvivingPair)) continue; //5-logic extension
 
 	//catch >1 dummy cases, always put dummy in the first position per layer!
+	const unsigned layers[6]={Layer10_[i].Stub2Address, Layer10_[i].Stub1Address, Layer32_[j].Stub2Address, Layer32_[j].Stub1Address, Layer54_[k].Stub2Address, Layer54_[k].Stub1Address};
 	unsigned dummyCounter=0;
-	for(unsigned l=0; l<layers.size(); ++l) if(layers[l]==PairCombinationFactory::BAD) ++dummyCounter;
+	for(unsigned l=0; l<6; ++l) if(layers[l]==PairCombinationFactory::BAD) ++dummyCounter;
 	if(dummyCounter>1) continue;
 
 	//build combination object
-	Combinations.push_back(layers);
+	combination.assign(layers, layers+6);
+	return true;
       }
     }
   }
-  return Combinations;
+  return false;
 }
 
-std::vector<std::vector<unsigned> > PairCombinationFactory::combine(const std::vector<std::vector<unsigned> >& groups, std::vector<std::vector<float> > DeltaS, bool FiveOfSix) {
-        std::vector<std::vector<unsigned> > combinations;
-        std::vector<std::vector<unsigned> > CombinationBase=groups;
-
+void PairCombinationFactory::begin(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix) {
         unsigned ngroups = groups.size(); //number of layers
-	std::vector<std::vector<std::pair<unsigned, float> > > Layer; //0 is innermost, 5 is outermost
 
-	//check for empty layers, add 1 dummy to nonempty layers
-	for(unsigned i=0; i<ngroups; ++i){
-	  if(!CombinationBase[i].size()){
-	    CombinationBase[i].push_back(PairCombinationFactory::BAD);
-	    DeltaS[i].push_back(999.);
-	  }
-	  else if(FiveOfSix){
-	    CombinationBase[i].insert(CombinationBase[i].begin(),PairCombinationFactory::BAD); //only insert dummies in full layers, if 5/6 permutations are desired
-	    DeltaS[i].insert(DeltaS[i].begin(),999.);
-	  }
-	}
+	//no combination until the layer pairs are built
+	Layer10_.clear();
+	i_=0, j_=0, k_=0;
 
-	if(ngroups!=6) return combinations; //catch less than 6 layers present
-	for(unsigned layer=0; layer<6; ++layer){ //compose all the layer information
-	  std::vector<std::pair<unsigned, float> > OneLayer;
-	  Layer.push_back(OneLayer);
-	  for(unsigned j=0; j<CombinationBase[layer].size(); ++j) Layer[layer].push_back(std::make_pair(CombinationBase[layer][j], Coarsener(DeltaS[layer][j],4,layer))); //pushes back stub iterator and coarsened DeltaS value
+	if(ngroups!=6) return; //catch less than 6 layers present
+	for(unsigned layer=0; layer<6; ++layer){ //compose all the layer information, 0 is innermost, 5 is outermost
+	  std::vector<std::pair<unsigned, float> >& OneLayer = Layer_[layer];
+	  OneLayer.clear();
+	  //check for empty layers, add 1 dummy to nonempty layers
+	  if(!groups[layer].size() || FiveOfSix) OneLayer.push_back(std::make_pair(unsigned(PairCombinationFactory::BAD), Coarsener(999.,4,layer))); //only insert dummies in full layers, if 5/6 permutations are desired
+	  for(unsigned j=0; j<groups[layer].size(); ++j) OneLayer.push_back(std::make_pair(groups[layer][j], Coarsener(DeltaS[layer][j],4,layer))); //pushes back stub iterator and coarsened DeltaS value
 	}
-	
+
 	//build layer pairs & pass cut values
-	std::vector<PairAssignment> Layer01=Stage1Pair(Layer[1],Layer[0],1.5);
-	std::vector<PairAssignment> Layer12=Stage1Pair(Layer[1],Layer[2],2.5);
-	std::vector<PairAssignment> Layer23=Stage1Pair(Layer[3],Layer[2],3.0);
-	std::vector<PairAssignment> Layer34=Stage1Pair(Layer[3],Layer[4],2.0);
-	std::vector<PairAssignment> Layer45=Stage1Pair(Layer[5],Layer[4],2.0);
+	Layer10_=Stage1Pair(Layer_[1],Layer_[0],1.5);
+	Layer12_=Stage1Pair(Layer_[1],Layer_[2],2.5);
+	Layer32_=Stage1Pair(Layer_[3],Layer_[2],3.0);
+	Layer34_=Stage1Pair(Layer_[3],Layer_[4],2.0);
+	Layer54_=Stage1Pair(Layer_[5],Layer_[4],2.0);
+	l0_=Layer_[0].size();
+	l2_=Layer_[2].size();
+	l4_=Layer_[4].size();
+}
+
+std::vector<std::vector<unsigned> > PairCombinationFactory::combine(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix) {
+        std::vector<std::vector<unsigned> > combinations;
+        std::vector<unsigned> combination;
 
 	//build the actual combinations
-	combinations = CombinationBuilder(Layer01,Layer12,Layer23,Layer34,Layer45,CombinationBase[0].size(),CombinationBase[2].size(),CombinationBase[4].size());
+	begin(groups, DeltaS, FiveOfSix);
+	while(next(combination)) combinations.push_back(combination);
 	//for(unsigned c=0; c<combinations.size(); ++c) std::cout<<combinations[c][0]<<","<<combinations[c][1]<<","<<combinations[c][2]<<","<<combinations[c][3]<<","<<combinations[c][4]<<","<<combinations[c][5]<<std::endl;  //combination verbose
         return combinations;
 }
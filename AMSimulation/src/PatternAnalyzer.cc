@@ -70,14 +70,18 @@ int PatternAnalyzer::makePatterns(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
-    if (reader.init(src, false)) {
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
     }
 
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
     // _________________________________________________________________________
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
+    // Get module index
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
 
     // _________________________________________________________________________
     // Book histograms
@@ -99,7 +103,7 @@ int PatternAnalyzer::makePatterns(TString src) {
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
@@ -119,7 +123,7 @@ int PatternAnalyzer::makePatterns(TString src) {
         unsigned ngoodstubs = 0;
         for (unsigned istub=0; istub<nstubs; ++istub) {
             unsigned moduleId = reader.vb_modId   ->at(istub);
-            if (ttrmap.find(moduleId) != ttrmap.end()) {
+            if (moduleIndex.isInTower(moduleIndex.index(moduleId), po_.tower)) {
                 ++ngoodstubs;
             }
         }
@@ -157,14 +161,14 @@ int PatternAnalyzer::makePatterns(TString src) {
     // Bookkeepers
     nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
         const unsigned nstubs = reader.vb_modId->size();
         if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
 
-        if (!keepEvents.at(ievt)) {
+        if (!keepEvents.at(ievt - firstEvent_)) {
             ++nRead;
             continue;
         }
@@ -186,32 +190,15 @@ int PatternAnalyzer::makePatterns(TString src) {
         // Start generating patterns
         patt.fill(0);
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            float    strip    = reader.vb_coordx  ->at(istub);  // in full-strip unit
-            float    segment  = reader.vb_coordy  ->at(istub);  // in full-strip unit
-
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-            float    stub_ds  = reader.vb_trigBend->at(istub);  // in full-strip unit
+        // Find superstrip IDs of all the reconstructed stubs
+        arbiter_ -> superstrips(nstubs, reader.vb_modId->data(), reader.vb_coordx->data(), reader.vb_coordy->data(),
+                                reader.vb_r->data(), reader.vb_phi->data(), reader.vb_z->data(), reader.vb_trigBend->data(), patt.data());
 
-            // Find superstrip ID
-            unsigned ssId = 0;
-            if (!arbiter_ -> useGlobalCoord()) {  // local coordinates
-                ssId = arbiter_ -> superstripLocal(moduleId, strip, segment);
-
-            } else {                              // global coordinates
-                ssId = arbiter_ -> superstripGlobal(moduleId, stub_r, stub_phi, stub_z, stub_ds);
-            }
-            patt.at(istub) = ssId;
-
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << strip << " segment: " << segment << " r: " << stub_r << " phi: " << stub_phi << " z: " << stub_z << " ds: " << stub_ds << std::endl;
-                std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << std::endl;
+        if (verbose_>2) {
+            for (unsigned istub=0; istub<nstubs; ++istub) {
+                std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << reader.vb_modId->at(istub) << " strip: " << reader.vb_coordx->at(istub) << " segment: " << reader.vb_coordy->at(istub) << " r: " << reader.vb_r->at(istub) << " phi: " << reader.vb_phi->at(istub) << " z: " << reader.vb_z->at(istub) << " ds: " << reader.vb_trigBend->at(istub) << std::endl;
+                std::cout << Debug() << "... ... stub: " << istub << " ssId: " << patt.at(istub) << std::endl;
             }
-
         }
 
         // Find pattern in the bank, update the attributes
@@ -229,7 +216,7 @@ int PatternAnalyzer::makePatterns(TString src) {
         } else {
             //std::cout << Warning() << "Failed to find: " << patt << std::endl;
 
-            keepEvents.at(ievt) = false;
+            keepEvents.at(ievt - firstEvent_) = false;
         }
 
         if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " patt: " << patt << std::endl;
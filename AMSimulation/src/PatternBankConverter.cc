@@ -0,0 +1,107 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternBankConverter.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankReader.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankBinary.h"
+
+#include <cstring>
+
+
+// _____________________________________________________________________________
+int PatternBankConverter::convertBank(TString src, TString out) {
+    if (verbose_)  std::cout << Info() << "Converting pattern bank " << src << " into " << out << std::endl;
+
+    // _________________________________________________________________________
+    // For reading pattern bank
+    PatternBankReader pbreader(verbose_);
+    if (pbreader.init(src)) {
+        std::cout << Error() << "Failed to initialize PatternBankReader." << std::endl;
+        return 1;
+    }
+
+    float       coverage   = 0.;
+    unsigned    count      = 0;
+    unsigned    tower      = 0;
+    std::string superstrip = "";
+    unsigned    nDCBits    = 0;
+    pbreader.getPatternBankInfo(coverage, count, tower, superstrip);
+    pbreader.getPatternBankDCBits(nDCBits);
+
+    // The superstrips are hashed with the definition the bank was generated with
+    arbiter_->setDefinition(superstrip, tower, ttmap_);
+    const unsigned nss       = arbiter_->nsuperstripsPerLayer();
+    const unsigned nssCoarse = dcNsuperstrips(nss, nDCBits);
+
+    const long long npatterns = pbreader.getPatterns();
+
+    if (verbose_)  std::cout << Info() << "Trigger tower: " << tower << " superstrip: " << superstrip << " nDCBits: " << nDCBits << " npatterns: " << npatterns << std::endl;
+
+    // _________________________________________________________________________
+    // For writing binary pattern bank
+    PatternBankBinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.npatterns            = npatterns;
+    header.nLayers              = po_.nLayers;
+    header.nDCBits              = nDCBits;
+    header.nsuperstripsPerLayer = nssCoarse;
+    header.tower                = tower;
+    header.coverage             = coverage;
+    header.count                = count;
+    std::strncpy(header.superstrip, superstrip.c_str(), sizeof(header.superstrip) - 1);
+
+    PatternBankBinaryWriter pbwriter(verbose_);
+    if (pbwriter.init(out, header)) {
+        std::cout << Error() << "Failed to initialize PatternBankBinaryWriter." << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // Convert the patterns
+
+    pattern_type pattHash;
+    pattern_bit_type pattBits;
+    float pattInvPt = 0.;
+
+    for (long long ipatt=0; ipatt<npatterns; ++ipatt) {
+        pbreader.getPattern(ipatt);
+        pbreader.getPatternInvPt(ipatt, pattInvPt);
+
+        if (pbreader.pb_superstripIds->size() != po_.nLayers) {
+            std::cout << Error() << "Pattern " << ipatt << " has " << pbreader.pb_superstripIds->size() << " layers, expected " << po_.nLayers << "." << std::endl;
+            return 1;
+        }
+
+        pattHash.fill(0);
+        for (unsigned layer=0; layer<po_.nLayers; ++layer) {
+            pattHash.at(layer) = simpleHash(layer, nssCoarse, pbreader.pb_superstripIds->at(layer));
+        }
+
+        pattBits.fill(0);
+        if (nDCBits > 0) {
+            assert(pbreader.pb_superstripBits->size() == po_.nLayers);
+            std::copy(pbreader.pb_superstripBits->begin(), pbreader.pb_superstripBits->end(), pattBits.begin());
+        }
+
+        pbwriter.fillPattern(ipatt, pattHash, pattBits, pbreader.pb_frequency, pattInvPt);
+    }
+
+    long long nentries = pbwriter.writeFile();
+    assert(nentries == npatterns);
+
+    if (verbose_)  std::cout << Info() << "Successfully converted " << nentries << " patterns." << std::endl;
+
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+// Main driver
+int PatternBankConverter::run() {
+    int exitcode = 0;
+    Timing(1);
+
+    exitcode = convertBank(po_.input, po_.output);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    return exitcode;
+}
@@ -1,14 +1,125 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternGenerator.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/WorkerPool.h"
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubReader.h"
 
+#include <cstdio>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 static const unsigned MAX_FREQUENCY = 0xffffffff;  // unsigned
 
 namespace {
-// Comparator
-bool sortByFrequency(const std::pair<pattern_type, unsigned>& lhs, const std::pair<pattern_type, unsigned>& rhs) {
-    return lhs.second > rhs.second;
+// Number of tracks read at a time for each worker thread
+const unsigned TRACKS_PER_THREAD = 1000;
+
+// A track that is put aside while waiting for the pattern generation
+struct GeneratorTrack {
+    std::vector<unsigned> moduleIds;
+    std::vector<float>    strips, segments, rs, phis, zs, dss;
+    float                 simChargeOverPt, simCotTheta, simPhi, simVz;
+    pattern_type          patt;
+    pattern_bit_type      pattLowBits;
+};
+
+// A batch of tracks. When their superstrips are found, the tracks of each
+// range of the batch are queued to the shard that owns their pattern
+struct GeneratorBatch {
+    std::vector<GeneratorTrack>                       tracks;
+    unsigned                                          n;
+    std::vector<std::vector<std::vector<unsigned> > > shardQueues;  // [range][shard] -> track
+
+    GeneratorBatch(unsigned batchSize, unsigned nRanges, unsigned nShards)
+    : tracks(batchSize), n(0),
+      shardQueues(nRanges, std::vector<std::vector<unsigned> >(nShards)) {}
+};
+
+// Find the superstrips of the tracks in [begin, end). The loop is instantiated
+// once per superstrip policy, through SuperstripArbiter::visit().
+// With DC bits, the pattern is made of coarse superstrips, and the low bits of
+// the full-resolution superstrips are kept aside
+struct PatternMaker {
+    std::vector<GeneratorTrack>& tracks;
+    std::vector<std::vector<unsigned> >& shardQueues;
+    unsigned begin, end;
+    unsigned nDCBits, nShards;
+    int      verbose;
+
+    template<typename Policy>
+    void operator()(const Policy& policy) const {
+        pattern_type ssIds;
+
+        for (unsigned ishard=0; ishard<nShards; ++ishard)
+            shardQueues.at(ishard).clear();
+
+        for (unsigned i=begin; i<end; ++i) {
+            GeneratorTrack& trk = tracks[i];
+            trk.patt.fill(0);
+            trk.pattLowBits.fill(0);
+
+            // Find superstrip IDs of all the reconstructed stubs
+            const unsigned nstubs = trk.moduleIds.size();
+            ssIds.fill(0);
+            policy.superstrips(nstubs, trk.moduleIds.data(), trk.strips.data(), trk.segments.data(),
+                               trk.rs.data(), trk.phis.data(), trk.zs.data(), trk.dss.data(), ssIds.data());
+
+            for (unsigned istub=0; istub<nstubs; ++istub) {
+                unsigned ssId = ssIds[istub];
+                trk.patt[istub] = ssId >> nDCBits;
+                trk.pattLowBits[istub] = ssId & ((1u << nDCBits) - 1);
+
+                if (verbose>2) {
+                    std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << trk.moduleIds.at(istub) << " strip: " << trk.strips.at(istub) << " segment: " << trk.segments.at(istub) << " r: " << trk.rs.at(istub) << " phi: " << trk.phis.at(istub) << " z: " << trk.zs.at(istub) << " ds: " << trk.dss.at(istub) << std::endl;
+                    std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << " low bits: " << trk.pattLowBits.at(istub) << std::endl;
+                }
+            }
+            const unsigned shard = PatternTable::shard(trk.patt, nShards);
+            shardQueues[shard].push_back(i);
+        }
+    }
+};
+
+// Write the patterns of a shard into a temporary file, sorted by pattern
+int writeRun(const PatternTable& shard, TString runFile) {
+    FILE * f = std::fopen(runFile.Data(), "wb");
+    if (!f)  return 1;
+
+    std::vector<const PatternRecord *> records;
+    records.reserve(shard.size());
+    for (size_t i=0; i<shard.size(); ++i)
+        records.push_back(&shard.at(i));
+
+    std::sort(records.begin(), records.end(), [](const PatternRecord * lhs, const PatternRecord * rhs) {
+        return lhs->patt < rhs->patt;
+    });
+
+    for (size_t i=0; i<records.size(); ++i)
+        std::fwrite(records.at(i), sizeof(PatternRecord), 1, f);
+
+    const bool failed = std::ferror(f);
+    if (std::fclose(f) != 0 || failed)
+        return 1;
+    return 0;
+}
+
+// A temporary file being merged, with its current record
+struct RunCursor {
+    FILE *        file;
+    PatternRecord rec;
+
+    bool next() { return std::fread(&rec, sizeof(rec), 1, file) == 1; }
+};
+
+// Comparator, ties are broken by the pattern so that the order does not depend
+// on the sharding (same order as a stable sort of a single std::map)
+bool sortByFrequency(const PatternRecord * lhs, const PatternRecord * rhs) {
+    if (lhs->freq != rhs->freq)
+        return lhs->freq > rhs->freq;
+    return lhs->patt < rhs->patt;
 }
 }
 
@@ -21,186 +132,473 @@ int PatternGenerator::makePatterns(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
-    if (reader.init(src, false)) {
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
     }
 
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
     // _________________________________________________________________________
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
+    // Get module index
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
 
 
     // _________________________________________________________________________
     // Loop over all events
 
-    patternBank_map_.clear();
-    pattern_type patt;
-    patt.fill(0);
+    // The main thread reads a batch of tracks, while the worker threads make
+    // the patterns of the previous batch: they find the superstrips, which
+    // queues each track to the shard of its pattern, then fill the bank, each
+    // thread owning one shard of it.
+    const unsigned nThreads  = po_.nThreads;
+    const unsigned nShards   = nThreads;
+    const unsigned batchSize = nThreads * TRACKS_PER_THREAD;
+
+    GeneratorBatch batches[2] = {GeneratorBatch(batchSize, nThreads, nShards), GeneratorBatch(batchSize, nThreads, nShards)};
+    std::vector<PatternTable>& shards = patternTables_;
+    shards.assign(nShards, PatternTable());
+
+    // If the patterns take more memory than allowed, they are written out to
+    // temporary files, sorted by pattern, and merged at the end
+    const double   maxBytes     = double(po_.maxMemory) * 1024 * 1024;
+    std::vector<TString> runFiles;
+    long int nSpilled = 0;
+
+    auto spillShards = [&]() -> int {
+        for (unsigned ishard=0; ishard<nShards; ++ishard) {
+            PatternTable& shard = shards.at(ishard);
+            if (shard.empty())
+                continue;
+
+            TString runFile = Form("%s.run%04lu.tmp", po_.output.c_str(), runFiles.size());
+            if (writeRun(shard, runFile)) {
+                std::cout << Error() << "Failed to write " << runFile << std::endl;
+                return 1;
+            }
+            runFiles.push_back(runFile);
+            nSpilled += shard.size();
+            shard.clear();
+        }
+        if (verbose_>1)  std::cout << Debug() << "... Wrote patterns to temporary files, # files: " << runFiles.size() << std::endl;
+        return 0;
+    };
+
+    const unsigned nDCBits = po_.nDCBits;
+
+    std::vector<long int> nInserted(nShards, 0);  // new patterns in each shard
+
+    // Find the superstrips of the tracks of the batch, in one range per thread
+    auto findSuperstrips = [&](GeneratorBatch& batch, unsigned irange) {
+        PatternMaker maker = {batch.tracks, batch.shardQueues.at(irange), batch.n * irange / nThreads, batch.n * (irange + 1) / nThreads, nDCBits, nShards, verbose_};
+        arbiter_ -> visit(maker);
+    };
+
+    // Insert the patterns queued to a shard, in the order they were read
+    auto fillShard = [&](GeneratorBatch& batch, unsigned ishard) {
+        PatternTable& shard = shards.at(ishard);
+
+        for (unsigned irange=0; irange<nThreads; ++irange) {
+            const std::vector<unsigned>& queue = batch.shardQueues.at(irange).at(ishard);
+
+            for (unsigned j=0; j<queue.size(); ++j) {
+                const GeneratorTrack& trk = batch.tracks[queue[j]];
+                const pattern_type& patt = trk.patt;
+
+                // Insert pattern into the bank
+                bool inserted = false;
+                PatternRecord& rec = shard.insert(patt, inserted);
+                ++rec.freq;
+                if (inserted)
+                    ++nInserted.at(ishard);
+
+                // Update the DC bits to accept this track
+                if (nDCBits > 0) {
+                    for (unsigned istub=0; istub<trk.moduleIds.size(); ++istub) {
+                        if (inserted)
+                            rec.bits.at(istub) = makeDCBits(trk.pattLowBits.at(istub));
+                        else
+                            rec.bits.at(istub) = mergeDCBits(rec.bits.at(istub), trk.pattLowBits.at(istub));
+                    }
+                }
+
+                // Update the attributes
+                if (po_.speedup<1) {
+                    ++ rec.n;
+                    rec.invPt.fill(trk.simChargeOverPt);
+                    rec.cotTheta.fill(trk.simCotTheta);
+                    rec.phi.fill(trk.simPhi);
+                    rec.z0.fill(trk.simVz);
+                }
+                else if (po_.speedup==1) {
+                    rec.invPt.fill(trk.simChargeOverPt);
+                    rec.phi.fill(trk.simPhi);
+                }
+
+                if (verbose_>2)  std::cout << Debug() << "... patt: " << patt << std::endl;
+            }
+        }
+    };
 
     // Bookkeepers
     float coverage = 0.;
     long int bankSize = 0, bankSizeOld = -100000, nKeptOld = -100000;
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        // Running estimate of coverage
-        if (verbose_>1 && ievt%100000==0) {
-            bankSize = patternBank_map_.size();
-            coverage = 1.0 - float(bankSize - bankSizeOld) / float(nKept - nKeptOld);
+    // With a target coverage, the coverage is measured on consecutive windows
+    // of kept tracks as the fraction of tracks that did not make a new pattern.
+    // Patterns that were written out to temporary files are made again, so the
+    // coverage is underestimated if patterns were written out.
+    const bool useTarget = (po_.targetCoverage > 0.);
+    float windowCoverage = -1.;
+    long int nKeptWindow = 0, nNewWindow = 0;
+    int nStableWindows = 0;
+
+    WorkerPool pool(nThreads);
+
+    // Wait for the batch being processed, then count the new patterns, and
+    // write the patterns out if they take too much memory
+    bool pending = false;
+
+    auto finishBatch = [&]() -> int {
+        if (!pending)
+            return 0;
+        pool.wait();
+        pending = false;
+
+        for (unsigned ishard=0; ishard<nShards; ++ishard) {
+            nNewWindow += nInserted.at(ishard);
+            nInserted.at(ishard) = 0;
+        }
 
-            std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld, # patterns: %7ld, coverage: %7.5f", ievt, nKept, bankSize, coverage) << std::endl;
+        size_t bytesInMemory = 0;
+        for (unsigned ishard=0; ishard<nShards; ++ishard)
+            bytesInMemory += shards.at(ishard).memoryUsage();
 
-            bankSizeOld = bankSize;
-            nKeptOld = nKept;
+        if (double(bytesInMemory) > maxBytes) {
+            if (spillShards())
+                return 1;
         }
+        return 0;
+    };
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
+    long long ievt = firstEvent_;
+    bool endOfInput = false;
+    unsigned ibatch = 0;
 
-        // Get sim info
-        float simPt           = reader.vp_pt->front();
-        float simEta          = reader.vp_eta->front();
-        float simPhi          = reader.vp_phi->front();
-        //float simVx           = reader.vp_vx->front();
-        //float simVy           = reader.vp_vy->front();
-        float simVz           = reader.vp_vz->front();
-        int   simCharge       = reader.vp_charge->front();
+    while (!endOfInput && ievt < firstEvent_+nEvents_) {
+        // _____________________________________________________________________
+        // Read a batch of tracks
+        GeneratorBatch& batch = batches[ibatch];
+        ibatch = 1 - ibatch;
+        batch.n = 0;
+
+        for (; batch.n<batchSize && ievt<firstEvent_+nEvents_; ++ievt) {
+            // End of a coverage window, process the batch first
+            if (useTarget && nKept - nKeptWindow >= po_.coverageWindow)
+                break;
+
+            // Running estimate of coverage, on the events before this one
+            if (verbose_>1 && ievt%100000==0) {
+                if (batch.n > 0)  // process the batch first
+                    break;
+                if (finishBatch())
+                    return 1;
+
+                // Patterns in more than one temporary file are counted more than
+                // once, so the estimate is a lower bound if patterns were written out
+                bankSize = nSpilled;
+                for (unsigned ishard=0; ishard<nShards; ++ishard)
+                    bankSize += shards.at(ishard).size();
+                coverage = 1.0 - float(bankSize - bankSizeOld) / float(nKept - nKeptOld);
+
+                std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld, # patterns: %7ld, coverage: %7.5f", ievt, nKept, bankSize, coverage) << std::endl;
+
+                bankSizeOld = bankSize;
+                nKeptOld = nKept;
+            }
 
-        float simCotTheta     = std::sinh(simEta);
-        float simChargeOverPt = float(simCharge)/simPt;
+            if (reader.loadTree(ievt) < 0) {
+                endOfInput = true;
+                break;
+            }
+            reader.getEntry(ievt);
+
+            const unsigned nstubs = reader.vb_modId->size();
+            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
+
+            // Get sim info
+            float simPt           = reader.vp_pt->front();
+            float simEta          = reader.vp_eta->front();
+            float simPhi          = reader.vp_phi->front();
+            //float simVx           = reader.vp_vx->front();
+            //float simVy           = reader.vp_vy->front();
+            float simVz           = reader.vp_vz->front();
+            int   simCharge       = reader.vp_charge->front();
+
+            float simCotTheta     = std::sinh(simEta);
+            float simChargeOverPt = float(simCharge)/simPt;
+
+            // Apply track pt requirement
+            if (simPt < po_.minPt || po_.maxPt < simPt) {
+                ++nRead;
+                continue;
+            }
 
-        // Apply track pt requirement
-        if (simPt < po_.minPt || po_.maxPt < simPt) {
+            // Apply trigger tower acceptance
+            unsigned ngoodstubs = 0;
+            for (unsigned istub=0; istub<nstubs; ++istub) {
+                unsigned moduleId = reader.vb_modId   ->at(istub);
+                if (moduleIndex.isInTower(moduleIndex.index(moduleId), po_.tower)) {
+                    ++ngoodstubs;
+                }
+            }
+            if (ngoodstubs != po_.nLayers) {
+                ++nRead;
+                continue;
+            }
+            assert(nstubs == po_.nLayers);
+
+            // Put the track aside. The stubs are swapped out of the reader
+            // rather than copied, the reader overwrites them at the next entry
+            GeneratorTrack& trk = batch.tracks.at(batch.n++);
+            trk.moduleIds.swap(*reader.vb_modId);
+            trk.strips   .swap(*reader.vb_coordx);
+            trk.segments .swap(*reader.vb_coordy);
+            trk.rs       .swap(*reader.vb_r);
+            trk.phis     .swap(*reader.vb_phi);
+            trk.zs       .swap(*reader.vb_z);
+            trk.dss      .swap(*reader.vb_trigBend);
+            trk.simChargeOverPt = simChargeOverPt;
+            trk.simCotTheta     = simCotTheta;
+            trk.simPhi          = simPhi;
+            trk.simVz           = simVz;
+
+            ++nKept;
             ++nRead;
-            continue;
         }
 
-        // Apply trigger tower acceptance
-        unsigned ngoodstubs = 0;
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            if (ttrmap.find(moduleId) != ttrmap.end()) {
-                ++ngoodstubs;
+        // _____________________________________________________________________
+        // Start generating the patterns of the batch, once the previous batch is done
+        if (finishBatch())
+            return 1;
+
+        std::vector<WorkerPool::Step> steps;
+        steps.push_back(WorkerPool::Step(nThreads, [&](unsigned irange) { findSuperstrips(batch, irange); }));
+        steps.push_back(WorkerPool::Step(nShards , [&](unsigned ishard) { fillShard(batch, ishard); }));
+        pool.start(steps);
+        pending = true;
+
+        // Stop reading if the target coverage is stable
+        if (useTarget && nKept - nKeptWindow >= po_.coverageWindow) {
+            if (finishBatch())
+                return 1;
+
+            windowCoverage = 1.0 - float(nNewWindow) / float(nKept - nKeptWindow);
+            if (windowCoverage >= po_.targetCoverage)
+                ++nStableWindows;
+            else
+                nStableWindows = 0;
+
+            if (verbose_>1)  std::cout << Debug() << Form("... Coverage window ending at event: %7lld, # new patterns: %7ld, coverage: %7.5f, # stable windows: %i", ievt, nNewWindow, windowCoverage, nStableWindows) << std::endl;
+
+            nKeptWindow = nKept;
+            nNewWindow = 0;
+
+            if (nStableWindows >= po_.stableWindows) {
+                if (verbose_)  std::cout << Info() << Form("Reached target coverage: %7.5f after %i windows, stop reading at event: %7lld", po_.targetCoverage, nStableWindows, ievt) << std::endl;
+                break;
             }
         }
-        if (ngoodstubs != po_.nLayers) {
-            ++nRead;
-            continue;
-        }
-        assert(nstubs == po_.nLayers);
+    }
 
+    if (finishBatch())
+        return 1;
 
-        // _____________________________________________________________________
-        // Start generating patterns
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
 
-        patt.fill(0);
+    bankSize = nSpilled;
+    for (unsigned ishard=0; ishard<nShards; ++ishard)
+        bankSize += shards.at(ishard).size();
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            float    strip    = reader.vb_coordx  ->at(istub);  // in full-strip unit
-            float    segment  = reader.vb_coordy  ->at(istub);  // in full-strip unit
+    // With a target coverage, use the coverage of the last window
+    if (useTarget && windowCoverage >= 0.)
+        coverage = windowCoverage;
 
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-            float    stub_ds  = reader.vb_trigBend->at(istub);  // in full-strip unit
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld, # patterns: %7ld, coverage: %7.5f", nRead, nKept, bankSize, coverage) << std::endl;
 
-            // Find superstrip ID
-            unsigned ssId = 0;
-            if (!arbiter_ -> useGlobalCoord()) {  // local coordinates
-                ssId = arbiter_ -> superstripLocal(moduleId, strip, segment);
+    // Save these numbers
+    coverage_        = coverage;
+    coverage_count_  = nKept;
+    coverage_events_ = nRead;
 
-            } else {                              // global coordinates
-                ssId = arbiter_ -> superstripGlobal(moduleId, stub_r, stub_phi, stub_z, stub_ds);
-            }
-            patt.at(istub) = ssId;
 
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << strip << " segment: " << segment << " r: " << stub_r << " phi: " << stub_phi << " z: " << stub_z << " ds: " << stub_ds << std::endl;
-                std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << std::endl;
-            }
-        }
+    // _________________________________________________________________________
+    // Sort by frequency
 
-        // Insert pattern into the bank
-        ++patternBank_map_[patt];
+    // If patterns were written out, write out the rest and merge the files
+    if (!runFiles.empty()) {
+        if (spillShards())
+            return 1;
+        if (mergePatterns(runFiles, TString(po_.output) + ".merged.tmp"))
+            return 1;
+    }
 
-        // Update the attributes
-        if (po_.speedup<1) {
-            std::pair<std::map<pattern_type, Attributes *>::iterator, bool> ins = patternAttributes_map_.insert(std::make_pair(patt, new Attributes()));
-            Attributes * attr = ins.first->second;
-            if (attr) {
-                ++ attr->n;
-                attr->invPt.fill(simChargeOverPt);
-                attr->cotTheta.fill(simCotTheta);
-                attr->phi.fill(simPhi);
-                attr->z0.fill(simVz);
-            }
-        }
-        else if (po_.speedup==1) {
-            std::pair<std::map<pattern_type, ShortAttributes *>::iterator, bool> ins = patternShortAttributes_map_.insert(std::make_pair(patt, new ShortAttributes()));
-            ShortAttributes * attr = ins.first->second;
-            if (attr) {
-                attr->invPt.fill(simChargeOverPt);
-                attr->phi.fill(simPhi);
-            }
-        }
+    // Sort the records of all the shards by frequency
+    size_t nInMemory = 0;
+    for (unsigned ishard=0; ishard<nShards; ++ishard)
+        nInMemory += shards.at(ishard).size();
+
+    patternOrder_.clear();
+    patternOrder_.reserve(nInMemory);
+    for (unsigned ishard=0; ishard<nShards; ++ishard) {
+        const PatternTable& shard = shards.at(ishard);
+        for (size_t i=0; i<shard.size(); ++i)
+            patternOrder_.push_back(&shard.at(i));
+    }
+
+    std::sort(patternOrder_.begin(), patternOrder_.end(), sortByFrequency);
 
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " patt: " << patt << std::endl;
+    const long long npatterns = getNumPatterns();
+    PatternRecord rec;
 
-        ++nKept;
-        ++nRead;
+    if (verbose_>2) {
+        for (long long i=0; i<npatterns; ++i) {
+            getPattern(i, rec);
+            std::cout << Debug() << "... patt: " << i << "  " << rec.patt << " freq: " << rec.freq << std::endl;
+        }
     }
 
-    if (nRead == 0) {
-        std::cout << Error() << "Failed to read any event." << std::endl;
+    unsigned highest_freq = 0;
+    if (npatterns) {
+        getPattern(0, rec);
+        highest_freq = rec.freq;
+    }
+    if (verbose_)  std::cout << Info() << "Generated " << npatterns << " patterns, highest freq: " << highest_freq << std::endl;
+    assert(highest_freq <= MAX_FREQUENCY);
+
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+// Merge the pattern banks
+int PatternGenerator::mergeBanks(TString src) {
+    std::vector<std::string> banks;
+    if (!src.EndsWith(".txt") || getInputFiles(src.Data(), banks) || banks.empty()) {
+        std::cout << Error() << "Input source must be a .txt file listing the pattern banks to merge" << std::endl;
         return 1;
     }
 
-    if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld, # patterns: %7lu, coverage: %7.5f", nRead, nKept, patternBank_map_.size(), coverage) << std::endl;
+    if (verbose_)  std::cout << Info() << "Merging " << banks.size() << " pattern banks." << std::endl;
 
-    // Save these numbers
-    coverage_       = coverage;
-    coverage_count_ = nKept;
+    // All the patterns are kept in memory, in a single table
+    std::vector<PatternTable>& shards = patternTables_;
+    shards.assign(1, PatternTable());
+    PatternTable& table = shards.front();
 
+    double coverageSum = 0.;
+    long int count = 0, events = 0;
 
-    // _________________________________________________________________________
-    // Sort by frequency
+    for (unsigned ibank=0; ibank<banks.size(); ++ibank) {
+        PatternBankReader pbreader(verbose_);
+        if (pbreader.init(banks.at(ibank))) {
+            std::cout << Error() << "Failed to initialize PatternBankReader." << std::endl;
+            return 1;
+        }
 
-    // Convert map to vector of pairs
-    const unsigned origSize = patternBank_map_.size();
-    //patternBank_pairs_.reserve(patternBank_map_.size());  // can cause bad_alloc
-    //patternBank_pairs_.insert(patternBank_pairs_.end(), patternBank_map_.begin(), patternBank_map_.end());
+        float       bankCoverage   = 0.;
+        unsigned    bankCount      = 0;
+        unsigned    bankTower      = 0;
+        std::string bankSuperstrip = "";
+        unsigned    bankNDCBits    = 0;
+        unsigned    bankEvents     = 0;
+        pbreader.getPatternBankInfo(bankCoverage, bankCount, bankTower, bankSuperstrip);
+        pbreader.getPatternBankDCBits(bankNDCBits);
+        pbreader.getPatternBankEvents(bankEvents);
+
+        // The banks must have been generated with the same settings
+        if (bankTower != po_.tower || bankSuperstrip != po_.superstrip || bankNDCBits != po_.nDCBits) {
+            std::cout << Error() << "Pattern bank " << banks.at(ibank) << " has tower: " << bankTower << " superstrip: " << bankSuperstrip << " nDCBits: " << bankNDCBits
+                      << ", expected tower: " << po_.tower << " superstrip: " << po_.superstrip << " nDCBits: " << po_.nDCBits << std::endl;
+            return 1;
+        }
 
-    for (std::map<pattern_type, unsigned>::const_iterator it = patternBank_map_.begin();
-         it != patternBank_map_.end(); ) {  // should not cause bad_alloc
-        patternBank_pairs_.push_back(*it);
-        it = patternBank_map_.erase(it);
-    }
-    assert(patternBank_pairs_.size() == origSize);
+        coverageSum += double(bankCoverage) * bankCount;
+        count       += bankCount;
+        events      += bankEvents;
 
-    // Clear map and release memory
-    std::map<pattern_type, unsigned> mapEmpty;
-    patternBank_map_.clear();
-    patternBank_map_.swap(mapEmpty);
+        const long long npatterns = pbreader.getPatterns();
+        pattern_type patt;
 
-    // Sort by frequency
-    std::stable_sort(patternBank_pairs_.begin(), patternBank_pairs_.end(), sortByFrequency);
+        for (long long ipatt=0; ipatt<npatterns; ++ipatt) {
+            pbreader.getPattern(ipatt);
 
-    if (verbose_>2) {
-        for (unsigned i=0; i<patternBank_pairs_.size(); ++i) {
-            const std::pair<pattern_type, unsigned>& apair = patternBank_pairs_.at(i);
-            std::cout << Debug() << "... patt: " << i << "  " << apair.first << " freq: " << apair.second << std::endl;
+            if (pbreader.pb_superstripIds->size() != po_.nLayers) {
+                std::cout << Error() << "Pattern " << ipatt << " has " << pbreader.pb_superstripIds->size() << " layers, expected " << po_.nLayers << "." << std::endl;
+                return 1;
+            }
+
+            patt.fill(0);
+            for (unsigned ilayer=0; ilayer<po_.nLayers; ++ilayer)
+                patt.at(ilayer) = pbreader.pb_superstripIds->at(ilayer);
+
+            // Sum the frequencies
+            bool inserted = false;
+            PatternRecord& rec = table.insert(patt, inserted);
+            const unsigned freq = pbreader.pb_frequency;
+            assert(rec.freq <= MAX_FREQUENCY - freq);
+            rec.freq += freq;
+
+            // Widen the DC bits to accept everything accepted in either bank
+            if (po_.nDCBits > 0) {
+                assert(pbreader.pb_superstripBits->size() == po_.nLayers);
+                for (unsigned ilayer=0; ilayer<po_.nLayers; ++ilayer) {
+                    if (inserted)
+                        rec.bits.at(ilayer) = pbreader.pb_superstripBits->at(ilayer);
+                    else
+                        rec.bits.at(ilayer) = combineDCBits(rec.bits.at(ilayer), pbreader.pb_superstripBits->at(ilayer));
+                }
+            }
+
+            // Combine the attributes, each pattern has one entry per track. The
+            // banks store the means and sigmas as floats, so the merged
+            // attributes match those of a single job to float precision
+            if (po_.speedup<=1 && pbreader.getPatternAttributes(ipatt) > 0) {
+                if (po_.speedup<1) {
+                    rec.n += freq;
+                    rec.cotTheta.merge(Statistics(freq, pbreader.pb_cotTheta_mean, pbreader.pb_cotTheta_sigma));
+                    rec.z0      .merge(Statistics(freq, pbreader.pb_z0_mean      , pbreader.pb_z0_sigma));
+                }
+                rec.invPt.merge(Statistics(freq, pbreader.pb_invPt_mean, pbreader.pb_invPt_sigma));
+                rec.phi  .merge(Statistics(freq, pbreader.pb_phi_mean  , pbreader.pb_phi_sigma));
+            }
         }
+
+        if (verbose_)  std::cout << Info() << "Read " << npatterns << " patterns from " << banks.at(ibank) << ", # patterns: " << table.size() << std::endl;
     }
 
-    unsigned highest_freq = patternBank_pairs_.size() ? patternBank_pairs_.front().second : 0;
-    if (verbose_)  std::cout << Info() << "Generated " << patternBank_pairs_.size() << " patterns, highest freq: " << highest_freq << std::endl;
-    assert(patternBank_pairs_.front().second <= MAX_FREQUENCY);
+    // Save these numbers. The coverage of the merged bank is estimated by the
+    // average of the coverages, weighted by the number of tracks
+    coverage_        = (count > 0) ? coverageSum / count : 0.;
+    coverage_count_  = count;
+    coverage_events_ = events;
+
+    // Sort by frequency
+    patternOrder_.clear();
+    patternOrder_.reserve(table.size());
+    for (size_t i=0; i<table.size(); ++i)
+        patternOrder_.push_back(&table.at(i));
+
+    std::sort(patternOrder_.begin(), patternOrder_.end(), sortByFrequency);
+
+    unsigned highest_freq = patternOrder_.empty() ? 0 : patternOrder_.front()->freq;
+    if (verbose_)  std::cout << Info() << "Merged " << patternOrder_.size() << " patterns, highest freq: " << highest_freq << std::endl;
 
     return 0;
 }
@@ -224,11 +622,14 @@ int PatternGenerator::writePatterns(TString out) {
     *(writer.pb_count)      = coverage_count_;
     *(writer.pb_tower)      = po_.tower;
     *(writer.pb_superstrip) = po_.superstrip;
+    *(writer.pb_nDCBits)    = po_.nDCBits;
+    *(writer.pb_events)     = coverage_events_;
     writer.fillPatternBankInfo();
 
     // _________________________________________________________________________
     // Save pattern bank
-    const long long npatterns = patternBank_pairs_.size();
+    const long long npatterns = getNumPatterns();
+    PatternRecord rec;
 
     // Bookkeepers
     unsigned nKept = 0;
@@ -248,7 +649,8 @@ int PatternGenerator::writePatterns(TString out) {
             if (ipatt%1000==0) std::cout << Debug() << Form("... Writing event: %7lld, sorted coverage: %7.5f", ipatt, coverage) << std::endl;
         }
 
-        freq = patternBank_pairs_.at(ipatt).second;
+        getPattern(ipatt, rec);
+        freq = rec.freq;
 
         // Check whether patterns are indeed sorted by frequency
         assert(oldFreq >= freq);
@@ -259,29 +661,35 @@ int PatternGenerator::writePatterns(TString out) {
             break;
 
         writer.pb_superstripIds->clear();
-        const pattern_type& patt = patternBank_pairs_.at(ipatt).first;
+        const pattern_type& patt = rec.patt;
         for (unsigned ilayer=0; ilayer<po_.nLayers; ++ilayer) {
             writer.pb_superstripIds->push_back(patt.at(ilayer));
         }
+
+        writer.pb_superstripBits->clear();
+        if (po_.nDCBits > 0) {
+            const pattern_bit_type& pattBits = rec.bits;
+            for (unsigned ilayer=0; ilayer<po_.nLayers; ++ilayer) {
+                writer.pb_superstripBits->push_back(pattBits.at(ilayer));
+            }
+        }
         *(writer.pb_frequency) = freq;
 
         if (po_.speedup<1) {
-            const Attributes * attr = patternAttributes_map_.at(patt);
-            *(writer.pb_invPt_mean)     = attr->invPt.getMean();
-            *(writer.pb_invPt_sigma)    = attr->invPt.getSigma();
-            *(writer.pb_cotTheta_mean)  = attr->cotTheta.getMean();
-            *(writer.pb_cotTheta_sigma) = attr->cotTheta.getSigma();
-            *(writer.pb_phi_mean)       = attr->phi.getMean();
-            *(writer.pb_phi_sigma)      = attr->phi.getSigma();
-            *(writer.pb_z0_mean)        = attr->z0.getMean();
-            *(writer.pb_z0_sigma)       = attr->z0.getSigma();
+            *(writer.pb_invPt_mean)     = rec.invPt.getMean();
+            *(writer.pb_invPt_sigma)    = rec.invPt.getSigma();
+            *(writer.pb_cotTheta_mean)  = rec.cotTheta.getMean();
+            *(writer.pb_cotTheta_sigma) = rec.cotTheta.getSigma();
+            *(writer.pb_phi_mean)       = rec.phi.getMean();
+            *(writer.pb_phi_sigma)      = rec.phi.getSigma();
+            *(writer.pb_z0_mean)        = rec.z0.getMean();
+            *(writer.pb_z0_sigma)       = rec.z0.getSigma();
         }
         else if (po_.speedup==1) {
-            const ShortAttributes * attr = patternShortAttributes_map_.at(patt);
-            *(writer.pb_invPt_mean)     = attr->invPt.getMean();
-            *(writer.pb_invPt_sigma)    = attr->invPt.getSigma();
-            *(writer.pb_phi_mean)       = attr->phi.getMean();
-            *(writer.pb_phi_sigma)      = attr->phi.getSigma();
+            *(writer.pb_invPt_mean)     = rec.invPt.getMean();
+            *(writer.pb_invPt_sigma)    = rec.invPt.getSigma();
+            *(writer.pb_phi_mean)       = rec.phi.getMean();
+            *(writer.pb_phi_sigma)      = rec.phi.getSigma();
         }
 
         writer.fillPatternBank();
@@ -294,14 +702,149 @@ int PatternGenerator::writePatterns(TString out) {
 
     if (verbose_)  {
     	std::cout << Info() << "After sorting by frequency: " << std::endl;
-    	std::cout << Info() << " N(90% cov) = " << n90 << "\tPopularity = " << patternBank_pairs_.at(n90).second << std::endl;
-    	std::cout << Info() << " N(95% cov) = " << n95 << "\tPopularity = " << patternBank_pairs_.at(n95).second << std::endl;
-    	std::cout << Info() << " N(99% cov) = " << n99 << "\tPopularity = " << patternBank_pairs_.at(n99).second << std::endl;
+    	getPattern(n90, rec);
+    	std::cout << Info() << " N(90% cov) = " << n90 << "\tPopularity = " << rec.freq << std::endl;
+    	getPattern(n95, rec);
+    	std::cout << Info() << " N(95% cov) = " << n95 << "\tPopularity = " << rec.freq << std::endl;
+    	getPattern(n99, rec);
+    	std::cout << Info() << " N(99% cov) = " << n99 << "\tPopularity = " << rec.freq << std::endl;
+    }
+
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+// Access the patterns sorted by frequency
+long long PatternGenerator::getNumPatterns() const {
+    if (mergedRecords_)
+        return mergedOrder_.size();
+    return patternOrder_.size();
+}
+
+void PatternGenerator::getPattern(long long ipatt, PatternRecord& rec) const {
+    if (mergedRecords_) {
+        rec = mergedRecords_[mergedOrder_.at(ipatt).second];
+        return;
+    }
+    rec = *patternOrder_.at(ipatt);
+}
+
+
+// _____________________________________________________________________________
+// Merge the temporary files
+int PatternGenerator::mergePatterns(const std::vector<TString>& runFiles, TString mergedFile) {
+    if (verbose_)  std::cout << Info() << "Merging " << runFiles.size() << " temporary files into " << mergedFile << std::endl;
+
+    FILE * out = std::fopen(mergedFile.Data(), "wb");
+    if (!out) {
+        std::cout << Error() << "Failed to open " << mergedFile << std::endl;
+        return 1;
+    }
+    mergedFile_ = mergedFile;
+
+    std::vector<RunCursor> runs(runFiles.size());
+    for (unsigned i=0; i<runFiles.size(); ++i) {
+        runs.at(i).file = std::fopen(runFiles.at(i).Data(), "rb");
+        if (!runs.at(i).file) {
+            std::cout << Error() << "Failed to open " << runFiles.at(i) << std::endl;
+            return 1;
+        }
+    }
+
+    // k-way merge: the heap holds the runs ordered by their current pattern
+    auto greaterPattern = [&](unsigned lhs, unsigned rhs) { return runs.at(rhs).rec.patt < runs.at(lhs).rec.patt; };
+    std::priority_queue<unsigned, std::vector<unsigned>, decltype(greaterPattern)> heap(greaterPattern);
+    for (unsigned i=0; i<runs.size(); ++i) {
+        if (runs.at(i).next())
+            heap.push(i);
     }
 
+    // Sum the frequencies and attributes of the same pattern found in different runs
+    PatternRecord merged = PatternRecord();
+    long long nmerged = 0;
+    bool first = true;
+
+    while (!heap.empty()) {
+        const unsigned i = heap.top();
+        heap.pop();
+        const PatternRecord& rec = runs.at(i).rec;
+
+        if (!first && rec.patt == merged.patt) {
+            merged.freq += rec.freq;
+            merged.n    += rec.n;
+            for (unsigned ilayer=0; ilayer<po_.nLayers; ++ilayer)
+                merged.bits.at(ilayer) = combineDCBits(merged.bits.at(ilayer), rec.bits.at(ilayer));
+            merged.invPt   .merge(rec.invPt);
+            merged.cotTheta.merge(rec.cotTheta);
+            merged.phi     .merge(rec.phi);
+            merged.z0      .merge(rec.z0);
+
+        } else {
+            if (!first) {
+                std::fwrite(&merged, sizeof(merged), 1, out);
+                ++nmerged;
+            }
+            merged = rec;
+            first = false;
+        }
+
+        if (runs.at(i).next())
+            heap.push(i);
+    }
+    if (!first) {
+        std::fwrite(&merged, sizeof(merged), 1, out);
+        ++nmerged;
+    }
+
+    for (unsigned i=0; i<runs.size(); ++i) {
+        std::fclose(runs.at(i).file);
+        std::remove(runFiles.at(i).Data());
+    }
+
+    const bool failed = std::ferror(out);
+    if (std::fclose(out) != 0 || failed) {
+        std::cout << Error() << "Failed to write " << mergedFile << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // Map the merged records, and sort them by frequency. The records are sorted
+    // by pattern, so ties keep the same order as the in-memory path.
+    if (nmerged > 0) {
+        int fd = open(mergedFile.Data(), O_RDONLY);
+        void * addr = (fd < 0) ? MAP_FAILED : mmap(0, nmerged * sizeof(PatternRecord), PROT_READ, MAP_SHARED, fd, 0);
+        if (fd >= 0)  close(fd);
+        if (addr == MAP_FAILED) {
+            std::cout << Error() << "Failed to map " << mergedFile << std::endl;
+            return 1;
+        }
+        mergedRecords_ = (const PatternRecord *) addr;
+        mergedSize_    = nmerged * sizeof(PatternRecord);
+    }
+
+    mergedOrder_.clear();
+    mergedOrder_.reserve(nmerged);
+    for (long long i=0; i<nmerged; ++i)
+        mergedOrder_.push_back(std::make_pair(mergedRecords_[i].freq, (size_t) i));
+
+    std::sort(mergedOrder_.begin(), mergedOrder_.end(), [](const std::pair<unsigned, size_t>& lhs, const std::pair<unsigned, size_t>& rhs) {
+        return (lhs.first != rhs.first) ? (lhs.first > rhs.first) : (lhs.second < rhs.second);
+    });
+
+    if (verbose_)  std::cout << Info() << "Merged " << nmerged << " patterns." << std::endl;
     return 0;
 }
 
+void PatternGenerator::unmapMergedPatterns() {
+    if (mergedRecords_)  munmap((void *) mergedRecords_, mergedSize_);
+    mergedRecords_ = 0;
+    mergedSize_ = 0;
+    mergedOrder_.clear();
+    if (mergedFile_ != "")  std::remove(mergedFile_.Data());
+    mergedFile_ = "";
+}
+
 
 // _____________________________________________________________________________
 // Main driver
@@ -309,7 +852,10 @@ int PatternGenerator::run() {
     int exitcode = 0;
     Timing(1);
 
-    exitcode = makePatterns(po_.input);
+    if (po_.merge)
+        exitcode = mergeBanks(po_.input);
+    else
+        exitcode = makePatterns(po_.input);
     if (exitcode)  return exitcode;
     Timing();
 
@@ -1,28 +1,49 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternMatcher.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitter.h"
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankReader.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankBinary.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubPlusTPReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTRoadReader.h"
 
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 namespace {
-// Join 'layer' and 'superstrip' into one number
-unsigned simpleHash(unsigned layer, unsigned nss, unsigned ss) {
-    return layer * nss + ss;
+// Number of events read at a time for each worker thread
+const unsigned EVENTS_PER_THREAD = 20;
+
+// An event that is put aside while waiting for the pattern recognition
+struct MatcherEvent {
+    unsigned                                                  nstubs;
+    std::vector<std::vector<std::pair<unsigned, unsigned> > > superstripHits;  // (hashed superstrip, stubRef), per trigger tower
+    std::vector<std::vector<TTRoad> >                         roads;           // per trigger tower
+    std::vector<TTSuperstripTable>                            superstrips;     // superstrips of the roads, per trigger tower
+    BasicEventBuffers                                         buffers;
+};
 }
 
-unsigned simpleHashUndo(unsigned layer, unsigned nss, unsigned ssh) {
-    return ssh % nss;
-}
 
-unsigned simpleHashNbins(unsigned nlayers, unsigned nss) {
-    return simpleHash(nlayers, nss, 0);
-}
+// _____________________________________________________________________________
+PatternMatcher::~PatternMatcher() {
+    if (ttmap_)     delete ttmap_;
+    for (unsigned itower=0; itower<arbiters_.size(); ++itower)
+        delete arbiters_.at(itower);
+    for (unsigned itower=0; itower<bankBinaries_.size(); ++itower)
+        delete bankBinaries_.at(itower);
 }
 
-
 // _____________________________________________________________________________
-int PatternMatcher::loadPatterns(TString bank) {
-    if (verbose_)  std::cout << Info() << "Loading patterns from " << bank << std::endl;
+int PatternMatcher::loadPatterns(unsigned itower, TString bank) {
+    if (bank.EndsWith(".bin"))
+        return loadPatternsBinary(itower, bank);
+
+    if (verbose_)  std::cout << Info() << "Loading patterns for trigger tower " << towers_.at(itower) << " from " << bank << std::endl;
+
+    SuperstripArbiter * arbiter           = arbiters_.at(itower);
+    HitBuffer&          hitBuffer         = hitBuffers_.at(itower);
+    AssociativeMemory&  associativeMemory = associativeMemories_.at(itower);
 
     // _________________________________________________________________________
     // For reading pattern bank
@@ -37,27 +58,40 @@ int PatternMatcher::loadPatterns(TString bank) {
         npatterns = po_.maxPatterns;
     assert(npatterns > 0);
 
-    // Setup hit buffer
-    const unsigned nss = arbiter_ -> nsuperstripsPerLayer();
+    // The bank must have been generated with the same number of DC bits
+    const unsigned nDCBits = po_.nDCBits;
+    unsigned bankDCBits = 0;
+    pbreader.getPatternBankDCBits(bankDCBits);
+    if (bankDCBits != nDCBits) {
+        std::cout << Error() << "Pattern bank has " << bankDCBits << " DC bits, expected " << nDCBits << "." << std::endl;
+        return 1;
+    }
+
+    // Setup hit buffer, the patterns store the coarse superstrips
+    const unsigned nss       = arbiter -> nsuperstripsPerLayer();
+    const unsigned nssCoarse = dcNsuperstrips(nss, nDCBits);
 
-    if (hitBuffer_.init(simpleHashNbins(po_.nLayers, nss))) {
+    if (hitBuffer.init(simpleHashNbins(po_.nLayers, nssCoarse) << nDCBits)) {
         std::cout << Error() << "Failed to initialize HitBuffer." << std::endl;
         return 1;
     }
 
     // Setup associative memory
-    if (associativeMemory_.init(npatterns)) {
+    if (associativeMemory.init(npatterns, amEngine_)) {
         std::cout << Error() << "Failed to initialize AssociativeMemory." << std::endl;
         return 1;
     }
 
     if (verbose_)  std::cout << Info() << "Assume " << nss << " possible superstrips per layer." << std::endl;
+    if (verbose_ && nDCBits)  std::cout << Info() << "Use " << nDCBits << " DC bits, " << nssCoarse << " possible coarse superstrips per layer." << std::endl;
 
     // _________________________________________________________________________
     // Load the patterns
 
     pattern_type pattHash;
     pattHash.fill(0);
+    pattern_bit_type pattBits;
+    pattBits.fill(0);
     float pattInvPt = 0.;
 
     for (long long ipatt=0; ipatt<npatterns; ++ipatt) {
@@ -79,250 +113,571 @@ int PatternMatcher::loadPatterns(TString bank) {
         // Fill the associative memory
         pbreader.getPatternInvPt(ipatt, pattInvPt);
 
-        //associativeMemory_.insert(pbreader.pb_superstripIds->begin(), pbreader.pb_superstripIds->end(), pattInvPt);
+        //associativeMemory.insert(pbreader.pb_superstripIds->begin(), pbreader.pb_superstripIds->end(), pattInvPt);
 
         // Fill the associative memory, after hashing
         pattHash.fill(0);
         for (unsigned layer=0; layer<po_.nLayers; ++layer) {
             const unsigned ssId     = pbreader.pb_superstripIds->at(layer);
-            const unsigned ssIdHash = simpleHash(layer, nss, ssId);
+            const unsigned ssIdHash = simpleHash(layer, nssCoarse, ssId);
             pattHash.at(layer) = ssIdHash;
         }
 
-        associativeMemory_.insert(pattHash, pattInvPt);
+        if (nDCBits > 0) {
+            assert(pbreader.pb_superstripBits->size() == po_.nLayers);
+            std::copy(pbreader.pb_superstripBits->begin(), pbreader.pb_superstripBits->end(), pattBits.begin());
+            associativeMemory.insert(pattHash, pattBits, pattInvPt);
+        } else {
+            associativeMemory.insert(pattHash, pattInvPt);
+        }
     }
 
-    associativeMemory_.freeze();
-    assert(associativeMemory_.size() == npatterns);
+    associativeMemory.freeze(po_.nLayers, nDCBits);
+    assert(associativeMemory.size() == npatterns);
 
     if (verbose_)  std::cout << Info() << "Successfully loaded " << npatterns << " patterns." << std::endl;
 
     return 0;
 }
 
-// _____________________________________________________________________________
-int PatternMatcher::makeRoads(TString src, TString out) {
-    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and matching patterns." << std::endl;
+int PatternMatcher::loadPatternsBinary(unsigned itower, TString bank) {
+    if (verbose_)  std::cout << Info() << "Loading patterns for trigger tower " << towers_.at(itower) << " from " << bank << std::endl;
+
+    SuperstripArbiter * arbiter           = arbiters_.at(itower);
+    HitBuffer&          hitBuffer         = hitBuffers_.at(itower);
+    AssociativeMemory&  associativeMemory = associativeMemories_.at(itower);
 
     // _________________________________________________________________________
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
+    // For reading binary pattern bank
+    PatternBankBinaryReader * pbreader = new PatternBankBinaryReader(verbose_);
+    delete bankBinaries_.at(itower);
+    bankBinaries_.at(itower) = pbreader;
+    if (pbreader->init(bank)) {
+        std::cout << Error() << "Failed to initialize PatternBankBinaryReader." << std::endl;
+        return 1;
+    }
 
+    const PatternBankBinaryHeader& header = pbreader->getHeader();
 
-    // _________________________________________________________________________
-    // For reading
-    TTStubPlusTPReader reader(verbose_);
-    if (reader.init(src)) {
-        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+    // The bank must have been converted for the same trigger tower, with the
+    // same layers, DC bits and superstrips
+    const unsigned nDCBits   = po_.nDCBits;
+    const unsigned nss       = arbiter -> nsuperstripsPerLayer();
+    const unsigned nssCoarse = dcNsuperstrips(nss, nDCBits);
+
+    if (header.tower != towers_.at(itower)) {
+        std::cout << Error() << "Pattern bank is for trigger tower " << header.tower << ", expected " << towers_.at(itower) << "." << std::endl;
+        return 1;
+    }
+    const std::string superstrip(header.superstrip, strnlen(header.superstrip, sizeof(header.superstrip)));
+    if (superstrip != po_.superstrip) {
+        std::cout << Error() << "Pattern bank has superstrip " << superstrip << ", expected " << po_.superstrip << "." << std::endl;
+        return 1;
+    }
+    if (header.nLayers != po_.nLayers) {
+        std::cout << Error() << "Pattern bank has " << header.nLayers << " layers, expected " << po_.nLayers << "." << std::endl;
+        return 1;
+    }
+    if (header.nDCBits != nDCBits) {
+        std::cout << Error() << "Pattern bank has " << header.nDCBits << " DC bits, expected " << nDCBits << "." << std::endl;
+        return 1;
+    }
+    if (header.nsuperstripsPerLayer != nssCoarse) {
+        std::cout << Error() << "Pattern bank has " << header.nsuperstripsPerLayer << " superstrips per layer, expected " << nssCoarse << "." << std::endl;
         return 1;
     }
 
-    // For writing
-    TTRoadWriter writer(verbose_);
-    if (writer.init(reader.getChain(), out, prefixRoad_, suffix_)) {
-        std::cout << Error() << "Failed to initialize TTRoadWriter." << std::endl;
+    // The patterns are sorted by decreasing frequency
+    const frequency_type * frequencies = pbreader->getFrequencies();
+
+    long long npatterns = pbreader->getPatterns();
+    if (npatterns > po_.maxPatterns)
+        npatterns = po_.maxPatterns;
+    for (long long ipatt=0; ipatt<npatterns; ++ipatt) {
+        if (frequencies[ipatt] < po_.minFrequency) {
+            npatterns = ipatt;
+            break;
+        }
+    }
+    assert(npatterns > 0);
+
+    // Setup hit buffer, the patterns store the coarse superstrips
+    if (hitBuffer.init(simpleHashNbins(po_.nLayers, nssCoarse) << nDCBits)) {
+        std::cout << Error() << "Failed to initialize HitBuffer." << std::endl;
+        return 1;
+    }
+
+    // Setup associative memory, nothing to reserve as it uses the mapped arrays
+    if (associativeMemory.init(0, amEngine_)) {
+        std::cout << Error() << "Failed to initialize AssociativeMemory." << std::endl;
         return 1;
     }
 
+    if (verbose_)  std::cout << Info() << "Assume " << nss << " possible superstrips per layer." << std::endl;
+    if (verbose_ && nDCBits)  std::cout << Info() << "Use " << nDCBits << " DC bits, " << nssCoarse << " possible coarse superstrips per layer." << std::endl;
+
+    associativeMemory.map(pbreader->getSuperstripIds(), pbreader->getSuperstripBits(), pbreader->getInvPts(), npatterns);
+    associativeMemory.freeze(po_.nLayers, nDCBits);
+    assert(associativeMemory.size() == npatterns);
+
+    if (verbose_)  std::cout << Info() << "Successfully loaded " << npatterns << " patterns." << std::endl;
+
+    return 0;
+}
+
+// _____________________________________________________________________________
+void PatternMatcher::prepareEvent(TTStubPlusTPReader& reader, long long ievt, const std::vector<uint64_t>& moduleTowers,
+                                  std::vector<std::vector<std::pair<unsigned, unsigned> > >& superstripHits) const {
+    const unsigned nstubs = reader.vb_modId->size();
 
     // _________________________________________________________________________
-    // Loop over all events
+    // Skip stubs
+
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
+
+    std::vector<uint64_t> stubTowers(nstubs, 0);  // bit i: in the i-th trigger tower
+    std::vector<bool> stubsNotInTower;  // true: not in any of the trigger towers
+    std::vector<bool> stubsInOverlapping(nstubs,false);  // true: stub is in overlapping region and has TO BE removed
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+    	unsigned moduleId = reader.vb_modId   ->at(istub);
+
+    	// Skip if not in the trigger towers
+    	unsigned imodule = moduleIndex.index(moduleId);
+    	if (imodule < moduleTowers.size())
+    	    stubTowers.at(istub) = moduleTowers[imodule];
+    	bool isNotInTower = (stubTowers.at(istub) == 0);
+    	stubsNotInTower.push_back(isNotInTower);
+
+    	// RR // Skip if in overlapping regions
+      if (removeOverlap_) {
+    	float    stub_coordx = reader.vb_coordx->at(istub);
+    	float    stub_coordy = reader.vb_coordy->at(istub);
+    	const ModuleOverlap* it_mo = momap_->find(moduleId);
+    	if (it_mo) {
+    		float minx = it_mo->x1;
+    		if (stub_coordx < minx) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t" << moduleId << "\t x1: " <<  stub_coordx << std::endl;
+    			stubsInOverlapping.at(istub)=true;
+    			continue;
+    		}
+    		float maxx = it_mo->x2;
+    		if (stub_coordx > maxx) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t x2: " <<  stub_coordx << std::endl;
+    			stubsInOverlapping.at(istub)=true;
+    			continue;
+    		}
+    		float miny = it_mo->y1;
+    		if (stub_coordy < miny) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y1: " <<  stub_coordy << std::endl;
+    			stubsInOverlapping.at(istub)=true;
+    			continue;
+    		}
+    		float maxy = it_mo->y2;
+    		if (stub_coordy > maxy) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y2: " <<  stub_coordy << std::endl;
+    			stubsInOverlapping.at(istub)=true;
+    			continue;
+    		}
+    	}
+    }
+    } // endif removeOverlap_
+    // Null stub information for those that are not in the trigger towers
+    reader.nullStubs(stubsNotInTower);
 
-    const unsigned nss = arbiter_ -> nsuperstripsPerLayer();
+    // _________________________________________________________________________
+    // Skip tracking particles
 
-    // Containers
-    std::vector<TTRoad> roads;
-    roads.reserve(300);
+    std::vector<bool> trkPartsNotPrimary;  // true: not primary
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+    const unsigned nparts = reader.vp2_primary->size();
+    for (unsigned ipart=0; ipart<nparts; ++ipart) {
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+        // Skip if not primary
+        bool  primary         = reader.vp2_primary->at(ipart);
+        int   simCharge       = reader.vp2_charge->at(ipart);
+        trkPartsNotPrimary.push_back(!(simCharge!=0 && primary));
+    }
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, triggering: %7ld", ievt, nKept) << std::endl;
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
+    // Null trkPart information for those that are not primary
+    reader.nullParticles(trkPartsNotPrimary);
 
-        if (!nstubs) {  // skip if no stub
-            ++nRead;
-            writer.fill(std::vector<TTRoad>());
+
+    // _________________________________________________________________________
+    // Find superstrips
+
+    // Route the reconstructed stubs to every trigger tower that contains their module
+    const unsigned ntowers = arbiters_.size();
+    std::vector<std::vector<unsigned> > towerStubs(ntowers);
+
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+        bool isNotInTower = stubsNotInTower.at(istub);
+        if (isNotInTower)
             continue;
+        if ((removeOverlap_) && stubsInOverlapping.at(istub))
+            continue;
+
+        unsigned moduleId = reader.vb_modId   ->at(istub);
+
+        if (verbose_>2) {
+            std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << reader.vb_coordx->at(istub) << " segment: " << reader.vb_coordy->at(istub) << " r: " << reader.vb_r->at(istub) << " phi: " << reader.vb_phi->at(istub) << " z: " << reader.vb_z->at(istub) << " ds: " << reader.vb_trigBend->at(istub) << std::endl;
         }
 
-        if (nstubs > 500000) {
-            std::cout << Error() << "Way too many stubs: " << nstubs << std::endl;
-            return 1;
+        for (uint64_t itowers = stubTowers.at(istub); itowers; itowers &= (itowers - 1)) {
+            towerStubs.at(__builtin_ctzll(itowers)).push_back(istub);
         }
+    }
 
+    // Find the superstrip IDs of the stubs of each trigger tower in one batch
+    std::vector<unsigned> moduleIds, ssIds;
+    std::vector<float> strips, segments, rs, phis, zs, dss;
 
-        // _____________________________________________________________________
-        // Skip stubs
-
-        std::vector<bool> stubsNotInTower;  // true: not in this trigger tower
-        std::vector<bool> stubsInOverlapping(nstubs,false);  // true: stub is in overlapping region and has TO BE removed
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-        	unsigned moduleId = reader.vb_modId   ->at(istub);
-
-        	// Skip if not in this trigger tower
-        	bool isNotInTower = (ttrmap.find(moduleId) == ttrmap.end());
-        	stubsNotInTower.push_back(isNotInTower);
-
-        	// RR // Skip if in overlapping regions
-          if (removeOverlap_) {
-        	float    stub_coordx = reader.vb_coordx->at(istub);
-        	float    stub_coordy = reader.vb_coordy->at(istub);
-        	std::map<unsigned,ModuleOverlap>::iterator it_mo = momap_->moduleOverlap_map_.find(moduleId);
-        	if (it_mo != momap_->moduleOverlap_map_.end()) {
-        		float minx = it_mo->second.x1;
-        		if (stub_coordx < minx) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t" << moduleId << "\t x1: " <<  stub_coordx << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float maxx = it_mo->second.x2;
-        		if (stub_coordx > maxx) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t x2: " <<  stub_coordx << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float miny = it_mo->second.y1;
-        		if (stub_coordy < miny) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y1: " <<  stub_coordy << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float maxy = it_mo->second.y2;
-        		if (stub_coordy > maxy) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y2: " <<  stub_coordy << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        	}
+    for (unsigned itower=0; itower<ntowers; ++itower) {
+        const std::vector<unsigned>& stubs = towerStubs.at(itower);
+        const unsigned nstubsInTower = stubs.size();
+        if (nstubsInTower == 0)
+            continue;
+
+        const SuperstripArbiter * arbiter = arbiters_.at(itower);
+        const unsigned nssCoarse = dcNsuperstrips(arbiter -> nsuperstripsPerLayer(), po_.nDCBits);
+
+        moduleIds.resize(nstubsInTower);
+        strips   .resize(nstubsInTower);
+        segments .resize(nstubsInTower);
+        rs       .resize(nstubsInTower);
+        phis     .resize(nstubsInTower);
+        zs       .resize(nstubsInTower);
+        dss      .resize(nstubsInTower);
+        ssIds    .resize(nstubsInTower);
+
+        for (unsigned i=0; i<nstubsInTower; ++i) {
+            const unsigned istub = stubs[i];
+            moduleIds[i] = (*reader.vb_modId)   [istub];
+            strips   [i] = (*reader.vb_coordx)  [istub];  // in full-strip unit
+            segments [i] = (*reader.vb_coordy)  [istub];  // in full-strip unit
+            rs       [i] = (*reader.vb_r)       [istub];
+            phis     [i] = (*reader.vb_phi)     [istub];
+            zs       [i] = (*reader.vb_z)       [istub];
+            dss      [i] = (*reader.vb_trigBend)[istub];  // in full-strip unit
         }
-        } // endif removeOverlap_
-        // Null stub information for those that are not in this trigger tower
-        reader.nullStubs(stubsNotInTower);
 
-        // _____________________________________________________________________
-        // Skip tracking particles
+        arbiter -> superstrips(nstubsInTower, moduleIds.data(), strips.data(), segments.data(),
+                               rs.data(), phis.data(), zs.data(), dss.data(), ssIds.data());
 
-        std::vector<bool> trkPartsNotPrimary;  // true: not primary
+        for (unsigned i=0; i<nstubsInTower; ++i) {
+            unsigned ssId     = ssIds[i];
+            unsigned lay16    = compressLayer(decodeLayer(moduleIds[i]));
+            unsigned ssIdHash = dcHash(lay16, nssCoarse, ssId, po_.nDCBits);
 
-        const unsigned nparts = reader.vp2_primary->size();
-        for (unsigned ipart=0; ipart<nparts; ++ipart) {
+            superstripHits.at(itower).push_back(std::make_pair(ssIdHash, stubs[i]));
 
-            // Skip if not primary
-            bool  primary         = reader.vp2_primary->at(ipart);
-            int   simCharge       = reader.vp2_charge->at(ipart);
-            trkPartsNotPrimary.push_back(!(simCharge!=0 && primary));
+            if (verbose_>2) {
+                std::cout << Debug() << "... ... stub: " << stubs[i] << " tower: " << towers_.at(itower) << " ssId: " << ssId << " ssIdHash: " << ssIdHash << std::endl;
+            }
         }
+    }
+}
 
-        // Null trkPart information for those that are not primary
-        reader.nullParticles(trkPartsNotPrimary);
+// _____________________________________________________________________________
+void PatternMatcher::matchEvent(unsigned itower, const std::vector<std::pair<unsigned, unsigned> >& superstripHits,
+                                HitBuffer& hitBuffer, AssociativeMemoryWorkspace& workspace, SuperstripTableIndex& tableIndex,
+                                std::vector<TTRoad>& roads, TTSuperstripTable& table) const {
+    const unsigned nDCBits   = po_.nDCBits;
+    const unsigned nssCoarse = dcNsuperstrips(arbiters_.at(itower) -> nsuperstripsPerLayer(), nDCBits);
+    const AssociativeMemory& associativeMemory = associativeMemories_.at(itower);
 
+    // _________________________________________________________________________
+    // Start pattern recognition
+    hitBuffer.reset();
 
-        // _____________________________________________________________________
-        // Start pattern recognition
-        hitBuffer_.reset();
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            bool isNotInTower = stubsNotInTower.at(istub);
-            if (isNotInTower)
-                continue;
-            if ((removeOverlap_) && stubsInOverlapping.at(istub))
-                continue;
-
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            float    strip    = reader.vb_coordx  ->at(istub);  // in full-strip unit
-            float    segment  = reader.vb_coordy  ->at(istub);  // in full-strip unit
-
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-            float    stub_ds  = reader.vb_trigBend->at(istub);  // in full-strip unit
-
-            // Find superstrip ID
-            unsigned ssId = 0;
-            if (!arbiter_ -> useGlobalCoord()) {  // local coordinates
-                ssId = arbiter_ -> superstripLocal(moduleId, strip, segment);
-
-            } else {                              // global coordinates
-                ssId = arbiter_ -> superstripGlobal(moduleId, stub_r, stub_phi, stub_z, stub_ds);
-            }
+    // Push into hit buffer
+    for (std::vector<std::pair<unsigned, unsigned> >::const_iterator it = superstripHits.begin();
+         it != superstripHits.end(); ++it) {
+        hitBuffer.insert(it->first, it->second);
+    }
 
-            unsigned lay16    = compressLayer(decodeLayer(moduleId));
-            unsigned ssIdHash = simpleHash(lay16, nss, ssId);
+    hitBuffer.freeze(po_.maxStubs);
 
-            // Push into hit buffer
-            hitBuffer_.insert(ssIdHash, istub);
+    // _________________________________________________________________________
+    // Perform associative memory lookup
+    const std::vector<unsigned>& firedPatterns = associativeMemory.lookup(hitBuffer, po_.nLayers, po_.maxMisses, workspace);
 
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << strip << " segment: " << segment << " r: " << stub_r << " phi: " << stub_phi << " z: " << stub_z << " ds: " << stub_ds << std::endl;
-                std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << " ssIdHash: " << ssIdHash << std::endl;
-            }
-        }
 
-        hitBuffer_.freeze(po_.maxStubs);
+    // _________________________________________________________________________
+    // Create roads
+    roads.clear();
+    table.clear();
+    tableIndex.reset();
+
+    // Collect stubs. The stubs of a superstrip are copied from the hit buffer
+    // into the superstrip table by the first road that has it, the other roads
+    // refer to the same entry
+    for (std::vector<unsigned>::const_iterator it = firedPatterns.begin(); it != firedPatterns.end(); ++it) {
+        // Create and set TTRoad
+        TTRoad aroad;
+        aroad.patternRef   = (*it);
+        aroad.tower        = towers_.at(itower);
+        aroad.nstubs       = 0;
+        aroad.patternInvPt = 0.;
+
+        // Retrieve the superstripIds and other attributes
+        pattern_type pattHash;
+        pattern_bit_type pattBits;
+        if (nDCBits > 0)
+            associativeMemory.retrieve(aroad.patternRef, pattHash, pattBits, aroad.patternInvPt);
+        else
+            associativeMemory.retrieve(aroad.patternRef, pattHash, aroad.patternInvPt);
+
+        aroad.superstripRefs.resize(po_.nLayers);
 
-        // _____________________________________________________________________
-        // Perform associative memory lookup
-        const std::vector<unsigned>& firedPatterns = associativeMemory_.lookup(hitBuffer_, po_.nLayers, po_.maxMisses);
+        for (unsigned layer=0; layer<po_.nLayers; ++layer) {
+            unsigned ref = SuperstripTableIndex::NONE;
+
+            if (nDCBits > 0) {
+                // Refine the coarse superstrip with the low bits that are hit and
+                // accepted by the DC bits, and collect their stubs
+                const unsigned ssIdHashCoarse = pattHash.at(layer);
+                const superstrip_bit_type dcBits = pattBits.at(layer);
+
+                unsigned lowBitsHit = 0;
+                for (unsigned lowBits=0; lowBits<(1u << nDCBits); ++lowBits) {
+                    const unsigned ssIdHash = (ssIdHashCoarse << nDCBits) | lowBits;
+                    if (matchDCBits(dcBits, lowBits) && hitBuffer.isHit(ssIdHash))
+                        lowBitsHit |= (1u << lowBits);
+                }
 
+                // The stubs only depend on the low bits that are hit. If no hit,
+                // the superstrip is the first accepted one
+                const unsigned key = lowBitsHit ? lowBitsHit : (0x10000 | (dcBits & 0xff));
 
-        // _____________________________________________________________________
-        // Create roads
-        roads.clear();
+                ref = tableIndex.find(ssIdHashCoarse, key);
+                if (ref == SuperstripTableIndex::NONE) {
+                    const unsigned ssIdCoarse = simpleHashUndo(layer, nssCoarse, ssIdHashCoarse);
+                    unsigned ssId = (ssIdCoarse << nDCBits) | (dcBits & 0xff);
+
+                    const unsigned begin = table.stubRefs.size();
+                    bool found = false;
+                    for (unsigned lowBits=0; lowBits<(1u << nDCBits); ++lowBits) {
+                        if (!(lowBitsHit & (1u << lowBits)))
+                            continue;
 
-        // Collect stubs
-        for (std::vector<unsigned>::const_iterator it = firedPatterns.begin(); it != firedPatterns.end(); ++it) {
-            // Create and set TTRoad
-            TTRoad aroad;
-            aroad.patternRef   = (*it);
-            aroad.tower        = po_.tower;
-            aroad.nstubs       = 0;
-            aroad.patternInvPt = 0.;
+                        if (!found)
+                            ssId = (ssIdCoarse << nDCBits) | lowBits;
+                        found = true;
 
-            // Retrieve the superstripIds and other attributes
-            pattern_type pattHash;
-            associativeMemory_.retrieve(aroad.patternRef, pattHash, aroad.patternInvPt);
+                        const StubRefSpan stubRefs = hitBuffer.getHits((ssIdHashCoarse << nDCBits) | lowBits);
+                        table.stubRefs.insert(table.stubRefs.end(), stubRefs.begin(), stubRefs.end());
+                    }
 
-            aroad.superstripIds.clear();
-            aroad.stubRefs.clear();
+                    if (table.stubRefs.size() - begin > (unsigned) po_.maxStubs)
+                        table.stubRefs.resize(begin + po_.maxStubs);
 
-            aroad.superstripIds.resize(po_.nLayers);
-            aroad.stubRefs.resize(po_.nLayers);
+                    ref = table.add(ssId);
+                    tableIndex.insert(ssIdHashCoarse, key, ref);
+                }
 
-            for (unsigned layer=0; layer<po_.nLayers; ++layer) {
+            } else {
                 const unsigned ssIdHash = pattHash.at(layer);
-                const unsigned ssId     = simpleHashUndo(layer, nss, ssIdHash);
 
-                if (hitBuffer_.isHit(ssIdHash)) {
-                    const std::vector<unsigned>& stubRefs = hitBuffer_.getHits(ssIdHash);
-                    aroad.superstripIds.at(layer) = ssId;
-                    aroad.stubRefs     .at(layer) = stubRefs;
-                    aroad.nstubs                 += stubRefs.size();
+                ref = tableIndex.find(ssIdHash, 0);
+                if (ref == SuperstripTableIndex::NONE) {
+                    const unsigned ssId = simpleHashUndo(layer, nssCoarse, ssIdHash);
+
+                    if (hitBuffer.isHit(ssIdHash)) {
+                        const StubRefSpan stubRefs = hitBuffer.getHits(ssIdHash);
+                        table.stubRefs.insert(table.stubRefs.end(), stubRefs.begin(), stubRefs.end());
+                    }
 
-                } else {
-                    aroad.superstripIds.at(layer) = ssId;
+                    ref = table.add(ssId);
+                    tableIndex.insert(ssIdHash, 0, ref);
                 }
             }
 
-            roads.push_back(aroad);  // save aroad
+            aroad.superstripRefs.at(layer) = ref;
+            aroad.nstubs                  += table.nstubs(ref);
+        }
+
+        roads.push_back(aroad);  // save aroad
+
+        if (verbose_>2)  std::cout << Debug() << "... ... road: " << roads.size() - 1 << " " << aroad << std::endl;
+
+        if (roads.size() >= (unsigned) po_.maxRoads)
+            break;
+    }
+}
+
+// _____________________________________________________________________________
+int PatternMatcher::makeRoads(TString src, TString out, TrackFitter* fitter) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and matching patterns." << std::endl;
+
+    const unsigned ntowers = towers_.size();
+
+    // _________________________________________________________________________
+    // Get the trigger towers of each module, as a bitmask of trigger tower indices
+    // indexed by the dense module index
+    const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
+    assert(ntowers <= 64);
+
+    std::vector<uint64_t> moduleTowers(moduleIndex.size(), 0);
+    for (unsigned imodule=0; imodule<moduleIndex.size(); ++imodule) {
+        for (unsigned itower=0; itower<ntowers; ++itower) {
+            if (moduleIndex.isInTower(imodule, towers_.at(itower)))
+                moduleTowers.at(imodule) |= (uint64_t(1) << itower);
+        }
+    }
+
+
+    // _________________________________________________________________________
+    // For reading
+    TTStubPlusTPReader reader(verbose_);
+    if (reader.init(src) || reader.enableReadAhead(po_.readAhead)) {
+        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+        return 1;
+    }
+
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
+    // For writing, with one set of road branches per trigger tower when there are several
+    std::vector<TString> suffixes;
+    if (ntowers == 1) {
+        suffixes.push_back(suffix_);
+    } else {
+        for (unsigned itower=0; itower<ntowers; ++itower)
+            suffixes.push_back(suffix_ + Form("_tt%u", towers_.at(itower)));
+    }
+
+    // The road file is optional when the roads are fitted in memory
+    const bool writeRoads = (fitter == 0 || out != "");
+
+    TTRoadWriter writer(verbose_);
+    if (writeRoads && writer.init(reader.getChain(), out, prefixRoad_, suffixes, po_.flatRoads, po_.dedupRoads)) {
+        std::cout << Error() << "Failed to initialize TTRoadWriter." << std::endl;
+        return 1;
+    }
+
+    if (fitter && fitter->beginFit(reader.getChain(), po_.output))
+        return 1;
+
+
+    // _________________________________________________________________________
+    // Loop over all events
+
+    // With more than one thread, a batch of events is read and put aside, the
+    // batch is processed by the worker threads, then the events are written in
+    // the original order
+    const unsigned nThreads  = po_.nThreads;
+    const unsigned batchSize = (nThreads > 1) ? nThreads * EVENTS_PER_THREAD : 1;
+
+    // Containers
+    std::vector<MatcherEvent> events(batchSize);
+    for (unsigned i=0; i<batchSize; ++i) {
+        events.at(i).superstripHits.resize(ntowers);
+        events.at(i).roads.resize(ntowers);
+        events.at(i).superstrips.resize(ntowers);
+        for (unsigned itower=0; itower<ntowers; ++itower)
+            events.at(i).roads.at(itower).reserve(300);
+    }
+
+    // Each worker thread has its own hit buffers and lookup workspaces
+    std::vector<std::vector<HitBuffer> > hitBuffers(nThreads, hitBuffers_);
+    std::vector<std::vector<AssociativeMemoryWorkspace> > workspaces(nThreads, std::vector<AssociativeMemoryWorkspace>(ntowers));
+    std::vector<std::vector<SuperstripTableIndex> > tableIndices(nThreads, std::vector<SuperstripTableIndex>(ntowers));
+
+    // Do pattern recognition in every trigger tower of an event
+    auto matchTowers = [&](MatcherEvent& evt, unsigned ithread) {
+        if (!evt.nstubs)  // skip if no stub
+            return;
+        for (unsigned itower=0; itower<ntowers; ++itower) {
+            matchEvent(itower, evt.superstripHits.at(itower), hitBuffers.at(ithread).at(itower), workspaces.at(ithread).at(itower),
+                       tableIndices.at(ithread).at(itower), evt.roads.at(itower), evt.superstrips.at(itower));
+        }
+    };
+
+    // Bookkeepers
+    long int nRead = 0, nKept = 0;
+
+    long long ievt = firstEvent_;
+    bool endOfInput = false;
 
-            if (verbose_>2)  std::cout << Debug() << "... ... road: " << roads.size() - 1 << " " << aroad << std::endl;
+    while (!endOfInput && ievt < firstEvent_+nEvents_) {
+        // _____________________________________________________________________
+        // Read a batch of events
+        unsigned nBatch = 0;
 
-            if (roads.size() >= (unsigned) po_.maxRoads)
+        for (; nBatch<batchSize && ievt<firstEvent_+nEvents_; ++nBatch, ++ievt) {
+            if (reader.loadTree(ievt) < 0) {
+                endOfInput = true;
                 break;
+            }
+            reader.getEntry(ievt);
+
+            const unsigned nstubs = reader.vb_modId->size();
+            if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, triggering: %7ld", ievt, nKept) << std::endl;
+            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
+
+            if (nstubs > 500000) {
+                std::cout << Error() << "Way too many stubs: " << nstubs << std::endl;
+                return 1;
+            }
+
+            MatcherEvent& evt = events.at(nBatch);
+            evt.nstubs = nstubs;
+            for (unsigned itower=0; itower<ntowers; ++itower) {
+                evt.superstripHits.at(itower).clear();
+                evt.roads.at(itower).clear();
+                evt.superstrips.at(itower).clear();
+            }
+
+            if (nstubs)  // skip if no stub
+                prepareEvent(reader, ievt, moduleTowers, evt.superstripHits);
+
+            if (batchSize > 1)
+                reader.swapEventBuffers(evt.buffers);
         }
 
-        if (! roads.empty())
-            ++nKept;
+        // _____________________________________________________________________
+        // Do pattern recognition
+        if (nThreads == 1 || nBatch <= 1) {
+            for (unsigned i=0; i<nBatch; ++i)
+                matchTowers(events.at(i), 0);
+
+        } else {
+            std::atomic<unsigned> nextEvent(0);
+            std::vector<std::thread> workers;
+
+            for (unsigned ithread=0; ithread<std::min(nThreads, nBatch); ++ithread) {
+                workers.push_back(std::thread([&, ithread]() {
+                    for (unsigned i=nextEvent++; i<nBatch; i=nextEvent++)
+                        matchTowers(events.at(i), ithread);
+                }));
+            }
+
+            for (unsigned ithread=0; ithread<workers.size(); ++ithread)
+                workers.at(ithread).join();
+        }
+
+        // _____________________________________________________________________
+        // Write the batch of events in order
+        for (unsigned i=0; i<nBatch; ++i) {
+            MatcherEvent& evt = events.at(i);
+
+            if (batchSize > 1)
+                reader.swapEventBuffers(evt.buffers);
 
-        writer.fill(roads);
-        ++nRead;
+            for (unsigned itower=0; itower<ntowers; ++itower) {
+                if (! evt.roads.at(itower).empty()) {
+                    ++nKept;
+                    break;
+                }
+            }
+
+            if (writeRoads)
+                writer.fill(evt.roads, evt.superstrips);
+            if (fitter)
+                fitter->fitRoads(reader, nRead, evt.roads, evt.superstrips);
+            ++nRead;
+        }
     }
 
     if (nRead == 0) {
@@ -332,8 +687,13 @@ int PatternMatcher::makeRoads(TString src, TString out) {
 
     if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
 
-    long long nentries = writer.writeTree();
-    assert(nentries == nRead);
+    if (fitter && fitter->endFit())
+        return 1;
+
+    if (writeRoads) {
+        long long nentries = writer.writeTree();
+        assert(nentries == nRead);
+    }
 
     return 0;
 }
@@ -345,8 +705,10 @@ int PatternMatcher::run() {
     int exitcode = 0;
     Timing(1);
 
-    exitcode = loadPatterns(po_.bankfile);
-    if (exitcode)  return exitcode;
+    for (unsigned itower=0; itower<towers_.size(); ++itower) {
+        exitcode = loadPatterns(itower, bankfiles_.at(itower));
+        if (exitcode)  return exitcode;
+    }
     Timing();
 
     exitcode = makeRoads(po_.input, po_.output);
@@ -355,3 +717,20 @@ int PatternMatcher::run() {
 
     return exitcode;
 }
+
+int PatternMatcher::run(TrackFitter& fitter) {
+    int exitcode = 0;
+    Timing(1);
+
+    for (unsigned itower=0; itower<towers_.size(); ++itower) {
+        exitcode = loadPatterns(itower, bankfiles_.at(itower));
+        if (exitcode)  return exitcode;
+    }
+    Timing();
+
+    exitcode = makeRoads(po_.input, po_.roadfile, &fitter);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    return exitcode;
+}
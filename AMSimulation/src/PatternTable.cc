@@ -0,0 +1,107 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternTable.h"
+using namespace slhcl1tt;
+
+#include <cassert>
+
+
+// _____________________________________________________________________________
+uint64_t PatternTable::hash(const pattern_type& patt, uint64_t seed) {
+    // Mix two superstrips at a time, with the MurmurHash3 finalizer at the end
+    const unsigned n = patt.size();
+    uint64_t h = seed;
+    for (unsigned i=0; i+1<n; i+=2) {
+        h ^= (uint64_t(patt[i]) << 32) | patt[i+1];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    if (n % 2 != 0) {  // odd number of superstrips
+        h ^= uint64_t(patt[n-1]) << 32;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// _____________________________________________________________________________
+PatternRecord& PatternTable::insert(const pattern_type& patt, bool& inserted) {
+    // Keep the load factor below 0.7
+    if ((size_ + 1) * 10 > slots_.size() * 7)
+        rehash(slots_.empty() ? 1024 : slots_.size() * 2);
+
+    const uint64_t h    = hash(patt);
+    const uint32_t tag  = h >> 32;
+    const size_t   mask = slots_.size() - 1;
+
+    for (size_t islot = h & mask; ; islot = (islot + 1) & mask) {
+        Slot& slot = slots_[islot];
+
+        if (slot.ref == 0) {  // not found, create the record
+            size_t ichunk, ioffset;
+            locate(size_, ichunk, ioffset);
+            if (ioffset == 0) {
+                chunks_.push_back(std::vector<PatternRecord>());
+                chunks_.back().reserve(chunkSize(ichunk));
+            }
+
+            PatternRecord rec = PatternRecord();
+            rec.patt = patt;
+            rec.bits.fill(0);
+            chunks_.back().push_back(rec);
+
+            slot.ref = ++size_;
+            slot.tag = tag;
+            inserted = true;
+            return chunks_.back().back();
+        }
+
+        if (slot.tag == tag) {
+            PatternRecord& rec = at(slot.ref - 1);
+            if (rec.patt == patt) {
+                inserted = false;
+                return rec;
+            }
+        }
+    }
+}
+
+// _____________________________________________________________________________
+void PatternTable::rehash(size_t nslots) {
+    assert((nslots & (nslots - 1)) == 0);  // power of 2
+
+    std::vector<Slot> slots(nslots);
+    const size_t mask = nslots - 1;
+
+    for (size_t i=0; i<slots_.size(); ++i) {
+        const Slot& slot = slots_[i];
+        if (slot.ref == 0)
+            continue;
+
+        const uint64_t h = hash(at(slot.ref - 1).patt);
+        size_t islot = h & mask;
+        while (slots[islot].ref != 0)
+            islot = (islot + 1) & mask;
+        slots[islot] = slot;
+    }
+    slots_.swap(slots);
+}
+
+// _____________________________________________________________________________
+size_t PatternTable::memoryUsage() const {
+    size_t bytes = slots_.capacity() * sizeof(Slot);
+    for (size_t ichunk=0; ichunk<chunks_.size(); ++ichunk)
+        bytes += chunks_[ichunk].capacity() * sizeof(PatternRecord);
+    return bytes;
+}
+
+void PatternTable::clear() {
+    std::vector<Slot> slotsEmpty;
+    slots_.swap(slotsEmpty);
+
+    std::vector<std::vector<PatternRecord> > chunksEmpty;
+    chunks_.swap(chunksEmpty);
+
+    size_ = 0;
+}
@@ -1,7 +1,11 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 
+#include <algorithm>
+#include <cassert>
+#include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
 
 
 namespace slhcl1tt {
@@ -18,6 +22,7 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
       << "  input: "        << po.input
       << "  output: "       << po.output
       << "  bankfile: "     << po.bankfile
+      << "  bankfiles: "    << po.bankfiles
       << "  matrixfile: "   << po.matrixfile
       << "  roadfile: "     << po.roadfile
       << "  trackfile: "    << po.trackfile
@@ -25,12 +30,19 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
       << "  verbose: "      << po.verbose
       << "  speedup: "      << po.speedup
       << "  maxEvents: "    << po.maxEvents
+      << "  firstEvent: "   << po.firstEvent
+      << "  iShard: "       << po.iShard
+      << "  nShards: "      << po.nShards
+      << "  merge: "        << po.merge
+      << "  nThreads: "     << po.nThreads
+      << "  readAhead: "    << po.readAhead
 
       << "  nLayers: "      << po.nLayers
       << "  nFakers: "      << po.nFakers
       << "  nDCBits: "      << po.nDCBits
 
       << "  tower: "        << po.tower
+      << "  towers: "       << po.towers
       << "  superstrip: "   << po.superstrip
       << "  algo: "         << po.algo
 
@@ -47,10 +59,17 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
 
       << "  picky: "        << po.picky
       << "  minFrequency: " << po.minFrequency
+      << "  maxMemory: "    << po.maxMemory
+      << "  targetCoverage: " << po.targetCoverage
+      << "  coverageWindow: " << po.coverageWindow
+      << "  stableWindows: "  << po.stableWindows
       << "  maxPatterns: "  << po.maxPatterns
       << "  maxMisses: "    << po.maxMisses
       << "  maxStubs: "     << po.maxStubs
       << "  maxRoads: "     << po.maxRoads
+      << "  lookup: "       << po.lookup
+      << "  flatRoads: "    << po.flatRoads
+      << "  dedupRoads: "   << po.dedupRoads
 
       << "  view: "         << po.view
       << "  hitBits: "      << po.hitBits
@@ -59,6 +78,7 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
       << "  minNdof: "      << po.minNdof
       << "  maxCombs: "     << po.maxCombs
       << "  maxTracks: "    << po.maxTracks
+      << "  batchFit: "     << po.batchFit
 
       << "  oldCB: "        << po.oldCB
       << "  FiveOfSix: "    << po.FiveOfSix
@@ -72,4 +92,40 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
     return o;
 }
 
+void getEventRange(const ProgramOption& po, long long nentries, long long& firstEvent, long long& nEvents) {
+    const long long begin = std::max(0LL, po.firstEvent);
+    const long long count = std::min(po.maxEvents, std::numeric_limits<long long>::max() - begin);
+
+    if (po.nShards <= 1) {
+        firstEvent = begin;
+        nEvents    = count;
+        return;
+    }
+
+    // Each shard gets a contiguous range, the ranges of all the shards cover
+    // the same events as a single shard
+    assert(nentries >= 0 && po.iShard < po.nShards);
+    const long long end   = std::min(nentries, begin + count);
+    const long long total = std::max(0LL, end - begin);
+    firstEvent = begin + total * po.iShard / po.nShards;
+    nEvents    = begin + total * (po.iShard + 1) / po.nShards - firstEvent;
+}
+
+int getInputFiles(const std::string& src, std::vector<std::string>& files) {
+    std::ifstream infile(src.c_str());
+    if (!infile)
+        return 1;
+
+    files.clear();
+    std::string line;
+    while (std::getline(infile, line)) {
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line.at(begin) == '#')
+            continue;
+        const size_t end = line.find_last_not_of(" \t\r");
+        files.push_back(line.substr(begin, end - begin + 1));
+    }
+    return 0;
+}
+
 }
@@ -18,12 +18,33 @@
 Statistics::Statistics()
 : n_(0),
   mean_(0.),
-  variance_(0.) {}
+  m2_(0.) {}
+
+Statistics::Statistics(long int n, double mean, double sigma)
+: n_(n > 0 ? n : 0),
+  mean_(n > 0 ? mean : 0.),
+  m2_(n > 1 ? sigma * sigma * (n - 1) : 0.) {}
 
 void Statistics::fill(double x) {
     ++ n_;
-    mean_ += (x - mean_)/n_;
-    if (n_ > 1)  variance_ += (x - mean_)*(x - mean_)/(n_-1) - variance_/n_;
+    const double delta = x - mean_;
+    mean_ += delta/n_;
+    m2_ += delta*(x - mean_);
+}
+
+void Statistics::merge(const Statistics& other) {
+    if (other.n_ == 0)  return;
+    if (n_ == 0) {
+        *this = other;
+        return;
+    }
+
+    // Combine the sums of squared deviations
+    const long int n = n_ + other.n_;
+    const double delta = other.mean_ - mean_;
+    m2_ += other.m2_ + delta * delta * n_ * other.n_ / n;
+    mean_ += delta * other.n_ / n;
+    n_ = n;
 }
 
 long int Statistics::getEntries() const {
@@ -35,11 +56,11 @@ double Statistics::getMean() const {
 };
 
 double Statistics::getVariance() const {
-    return variance_;
+    return (n_ > 1) ? m2_/(n_-1) : 0.;
 };
 
 double Statistics::getSigma() const {
-    return std::sqrt(variance_);
+    return std::sqrt(getVariance());
 };
 
 
@@ -0,0 +1,67 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/StubCacheConverter.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubReader.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+
+
+// _____________________________________________________________________________
+int StubCacheConverter::convertStubs(TString src, TString out) {
+    if (verbose_)  std::cout << Info() << "Converting stubs " << src << " into " << out << std::endl;
+
+    // _________________________________________________________________________
+    // For reading
+    TTStubReader reader(verbose_);
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
+        std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
+        return 1;
+    }
+
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
+    // _________________________________________________________________________
+    // For writing
+    StubCacheWriter writer(verbose_);
+    if (writer.init(out)) {
+        std::cout << Error() << "Failed to initialize StubCacheWriter." << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // Loop over all events
+
+    long long ievt = firstEvent_;
+    for (; ievt<firstEvent_+nEvents_; ++ievt) {
+        if (reader.loadTree(ievt) < 0)  break;
+        reader.getEntry(ievt);
+
+        writer.fill(reader);
+
+        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld", ievt) << std::endl;
+    }
+
+    long long nwritten = writer.writeFile();
+    if (nwritten != ievt - firstEvent_) {
+        std::cout << Error() << "Failed to write " << out << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << "Successfully converted " << nwritten << " events." << std::endl;
+
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+// Main driver
+int StubCacheConverter::run() {
+    int exitcode = 0;
+    Timing(1);
+
+    exitcode = convertStubs(po_.input, po_.output);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    return exitcode;
+}
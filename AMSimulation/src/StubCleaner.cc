@@ -62,11 +62,15 @@ int StubCleaner::cleanStubs(TString src, TString out) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
-    if (reader.init(src, false)) {
+    if (reader.init(src, false) || reader.enableReadAhead(po_.readAhead)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
     }
 
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
+
     // For writing
     TTStubWriter writer(verbose_);
     if (writer.init(reader.getChain(), out)) {
@@ -91,7 +95,7 @@ int StubCleaner::cleanStubs(TString src, TString out) {
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=firstEvent_; ievt<firstEvent_+nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
@@ -167,24 +171,24 @@ int StubCleaner::cleanStubs(TString src, TString out) {
             if (removeOverlap_) {
             	float    stub_coordx = reader.vb_coordx->at(istub);
             	float    stub_coordy = reader.vb_coordy->at(istub);
-            	std::map<unsigned,ModuleOverlap>::iterator it_mo = momap_->moduleOverlap_map_.find(moduleId);
-            	if (it_mo != momap_->moduleOverlap_map_.end()) {
-            		float minx = it_mo->second.x1;
+            	const ModuleOverlap* it_mo = momap_->find(moduleId);
+            	if (it_mo) {
+            		float minx = it_mo->x1;
             		if (stub_coordx < minx) {
             			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t" << moduleId << "\t x1: " <<  stub_coordx << std::endl;
             			continue;
             		}
-            		float maxx = it_mo->second.x2;
+            		float maxx = it_mo->x2;
             		if (stub_coordx > maxx) {
             			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t x2: " <<  stub_coordx << std::endl;
             			continue;
             		}
-            		float miny = it_mo->second.y1;
+            		float miny = it_mo->y1;
             		if (stub_coordy < miny) {
             			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y1: " <<  stub_coordy << std::endl;
             			continue;
             		}
-            		float maxy = it_mo->second.y2;
+            		float maxy = it_mo->y2;
             		if (stub_coordy > maxy) {
             			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y2: " <<  stub_coordy << std::endl;
             			continue;
@@ -353,8 +357,8 @@ int StubCleaner::cleanStubs(TString src, TString out) {
 
     if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", nRead, nKept) << std::endl;
 
-    long long nentries = writer.writeTree();
-    assert(nentries == nRead);
+    long long nwritten = writer.writeTree();
+    assert(nwritten == nRead);
 
     return 0;
 }
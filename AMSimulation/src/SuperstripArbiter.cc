@@ -217,22 +217,13 @@ void SuperstripArbiter::setDefinition(TString definition, unsigned tt, const Tri
 
     // Learn about the trigger tower geometry
     if (!useGlobalCoord()) {
-        towerModules_.clear();
-        towerModules_.resize(16);
+        const ModuleIndex& moduleIndex = ttmap->getModuleIndex();
 
+        // Sanity check
         const std::vector<unsigned>& moduleIds = ttmap->getTriggerTowerModules(tt);
         for (unsigned i=0; i<moduleIds.size(); ++i) {
-            unsigned moduleId = moduleIds.at(i);
-            unsigned lay16    = compressLayer(decodeLayer(moduleId));
-            assert(lay16 < 16);
-
-            towerModules_.at(lay16).push_back(moduleId);
-        }
-
-        // Sanity check
-        for (std::vector<std::vector<unsigned> >::const_iterator it = towerModules_.begin();
-             it != towerModules_.end(); ++it) {
-            assert(towerModules_.size() < (1u << MODULE_NBITS));  // make sure number of bits is enough
+            unsigned moduleCode = moduleIndex.moduleCode(moduleIndex.index(moduleIds.at(i)), tt);
+            assert(moduleCode < (1u << MODULE_NBITS));  // make sure number of bits is enough
         }
 
     } else {
@@ -336,119 +327,69 @@ void SuperstripArbiter::setDefinition(TString definition, unsigned tt, const Tri
         break;
     }
 
-}
-
-// _____________________________________________________________________________
-unsigned SuperstripArbiter::superstripLocal(unsigned moduleId, float strip, float segment) const {
-    switch (sstype_) {
+    // Build the superstrip policy with the parameters of the definition
+    switch(sstype_) {
     case SuperstripType::FIXEDWIDTH:
-        return superstripFixedwidth(moduleId, strip, segment);
+        fixedwidth_ = FixedwidthSuperstrip(fixedwidth_bit_rshift1_, fixedwidth_bit_rshift2_,
+                                           fixedwidth_bit_lshift1_, fixedwidth_bit_lshift2_,
+                                           MAX_NSEGMENTS, &ttmap->getModuleIndex(), tt);
         break;
 
-    default:
-        throw std::logic_error("Incompatible superstrip type.");
-        break;
-    }
-}
-
-// _____________________________________________________________________________
-unsigned SuperstripArbiter::superstripGlobal(unsigned moduleId, float r, float phi, float z, float ds) const {
-    switch (sstype_) {
     case SuperstripType::PROJECTIVE:
-        return superstripProjective(moduleId, r, phi, z, ds);
+        binned_ = BinnedSuperstrip(phiMins_, zMins_, projective_phiBins_, projective_zBins_,
+                                   projective_max_nx_, projective_nz_);
         break;
 
     case SuperstripType::FOUNTAIN:
-        return superstripFountain(moduleId, r, phi, z, ds);
-        break;
-
     case SuperstripType::FOUNTAINOPT:
-        return superstripFountain(moduleId, r, phi, z, ds);
+        binned_ = BinnedSuperstrip(phiMins_, zMins_, fountain_phiBins_, fountain_zBins_,
+                                   fountain_max_nx_, fountain_nz_);
         break;
 
     default:
-        throw std::logic_error("Incompatible superstrip type.");
         break;
     }
 }
 
 // _____________________________________________________________________________
-unsigned SuperstripArbiter::compressModuleId(unsigned moduleId) const {
-    unsigned lay16    = compressLayer(decodeLayer(moduleId));
-    //assert(lay16 < 16);
-
-    std::vector<unsigned>::const_iterator found = std::lower_bound(towerModules_.at(lay16).begin(), towerModules_.at(lay16).end(), moduleId);
-    if (found == towerModules_.at(lay16).end() || *found != moduleId)
-        throw std::logic_error("Unexpected module ID.");
+unsigned SuperstripArbiter::superstripLocal(unsigned moduleId, float strip, float segment) const {
+    if (sstype_ != SuperstripType::FIXEDWIDTH)
+        throw std::logic_error("Incompatible superstrip type.");
 
-    return found - towerModules_.at(lay16).begin();
+    return fixedwidth_.superstrip(moduleId, strip, segment, 0., 0., 0., 0.);
 }
 
-
 // _____________________________________________________________________________
-unsigned SuperstripArbiter::superstripFixedwidth(unsigned moduleId, float strip, float segment) const {
-    // The superstrip ID is an unsigned integer with 3 fields: moduleId|segment|strip
-    // The length of the 'strip' field is controlled by fixedwidth_bitshift1
-    // The length of the 'segment' field is controlled by (fixedwidth_bitshift2 - fixedwidth_bitshift1)
-
-    unsigned moduleCode = compressModuleId(moduleId);
-    strip    -= 0.25;  // round down the half int precision
-    segment  -= 0.25;  // round down the half int precision
-
-    // Use strip in the least significant field
-    unsigned ss = round_to_uint(strip) >> fixedwidth_bit_rshift1_;
-    //std::cout << strip+0.25 << " " << round_to_uint(strip) << " " << ss << std::endl;
-
-    // Use segment in the 2nd most sig field
-    if (isPSModule(moduleId))
-        ss |= ((round_to_uint(segment) >> fixedwidth_bit_rshift2_) << fixedwidth_bit_lshift1_);
-    else
-        ss |= (((round_to_uint(segment)*MAX_NSEGMENTS/2) >> fixedwidth_bit_rshift2_) << fixedwidth_bit_lshift1_);
-    //std::cout << segment+0.25 << " " << round_to_uint(segment) << " " << ss << std::endl;
-
-    // Use module ID in the most sig field
-    ss |= (moduleCode << (fixedwidth_bit_lshift1_ + fixedwidth_bit_lshift2_));
-    //std::cout << moduleId << " " << moduleCode << " " << ss << std::endl;
+unsigned SuperstripArbiter::superstripGlobal(unsigned moduleId, float r, float phi, float z, float ds) const {
+    if (!useGlobalCoord())
+        throw std::logic_error("Incompatible superstrip type.");
 
-    return ss;
+    return binned_.superstrip(moduleId, 0., 0., r, phi, z, ds);
 }
 
 // _____________________________________________________________________________
-unsigned SuperstripArbiter::superstripProjective(unsigned moduleId, float r, float phi, float z, float ds) const {
-    unsigned lay16    = compressLayer(decodeLayer(moduleId));
-
-    int n_phi = projective_max_nx_;
-    int n_z   = projective_nz_;
-
-    int i_phi = std::floor((phi - phiMins_.at(lay16)) / projective_phiBins_.at(lay16));
-    int i_z   = std::floor((z - zMins_.at(lay16)) / projective_zBins_.at(lay16));
-
-    i_phi     = (i_phi < 0) ? 0 : (i_phi >= n_phi) ? (n_phi - 1) : i_phi;  // proper range
-    i_z       = (i_z   < 0) ? 0 : (i_z   >= n_z  ) ? (n_z   - 1) : i_z;    // proper range
-
-    unsigned ss = i_z * n_phi + i_phi;
-    return ss;
+void SuperstripArbiter::superstrips(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments,
+                                    const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const {
+    if (!useGlobalCoord())
+        superstripsLocal(n, moduleIds, strips, segments, ssIds);
+    else
+        superstripsGlobal(n, moduleIds, rs, phis, zs, dss, ssIds);
 }
 
 // _____________________________________________________________________________
-unsigned SuperstripArbiter::superstripFountain(unsigned moduleId, float r, float phi, float z, float ds) const {
-    unsigned lay16    = compressLayer(decodeLayer(moduleId));
-
-    // For barrel, correct phi based on ds and dr
-    //if (lay16 < 6)
-    //    phi = phi + drCorrs_.at(lay16) * ds * (r - rMeans_.at(lay16));
-
-    int n_phi = fountain_max_nx_;
-    int n_z   = fountain_nz_;
+void SuperstripArbiter::superstripsLocal(unsigned n, const unsigned* moduleIds, const float* strips, const float* segments, unsigned* ssIds) const {
+    if (sstype_ != SuperstripType::FIXEDWIDTH)
+        throw std::logic_error("Incompatible superstrip type.");
 
-    int i_phi = std::floor((phi - phiMins_.at(lay16)) / fountain_phiBins_.at(lay16));
-    int i_z   = std::floor((z - zMins_.at(lay16)) / fountain_zBins_.at(lay16));
+    fixedwidth_.superstrips(n, moduleIds, strips, segments, 0, 0, 0, 0, ssIds);
+}
 
-    i_phi     = (i_phi < 0) ? 0 : (i_phi >= n_phi) ? (n_phi - 1) : i_phi;  // proper range
-    i_z       = (i_z   < 0) ? 0 : (i_z   >= n_z  ) ? (n_z   - 1) : i_z;    // proper range
+// _____________________________________________________________________________
+void SuperstripArbiter::superstripsGlobal(unsigned n, const unsigned* moduleIds, const float* rs, const float* phis, const float* zs, const float* dss, unsigned* ssIds) const {
+    if (!useGlobalCoord())
+        throw std::logic_error("Incompatible superstrip type.");
 
-    unsigned ss = i_z * n_phi + i_phi;
-    return ss;
+    binned_.superstrips(n, moduleIds, 0, 0, rs, phis, zs, dss, ssIds);
 }
 
 // _____________________________________________________________________________
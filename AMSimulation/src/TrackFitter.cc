@@ -2,9 +2,20 @@
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTRoadReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTTrackReader.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/WorkerPool.h"
+
+#include <algorithm>
+#include <unordered_map>
 
 
 namespace {
+// Number of events read at a time for each worker thread
+const unsigned EVENTS_PER_THREAD = 20;
+
+// Number of roads fitted by a task. The roads of a busier event are split
+// into several tasks
+const unsigned ROADS_PER_TASK = 50;
+
 unsigned getPtSegment(float invPt) {  // for PCA
     return (invPt - PCA_MIN_INVPT) / (PCA_MAX_INVPT - PCA_MIN_INVPT) * PCA_NSEGMENTS;
 }
@@ -28,6 +39,188 @@ unsigned getHitBits(const std::vector<bool>& stubs_bool) {
     }
 }
 
+// Roads read from a road file, in either layout. The tracks of a road file
+// belong to the trigger tower given in the options
+class RoadReaderSource {
+  public:
+    RoadReaderSource(const TTRoadReader& reader, unsigned tower) : reader_(reader), tower_(tower) {}
+
+    unsigned size()                   const { return reader_.vr_patternRef->size(); }
+    unsigned patternRef(unsigned i)   const { return reader_.vr_patternRef->at(i); }
+    unsigned tower(unsigned)          const { return tower_; }
+    float    patternInvPt(unsigned i) const { return reader_.vr_patternInvPt->at(i); }
+    unsigned nLayers(unsigned i)      const { return reader_.getNLayers(i); }
+
+    void getStubRefs(unsigned i, std::vector<std::vector<unsigned> >& stubRefs) const { reader_.getStubRefs(i, stubRefs); }
+
+  private:
+    const TTRoadReader& reader_;
+    const unsigned      tower_;
+};
+
+// Roads in memory, that refer to the superstrips in the table
+class RoadVectorSource {
+  public:
+    RoadVectorSource(const std::vector<TTRoad>& roads, const TTSuperstripTable& table)
+    : roads_(roads), table_(table) {}
+
+    unsigned size()                   const { return roads_.size(); }
+    unsigned patternRef(unsigned i)   const { return roads_.at(i).patternRef; }
+    unsigned tower(unsigned i)        const { return roads_.at(i).tower; }
+    float    patternInvPt(unsigned i) const { return roads_.at(i).patternInvPt; }
+    unsigned nLayers(unsigned i)      const { return roads_.at(i).superstripRefs.size(); }
+
+    void getStubRefs(unsigned i, std::vector<std::vector<unsigned> >& stubRefs) const {
+        const std::vector<unsigned>& superstripRefs = roads_.at(i).superstripRefs;
+        const TTSuperstripTable& table = table_;
+
+        stubRefs.resize(superstripRefs.size());
+        for (unsigned ilayer=0; ilayer<superstripRefs.size(); ++ilayer) {
+            const unsigned ref = superstripRefs.at(ilayer);
+            stubRefs[ilayer].assign(table.stubRefs.begin() + table.stubRefOffsets.at(ref),
+                                    table.stubRefs.begin() + table.stubRefOffsets.at(ref+1));
+        }
+    }
+
+  private:
+    const std::vector<TTRoad>& roads_;
+    const TTSuperstripTable&   table_;
+};
+
+// An event that is put aside while waiting for the track fitting. It keeps a
+// copy of the roads, and of the stubs and the tracking particles used by the
+// fit, with the names of TTStubPlusTPReader
+struct FitterEvent {
+    FitterEvent()
+    : vb_r(&r), vb_phi(&phi), vb_z(&z), vb_trigBend(&trigBend),
+      vp2_pt(&pt), vp2_eta(&eta), vp2_phi(&partPhi), vp2_vz(&vz),
+      vp2_charge(&charge), vp2_pdgId(&pdgId), vp2_primary(&primary) {}
+
+    // The pointers refer to the members of this event
+    FitterEvent(const FitterEvent&) = delete;
+    FitterEvent& operator=(const FitterEvent&) = delete;
+
+    // Copy what the fit reads from the current event of the reader, keeping
+    // the first maxRoads roads. As in RoadReaderSource, the roads get the
+    // trigger tower given in the options
+    void set(const TTRoadReader& reader, long long ievent, unsigned maxRoads, unsigned tower) {
+        ievt = ievent;
+        r = *reader.vb_r;  phi = *reader.vb_phi;  z = *reader.vb_z;  trigBend = *reader.vb_trigBend;
+        pt = *reader.vp2_pt;  eta = *reader.vp2_eta;  partPhi = *reader.vp2_phi;  vz = *reader.vp2_vz;
+        charge = *reader.vp2_charge;  pdgId = *reader.vp2_pdgId;  primary = *reader.vp2_primary;
+
+        // Every layer of every road gets its own entry in the superstrip table
+        const unsigned nroads = std::min((unsigned) reader.vr_patternRef->size(), maxRoads);
+        roads.resize(nroads);
+        table.clear();
+        for (unsigned iroad=0; iroad<nroads; ++iroad) {
+            TTRoad& road = roads.at(iroad);
+            road.patternRef   = reader.vr_patternRef->at(iroad);
+            road.tower        = tower;
+            road.nstubs       = reader.vr_nstubs->at(iroad);
+            road.patternInvPt = reader.vr_patternInvPt->at(iroad);
+
+            const unsigned nlayers = reader.getNLayers(iroad);
+            road.superstripRefs.resize(nlayers);
+            for (unsigned ilayer=0; ilayer<nlayers; ++ilayer) {
+                const unsigned nstubs = reader.getNStubs(iroad, ilayer);
+                for (unsigned istub=0; istub<nstubs; ++istub)
+                    table.stubRefs.push_back(reader.getStubRef(iroad, ilayer, istub));
+                road.superstripRefs.at(ilayer) = table.add(reader.getSuperstripId(iroad, ilayer));
+            }
+        }
+        tracks.clear();
+        triggered = false;
+    }
+
+    long long                   ievt;
+    std::vector<TTRoad>         roads;
+    TTSuperstripTable           table;
+    std::vector<TTTrack2>       tracks;
+    bool                        triggered;
+    BasicEventBuffers           buffers;
+
+    std::vector<float> r, phi, z, trigBend;
+    std::vector<float> pt, eta, partPhi, vz;
+    std::vector<int>   charge, pdgId;
+    std::vector<bool>  primary;
+
+    const std::vector<float> * vb_r;
+    const std::vector<float> * vb_phi;
+    const std::vector<float> * vb_z;
+    const std::vector<float> * vb_trigBend;
+    const std::vector<float> * vp2_pt;
+    const std::vector<float> * vp2_eta;
+    const std::vector<float> * vp2_phi;
+    const std::vector<float> * vp2_vz;
+    const std::vector<int> *   vp2_charge;
+    const std::vector<int> *   vp2_pdgId;
+    const std::vector<bool> *  vp2_primary;
+};
+
+// A range of roads of an event in the batch, fitted by one worker thread
+struct FitterTask {
+    unsigned              ievent;
+    unsigned              beginRoad;
+    unsigned              endRoad;
+    std::vector<TTTrack2> tracks;
+};
+
+// A batch of events. While the worker threads fit a batch, the next batch is
+// read and the previous one is written
+struct FitterBatch {
+    std::vector<FitterEvent>                     events;
+    unsigned                                     n;
+    std::vector<FitterTask>                      tasks;
+    std::vector<std::pair<unsigned, unsigned> >  eventTasks;  // range of the tasks of each event
+
+    explicit FitterBatch(unsigned batchSize)
+    : events(batchSize), n(0), eventTasks(batchSize) {
+        for (unsigned i=0; i<batchSize; ++i)
+            events.at(i).tracks.reserve(300);
+    }
+
+    // Split the roads of the events into tasks of up to ROADS_PER_TASK roads
+    void makeTasks() {
+        tasks.clear();
+        for (unsigned i=0; i<n; ++i) {
+            const unsigned nroads = events.at(i).roads.size();
+            eventTasks.at(i).first = tasks.size();
+            for (unsigned beginRoad=0; beginRoad<nroads; beginRoad+=ROADS_PER_TASK) {
+                tasks.resize(tasks.size() + 1);
+                FitterTask& task = tasks.back();
+                task.ievent    = i;
+                task.beginRoad = beginRoad;
+                task.endRoad   = std::min(beginRoad + ROADS_PER_TASK, nroads);
+                task.tracks.clear();
+            }
+            eventTasks.at(i).second = tasks.size();
+        }
+    }
+};
+
+// Key of a fit: the stubs of the combination and the selector of the PCA matrix.
+// It holds # stubs, ptSegment, hitBits and all the stubRefs, so that no
+// combination is ever mistaken for another, whatever its number of stubs
+typedef std::vector<unsigned> FitKey;
+
+void makeFitKey(const TTRoadComb& acomb, FitKey& key) {
+    key.clear();
+    key.push_back(acomb.stubRefs.size());
+    key.push_back(acomb.ptSegment);
+    key.push_back(acomb.hitBits);
+    key.insert(key.end(), acomb.stubRefs.begin(), acomb.stubRefs.end());
+}
+
+struct FitKeyHash {
+    std::size_t operator()(const FitKey& key) const {
+        std::size_t h = 0;
+        for (unsigned i=0; i<key.size(); ++i)
+            h = (h ^ key[i]) * 0x100000001b3ULL;  // FNV-1a on the words
+        return h;
+    }
+};
+
 // Comparator
 bool sortByPt(const TTTrack2& lhs, const TTTrack2& rhs) {
     return lhs.pt() > rhs.pt();
@@ -36,247 +229,471 @@ bool sortByPt(const TTTrack2& lhs, const TTTrack2& rhs) {
 
 
 // _____________________________________________________________________________
-// Do track fitting
-int TrackFitter::makeTracks(TString src, TString out) {
-    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and fitting tracks." << std::endl;
+TrackFitter::Worker::Worker(const ProgramOption& po)
+: combinationBuilderFactory(std::make_shared<CombinationBuilderFactory>(po.FiveOfSix)),
+  nFits(0), nFitsReused(0) {
+
+    // Decide the track fitter to use
+    fitter = 0;
+    if (po.batchFit && po.algo == "PCA4" && po.view == "XYZ") {
+        fitter = new TrackFitterAlgoPCAFixed<12, 4>(po);
+    } else if (po.batchFit && po.algo == "PCA5" && po.view == "XYZ") {
+        fitter = new TrackFitterAlgoPCAFixed<12, 5>(po);
+    } else if (po.algo == "PCA4" || po.algo == "PCA5") {
+        fitter = new TrackFitterAlgoPCA(po);
+    } else if (po.algo == "ATF4") {
+        fitter = new TrackFitterAlgoATF(false);
+    } else if (po.algo == "ATF5") {
+        fitter = new TrackFitterAlgoATF(true);
+    } else if (po.algo == "LTF") {
+        fitter = new TrackFitterAlgoLTF(po);
+    } else {
+        throw std::invalid_argument("unknown track fitter algo.");
+    }
+}
 
-    // _________________________________________________________________________
-    // For reading
-    TTRoadReader reader(verbose_);
+TrackFitter::Worker::~Worker() {
+    if (fitter)  delete fitter;
+}
 
-    if (reader.init(src, prefixRoad_, suffix_)) {
-        std::cout << Error() << "Failed to initialize TTRoadReader." << std::endl;
-        return 1;
-    }
+// _____________________________________________________________________________
+TrackFitter::~TrackFitter() {
+    for (unsigned ithread=0; ithread<workers_.size(); ++ithread)
+        delete workers_.at(ithread);
+    if (pipelineWriter_)  delete pipelineWriter_;
+}
 
-    // _________________________________________________________________________
-    // For writing
-    TTTrackWriter writer(verbose_);
-    if (writer.init(reader.getChain(), out, prefixTrack_, suffix_)) {
-        std::cout << Error() << "Failed to initialize TTTrackWriter." << std::endl;
-        return 1;
-    }
+// _____________________________________________________________________________
+// Get the next combination of the current road
+bool TrackFitter::nextCombination(Worker& worker, std::vector<unsigned>& combination) {
+    if (po_.oldCB)
+        return worker.combinationFactory.next(combination);
+    else if (po_.PDDS)
+        return worker.pairCombinationFactory.next(combination);
+    else
+        return worker.combinationBuilderFactory->next(combination);
+}
 
-    // _________________________________________________________________________
-    // Loop over all events
+// _____________________________________________________________________________
+// Fit the roads of one event
+template<typename StubSource, typename RoadSource>
+bool TrackFitter::fitEvent(Worker& worker, const StubSource& stubs, long long ievt, const RoadSource& roads,
+                           std::vector<TTTrack2>& tracks) {
+    tracks.clear();
+    fitRoadRange(worker, stubs, roads, 0, roads.size(), tracks);
+    return finishEvent(worker, stubs, ievt, tracks);
+}
 
-    // Containers
-    std::vector<TTTrack2> tracks;
-    tracks.reserve(300);
+// _____________________________________________________________________________
+// Fit a range of roads of one event
+template<typename StubSource, typename RoadSource>
+void TrackFitter::fitRoadRange(Worker& worker, const StubSource& stubs, const RoadSource& roads,
+                               unsigned beginRoad, unsigned endRoad, std::vector<TTTrack2>& tracks) {
+    std::vector<std::vector<unsigned> > stubRefs;
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+    // Combinations of a road and their tracks, fitted as a block
+    std::vector<TTRoadComb> acombs;
+    std::vector<TTTrack2> atracks;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+    // Fits of the range of roads, reused by the same combination in another road
+    std::unordered_map<FitKey, unsigned, FitKeyHash> fitCache;  // index in fitTracks
+    std::vector<TTTrack2> fitTracks;
+    std::vector<unsigned> fitIndices;  // index in fitTracks of each combination of a road
+    std::vector<bool> fitNew;          // whether each combination of a road is fitted now
+    std::vector<TTRoadComb> fitCombs;
+    FitKey key;
 
-        const unsigned nroads = reader.vr_patternRef->size();
-        if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, fitting: %7ld", ievt, nKept) << std::endl;
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # roads: " << nroads << std::endl;
 
-        if (!nroads) {  // skip if no road
-            writer.fill(std::vector<TTTrack2>());
-            ++nRead;
-            continue;
+    // _________________________________________________________________________
+    // Track fitters taking fit combinations
+
+    // Loop over the roads
+    for (unsigned iroad=beginRoad; iroad<endRoad; ++iroad) {
+        if (iroad >= (unsigned) po_.maxRoads)  break;
+
+        const unsigned patternRef = roads.patternRef(iroad);
+        if (patternRef >= (unsigned) po_.maxPatterns)  continue;
+
+        // Get combinations of stubRefs
+        roads.getStubRefs(iroad, stubRefs);
+	std::vector<std::vector<float> > stubDeltaS; //pass DeltaS information for each stub to the PDDS
+        for (unsigned ilayer=0; ilayer<stubRefs.size(); ++ilayer) {
+	    std::vector<float> placeholderTemp;
+	    stubDeltaS.push_back(placeholderTemp);
+	    if(po_.PDDS) for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(stubs.vb_trigBend->at(stubRefs[ilayer][istub]));
+	    else for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(0.); //default DDS is 0 to disable PDDS cleaning
+            if (stubRefs.at(ilayer).size() > (unsigned) po_.maxStubs){
+                stubRefs.at(ilayer).resize(po_.maxStubs);
+		stubDeltaS.at(ilayer).resize(po_.maxStubs);
+	    }
         }
+	
+	//choose either the normal combination building or the 5/6 permutations per 6/6 road in addition and/or pairwise Delta Delta S cleaning (PDDS)
+	//the combinations are made one at a time, only those that are fitted
+	if (po_.oldCB) worker.combinationFactory.begin(stubRefs);
+        else if(po_.PDDS) worker.pairCombinationFactory.begin(stubRefs, stubDeltaS, po_.FiveOfSix);
+	else worker.combinationBuilderFactory->begin(stubRefs);
+
+        // Loop over the combinations
+        unsigned ncombs = 0;
+        while (ncombs < (unsigned) po_.maxCombs) {
+            if (acombs.size() == ncombs)
+                acombs.resize(ncombs + 1);
+
+            // Get the next combination of stubRefs
+            TTRoadComb& acomb = acombs.at(ncombs);
+            if (!nextCombination(worker, acomb.stubRefs))
+                break;
+            assert(acomb.stubRefs.size() == roads.nLayers(iroad));
+
+            // Create and set TTRoadComb
+            const unsigned icomb = ncombs++;
+            acomb.roadRef    = iroad;
+            acomb.combRef    = icomb;
+            acomb.patternRef = patternRef;
+            acomb.ptSegment  = getPtSegment(roads.patternInvPt(iroad));
+
+            acomb.stubs_r   .clear();
+            acomb.stubs_phi .clear();
+            acomb.stubs_z   .clear();
+            acomb.stubs_bool.clear();
+
+            for (unsigned istub=0; istub<acomb.stubRefs.size(); ++istub) {
+                const unsigned stubRef = acomb.stubRefs.at(istub);
+                if (stubRef != CombinationFactory::BAD) {
+                    acomb.stubs_r   .push_back(stubs.vb_r   ->at(stubRef));
+                    acomb.stubs_phi .push_back(stubs.vb_phi ->at(stubRef));
+                    acomb.stubs_z   .push_back(stubs.vb_z   ->at(stubRef));
+                    acomb.stubs_bool.push_back(true);
+                } else {
+                    acomb.stubs_r   .push_back(0.);
+                    acomb.stubs_phi .push_back(0.);
+                    acomb.stubs_z   .push_back(0.);
+                    acomb.stubs_bool.push_back(false);
+                }
+            }
 
-        tracks.clear();
-        int fitstatus = 0;
+            acomb.hitBits = getHitBits(acomb.stubs_bool);
 
+            if (verbose_>2) {
+                std::cout << Debug() << "... ... ... comb: " << icomb << " " << acomb;
+                std::cout << std::endl;
+            }
+        }
+        acombs.resize(ncombs);
 
-        // _____________________________________________________________________
-        // Track fitters taking fit combinations
+        if (verbose_>2) {
+            std::cout << Debug() << "... ... road: " << iroad << " # combinations: " << ncombs << std::endl;
+        }
 
-        // Loop over the roads
-        for (unsigned iroad=0; iroad<nroads; ++iroad) {
-            if (iroad >= (unsigned) po_.maxRoads)  break;
-
-            const unsigned patternRef = reader.vr_patternRef->at(iroad);
-            if (patternRef >= (unsigned) po_.maxPatterns)  continue;
-
-            // Get combinations of stubRefs
-            std::vector<std::vector<unsigned> > stubRefs = reader.vr_stubRefs->at(iroad);
-	    std::vector<std::vector<float> > stubDeltaS; //pass DeltaS information for each stub to the PDDS
-            for (unsigned ilayer=0; ilayer<stubRefs.size(); ++ilayer) {
-	        std::vector<float> placeholderTemp;
-	        stubDeltaS.push_back(placeholderTemp);
-		if(po_.PDDS) for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(reader.vb_trigBend->at(stubRefs[ilayer][istub]));
-		else for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(0.); //default DDS is 0 to disable PDDS cleaning
-                if (stubRefs.at(ilayer).size() > (unsigned) po_.maxStubs){
-                    stubRefs.at(ilayer).resize(po_.maxStubs);
-		    stubDeltaS.at(ilayer).resize(po_.maxStubs);
-		}
+        // _____________________________________________________________________
+        // Fit the combinations not yet fitted in the event, the others reuse
+        // the earlier fits
+
+        fitIndices.resize(ncombs);
+        fitNew.assign(ncombs, false);
+        fitCombs.clear();
+        for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+            // Look the key up before inserting it, a key is only copied once
+            makeFitKey(acombs.at(icomb), key);
+            std::unordered_map<FitKey, unsigned, FitKeyHash>::const_iterator found = fitCache.find(key);
+
+            if (found != fitCache.end()) {
+                fitIndices.at(icomb) = found->second;
+
+            } else {  // not yet fitted
+                fitIndices.at(icomb) = fitTracks.size() + fitCombs.size();
+                fitCache.insert(std::make_pair(key, fitIndices.at(icomb)));
+                fitNew.at(icomb) = true;
+                fitCombs.resize(fitCombs.size() + 1);
+                std::swap(fitCombs.back(), acombs.at(icomb));
             }
-	    
-	    //choose either the normal combination building or the 5/6 permutations per 6/6 road in addition and/or pairwise Delta Delta S cleaning (PDDS)
-	    std::vector<std::vector<unsigned> > combinations;
-	    if (po_.oldCB) combinations = combinationFactory_.combine(stubRefs);
-            else if(po_.PDDS) combinations = pairCombinationFactory_.combine(stubRefs, stubDeltaS, po_.FiveOfSix);
-	    else combinations = combinationBuilderFactory_->combine(stubRefs);
+        }
 
-	    // std::cout << "combinations = " << combinations.size() << std::endl;
+        const int fitstatus = worker.fitter->fitBlock(fitCombs, atracks);
+        fitTracks.insert(fitTracks.end(), atracks.begin(), atracks.end());
 
-            for (unsigned icomb=0; icomb<combinations.size(); ++icomb)
-                assert(combinations.at(icomb).size() == reader.vr_stubRefs->at(iroad).size());
+        // Put the fitted combinations back
+        for (unsigned icomb=0, jcomb=0; icomb<ncombs; ++icomb) {
+            if (fitNew.at(icomb))
+                std::swap(fitCombs.at(jcomb++), acombs.at(icomb));
+        }
 
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... road: " << iroad << " # combinations: " << combinations.size() << std::endl;
-            }
+        worker.nFits += fitCombs.size();
+        worker.nFitsReused += ncombs - fitCombs.size();
 
-            // Loop over the combinations
-            for (unsigned icomb=0; icomb<combinations.size(); ++icomb) {
-                if (icomb >= (unsigned) po_.maxCombs)  break;
-
-                // Create and set TTRoadComb
-                TTRoadComb acomb;
-                acomb.roadRef    = iroad;
-                acomb.combRef    = icomb;
-                acomb.patternRef = patternRef;
-                acomb.ptSegment  = getPtSegment(reader.vr_patternInvPt->at(iroad));
-                acomb.stubRefs   = combinations.at(icomb);
-
-                acomb.stubs_r   .clear();
-                acomb.stubs_phi .clear();
-                acomb.stubs_z   .clear();
-                acomb.stubs_bool.clear();
-
-                for (unsigned istub=0; istub<acomb.stubRefs.size(); ++istub) {
-                    const unsigned stubRef = acomb.stubRefs.at(istub);
-                    if (stubRef != CombinationFactory::BAD) {
-                        acomb.stubs_r   .push_back(reader.vb_r   ->at(stubRef));
-                        acomb.stubs_phi .push_back(reader.vb_phi ->at(stubRef));
-                        acomb.stubs_z   .push_back(reader.vb_z   ->at(stubRef));
-                        acomb.stubs_bool.push_back(true);
-                    } else {
-                        acomb.stubs_r   .push_back(0.);
-                        acomb.stubs_phi .push_back(0.);
-                        acomb.stubs_z   .push_back(0.);
-                        acomb.stubs_bool.push_back(false);
-                    }
-                }
+        for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+            const TTRoadComb& acomb = acombs.at(icomb);
+            TTTrack2 atrack = fitTracks.at(fitIndices.at(icomb));
 
-                acomb.hitBits = getHitBits(acomb.stubs_bool);
+            atrack.setTower     (roads.tower(iroad));
+            atrack.setRoadRef   (acomb.roadRef);
+            atrack.setCombRef   (acomb.combRef);
+            atrack.setPatternRef(acomb.patternRef);
+            atrack.setPtSegment (acomb.ptSegment);
+            atrack.setHitBits   (acomb.hitBits);
+            atrack.setStubRefs  (acomb.stubRefs);
 
-                if (verbose_>2) {
-                    std::cout << Debug() << "... ... ... comb: " << icomb << " " << acomb;
-                    std::cout << std::endl;
-                }
+            if (atrack.chi2Red() < po_.maxChi2)  // reduced chi^2 = chi^2 / ndof
+                tracks.push_back(atrack);
 
-                // _____________________________________________________________
-                // Fit
-                TTTrack2 atrack;
-                fitstatus = fitter_->fit(acomb, atrack);
+            if (verbose_>2)  std::cout << Debug() << "... ... ... track: " << icomb << " status: " << fitstatus << " reduced chi2: " << atrack.chi2Red() << " invPt: " << atrack.invPt() << " phi0: " << atrack.phi0() << " cottheta: " << atrack.cottheta() << " z0: " << atrack.z0() << std::endl;
+        }
+    }  // loop over the roads
+}
 
-                atrack.setTower     (po_.tower);
-                atrack.setRoadRef   (acomb.roadRef);
-                atrack.setCombRef   (acomb.combRef);
-                atrack.setPatternRef(acomb.patternRef);
-                atrack.setPtSegment (acomb.ptSegment);
-                atrack.setHitBits   (acomb.hitBits);
-                atrack.setStubRefs  (acomb.stubRefs);
+// _____________________________________________________________________________
+// Clean up the tracks of one event
+template<typename StubSource>
+bool TrackFitter::finishEvent(Worker& worker, const StubSource& stubs, long long ievt, std::vector<TTTrack2>& tracks) {
+    std::sort(tracks.begin(), tracks.end(), sortByPt);
 
-                if (atrack.chi2Red() < po_.maxChi2)  // reduced chi^2 = chi^2 / ndof
-                    tracks.push_back(atrack);
 
-                if (verbose_>2)  std::cout << Debug() << "... ... ... track: " << icomb << " status: " << fitstatus << " reduced chi2: " << atrack.chi2Red() << " invPt: " << atrack.invPt() << " phi0: " << atrack.phi0() << " cottheta: " << atrack.cottheta() << " z0: " << atrack.z0() << std::endl;
-            }
-        }  // loop over the roads
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # tracks: " << tracks.size() << std::endl;
+    if (verbose_>3) {
+        for (unsigned itrack=0; itrack!=tracks.size(); ++itrack) {
+            std::cout << "... ... track: " << itrack << " " << tracks.at(itrack) << std::endl;
+        }
+    }
 
-        std::sort(tracks.begin(), tracks.end(), sortByPt);
+    // _________________________________________________________________________
+    // Find ghosts
 
+    worker.ghostBuster.findGhostTracks(tracks);
 
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # tracks: " << tracks.size() << std::endl;
-        if (verbose_>3) {
-            for (unsigned itrack=0; itrack!=tracks.size(); ++itrack) {
-                std::cout << "... ... track: " << itrack << " " << tracks.at(itrack) << std::endl;
-            }
-        }
+    const bool triggered = !tracks.empty();
 
-        // _____________________________________________________________________
-        // Find ghosts
 
-        for (unsigned itrack=0; itrack<tracks.size(); ++itrack) {  // all tracks
-            for (unsigned jtrack=0; jtrack<itrack; ++jtrack) {  // only non ghost tracks
-                if (tracks.at(jtrack).isGhost())  continue;
+    if (tracks.size() > (unsigned) po_.maxTracks)
+        tracks.resize(po_.maxTracks);
 
-                bool isGhost = ghostBuster_.isGhostTrack(tracks.at(jtrack).stubRefs(), tracks.at(itrack).stubRefs());
-                if (isGhost) {
-                    tracks.at(itrack).setAsGhost();
-                }
+
+
+    // ---------------------------------------------------------------------
+    // Classify tracks as duplicates or not (for duplicate removal)
+    // In the algorithm tracking particles are sorted by pT
+    // And AM tracks are sorted by logic and pT
+    // ---------------------------------------------------------------------
+    DuplicateRemoval flagDuplicates;
+    flagDuplicates.CheckTracks(tracks, po_.rmDuplicate);
+
+    //----------------------------------------------------------------------
+    // Identify and flag duplicates by defining a track-parameter space 
+    // inside of which anything is considered to be a single track
+    //----------------------------------------------------------------------
+    ParameterDuplicateRemoval RemoveParameterDuplicates;
+    if(po_.rmParDuplicate) RemoveParameterDuplicates.ReduceTracks(tracks);
+
+
+
+
+    // _____________________________________________________________________        // Track categorization
+
+    if (po_.speedup<1) {
+        const unsigned nparts = stubs.vp2_primary->size();
+        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # particles: " << nparts << std::endl;
+
+        std::vector<TrackingParticle> trkParts;
+        for (unsigned ipart=0; ipart<nparts; ++ipart) {
+            bool  primary         = stubs.vp2_primary->at(ipart);
+            int   simCharge       = stubs.vp2_charge->at(ipart);
+
+            if (simCharge!=0 && primary) {
+                float simPt           = stubs.vp2_pt->at(ipart);
+                float simEta          = stubs.vp2_eta->at(ipart);
+                float simPhi          = stubs.vp2_phi->at(ipart);
+                //float simVx           = stubs.vp2_vx->at(ipart);
+                //float simVy           = stubs.vp2_vy->at(ipart);
+                float simVz           = stubs.vp2_vz->at(ipart);
+                int   simCharge       = stubs.vp2_charge->at(ipart);
+                int   simPdgId        = stubs.vp2_pdgId->at(ipart);
+
+                float simCotTheta     = std::sinh(simEta);
+                float simChargeOverPt = float(simCharge)/simPt;
+
+                trkParts.emplace_back(TrackingParticle{  // using POD type constructor
+                    (int) ipart,
+                    simPdgId,
+                    simChargeOverPt,
+                    simPhi,
+                    simCotTheta,
+                    simVz,
+                    0.
+                });
+
+                if (verbose_>3)  std::cout << Debug() << "... ... part: " << ipart << " primary: " << primary << " " << trkParts.back();
             }
         }
+        worker.truthAssociator.associate(trkParts, tracks);
+    }
 
-        if (! tracks.empty())
-            ++nKept;
+    return triggered;
+}
 
-        if (tracks.size() > (unsigned) po_.maxTracks)
-            tracks.resize(po_.maxTracks);
+// _____________________________________________________________________________
+// Do track fitting
+int TrackFitter::makeTracks(TString src, TString out) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and fitting tracks." << std::endl;
 
+    // _________________________________________________________________________
+    // For reading
+    TTRoadReader reader(verbose_);
 
+    if (reader.init(src, prefixRoad_, suffix_) || reader.enableReadAhead(po_.readAhead)) {
+        std::cout << Error() << "Failed to initialize TTRoadReader." << std::endl;
+        return 1;
+    }
 
-	// ---------------------------------------------------------------------
-	// Classify tracks as duplicates or not (for duplicate removal)
-	// In the algorithm tracking particles are sorted by pT
-	// And AM tracks are sorted by logic and pT
-	// ---------------------------------------------------------------------
-	DuplicateRemoval flagDuplicates;
-	flagDuplicates.CheckTracks(tracks, po_.rmDuplicate);
+    // Get the range of the events to be read
+    const long long nentries = (po_.nShards > 1) ? reader.getEntries() : -1;
+    getEventRange(po_, nentries, firstEvent_, nEvents_);
 
-	//----------------------------------------------------------------------
-	// Identify and flag duplicates by defining a track-parameter space 
-	// inside of which anything is considered to be a single track
-	//----------------------------------------------------------------------
-	ParameterDuplicateRemoval RemoveParameterDuplicates;
-	if(po_.rmParDuplicate) RemoveParameterDuplicates.ReduceTracks(tracks);
+    // _________________________________________________________________________
+    // For writing
+    TTTrackWriter writer(verbose_);
+    if (writer.init(reader.getChain(), out, prefixTrack_, suffix_)) {
+        std::cout << Error() << "Failed to initialize TTTrackWriter." << std::endl;
+        return 1;
+    }
 
+    // _________________________________________________________________________
+    // Loop over all events
 
+    // With more than one thread, the events are read in batches and put
+    // aside. The worker threads of a persistent pool fit the roads of a batch,
+    // in tasks of up to ROADS_PER_TASK roads, then clean up the tracks of each
+    // event. Meanwhile the next batch is read and the previous one is written
+    // in the original order
+    const unsigned nThreads  = po_.nThreads;
+    const unsigned batchSize = nThreads * EVENTS_PER_THREAD;
 
+    while (workers_.size() < std::max(nThreads, 1u))
+        workers_.push_back(new Worker(po_));
 
-        // _____________________________________________________________________        // Track categorization
+    // Bookkeepers
+    long int nRead = 0, nKept = 0;
 
-        if (po_.speedup<1) {
-            const unsigned nparts = reader.vp2_primary->size();
-            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # particles: " << nparts << std::endl;
+    long long ievt = firstEvent_;
 
-            std::vector<TrackingParticle> trkParts;
-            for (unsigned ipart=0; ipart<nparts; ++ipart) {
-                bool  primary         = reader.vp2_primary->at(ipart);
-                int   simCharge       = reader.vp2_charge->at(ipart);
+    if (nThreads <= 1) {
+        std::vector<TTTrack2> tracks;
+        tracks.reserve(300);
 
-                if (simCharge!=0 && primary) {
-                    float simPt           = reader.vp2_pt->at(ipart);
-                    float simEta          = reader.vp2_eta->at(ipart);
-                    float simPhi          = reader.vp2_phi->at(ipart);
-                    //float simVx           = reader.vp2_vx->at(ipart);
-                    //float simVy           = reader.vp2_vy->at(ipart);
-                    float simVz           = reader.vp2_vz->at(ipart);
-                    int   simCharge       = reader.vp2_charge->at(ipart);
-                    int   simPdgId        = reader.vp2_pdgId->at(ipart);
+        for (; ievt<firstEvent_+nEvents_; ++ievt) {
+            if (reader.loadTree(ievt) < 0)  break;
+            reader.getEntry(ievt);
 
-                    float simCotTheta     = std::sinh(simEta);
-                    float simChargeOverPt = float(simCharge)/simPt;
+            const unsigned nroads = reader.vr_patternRef->size();
+            if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, fitting: %7ld", ievt, nKept) << std::endl;
+            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # roads: " << nroads << std::endl;
 
-                    trkParts.emplace_back(TrackingParticle{  // using POD type constructor
-                        (int) ipart,
-                        simPdgId,
-                        simChargeOverPt,
-                        simPhi,
-                        simCotTheta,
-                        simVz,
-                        0.
-                    });
+            tracks.clear();
+            bool triggered = false;
+            if (nroads)  // skip if no road
+                triggered = fitEvent(*workers_.at(0), reader, ievt, RoadReaderSource(reader, po_.tower), tracks);
 
-                    if (verbose_>3)  std::cout << Debug() << "... ... part: " << ipart << " primary: " << primary << " " << trkParts.back();
-                }
+            if (triggered)
+                ++nKept;
+
+            writer.fill(tracks);
+            ++nRead;
+        }
+        return writeTracks(writer, nRead, nKept);
+    }
+
+    // Containers
+    FitterBatch batches[2] = {FitterBatch(batchSize), FitterBatch(batchSize)};
+
+    WorkerPool pool(nThreads);
+
+    // Fit the roads of a batch, then clean up the tracks of each event, whose
+    // roads are concatenated in the original order
+    auto fitTask = [&](FitterBatch& batch, unsigned itask) {
+        FitterTask& task = batch.tasks.at(itask);
+        FitterEvent& evt = batch.events.at(task.ievent);
+        fitRoadRange(*workers_.at(WorkerPool::threadIndex()), evt, RoadVectorSource(evt.roads, evt.table), task.beginRoad, task.endRoad, task.tracks);
+    };
+
+    auto finishTask = [&](FitterBatch& batch, unsigned i) {
+        FitterEvent& evt = batch.events.at(i);
+        if (evt.roads.empty())  // skip if no road
+            return;
+
+        for (unsigned itask=batch.eventTasks.at(i).first; itask<batch.eventTasks.at(i).second; ++itask) {
+            const std::vector<TTTrack2>& taskTracks = batch.tasks.at(itask).tracks;
+            evt.tracks.insert(evt.tracks.end(), taskTracks.begin(), taskTracks.end());
+        }
+        evt.triggered = finishEvent(*workers_.at(WorkerPool::threadIndex()), evt, evt.ievt, evt.tracks);
+    };
+
+    // Write a batch whose job is done, in order
+    auto writeBatch = [&](FitterBatch& batch) {
+        for (unsigned i=0; i<batch.n; ++i) {
+            FitterEvent& evt = batch.events.at(i);
+            reader.swapEventBuffers(evt.buffers);
+
+            if (evt.triggered)
+                ++nKept;
+
+            writer.fill(evt.tracks);
+            ++nRead;
+        }
+        batch.n = 0;
+    };
+
+    bool endOfInput = false;
+    unsigned ibatch = 0;
+
+    while (!endOfInput && ievt < firstEvent_+nEvents_) {
+        // _____________________________________________________________________
+        // Read a batch of events, while the previous batch is being fitted
+        FitterBatch& batch = batches[ibatch];
+        ibatch = 1 - ibatch;
+        assert(batch.n == 0);
+
+        for (; batch.n<batchSize && ievt<firstEvent_+nEvents_; ++batch.n, ++ievt) {
+            if (reader.loadTree(ievt) < 0) {
+                endOfInput = true;
+                break;
             }
-            truthAssociator_.associate(trkParts, tracks);
+            reader.getEntry(ievt);
+
+            const unsigned nroads = reader.vr_patternRef->size();
+            if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, fitting: %7ld", ievt, nKept) << std::endl;
+            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # roads: " << nroads << std::endl;
+
+            FitterEvent& evt = batch.events.at(batch.n);
+            evt.set(reader, ievt, po_.maxRoads, po_.tower);
+            reader.swapEventBuffers(evt.buffers);
         }
 
-        writer.fill(tracks);
-        ++nRead;
+        // _____________________________________________________________________
+        // Start fitting the batch once the previous batch is done, then write
+        // the previous batch while this one is being fitted
+        pool.wait();
+
+        batch.makeTasks();
+
+        // The job outlives this iteration, it keeps a pointer to the batch
+        FitterBatch * const fitted = &batch;
+
+        std::vector<WorkerPool::Step> steps;
+        steps.push_back(WorkerPool::Step(fitted->tasks.size(), [&fitTask, fitted](unsigned itask) { fitTask(*fitted, itask); }));
+        steps.push_back(WorkerPool::Step(fitted->n, [&finishTask, fitted](unsigned i) { finishTask(*fitted, i); }));
+        pool.start(steps);
+
+        writeBatch(batches[ibatch]);
     }
 
+    // Write the last batch
+    pool.wait();
+    writeBatch(batches[1 - ibatch]);
+
+    return writeTracks(writer, nRead, nKept);
+}
+
+// _____________________________________________________________________________
+int TrackFitter::writeTracks(TTTrackWriter& writer, long int nRead, long int nKept) {
     if (nRead == 0) {
         std::cout << Error() << "Failed to read any event." << std::endl;
         return 1;
@@ -284,12 +701,22 @@ int TrackFitter::makeTracks(TString src, TString out) {
 
     if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
 
+    long int nFits = 0, nFitsReused = 0;
+    for (unsigned ithread=0; ithread<workers_.size(); ++ithread) {
+        nFits += workers_.at(ithread)->nFits;
+        nFitsReused += workers_.at(ithread)->nFitsReused;
+    }
+
+    const long int nCombs = nFits + nFitsReused;
+    if (verbose_)  std::cout << Info() << Form("Combinations: %7ld, fitted: %7ld, reused earlier fits: %7ld (%.1f%%)", nCombs, nFits, nFitsReused, (nCombs > 0 ? 100. * nFitsReused / nCombs : 0.)) << std::endl;
+
 
     // _________________________________________________________________________
     // Write histograms
 
-    for (std::map<TString, TH1F *>::const_iterator it=fitter_->histograms_.begin();
-         it!=fitter_->histograms_.end(); ++it) {
+    const TrackFitterAlgoBase * fitter = workers_.at(0)->fitter;
+    for (std::map<TString, TH1F *>::const_iterator it=fitter->histograms_.begin();
+         it!=fitter->histograms_.end(); ++it) {
         if (it->second)  it->second->SetDirectory(gDirectory);
     }
 
@@ -300,6 +727,79 @@ int TrackFitter::makeTracks(TString src, TString out) {
 }
 
 
+// _____________________________________________________________________________
+int TrackFitter::beginFit(TChain* tchain, TString out) {
+    if (verbose_)  std::cout << Info() << "Fitting tracks in the roads of the pattern recognition." << std::endl;
+
+    // The input has no road, so the roads are written alongside the tracks,
+    // as if they had been read from a road file
+    pipelineWriter_ = new TTTrackWriter(verbose_);
+    if (pipelineWriter_->init(tchain, out, prefixRoad_, prefixTrack_, suffix_, po_.flatRoads, po_.dedupRoads)) {
+        std::cout << Error() << "Failed to initialize TTTrackWriter." << std::endl;
+        return 1;
+    }
+
+    pipelineTracks_.reserve(300);
+    nPipelineRead_ = 0;
+    nPipelineKept_ = 0;
+    return 0;
+}
+
+void TrackFitter::fitRoads(const TTStubPlusTPReader& reader, long long ievt, const std::vector<std::vector<TTRoad> >& roadsPerTower,
+                           const std::vector<TTSuperstripTable>& tablesPerTower) {
+    assert(pipelineWriter_ != 0);
+    assert(roadsPerTower.size() == tablesPerTower.size());
+
+    // Fit the roads of all the trigger towers together. With several trigger
+    // towers, their roads and superstrip tables are merged, so that the
+    // roadRef of a track is the index of its road in the road branches
+    const std::vector<TTRoad> * roads = &pipelineRoads_;
+    const TTSuperstripTable * table = &pipelineTable_;
+
+    if (roadsPerTower.size() == 1) {
+        roads = &roadsPerTower.front();
+        table = &tablesPerTower.front();
+
+    } else {
+        pipelineRoads_.clear();
+        pipelineTable_.clear();
+        for (unsigned itower=0; itower<roadsPerTower.size(); ++itower) {
+            const TTSuperstripTable& towerTable = tablesPerTower.at(itower);
+            const unsigned offset = pipelineTable_.size();
+            for (unsigned i=0; i<towerTable.size(); ++i) {
+                pipelineTable_.stubRefs.insert(pipelineTable_.stubRefs.end(), towerTable.stubRefs.begin() + towerTable.stubRefOffsets.at(i),
+                                               towerTable.stubRefs.begin() + towerTable.stubRefOffsets.at(i+1));
+                pipelineTable_.add(towerTable.superstripIds.at(i));
+            }
+
+            const std::vector<TTRoad>& towerRoads = roadsPerTower.at(itower);
+            for (unsigned iroad=0; iroad<towerRoads.size(); ++iroad) {
+                pipelineRoads_.push_back(towerRoads.at(iroad));
+                std::vector<unsigned>& superstripRefs = pipelineRoads_.back().superstripRefs;
+                for (unsigned ilayer=0; ilayer<superstripRefs.size(); ++ilayer)
+                    superstripRefs.at(ilayer) += offset;
+            }
+        }
+    }
+
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # roads: " << roads->size() << std::endl;
+
+    if (roads->empty()) {  // skip if no road
+        pipelineTracks_.clear();
+
+    } else if (fitEvent(*workers_.at(0), reader, ievt, RoadVectorSource(*roads, *table), pipelineTracks_)) {
+        ++nPipelineKept_;
+    }
+
+    pipelineWriter_->fill(*roads, *table, pipelineTracks_);
+    ++nPipelineRead_;
+}
+
+int TrackFitter::endFit() {
+    assert(pipelineWriter_ != 0);
+    return writeTracks(*pipelineWriter_, nPipelineRead_, nPipelineKept_);
+}
+
 // _____________________________________________________________________________
 // Main driver
 int TrackFitter::run() {
@@ -76,6 +76,13 @@ void TriggerTowerMap::readTriggerTowerMap(TString csvfile) {
     }
     assert(tt == NTOWERS_ETA * NTOWERS_PHI);
 
+    // Make module index
+    moduleIndex_.clear();
+    for (std::map<unsigned, std::vector<unsigned> >::const_iterator itmap = ttmap_.begin();
+         itmap != ttmap_.end(); ++itmap) {
+        moduleIndex_.setTowerModules(itmap->first, itmap->second);
+    }
+
     // Make trigger tower reverse map
     //ttrmap_.clear();
     //for (std::map<unsigned, std::vector<unsigned> >::const_iterator itmap = ttmap_.begin();
@@ -0,0 +1,104 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/WorkerPool.h"
+
+using namespace slhcl1tt;
+
+
+namespace {
+// Index of the worker thread of the calling thread
+thread_local unsigned workerIndex = 0;
+}
+
+
+WorkerPool::WorkerPool(unsigned nThreads)
+: step_(0), next_(0), running_(0), busy_(false), stop_(false) {
+    // A single thread runs the jobs inline
+    if (nThreads <= 1)
+        return;
+
+    for (unsigned ithread=0; ithread<nThreads; ++ithread)
+        threads_.push_back(std::thread(&WorkerPool::work, this, ithread));
+}
+
+WorkerPool::~WorkerPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    workCondition_.notify_all();
+
+    for (unsigned ithread=0; ithread<threads_.size(); ++ithread)
+        threads_.at(ithread).join();
+}
+
+void WorkerPool::start(const std::vector<Step>& steps) {
+    wait();
+
+    if (threads_.empty()) {
+        for (unsigned istep=0; istep<steps.size(); ++istep)
+            for (unsigned i=0; i<steps.at(istep).first; ++i)
+                steps.at(istep).second(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        steps_   = steps;
+        step_    = 0;
+        next_    = 0;
+        running_ = 0;
+        busy_    = true;
+        advance();
+    }
+    workCondition_.notify_all();
+}
+
+unsigned WorkerPool::threadIndex() {
+    return workerIndex;
+}
+
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCondition_.wait(lock, [this]() { return !busy_; });
+}
+
+void WorkerPool::advance() {
+    while (step_ < steps_.size() && steps_.at(step_).first == 0)
+        ++step_;
+
+    if (step_ == steps_.size()) {
+        busy_ = false;
+        steps_.clear();
+        doneCondition_.notify_all();
+    }
+}
+
+void WorkerPool::work(unsigned ithread) {
+    workerIndex = ithread;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        workCondition_.wait(lock, [this]() { return stop_ || (busy_ && next_ < steps_.at(step_).first); });
+        if (stop_)
+            return;
+
+        const unsigned i = next_++;
+        ++running_;
+        const Task task = steps_.at(step_).second;
+
+        lock.unlock();
+        task(i);
+        lock.lock();
+
+        --running_;
+
+        // The last task of the step starts the next step
+        if (next_ == steps_.at(step_).first && running_ == 0) {
+            ++step_;
+            next_ = 0;
+            advance();
+            workCondition_.notify_all();
+        }
+    }
+}
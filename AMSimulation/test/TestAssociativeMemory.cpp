@@ -0,0 +1,268 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/AssociativeMemory.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/HitBuffer.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <map>
+#include <random>
+#include <thread>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestAssociativeMemory : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestAssociativeMemory);
+CPPUNIT_TEST(testLookupIndex);
+CPPUNIT_TEST(testLookupBitslice);
+CPPUNIT_TEST(testLookupThreads);
+CPPUNIT_TEST(testLookupDCBits);
+CPPUNIT_TEST(testLookupMapped);
+CPPUNIT_TEST(testHitBuffer);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    static const unsigned nLayers_     = 6;
+    static const unsigned nss_         = 64;   // superstrips per layer
+    static const unsigned npatterns_   = 5000;
+    static const unsigned nevents_     = 200;
+
+    std::mt19937 rng_;
+
+    // Fill a bank with random patterns, using the same hashing as PatternMatcher
+    void fillBank(AssociativeMemory& am, AssociativeMemoryEngine engine) {
+        std::mt19937 rng(1234);
+        std::uniform_int_distribution<unsigned> dist(0, nss_ - 1);
+
+        am.init(npatterns_, engine);
+        for (unsigned ipatt=0; ipatt<npatterns_; ++ipatt) {
+            pattern_type patt;
+            patt.fill(0);
+            for (unsigned layer=0; layer<nLayers_; ++layer)
+                patt.at(layer) = layer * nss_ + dist(rng);
+            am.insert(patt, 0.);
+        }
+        am.freeze(nLayers_);
+    }
+
+    // Fill a bank with random coarse patterns and random DC bits
+    void fillBankDCBits(AssociativeMemory& am, AssociativeMemoryEngine engine, unsigned nDCBits) {
+        std::mt19937 rng(4321);
+        std::uniform_int_distribution<unsigned> dist(0, (nss_ >> nDCBits) - 1);
+        std::uniform_int_distribution<unsigned> distBits(0, (1u << nDCBits) - 1);
+
+        am.init(npatterns_, engine);
+        for (unsigned ipatt=0; ipatt<npatterns_; ++ipatt) {
+            pattern_type patt;
+            patt.fill(0);
+            pattern_bit_type pattBits;
+            pattBits.fill(0);
+            for (unsigned layer=0; layer<nLayers_; ++layer) {
+                patt.at(layer) = layer * (nss_ >> nDCBits) + dist(rng);
+                pattBits.at(layer) = mergeDCBits(makeDCBits(distBits(rng)), distBits(rng));
+            }
+            am.insert(patt, pattBits, 0.);
+        }
+        am.freeze(nLayers_, nDCBits);
+    }
+
+    // Fire a random subset of superstrips
+    void fillEvent(HitBuffer& hitBuffer, unsigned nhits) {
+        std::uniform_int_distribution<unsigned> dist(0, nLayers_ * nss_ - 1);
+
+        hitBuffer.reset();
+        for (unsigned istub=0; istub<nhits; ++istub)
+            hitBuffer.insert(dist(rng_), istub);
+        hitBuffer.freeze(999999999);
+    }
+
+public:
+    void setUp() {
+        rng_.seed(5678);
+    }
+
+    void tearDown() {}
+
+    void testLookupIndex() {
+        AssociativeMemory amScan, amIndex;
+        fillBank(amScan, AssociativeMemoryEngine::AMSCAN);
+        fillBank(amIndex, AssociativeMemoryEngine::AMINDEX);
+
+        HitBuffer hitBuffer;
+        hitBuffer.init(nLayers_ * nss_);
+
+        for (unsigned ievt=0; ievt<nevents_; ++ievt) {
+            fillEvent(hitBuffer, 20 + ievt);
+
+            for (unsigned maxMisses=0; maxMisses<=nLayers_; ++maxMisses) {
+                const std::vector<unsigned>& fired1 = amScan .lookup(hitBuffer, nLayers_, maxMisses);
+                const std::vector<unsigned>& fired2 = amIndex.lookup(hitBuffer, nLayers_, maxMisses);
+                CPPUNIT_ASSERT(fired1 == fired2);
+            }
+        }
+    }
+
+    void testLookupBitslice() {
+        AssociativeMemory amScan, amBitslice;
+        fillBank(amScan, AssociativeMemoryEngine::AMSCAN);
+        fillBank(amBitslice, AssociativeMemoryEngine::AMBITSLICE);
+
+        HitBuffer hitBuffer;
+        hitBuffer.init(nLayers_ * nss_);
+
+        for (unsigned ievt=0; ievt<nevents_; ++ievt) {
+            fillEvent(hitBuffer, 20 + ievt);
+
+            for (unsigned maxMisses=0; maxMisses<=nLayers_; ++maxMisses) {
+                const std::vector<unsigned>& fired1 = amScan    .lookup(hitBuffer, nLayers_, maxMisses);
+                const std::vector<unsigned>& fired2 = amBitslice.lookup(hitBuffer, nLayers_, maxMisses);
+                CPPUNIT_ASSERT(fired1 == fired2);
+            }
+        }
+    }
+
+    void testLookupThreads() {
+        AssociativeMemory amScan, amBitslice;
+        fillBank(amScan, AssociativeMemoryEngine::AMSCAN);
+        fillBank(amBitslice, AssociativeMemoryEngine::AMBITSLICE);
+
+        const unsigned nthreads = 4;
+        std::vector<HitBuffer> hitBuffers(nthreads);
+        std::vector<std::vector<unsigned> > expected(nthreads);
+        for (unsigned ithread=0; ithread<nthreads; ++ithread) {
+            hitBuffers.at(ithread).init(nLayers_ * nss_);
+            fillEvent(hitBuffers.at(ithread), 100 + ithread);
+            expected.at(ithread) = amScan.lookup(hitBuffers.at(ithread), nLayers_, 1);
+        }
+
+        // Each thread uses its own workspace on the shared bank
+        std::vector<AssociativeMemoryWorkspace> workspaces(nthreads);
+        std::vector<int> results(nthreads, 1);
+        std::vector<std::thread> workers;
+        for (unsigned ithread=0; ithread<nthreads; ++ithread) {
+            workers.push_back(std::thread([&, ithread]() {
+                for (unsigned i=0; i<nevents_; ++i) {
+                    if (amBitslice.lookup(hitBuffers.at(ithread), nLayers_, 1, workspaces.at(ithread)) != expected.at(ithread))
+                        results.at(ithread) = 0;
+                }
+            }));
+        }
+        for (unsigned ithread=0; ithread<nthreads; ++ithread)
+            workers.at(ithread).join();
+
+        for (unsigned ithread=0; ithread<nthreads; ++ithread)
+            CPPUNIT_ASSERT(results.at(ithread));
+    }
+
+    void testLookupDCBits() {
+        const unsigned nDCBits = 2;
+
+        AssociativeMemory amScan, amIndex, amBitslice;
+        fillBankDCBits(amScan, AssociativeMemoryEngine::AMSCAN, nDCBits);
+        fillBankDCBits(amIndex, AssociativeMemoryEngine::AMINDEX, nDCBits);
+        fillBankDCBits(amBitslice, AssociativeMemoryEngine::AMBITSLICE, nDCBits);
+
+        HitBuffer hitBuffer;
+        hitBuffer.init(nLayers_ * nss_);
+
+        for (unsigned ievt=0; ievt<nevents_; ++ievt) {
+            fillEvent(hitBuffer, 20 + ievt);
+
+            for (unsigned maxMisses=0; maxMisses<=nLayers_; ++maxMisses) {
+                // Brute force TCAM matching
+                std::vector<unsigned> expected;
+                for (unsigned ipatt=0; ipatt<npatterns_; ++ipatt) {
+                    pattern_type patt;
+                    pattern_bit_type pattBits;
+                    float invPt;
+                    amScan.retrieve(ipatt, patt, pattBits, invPt);
+
+                    unsigned nMisses = 0;
+                    for (unsigned layer=0; layer<nLayers_; ++layer) {
+                        bool hit = false;
+                        for (unsigned lowBits=0; lowBits<(1u << nDCBits); ++lowBits) {
+                            if (matchDCBits(pattBits.at(layer), lowBits) && hitBuffer.isHit((patt.at(layer) << nDCBits) | lowBits))
+                                hit = true;
+                        }
+                        if (!hit)
+                            ++nMisses;
+                    }
+                    if (nMisses <= maxMisses)
+                        expected.push_back(ipatt);
+                }
+
+                CPPUNIT_ASSERT(amScan    .lookup(hitBuffer, nLayers_, maxMisses) == expected);
+                CPPUNIT_ASSERT(amIndex   .lookup(hitBuffer, nLayers_, maxMisses) == expected);
+                CPPUNIT_ASSERT(amBitslice.lookup(hitBuffer, nLayers_, maxMisses) == expected);
+            }
+        }
+    }
+
+    void testLookupMapped() {
+        const unsigned nDCBits = 2;
+
+        AssociativeMemory amScan;
+        fillBankDCBits(amScan, AssociativeMemoryEngine::AMSCAN, nDCBits);
+
+        // Copy the bank into flat arrays, as in a memory-mapped pattern bank
+        std::vector<pattern_type>     patterns(npatterns_);
+        std::vector<pattern_bit_type> patternBits(npatterns_);
+        std::vector<float>            invPts(npatterns_);
+        for (unsigned ipatt=0; ipatt<npatterns_; ++ipatt)
+            amScan.retrieve(ipatt, patterns.at(ipatt), patternBits.at(ipatt), invPts.at(ipatt));
+
+        AssociativeMemory amIndex, amBitslice;
+        amIndex.init(0, AssociativeMemoryEngine::AMINDEX);
+        amIndex.map(&patterns[0], &patternBits[0], &invPts[0], npatterns_);
+        amIndex.freeze(nLayers_, nDCBits);
+        amBitslice.init(0, AssociativeMemoryEngine::AMBITSLICE);
+        amBitslice.map(&patterns[0], &patternBits[0], &invPts[0], npatterns_);
+        amBitslice.freeze(nLayers_, nDCBits);
+        CPPUNIT_ASSERT(amIndex.size() == npatterns_);
+
+        HitBuffer hitBuffer;
+        hitBuffer.init(nLayers_ * nss_);
+
+        for (unsigned ievt=0; ievt<nevents_; ++ievt) {
+            fillEvent(hitBuffer, 20 + ievt);
+
+            for (unsigned maxMisses=0; maxMisses<=nLayers_; ++maxMisses) {
+                const std::vector<unsigned>& fired1 = amScan    .lookup(hitBuffer, nLayers_, maxMisses);
+                const std::vector<unsigned>& fired2 = amIndex   .lookup(hitBuffer, nLayers_, maxMisses);
+                const std::vector<unsigned>& fired3 = amBitslice.lookup(hitBuffer, nLayers_, maxMisses);
+                CPPUNIT_ASSERT(fired1 == fired2);
+                CPPUNIT_ASSERT(fired1 == fired3);
+            }
+        }
+    }
+
+    void testHitBuffer() {
+        HitBuffer hitBuffer;
+        hitBuffer.init(nLayers_ * nss_);
+
+        for (unsigned ievt=0; ievt<nevents_; ++ievt) {
+            // Reference: superstrip --> stubRefs, in order of insertion
+            std::uniform_int_distribution<unsigned> dist(0, nLayers_ * nss_ - 1);
+            std::map<superstrip_type, std::vector<unsigned> > expected;
+            const unsigned maxStubs = 1 + ievt % 4;
+
+            hitBuffer.reset();
+            for (unsigned istub=0; istub<20 + ievt; ++istub) {
+                const superstrip_type ss = dist(rng_);
+                hitBuffer.insert(ss, istub);
+                if (expected[ss].size() < maxStubs)
+                    expected[ss].push_back(istub);
+            }
+            hitBuffer.freeze(maxStubs);
+
+            CPPUNIT_ASSERT(hitBuffer.getHitSuperstrips().size() == expected.size());
+            for (superstrip_type ss=0; ss<nLayers_ * nss_; ++ss) {
+                const StubRefSpan stubRefs = hitBuffer.getHits(ss);
+                CPPUNIT_ASSERT(hitBuffer.isHit(ss) == (expected.count(ss) != 0));
+                CPPUNIT_ASSERT(std::vector<unsigned>(stubRefs.begin(), stubRefs.end()) == expected[ss]);
+            }
+        }
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestAssociativeMemory);
@@ -0,0 +1,213 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CombinationFactory.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PairCombinationFactory.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestCombinationFactory : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestCombinationFactory);
+CPPUNIT_TEST(testCombine);
+CPPUNIT_TEST(testPairCombine);
+CPPUNIT_TEST(testPairCombineFiveOfSix);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    typedef std::vector<std::vector<unsigned> > Groups;
+
+    std::mt19937 rng_;
+
+    // Six layers of 0 to 3 stubs, with DeltaS values in steps of 0.5
+    void makeRoad(Groups& groups, std::vector<std::vector<float> >& deltaS) {
+        std::uniform_int_distribution<unsigned> ndist(0, 3);
+        std::uniform_int_distribution<int> sdist(-8, 8);
+
+        groups.assign(6, std::vector<unsigned>());
+        deltaS.assign(6, std::vector<float>());
+        unsigned ref = 0;
+        for (unsigned ilayer=0; ilayer<6; ++ilayer) {
+            const unsigned n = ndist(rng_);
+            for (unsigned istub=0; istub<n; ++istub) {
+                groups.at(ilayer).push_back(ref++);
+                deltaS.at(ilayer).push_back(0.5 * sdist(rng_));
+            }
+        }
+    }
+
+    static Groups getAll(CombinationFactory& factory) {
+        Groups combinations;
+        std::vector<unsigned> combination;
+        while (factory.next(combination))
+            combinations.push_back(combination);
+        return combinations;
+    }
+
+    static Groups getAll(PairCombinationFactory& factory) {
+        Groups combinations;
+        std::vector<unsigned> combination;
+        while (factory.next(combination))
+            combinations.push_back(combination);
+        return combinations;
+    }
+
+    // Every element of every group, the last group running fastest
+    static Groups combineAll(const Groups& groups) {
+        Groups combinations(1);
+        for (unsigned i=0; i<groups.size(); ++i) {
+            Groups extended;
+            for (unsigned j=0; j<combinations.size(); ++j) {
+                if (groups.at(i).empty()) {
+                    extended.push_back(combinations.at(j));
+                    extended.back().push_back(CombinationFactory::BAD);
+                }
+                for (unsigned k=0; k<groups.at(i).size(); ++k) {
+                    extended.push_back(combinations.at(j));
+                    extended.back().push_back(groups.at(i).at(k));
+                }
+            }
+            combinations.swap(extended);
+        }
+        return combinations;
+    }
+
+    // The pairwise DeltaS selection over all the 6-stub permutations, in the
+    // order of the layer pairs (1,0), (3,2), (5,4)
+    static Groups pairCombineAll(const Groups& groups, const std::vector<std::vector<float> >& deltaS, bool fiveOfSix) {
+        const unsigned BAD = PairCombinationFactory::BAD;
+        const unsigned order[6] = {1, 0, 3, 2, 5, 4};
+        const unsigned pairs[5][2] = {{1,0}, {1,2}, {3,2}, {3,4}, {5,4}};
+        const float cuts[5] = {1.5, 2.5, 3.0, 2.0, 2.0};
+
+        // Add the dummies
+        Groups stubs(6);
+        std::vector<std::vector<float> > values(6);
+        for (unsigned ilayer=0; ilayer<6; ++ilayer) {
+            if (groups.at(ilayer).empty() || fiveOfSix) {
+                stubs.at(ilayer).push_back(BAD);
+                values.at(ilayer).push_back(999.);
+            }
+            stubs.at(ilayer).insert(stubs.at(ilayer).end(), groups.at(ilayer).begin(), groups.at(ilayer).end());
+            values.at(ilayer).insert(values.at(ilayer).end(), deltaS.at(ilayer).begin(), deltaS.at(ilayer).end());
+        }
+
+        Groups combinations;
+        unsigned idx[6];
+        unsigned n = 1;
+        for (unsigned ilayer=0; ilayer<6; ++ilayer)
+            n *= stubs.at(ilayer).size();
+
+        for (unsigned icomb=0; icomb<n; ++icomb) {
+            unsigned rest = icomb;
+            for (int i=5; i>=0; --i) {
+                const unsigned ilayer = order[i];
+                idx[ilayer] = rest % stubs.at(ilayer).size();
+                rest /= stubs.at(ilayer).size();
+            }
+
+            bool pass = true;
+            unsigned ndummies = 0;
+            for (unsigned ilayer=0; ilayer<6; ++ilayer)
+                if (stubs.at(ilayer).at(idx[ilayer]) == BAD)
+                    ++ndummies;
+            for (unsigned ipair=0; ipair<5; ++ipair) {
+                const unsigned a = pairs[ipair][0], b = pairs[ipair][1];
+                const bool badA = stubs.at(a).at(idx[a]) == BAD, badB = stubs.at(b).at(idx[b]) == BAD;
+                if (badA && badB)
+                    pass = false;
+                else if (!badA && !badB && std::abs(values.at(a).at(idx[a]) - values.at(b).at(idx[b])) > cuts[ipair])
+                    pass = false;
+            }
+            if (!pass || ndummies > 1)
+                continue;
+
+            std::vector<unsigned> combination;
+            for (unsigned ilayer=0; ilayer<6; ++ilayer)
+                combination.push_back(stubs.at(ilayer).at(idx[ilayer]));
+            combinations.push_back(combination);
+        }
+        return combinations;
+    }
+
+    void checkPairCombine(bool fiveOfSix) {
+        PairCombinationFactory factory;
+        Groups groups;
+        std::vector<std::vector<float> > deltaS;
+
+        for (unsigned iroad=0; iroad<300; ++iroad) {
+            makeRoad(groups, deltaS);
+            const Groups expected = pairCombineAll(groups, deltaS, fiveOfSix);
+
+            factory.begin(groups, deltaS, fiveOfSix);
+            CPPUNIT_ASSERT(getAll(factory) == expected);
+            CPPUNIT_ASSERT(factory.combine(groups, deltaS, fiveOfSix) == expected);
+
+            // begin() restarts in the middle of the combinations
+            std::vector<unsigned> combination;
+            factory.begin(groups, deltaS, fiveOfSix);
+            factory.next(combination);
+            factory.begin(groups, deltaS, fiveOfSix);
+            CPPUNIT_ASSERT(getAll(factory) == expected);
+        }
+
+        // Less than 6 layers
+        groups.resize(5);
+        deltaS.resize(5);
+        factory.begin(groups, deltaS, fiveOfSix);
+        CPPUNIT_ASSERT(getAll(factory).empty());
+        CPPUNIT_ASSERT(factory.combine(groups, deltaS, fiveOfSix).empty());
+    }
+
+public:
+    void setUp() {
+        rng_.seed(2015);
+    }
+
+    void tearDown() {}
+
+    // next() gives all the combinations of combine(), in the same order
+    void testCombine() {
+        CombinationFactory factory;
+        Groups groups;
+        std::vector<std::vector<float> > deltaS;
+
+        for (unsigned iroad=0; iroad<300; ++iroad) {
+            makeRoad(groups, deltaS);
+            const Groups expected = combineAll(groups);
+
+            factory.begin(groups);
+            CPPUNIT_ASSERT(getAll(factory) == expected);
+            CPPUNIT_ASSERT(factory.combine(groups) == expected);
+
+            // begin() restarts in the middle of the combinations
+            std::vector<unsigned> combination;
+            factory.begin(groups);
+            factory.next(combination);
+            factory.begin(groups);
+            CPPUNIT_ASSERT(getAll(factory) == expected);
+        }
+
+        // All the groups empty, and no group
+        groups.assign(6, std::vector<unsigned>());
+        CPPUNIT_ASSERT(factory.combine(groups) == Groups(1, std::vector<unsigned>(6, CombinationFactory::BAD)));
+        groups.clear();
+        CPPUNIT_ASSERT(factory.combine(groups) == Groups(1));
+    }
+
+    // The pairwise DeltaS cleaning keeps the combinations that pass the cuts
+    void testPairCombine() {
+        checkPairCombine(false);
+    }
+
+    // Same with the 5/6 permutations of the full layers
+    void testPairCombineFiveOfSix() {
+        checkPairCombine(true);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestCombinationFactory);
@@ -0,0 +1,101 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/GhostBuster.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <random>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestGhostBuster : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestGhostBuster);
+CPPUNIT_TEST(testFindGhostTracks);
+CPPUNIT_TEST(testFindGhostTracksEmpty);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    std::mt19937 rng_;
+
+    // Tracks of 6 layers, whose stubs are drawn from nstubs stubs per layer.
+    // Some layers have no stub, and a few tracks are already ghosts
+    void makeTracks(unsigned ntracks, unsigned nstubs, std::vector<TTTrack2>& tracks) {
+        std::uniform_int_distribution<unsigned> sdist(0, nstubs - 1);
+        std::uniform_int_distribution<unsigned> pdist(0, 99);
+
+        tracks.assign(ntracks, TTTrack2());
+        for (unsigned itrack=0; itrack<ntracks; ++itrack) {
+            std::vector<unsigned> stubRefs(6);
+            for (unsigned ilayer=0; ilayer<6; ++ilayer)
+                stubRefs.at(ilayer) = (pdist(rng_) < 20) ? unsigned(GhostBuster::BAD) : sdist(rng_);
+            if (pdist(rng_) < 2)
+                stubRefs.assign(6, GhostBuster::BAD);
+
+            tracks.at(itrack).setStubRefs(stubRefs);
+            if (pdist(rng_) < 5)
+                tracks.at(itrack).setAsGhost();
+        }
+    }
+
+    // Compare every track with every earlier track that is not a ghost
+    static void findGhostTracksPairwise(const GhostBuster& ghostBuster, std::vector<TTTrack2>& tracks, unsigned threshold) {
+        for (unsigned i=0; i<tracks.size(); ++i) {
+            for (unsigned j=0; j<i; ++j) {
+                if (tracks.at(j).isGhost())
+                    continue;
+                if (ghostBuster.isGhostTrack(tracks.at(j).stubRefs(), tracks.at(i).stubRefs(), threshold))
+                    tracks.at(i).setAsGhost();
+            }
+        }
+    }
+
+public:
+    void setUp() {
+        rng_.seed(2015);
+    }
+
+    void tearDown() {}
+
+    // The indexed search flags the same ghosts as the pairwise comparison.
+    // The same GhostBuster is reused for events of any size
+    void testFindGhostTracks() {
+        GhostBuster ghostBuster;
+        std::uniform_int_distribution<unsigned> ndist(1, 300);
+        std::uniform_int_distribution<unsigned> sdist(2, 13);
+        unsigned nghosts = 0, nkept = 0;
+
+        for (unsigned ievt=0; ievt<400; ++ievt) {
+            const unsigned threshold = ievt % 4;
+            const unsigned ntracks = (ievt == 399) ? 3000 : ndist(rng_);
+
+            std::vector<TTTrack2> tracks;
+            makeTracks(ntracks, sdist(rng_), tracks);
+
+            std::vector<TTTrack2> expected = tracks;
+            findGhostTracksPairwise(ghostBuster, expected, threshold);
+            ghostBuster.findGhostTracks(tracks, threshold);
+
+            for (unsigned itrack=0; itrack<ntracks; ++itrack) {
+                CPPUNIT_ASSERT_EQUAL(expected.at(itrack).isGhost(), tracks.at(itrack).isGhost());
+                if (tracks.at(itrack).isGhost())
+                    ++nghosts;
+                else
+                    ++nkept;
+            }
+        }
+
+        // Both outcomes are tested
+        CPPUNIT_ASSERT(nghosts > 0 && nkept > 0);
+    }
+
+    // No track
+    void testFindGhostTracksEmpty() {
+        GhostBuster ghostBuster;
+        std::vector<TTTrack2> tracks;
+        ghostBuster.findGhostTracks(tracks);
+        CPPUNIT_ASSERT(tracks.empty());
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestGhostBuster);
@@ -0,0 +1,201 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternTable.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <map>
+#include <random>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestPatternTable : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestPatternTable);
+CPPUNIT_TEST(testInsert);
+CPPUNIT_TEST(testFind);
+CPPUNIT_TEST(testRehash);
+CPPUNIT_TEST(testClear);
+CPPUNIT_TEST(testCollisions);
+CPPUNIT_TEST(testHash);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    std::vector<pattern_type> patterns_;
+
+    static pattern_type makePattern(std::mt19937& rng) {
+        std::uniform_int_distribution<superstrip_type> dist(0, 1u << 16);
+        pattern_type patt;
+        for (unsigned i=0; i<patt.size(); ++i)
+            patt[i] = dist(rng);
+        return patt;
+    }
+
+    // Insert the patterns, and check that each of them is found at its index
+    static void fillAndCheck(PatternTable& table, const std::vector<pattern_type>& patterns) {
+        bool inserted = false;
+        for (unsigned i=0; i<patterns.size(); ++i) {
+            PatternRecord& rec = table.insert(patterns.at(i), inserted);
+            CPPUNIT_ASSERT(inserted);
+            CPPUNIT_ASSERT(&rec == &table.at(i));
+            rec.freq = i;
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(patterns.size()), table.size());
+
+        for (unsigned i=0; i<patterns.size(); ++i) {
+            const PatternRecord& rec = table.insert(patterns.at(i), inserted);
+            CPPUNIT_ASSERT(!inserted);
+            CPPUNIT_ASSERT(&rec == &table.at(i));
+            CPPUNIT_ASSERT(rec.patt == patterns.at(i));
+            CPPUNIT_ASSERT_EQUAL(i, rec.freq);
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(patterns.size()), table.size());
+    }
+
+public:
+    void setUp() {
+        std::mt19937 rng(2015);
+
+        // Unique patterns
+        std::map<pattern_type, unsigned> unique;
+        while (patterns_.size() < 5000) {
+            pattern_type patt = makePattern(rng);
+            if (unique.insert(std::make_pair(patt, 0)).second)
+                patterns_.push_back(patt);
+        }
+    }
+
+    void tearDown() {
+        patterns_.clear();
+    }
+
+    // A new pattern makes an empty record, at the end
+    void testInsert() {
+        PatternTable table;
+        CPPUNIT_ASSERT(table.empty());
+
+        bool inserted = false;
+        PatternRecord& rec = table.insert(patterns_.at(0), inserted);
+        CPPUNIT_ASSERT(inserted);
+        CPPUNIT_ASSERT(rec.patt == patterns_.at(0));
+        CPPUNIT_ASSERT_EQUAL(0u, rec.freq);
+        CPPUNIT_ASSERT_EQUAL(0L, rec.n);
+        CPPUNIT_ASSERT_EQUAL(0L, rec.invPt.getEntries());
+        for (unsigned i=0; i<rec.bits.size(); ++i)
+            CPPUNIT_ASSERT_EQUAL(superstrip_bit_type(0), rec.bits[i]);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), table.size());
+        CPPUNIT_ASSERT(!table.empty());
+    }
+
+    // A known pattern gives back its record
+    void testFind() {
+        PatternTable table;
+        std::vector<pattern_type> patterns(patterns_.begin(), patterns_.begin() + 100);
+        fillAndCheck(table, patterns);
+    }
+
+    // The records stay in place and are found again after the slots are rehashed,
+    // with records in the growing chunks and the full-size chunks
+    void testRehash() {
+        std::mt19937 rng(2016);
+        std::map<pattern_type, unsigned> unique;
+        std::vector<pattern_type> patterns;
+        while (patterns.size() < 200000) {
+            pattern_type patt = makePattern(rng);
+            if (unique.insert(std::make_pair(patt, 0)).second)
+                patterns.push_back(patt);
+        }
+
+        PatternTable table;
+        bool inserted = false;
+        PatternRecord * first = &table.insert(patterns.at(0), inserted);
+        first->freq = 0;
+
+        std::vector<pattern_type> rest(patterns.begin() + 1, patterns.end());
+        for (unsigned i=0; i<rest.size(); ++i)
+            table.insert(rest.at(i), inserted).freq = i + 1;
+
+        CPPUNIT_ASSERT(first == &table.at(0));
+        for (unsigned i=0; i<patterns.size(); ++i) {
+            const PatternRecord& rec = table.insert(patterns.at(i), inserted);
+            CPPUNIT_ASSERT(!inserted);
+            CPPUNIT_ASSERT(&rec == &table.at(i));
+            CPPUNIT_ASSERT_EQUAL(i, rec.freq);
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(patterns.size()), table.size());
+    }
+
+    // A cleared table is empty, releases its memory and can be filled again
+    void testClear() {
+        PatternTable table;
+        fillAndCheck(table, patterns_);
+        CPPUNIT_ASSERT(table.memoryUsage() > 0);
+
+        table.clear();
+        CPPUNIT_ASSERT(table.empty());
+        CPPUNIT_ASSERT_EQUAL(size_t(0), table.memoryUsage());
+
+        fillAndCheck(table, patterns_);
+    }
+
+    // Patterns that start probing from the same slot, and patterns with the
+    // same tag, are kept apart
+    void testCollisions() {
+        std::mt19937 rng(2017);
+
+        // Patterns with the same 10 low bits of the hash, i.e. the same first
+        // slot while the table has 1024 slots (up to 716 records)
+        std::vector<pattern_type> sameSlot;
+        std::map<pattern_type, unsigned> unique;
+        while (sameSlot.size() < 500) {
+            pattern_type patt = makePattern(rng);
+            if ((PatternTable::hash(patt) & 1023) == 0 && unique.insert(std::make_pair(patt, 0)).second)
+                sameSlot.push_back(patt);
+        }
+
+        PatternTable table;
+        fillAndCheck(table, sameSlot);
+
+        // Patterns with the same tag (the 32 high bits of the hash)
+        std::map<uint32_t, pattern_type> tags;
+        std::vector<pattern_type> sameTag;
+        while (sameTag.size() < 4) {
+            pattern_type patt = makePattern(rng);
+            const uint32_t tag = PatternTable::hash(patt) >> 32;
+            std::map<uint32_t, pattern_type>::const_iterator found = tags.find(tag);
+            if (found == tags.end())
+                tags.insert(std::make_pair(tag, patt));
+            else if (found->second != patt) {
+                sameTag.push_back(found->second);
+                sameTag.push_back(patt);
+                tags.erase(tag);
+            }
+        }
+
+        PatternTable table2;
+        fillAndCheck(table2, sameTag);
+    }
+
+    // A pattern that differs in any superstrip has another hash
+    void testHash() {
+        const pattern_type patt = patterns_.at(0);
+        const uint64_t h = PatternTable::hash(patt);
+
+        for (unsigned i=0; i<patt.size(); ++i) {
+            pattern_type patt2 = patt;
+            patt2[i] ^= 1;
+            CPPUNIT_ASSERT(PatternTable::hash(patt2) != h);
+        }
+
+        // The shards do not follow the slots
+        std::vector<unsigned> counts(4, 0);
+        for (unsigned i=0; i<patterns_.size(); ++i) {
+            if ((PatternTable::hash(patterns_.at(i)) & 3) == 0)
+                ++counts.at(PatternTable::shard(patterns_.at(i), 4));
+        }
+        for (unsigned ishard=0; ishard<4; ++ishard)
+            CPPUNIT_ASSERT(counts.at(ishard) > 200);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPatternTable);
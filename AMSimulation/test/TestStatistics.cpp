@@ -0,0 +1,180 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Statistics.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Moments.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestStatistics : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestStatistics);
+CPPUNIT_TEST(testFill);
+CPPUNIT_TEST(testMerge);
+CPPUNIT_TEST(testMergeStored);
+CPPUNIT_TEST(testMomentsMerge);
+CPPUNIT_TEST(testMomentsReadWrite);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    static const unsigned n_ = 1000;
+    static const unsigned dim_ = 5;
+
+    std::vector<double> values_;
+    std::vector<Eigen::VectorXd> vectors_;  // correlated, with different scales
+
+public:
+    void setUp() {
+        std::mt19937 rng(2015);
+        std::normal_distribution<double> dist(3., 4.);
+
+        values_.clear();
+        for (unsigned i=0; i<n_; ++i)
+            values_.push_back(dist(rng));
+
+        vectors_.clear();
+        for (unsigned i=0; i<n_; ++i) {
+            Eigen::VectorXd x = Eigen::VectorXd::Zero(dim_);
+            for (unsigned j=0; j<dim_; ++j)
+                x(j) = dist(rng) * std::pow(10., int(j) - 2) + (j ? 0.5 * x(j-1) : 100.);
+            vectors_.push_back(x);
+        }
+    }
+
+    void tearDown() {}
+
+    // The running update gives the sample mean and variance
+    void testFill() {
+        Statistics stat;
+        for (unsigned i=0; i<values_.size(); ++i)
+            stat.fill(values_.at(i));
+
+        double mean = 0.;
+        for (unsigned i=0; i<values_.size(); ++i)
+            mean += values_.at(i);
+        mean /= values_.size();
+
+        double variance = 0.;
+        for (unsigned i=0; i<values_.size(); ++i)
+            variance += (values_.at(i) - mean) * (values_.at(i) - mean);
+        variance /= (values_.size() - 1);
+
+        CPPUNIT_ASSERT(stat.getEntries() == (long int) n_);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, stat.getMean(), 1e-12 * std::abs(mean));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(variance, stat.getVariance(), 1e-12 * variance);
+
+        Statistics one;
+        one.fill(1.);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0., one.getVariance(), 0.);
+    }
+
+    // Merging partial fills gives the same as filling everything at once
+    void testMerge() {
+        Statistics all;
+        for (unsigned i=0; i<values_.size(); ++i)
+            all.fill(values_.at(i));
+
+        const unsigned splits[] = {1, 7, n_/2, n_-1};
+        for (unsigned isplit=0; isplit<sizeof(splits)/sizeof(splits[0]); ++isplit) {
+            Statistics first, second, empty;
+            for (unsigned i=0; i<values_.size(); ++i)
+                (i < splits[isplit] ? first : second).fill(values_.at(i));
+
+            first.merge(empty);
+            first.merge(second);
+
+            CPPUNIT_ASSERT(first.getEntries() == all.getEntries());
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(all.getMean(), first.getMean(), 1e-12 * std::abs(all.getMean()));
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(all.getVariance(), first.getVariance(), 1e-12 * all.getVariance());
+        }
+    }
+
+    // Merging the entries, means and sigmas stored as floats in the banks of
+    // several jobs gives the same as a single job, to float precision
+    void testMergeStored() {
+        Statistics all;
+        for (unsigned i=0; i<values_.size(); ++i)
+            all.fill(values_.at(i));
+
+        const unsigned njobs = 4;
+        std::vector<Statistics> jobs(njobs);
+        for (unsigned i=0; i<values_.size(); ++i)
+            jobs.at(i * njobs / values_.size()).fill(values_.at(i));
+
+        Statistics merged;
+        for (unsigned ijob=0; ijob<njobs; ++ijob) {
+            const float mean  = jobs.at(ijob).getMean();
+            const float sigma = jobs.at(ijob).getSigma();
+            merged.merge(Statistics(jobs.at(ijob).getEntries(), mean, sigma));
+        }
+
+        CPPUNIT_ASSERT(merged.getEntries() == all.getEntries());
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(all.getMean(), merged.getMean(), 1e-6 * std::abs(all.getMean()));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(all.getSigma(), merged.getSigma(), 1e-6 * all.getSigma());
+    }
+
+    // Merging the moments of k shards gives the same as a single fill
+    void testMomentsMerge() {
+        Moments all(dim_);
+        for (unsigned i=0; i<vectors_.size(); ++i)
+            all.fill(vectors_.at(i));
+
+        const Eigen::VectorXd means = all.getMeans();
+        const Eigen::MatrixXd covariances = all.getCovariances();
+
+        const unsigned nshards[] = {1, 2, 3, 8, n_+1};  // the last one has an empty shard
+        for (unsigned ik=0; ik<sizeof(nshards)/sizeof(nshards[0]); ++ik) {
+            const unsigned k = nshards[ik];
+            std::vector<Moments> shards(k, Moments(dim_));
+            for (unsigned i=0; i<vectors_.size(); ++i)
+                shards.at(i * k / vectors_.size()).fill(vectors_.at(i));
+
+            Moments merged(dim_);
+            for (unsigned ishard=0; ishard<k; ++ishard)
+                merged.merge(shards.at(ishard));
+
+            CPPUNIT_ASSERT(merged.getEntries() == all.getEntries());
+            CPPUNIT_ASSERT(merged.getDimension() == dim_);
+            for (unsigned i=0; i<dim_; ++i) {
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(means(i), merged.getMeans()(i), 1e-12 * std::abs(means(i)));
+                for (unsigned j=0; j<dim_; ++j) {
+                    const double scale = std::sqrt(covariances(i, i) * covariances(j, j));
+                    CPPUNIT_ASSERT_DOUBLES_EQUAL(covariances(i, j), merged.getCovariances()(i, j), 1e-12 * scale);
+                }
+            }
+        }
+    }
+
+    // Writing and reading back the moments as text loses nothing
+    void testMomentsReadWrite() {
+        Moments moments(dim_);
+        for (unsigned i=0; i<vectors_.size(); ++i)
+            moments.fill(vectors_.at(i));
+
+        std::vector<Moments> written;
+        written.push_back(moments);
+        written.push_back(Moments(dim_));  // no entry
+        written.push_back(Moments());      // no dimension
+
+        std::stringstream ss;
+        for (unsigned i=0; i<written.size(); ++i)
+            written.at(i).write(ss);
+
+        for (unsigned i=0; i<written.size(); ++i) {
+            Moments read(1);
+            CPPUNIT_ASSERT_EQUAL(0, read.read(ss));
+            CPPUNIT_ASSERT(read == written.at(i));
+        }
+
+        // Nothing left to read
+        Moments read;
+        CPPUNIT_ASSERT_EQUAL(1, read.read(ss));
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestStatistics);
@@ -0,0 +1,182 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/BasicReader.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestStubCache : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestStubCache);
+CPPUNIT_TEST(testRoundTrip);
+CPPUNIT_TEST(testBadOffsets);
+CPPUNIT_TEST(testTruncated);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    // The columns of an event, in the order of StubCacheWriter
+    struct Event {
+        std::vector<float>    floats[13];
+        std::vector<int>      charge, tpId;
+        std::vector<unsigned> modId;
+    };
+
+    static const char * path_;
+
+    std::vector<Event> events_;
+
+    // Point the reader at the columns of an event
+    static void bind(BasicReader& reader, Event& evt) {
+        reader.vp_pt       = &evt.floats[ 0];
+        reader.vp_eta      = &evt.floats[ 1];
+        reader.vp_phi      = &evt.floats[ 2];
+        reader.vp_vx       = &evt.floats[ 3];
+        reader.vp_vy       = &evt.floats[ 4];
+        reader.vp_vz       = &evt.floats[ 5];
+        reader.vp_charge   = &evt.charge;
+        reader.vb_z        = &evt.floats[ 6];
+        reader.vb_r        = &evt.floats[ 7];
+        reader.vb_eta      = &evt.floats[ 8];
+        reader.vb_phi      = &evt.floats[ 9];
+        reader.vb_coordx   = &evt.floats[10];
+        reader.vb_coordy   = &evt.floats[11];
+        reader.vb_trigBend = &evt.floats[12];
+        reader.vb_modId    = &evt.modId;
+        reader.vb_tpId     = &evt.tpId;
+    }
+
+    void writeCache() {
+        StubCacheWriter writer(0);
+        CPPUNIT_ASSERT_EQUAL(0, writer.init(path_));
+
+        BasicReader reader(0);
+        for (unsigned ievt=0; ievt<events_.size(); ++ievt) {
+            bind(reader, events_.at(ievt));
+            writer.fill(reader);
+        }
+        CPPUNIT_ASSERT_EQUAL(Long64_t(events_.size()), writer.writeFile());
+
+        // The temporary files are gone
+        for (unsigned icol=0; icol<16; ++icol) {
+            std::FILE* f = std::fopen(Form("%s.%u.tmp", path_, icol), "rb");
+            CPPUNIT_ASSERT(f == 0);
+        }
+    }
+
+    template <typename T>
+    static void checkColumn(const StubCacheReader& reader, const char* name, StubCacheType type,
+                            Long64_t entry, const std::vector<T>& expected) {
+        const int icol = reader.findColumn(name, type);
+        CPPUNIT_ASSERT(icol >= 0);
+
+        const T * begin = 0, * end = 0;
+        reader.getColumn(icol, entry, begin, end);
+        CPPUNIT_ASSERT(std::vector<T>(begin, end) == expected);
+    }
+
+public:
+    void setUp() {
+        std::mt19937 rng(2015);
+        std::uniform_real_distribution<float> fdist(-10., 10.);
+        std::uniform_int_distribution<unsigned> udist(0, 100000);
+
+        // Events of different sizes, one of them without stubs and particles
+        const unsigned nstubs[4] = {7, 0, 130, 1};
+        const unsigned nparts[4] = {1, 0, 3, 2};
+
+        events_.assign(4, Event());
+        for (unsigned ievt=0; ievt<events_.size(); ++ievt) {
+            Event& evt = events_.at(ievt);
+            for (unsigned i=0; i<13; ++i) {
+                const unsigned n = (i < 6) ? nparts[ievt] : nstubs[ievt];
+                for (unsigned j=0; j<n; ++j)
+                    evt.floats[i].push_back(fdist(rng));
+            }
+            for (unsigned j=0; j<nparts[ievt]; ++j)
+                evt.charge.push_back(int(udist(rng) % 3) - 1);
+            for (unsigned j=0; j<nstubs[ievt]; ++j) {
+                evt.modId.push_back(udist(rng));
+                evt.tpId.push_back(int(udist(rng)) - 1000);
+            }
+        }
+    }
+
+    void tearDown() {
+        std::remove(path_);
+    }
+
+    // Every column of every event reads back as written
+    void testRoundTrip() {
+        writeCache();
+
+        StubCacheReader reader(0);
+        CPPUNIT_ASSERT_EQUAL(0, reader.init(path_));
+        CPPUNIT_ASSERT_EQUAL(Long64_t(events_.size()), reader.getEntries());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(16), uint64_t(reader.getHeader().ncolumns));
+        CPPUNIT_ASSERT_EQUAL(uint64_t(138), reader.getHeader().nstubs);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(6), reader.getHeader().nparts);
+        CPPUNIT_ASSERT(reader.findColumn("TTStubs_modId", STUB_CACHE_FLOAT) < 0);
+        CPPUNIT_ASSERT(reader.findColumn("TTStubs_x", STUB_CACHE_FLOAT) < 0);
+
+        const char * floatNames[13] = {"genParts_pt", "genParts_eta", "genParts_phi", "genParts_vx", "genParts_vy", "genParts_vz",
+                                       "TTStubs_z", "TTStubs_r", "TTStubs_eta", "TTStubs_phi", "TTStubs_coordx", "TTStubs_coordy", "TTStubs_trigBend"};
+
+        for (unsigned ievt=0; ievt<events_.size(); ++ievt) {
+            const Event& evt = events_.at(ievt);
+            for (unsigned i=0; i<13; ++i)
+                checkColumn(reader, floatNames[i], STUB_CACHE_FLOAT, ievt, evt.floats[i]);
+            checkColumn(reader, "genParts_charge", STUB_CACHE_INT , ievt, evt.charge);
+            checkColumn(reader, "TTStubs_modId"  , STUB_CACHE_UINT, ievt, evt.modId);
+            checkColumn(reader, "TTStubs_tpId"   , STUB_CACHE_INT , ievt, evt.tpId);
+        }
+    }
+
+    // A cache whose event offsets do not match the columns is rejected
+    void testBadOffsets() {
+        writeCache();
+
+        StubCacheHeader header;
+        std::FILE* f = std::fopen(path_, "r+b");
+        CPPUNIT_ASSERT(f != 0);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), std::fread(&header, sizeof(header), 1, f));
+
+        // Event 1 ends past the last stub
+        const uint64_t bad = header.nstubs + 1;
+        CPPUNIT_ASSERT_EQUAL(0, std::fseek(f, header.stubOffsetsOffset + 2 * sizeof(uint64_t), SEEK_SET));
+        CPPUNIT_ASSERT_EQUAL(size_t(1), std::fwrite(&bad, sizeof(bad), 1, f));
+        std::fclose(f);
+
+        StubCacheReader reader(0);
+        CPPUNIT_ASSERT_EQUAL(1, reader.init(path_));
+    }
+
+    // A cache that lost its end is rejected
+    void testTruncated() {
+        writeCache();
+
+        std::FILE* f = std::fopen(path_, "rb");
+        CPPUNIT_ASSERT(f != 0);
+        std::vector<char> data;
+        char c;
+        while (std::fread(&c, 1, 1, f) == 1)
+            data.push_back(c);
+        std::fclose(f);
+
+        f = std::fopen(path_, "wb");
+        CPPUNIT_ASSERT(f != 0);
+        CPPUNIT_ASSERT_EQUAL(data.size() - 64, std::fwrite(data.data(), 1, data.size() - 64, f));
+        std::fclose(f);
+
+        StubCacheReader reader(0);
+        CPPUNIT_ASSERT_EQUAL(1, reader.init(path_));
+    }
+};
+
+const char * TestStubCache::path_ = "TestStubCache.stubcache";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestStubCache);
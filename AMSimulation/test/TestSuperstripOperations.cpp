@@ -4,6 +4,7 @@
 using namespace slhcl1tt;
 
 #include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
 #include <stdexcept>
 
 
@@ -114,6 +115,57 @@ unsigned superstrip_fountain(unsigned lay, float phi, float z,
     return h;
 }
 
+// _____________________________________________________________________________
+// Test optimized fountain superstrip, as the fountain superstrip with the
+// optimized phi units
+unsigned superstrip_fountain_opt(unsigned lay, float phi, float z,
+                                 const bool lowpt, const float divide_z) {
+    unsigned h = 0;
+
+    static const float units_phi_lowpt[6] = {0.01091, 0.00518, 0.00409, 0.00309, 0.00275, 0.00571};
+    static const float units_phi_highpt[6] = {0.01079, 0.00612, 0.00439, 0.00330, 0.00260, 0.00450};
+    static const float edges_phi[6*2] = {0.564430,1.791765,0.653554,1.710419,0.641981,1.756567,0.717273,1.638922,0.658179,1.673851,0.618448,1.778293};
+    static const float edges_z[6*2] = {-6.7127,26.9799,-6.7797,36.7048,-5.2542,47.7511,-9.5318,59.4103,-9.5318,78.7372,-9.5318,88.9935};
+    const float * units_phi = lowpt ? units_phi_lowpt : units_phi_highpt;
+
+    int n_phi = 0;  // the largest number of phi units over the layers
+    for (unsigned i=0; i<6; ++i)
+        n_phi = std::max(n_phi, int(floor((edges_phi[2*i+1] - edges_phi[2*i]) / units_phi[i] + 0.5)));
+    int n_z   = divide_z;
+    assert(n_phi > 0 && n_z > 0);
+
+    if (lay < 6) {  // barrel only
+        float unit_phi = units_phi[lay];
+        float unit_z   = (edges_z[2*lay+1] - edges_z[2*lay]) / divide_z;
+
+        phi -= edges_phi[2*lay];  // lowest phi value in trigger tower
+        z   -= edges_z[2*lay];    // lowest z value in trigger tower
+
+        int i_phi = floor(phi / unit_phi);
+        int i_z   = floor(z   / unit_z);
+        i_phi = (i_phi < 0) ? 0 : (i_phi >= n_phi) ? (n_phi - 1) : i_phi;  // proper range
+        i_z   = (i_z   < 0) ? 0 : (i_z   >= n_z  ) ? (n_z   - 1) : i_z  ;  // proper range
+
+        h = i_z * n_phi + i_phi;
+    }
+
+    return h;
+}
+
+// _____________________________________________________________________________
+// Find the superstrips with the policy picked by the arbiter
+struct SuperstripVisitor {
+    unsigned n;
+    const unsigned * moduleIds;
+    const float * strips, * segments, * rs, * phis, * zs, * dss;
+    unsigned * ssIds;
+
+    template<typename Policy>
+    void operator()(const Policy& policy) {
+        policy.superstrips(n, moduleIds, strips, segments, rs, phis, zs, dss, ssIds);
+    }
+};
+
 
 // _____________________________________________________________________________
 // Unit test class
@@ -124,6 +176,9 @@ CPPUNIT_TEST(testArbiterDefinition);
 CPPUNIT_TEST(testArbiterFixedwidth);
 CPPUNIT_TEST(testArbiterProjective);
 CPPUNIT_TEST(testArbiterFountain);
+CPPUNIT_TEST(testArbiterBatch);
+CPPUNIT_TEST(testArbiterVisit);
+CPPUNIT_TEST(testModuleIndex);
 CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -337,6 +392,170 @@ public:
             }
         }
     }
+
+    void testArbiterBatch() {
+        static const float edges_phi[6*2] = {0.564430,1.791765,0.653554,1.710419,0.641981,1.756567,0.717273,1.638922,0.658179,1.673851,0.618448,1.778293};
+        static const float edges_z[6*2] = {-6.7127,26.9799,-6.7797,36.7048,-5.2542,47.7511,-9.5318,59.4103,-9.5318,78.7372,-9.5318,88.9935};
+
+        // Stubs in all the modules of the trigger tower, and across the layers
+        std::vector<unsigned> moduleIds, moduleCodes, layers;
+        std::vector<float> strips, segments, rs, phis, zs, dss;
+
+        unsigned lay = 5;
+        unsigned code = 0;
+        for (auto itmap : ttrmap_) {
+            unsigned moduleId = itmap.first;
+            if (lay != decodeLayer(moduleId)) {  // new layer
+                lay = decodeLayer(moduleId);
+                code = 0;
+            }
+            unsigned i = lay - 5;
+            if (i >= 6) {  // barrel only
+                ++code;
+                continue;
+            }
+
+            for (unsigned k=0; k<64; ++k) {
+                moduleIds  .push_back(moduleId);
+                moduleCodes.push_back(code);
+                layers     .push_back(i);
+                strips     .push_back(k * 16);
+                segments   .push_back(isPSModule(moduleId) ? (k % 32) : (k % 2));
+                rs         .push_back(20.);  // dummy
+                phis       .push_back(edges_phi[i*2] + (edges_phi[i*2+1] - edges_phi[i*2]) / 70. * (k + 3));
+                zs         .push_back(edges_z[i*2] + (edges_z[i*2+1] - edges_z[i*2]) / 70. * (k + 3));
+                dss        .push_back(0.);   // dummy
+            }
+            ++code;
+        }
+        const unsigned n = moduleIds.size();
+        std::vector<unsigned> ssIds(n);
+
+        // Compare with the superstrips found one stub at a time by the old formulas.
+        // The old fountain formula counts the phi units of each layer, instead
+        // of the largest count over the layers, so it only agrees with one z bin
+        const char * definitions[4] = {"ss256_nz2", "nx200_nz1", "sf1_nz1", "op1_nz2"};
+        for (unsigned idef=0; idef<4; ++idef) {
+            TString ss = definitions[idef];
+            arbiter_ -> setDefinition(ss, tt_, ttmap_);
+
+            arbiter_ -> superstrips(n, moduleIds.data(), strips.data(), segments.data(),
+                                    rs.data(), phis.data(), zs.data(), dss.data(), ssIds.data());
+
+            std::vector<unsigned> ssIdsVisited(n);
+            SuperstripVisitor visitor = {n, moduleIds.data(), strips.data(), segments.data(),
+                                         rs.data(), phis.data(), zs.data(), dss.data(), ssIdsVisited.data()};
+            arbiter_ -> visit(visitor);
+
+            for (unsigned i=0; i<n; ++i) {
+                unsigned ss1 = 0;
+                if (idef == 0)
+                    ss1 = test_ss256_nz2_tt27(moduleIds.at(i), moduleCodes.at(i), strips.at(i), segments.at(i));
+                else if (idef == 1)
+                    ss1 = superstrip_projective(layers.at(i), phis.at(i), zs.at(i), M_PI / 4. / 200., 1.);
+                else if (idef == 2)
+                    ss1 = superstrip_fountain(layers.at(i), phis.at(i), zs.at(i), 1., 1.);
+                else
+                    ss1 = superstrip_fountain_opt(layers.at(i), phis.at(i), zs.at(i), true, 2.);
+
+                CPPUNIT_ASSERT_EQUAL(ss1, ssIds.at(i));
+                CPPUNIT_ASSERT_EQUAL(ss1, ssIdsVisited.at(i));
+            }
+        }
+
+        // Wrong superstrip type
+        arbiter_ -> setDefinition("ss256_nz2", tt_, ttmap_);
+        CPPUNIT_ASSERT_THROW(arbiter_ -> superstripsGlobal(n, moduleIds.data(), rs.data(), phis.data(), zs.data(), dss.data(), ssIds.data()), std::logic_error);
+    }
+
+    // Superstrips of a few stubs, worked out by hand
+    void testArbiterVisit() {
+        std::vector<unsigned> ssIds(3);
+
+        // ss256_nz2: strip/256 | (segment/16) << 2 | module code << 3,
+        // the 2S modules have a single segment of 16 in the PS unit
+        if (true) {
+            const unsigned moduleIds[3] = {50232, 80612, 60326};  // module codes 2, 1, 0
+            const float strips[3]       = {700., 300., 1023.};
+            const float segments[3]     = {20., 1., 31.};
+            const float zeros[3]        = {0., 0., 0.};
+
+            arbiter_ -> setDefinition("ss256_nz2", tt_, ttmap_);
+            SuperstripVisitor visitor = {3, moduleIds, strips, segments, zeros, zeros, zeros, zeros, ssIds.data()};
+            arbiter_ -> visit(visitor);
+
+            CPPUNIT_ASSERT_EQUAL(2u | (1u << 2) | (2u << 3), ssIds.at(0));  // 22
+            CPPUNIT_ASSERT_EQUAL(1u | (1u << 2) | (1u << 3), ssIds.at(1));  // 13
+            CPPUNIT_ASSERT_EQUAL(3u | (1u << 2) | (0u << 3), ssIds.at(2));  // 7
+        }
+
+        // nx200_nz1: phi bins of pi/4/200 = 0.0039270 from the lower edge of
+        // the layer, 0.564430 in layer 5 and 0.653554 in layer 6
+        if (true) {
+            const unsigned moduleIds[3] = {50232, 60326, 50232};
+            const float phis[3]         = {0.564430 + 0.0413, 0.653554 + 0.1, 0.5};
+            const float zs[3]           = {0., 0., 0.};
+            const float zeros[3]        = {0., 0., 0.};
+
+            arbiter_ -> setDefinition("nx200_nz1", tt_, ttmap_);
+            SuperstripVisitor visitor = {3, moduleIds, zeros, zeros, zeros, phis, zs, zeros, ssIds.data()};
+            arbiter_ -> visit(visitor);
+
+            CPPUNIT_ASSERT_EQUAL(10u, ssIds.at(0));  // 0.0413 / 0.0039270 = 10.52
+            CPPUNIT_ASSERT_EQUAL(25u, ssIds.at(1));  // 0.1 / 0.0039270 = 25.46
+            CPPUNIT_ASSERT_EQUAL( 0u, ssIds.at(2));  // below the lower edge
+        }
+
+        // sf1_nz4: phi bins of 0.00381 in layer 5 and 0.00523 in layer 9, with
+        // 322 phi bins per z bin (layer 5). z bins of (26.9799 + 6.7127) / 4 =
+        // 8.42315 in layer 5 and (78.7372 + 9.5318) / 4 = 22.06725 in layer 9
+        if (true) {
+            const unsigned moduleIds[3] = {50232, 90712, 50232};
+            const float phis[3]         = {0.564430 + 0.02, 0.658179 + 0.1, 0.564430 + 0.02};
+            const float zs[3]           = {-6.7127 + 20., 50., 200.};
+            const float zeros[3]        = {0., 0., 0.};
+
+            arbiter_ -> setDefinition("sf1_nz4", tt_, ttmap_);
+            SuperstripVisitor visitor = {3, moduleIds, zeros, zeros, zeros, phis, zs, zeros, ssIds.data()};
+            arbiter_ -> visit(visitor);
+
+            CPPUNIT_ASSERT_EQUAL(2u * 322 +  5, ssIds.at(0));  // phi: 5.25, z: 2.37
+            CPPUNIT_ASSERT_EQUAL(2u * 322 + 19, ssIds.at(1));  // phi: 19.12, z: 2.70
+            CPPUNIT_ASSERT_EQUAL(3u * 322 +  5, ssIds.at(2));  // above the upper edge in z
+        }
+    }
+
+    void testModuleIndex() {
+        const ModuleIndex& moduleIndex = ttmap_ -> getModuleIndex();
+
+        // Compare with the reverse map of every trigger tower
+        for (unsigned tt=0; tt<48; ++tt) {
+            const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(tt);
+            const std::vector<unsigned>& moduleIds = ttmap_ -> getTriggerTowerModules(tt);
+
+            std::vector<unsigned> counts(16, 0);
+            for (unsigned i=0; i<moduleIds.size(); ++i) {
+                unsigned moduleId = moduleIds.at(i);
+                unsigned imodule  = moduleIndex.index(moduleId);
+                CPPUNIT_ASSERT(imodule < moduleIndex.size());
+                CPPUNIT_ASSERT_EQUAL(moduleId, moduleIndex.moduleId(imodule));
+                CPPUNIT_ASSERT_EQUAL(compressLayer(decodeLayer(moduleId)), moduleIndex.layer(imodule));
+                CPPUNIT_ASSERT(moduleIndex.isInTower(imodule, tt));
+                CPPUNIT_ASSERT_EQUAL(counts.at(moduleIndex.layer(imodule))++, moduleIndex.moduleCode(imodule, tt));
+            }
+
+            for (unsigned imodule=0; imodule<moduleIndex.size(); ++imodule) {
+                bool inTower = (ttrmap.find(moduleIndex.moduleId(imodule)) != ttrmap.end());
+                CPPUNIT_ASSERT_EQUAL(inTower, moduleIndex.isInTower(imodule, tt));
+                CPPUNIT_ASSERT_EQUAL(inTower, moduleIndex.moduleCode(imodule, tt) != ModuleIndex::INVALID);
+            }
+        }
+
+        // Unknown modules
+        CPPUNIT_ASSERT_EQUAL(unsigned(ModuleIndex::INVALID), moduleIndex.index(999999));
+        CPPUNIT_ASSERT_EQUAL(unsigned(ModuleIndex::INVALID), moduleIndex.index(50299));
+        CPPUNIT_ASSERT(!moduleIndex.isInTower(moduleIndex.index(999999), tt_));
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TestSuperstripOperations);
@@ -0,0 +1,119 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCAFixed.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestTrackFitterAlgoPCA : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestTrackFitterAlgoPCA);
+CPPUNIT_TEST(testFit);
+CPPUNIT_TEST(testFitBlock);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    ProgramOption po_;
+    std::vector<TTRoadComb> combs_;
+
+    // The fixed-size fitter gives the same track, up to the rounding of the products
+    static void checkTrack(const TTTrack2& expected, const TTTrack2& track) {
+        const double tol = 1e-9;
+        CPPUNIT_ASSERT_EQUAL(expected.ndof(), track.ndof());
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.chi2()    , track.chi2()    , tol * (1. + std::abs(expected.chi2())));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.rinv()    , track.rinv()    , tol * (1. + std::abs(expected.rinv())));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.phi0()    , track.phi0()    , tol * (1. + std::abs(expected.phi0())));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.cottheta(), track.cottheta(), tol * (1. + std::abs(expected.cottheta())));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z0()      , track.z0()      , tol * (1. + std::abs(expected.z0())));
+
+        const std::vector<float> principals1 = expected.principals();
+        const std::vector<float> principals2 = track.principals();
+        CPPUNIT_ASSERT_EQUAL(principals1.size(), principals2.size());
+        for (unsigned i=0; i<principals1.size(); ++i)
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(principals1.at(i), principals2.at(i), 1e-5 * (1. + std::abs(principals1.at(i))));
+    }
+
+public:
+    void setUp() {
+        po_.datadir  = std::getenv("CMSSW_BASE");
+        po_.datadir += "/src/SLHCL1TrackTriggerSimulations/AMSimulation/data/";
+        po_.tower    = 27;
+        po_.verbose  = 0;
+        po_.view     = "XYZ";
+        po_.algo     = "PCA4";
+
+        // Combinations of 6 stubs along a track, in every (ptSegment, hitBits).
+        // Consecutive combinations often share their matrix, as in a road
+        std::mt19937 rng(2015);
+        std::uniform_real_distribution<double> udist(0., 1.);
+        const double radii[6] = {22.6, 35.5, 50.5, 68.3, 88.5, 107.7};
+
+        combs_.clear();
+        for (unsigned icomb=0; icomb<500; ++icomb) {
+            TTRoadComb acomb;
+            if (icomb%5 == 0 || combs_.empty()) {
+                acomb.ptSegment = std::min(unsigned(udist(rng) * PCA_NSEGMENTS), PCA_NSEGMENTS - 1);
+                acomb.hitBits   = std::min(unsigned(udist(rng) * PCA_NHITBITS), PCA_NHITBITS - 1);
+            } else {
+                acomb.ptSegment = combs_.back().ptSegment;
+                acomb.hitBits   = combs_.back().hitBits;
+            }
+
+            const double phi0 = 0.8 + 0.1 * udist(rng);
+            const double rinv = 0.005 * (udist(rng) - 0.5);
+            const double z0   = 10. * (udist(rng) - 0.5);
+            const double cot  = 0.3 + 0.2 * udist(rng);
+            for (unsigned istub=0; istub<6; ++istub) {
+                const double r = radii[istub] + 0.5 * udist(rng);
+                acomb.stubs_r   .push_back(r);
+                acomb.stubs_phi .push_back(phi0 - 0.5 * r * rinv + 1e-4 * udist(rng));
+                acomb.stubs_z   .push_back(z0 + r * cot + 0.05 * udist(rng));
+                acomb.stubs_bool.push_back(true);
+            }
+            combs_.push_back(acomb);
+        }
+    }
+
+    void tearDown() {}
+
+    // A single combination
+    void testFit() {
+        TrackFitterAlgoPCA dynamic(po_);
+        TrackFitterAlgoPCAFixed<12, 4> fixed(po_);
+
+        for (unsigned icomb=0; icomb<combs_.size(); ++icomb) {
+            TTTrack2 track1, track2;
+            CPPUNIT_ASSERT_EQUAL(0, dynamic.fit(combs_.at(icomb), track1));
+            CPPUNIT_ASSERT_EQUAL(0, fixed.fit(combs_.at(icomb), track2));
+            checkTrack(track1, track2);
+        }
+    }
+
+    // Blocks of combinations, of decreasing sizes so that the buffers are reused
+    void testFitBlock() {
+        TrackFitterAlgoPCA dynamic(po_);
+        TrackFitterAlgoPCAFixed<12, 4> fixed(po_);
+
+        const unsigned sizes[] = {500, 1, 37, 0, 200};
+        for (unsigned isize=0; isize<sizeof(sizes)/sizeof(sizes[0]); ++isize) {
+            const std::vector<TTRoadComb> combs(combs_.begin(), combs_.begin() + sizes[isize]);
+
+            std::vector<TTTrack2> tracks;
+            CPPUNIT_ASSERT_EQUAL(0, fixed.fitBlock(combs, tracks));
+            CPPUNIT_ASSERT_EQUAL(combs.size(), tracks.size());
+
+            for (unsigned icomb=0; icomb<combs.size(); ++icomb) {
+                TTTrack2 track;
+                CPPUNIT_ASSERT_EQUAL(0, dynamic.fit(combs.at(icomb), track));
+                checkTrack(track, tracks.at(icomb));
+            }
+        }
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestTrackFitterAlgoPCA);
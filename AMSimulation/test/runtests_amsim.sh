@@ -10,23 +10,78 @@ PYTHONTEST=${CMSSW_BASE}/src/SLHCL1TrackTriggerSimulations/AMSimulation/python/t
 
 (amsim -C -i test_ntuple.root -o stubs.root -n 100 --timing) || die 'Failure during stub cleaning' $?
 (python ${PYTHONTEST}/testStubCleaning.py ${LOCAL_TOP_DIR}/stubs.root) || die 'Failure using tesStubCleaning.py' $?
+(amsim -C -i test_ntuple.root -o stubs_readahead.root -n 100 --readAhead 8 --timing) || die 'Failure during stub cleaning with read-ahead' $?
 
 (amsim -B -i stubs.root -o bank.root -n 100 --timing) || die 'Failure during pattern bank generation' $?
+(amsim -B -i stubs.root -o bank_threads.root -n 100 --threads 4 --timing) || die 'Failure during multi-threaded pattern bank generation' $?
+(python ${PYTHONTEST}/compareOutputs.py bank_threads.root bank.root --tree patternBank --tree patternAttributes --tree patternBankInfo) || die 'Failure comparing the multi-threaded pattern bank' $?
+(amsim -B -i stubs.root -o bank_spill.root -n 100 --maxMemory 0 --timing) || die 'Failure during out-of-core pattern bank generation' $?
+(python ${PYTHONTEST}/compareOutputs.py bank_spill.root bank.root --tree patternBank --tree patternBankInfo) || die 'Failure comparing the out-of-core pattern bank' $?
+(python ${PYTHONTEST}/compareOutputs.py bank_spill.root bank.root --tree patternAttributes --tolerance 1e-5) || die 'Failure comparing the out-of-core pattern attributes' $?
+(amsim -B -i stubs.root -o bank_target.root -n 100 --targetCoverage 0.5 --coverageWindow 10 --stableWindows 2 --timing) || die 'Failure during pattern bank generation with target coverage' $?
+(amsim -B -i stubs.root -o bank_shard0.root -n 100 --shard 0/2 --timing) || die 'Failure during pattern bank generation over shard 0' $?
+(amsim -B -i stubs.root -o bank_shard1.root -n 100 --shard 1/2 --timing) || die 'Failure during pattern bank generation over shard 1' $?
+(printf "bank_shard0.root\nbank_shard1.root\n" > banks_shards.txt) || die 'Failure listing the pattern banks' $?
+(amsim -B --merge -i banks_shards.txt -o bank_merged.root --timing) || die 'Failure during pattern bank merging' $?
+(python ${PYTHONTEST}/compareOutputs.py bank_merged.root bank.root --tree patternBank) || die 'Failure comparing the merged pattern bank' $?
+(python ${PYTHONTEST}/compareOutputs.py bank_merged.root bank.root --tree patternAttributes --tolerance 1e-5 --abs-tolerance 1e-6) || die 'Failure comparing the merged pattern attributes' $?
+(amsim -S -i stubs.root -o stubs.stubcache -n 100 --timing) || die 'Failure during stub conversion' $?
+(amsim -B -i stubs.stubcache -o bank_cache.root -n 100 --timing) || die 'Failure during pattern bank generation from stub cache' $?
 #WONTFIX# (python ${PYTHONTEST}/testBankGeneration.py ${LOCAL_TOP_DIR}/bank.root) || die 'Failure using testBankGeneration.py' $?
 
 (amsim -R -i test_ntuple.root -o roads.root -b bank.root -n 100 --timing) || die 'Failure during pattern recognition' $?
 #WONTFIX# (python ${PYTHONTEST}/testPatternRecognition.py ${LOCAL_TOP_DIR}/roads.root) || die 'Failure using testPatternRecognition.py' $?
 
+(amsim -R -i test_ntuple.root -o roads_index.root -b bank.root -n 100 --lookup index --timing) || die 'Failure during pattern recognition with inverted index' $?
+(amsim -R -i test_ntuple.root -o roads_bitslice.root -b bank.root -n 100 --lookup bitslice --timing) || die 'Failure during pattern recognition with bit-sliced bank' $?
+(amsim -R -i test_ntuple.root -o roads_threads.root -b bank.root -n 100 --threads 4 --timing) || die 'Failure during multi-threaded pattern recognition' $?
+(amsim -R -i test_ntuple.root -o roads_readahead.root -b bank.root -n 100 --readAhead 8 --timing) || die 'Failure during pattern recognition with read-ahead' $?
+(amsim -R -i test_ntuple.root -o roads_flat.root -b bank.root -n 100 --flatRoads --timing) || die 'Failure during pattern recognition with flat roads' $?
+(amsim -R -i test_ntuple.root -o roads_dedup.root -b bank.root -n 100 --dedupRoads --timing) || die 'Failure during pattern recognition with deduplicated roads' $?
+
+(amsim -K -i bank.root -o bank.bin --timing) || die 'Failure during pattern bank conversion' $?
+(amsim -R -i test_ntuple.root -o roads_bin.root -b bank.bin -n 100 --timing) || die 'Failure during pattern recognition with binary pattern bank' $?
+
+(amsim -B -i stubs.root -o bank_dc.root -n 100 --nDCBits 2 --timing) || die 'Failure during pattern bank generation with DC bits' $?
+(amsim -R -i test_ntuple.root -o roads_dc.root -b bank_dc.root -n 100 --nDCBits 2 --timing) || die 'Failure during pattern recognition with DC bits' $?
+
 (amsim -M -i stubs.root -o matrices.txt -n 100 --timing) || die 'Failure during matrix building' $?
+(amsim -M -i stubs.stubcache -o matrices_cache.txt -n 100 --timing) || die 'Failure during matrix building from stub cache' $?
+(printf "matrices_shard0.txt\nmatrices_shard1.txt\n" > matrices_shards.txt) || die 'Failure listing the matrix statistics' $?
+(amsim -M -i stubs.root -o matrices_shard0.txt -n 100 --shard 0/2 --timing) || die 'Failure during matrix building pass 0 over shard 0' $?
+(amsim -M -i stubs.root -o matrices_shard1.txt -n 100 --shard 1/2 --timing) || die 'Failure during matrix building pass 0 over shard 1' $?
+(amsim -M --merge -i matrices_shards.txt -o matrices_merged.txt --timing) || die 'Failure during matrix statistics merging pass 0' $?
+(amsim -M -i stubs.root -o matrices_shard0.txt -m matrices_merged.txt -n 100 --shard 0/2 --timing) || die 'Failure during matrix building pass 1 over shard 0' $?
+(amsim -M -i stubs.root -o matrices_shard1.txt -m matrices_merged.txt -n 100 --shard 1/2 --timing) || die 'Failure during matrix building pass 1 over shard 1' $?
+(amsim -M --merge -i matrices_shards.txt -o matrices_merged.txt --timing) || die 'Failure during matrix statistics merging pass 1' $?
+(amsim -M -i stubs.root -o matrices_shard0.txt -m matrices_merged.txt -n 100 --shard 0/2 --timing) || die 'Failure during matrix building pass 2 over shard 0' $?
+(amsim -M -i stubs.root -o matrices_shard1.txt -m matrices_merged.txt -n 100 --shard 1/2 --timing) || die 'Failure during matrix building pass 2 over shard 1' $?
+(amsim -M --merge -i matrices_shards.txt -o matrices_merged.txt --timing) || die 'Failure during matrix statistics merging pass 2' $?
+(python ${PYTHONTEST}/compareOutputs.py matrices_merged.txt matrices.txt --tolerance 1e-6 --abs-tolerance 1e-9) || die 'Failure comparing the matrices of the merged statistics' $?
 #WONTFIX# (python ${PYTHONTEST}/testMatrixBuilding.py ${LOCAL_TOP_DIR}/matrices.txt) || die 'Failure using testMatrixBuilding.py' $?
 
 (amsim -T -i roads.root -o tracks.root -m matrices.txt -n 100 --timing) || die 'Failure during track fitting' $?
+(amsim -T -i roads_flat.root -o tracks_flat.root -m matrices.txt -n 100 --timing) || die 'Failure during track fitting with flat roads' $?
+(amsim -T -i roads_dedup.root -o tracks_dedup.root -m matrices.txt -n 100 --timing) || die 'Failure during track fitting with deduplicated roads' $?
+(amsim -T -i roads.root -o tracks_pca.root -m matrices.txt -n 100 --algo PCA4 --timing) || die 'Failure during PCA track fitting' $?
+(amsim -T -i roads.root -o tracks_batch.root -m matrices.txt -n 100 --algo PCA4 --batchFit --timing) || die 'Failure during PCA track fitting in blocks' $?
+(amsim -T -i roads.root -o tracks_oldcb.root -m matrices.txt -n 100 --oldCB --maxCombs 4 --timing) || die 'Failure during track fitting with the old combination builder' $?
+(amsim -T -i roads.root -o tracks_pdds.root -m matrices.txt -n 100 --PDDS --FiveOfSix --maxCombs 4 --timing) || die 'Failure during track fitting with PDDS combination cleaning' $?
+(amsim -T -i roads.root -o tracks_readahead.root -m matrices.txt -n 100 --readAhead 8 --timing) || die 'Failure during track fitting with read-ahead' $?
+(amsim -T -i roads.root -o tracks_threads.root -m matrices.txt -n 100 --threads 4 --timing) || die 'Failure during multi-threaded track fitting' $?
+(python ${PYTHONTEST}/compareOutputs.py tracks_threads.root tracks.root --prefix AMTT) || die 'Failure comparing the roads and tracks of multi-threaded track fitting' $?
+(amsim -RT -i test_ntuple.root -o tracks_pipeline.root -b bank.root -m matrices.txt -n 100 --timing) || die 'Failure during combined pattern recognition and track fitting' $?
+(amsim -RT -i test_ntuple.root -o tracks_pipeline2.root --roads roads_pipeline.root -b bank.root -m matrices.txt -n 100 --timing) || die 'Failure during combined pattern recognition and track fitting with a road file' $?
+(python ${PYTHONTEST}/compareOutputs.py tracks_pipeline.root tracks.root --prefix AMTT) || die 'Failure comparing the roads and tracks of combined pattern recognition and track fitting' $?
+(python ${PYTHONTEST}/compareOutputs.py roads_pipeline.root roads.root --prefix AMTTRoads_) || die 'Failure comparing the road file of combined pattern recognition and track fitting' $?
 #WONTFIX# (python ${PYTHONTEST}/testTrackFitting.py ${LOCAL_TOP_DIR}/tracks.root) || die 'Failure using testTrackFitting.py' $?
 
 (amsim -A -i stubs.root -o attribs.root -b bank.root -n 100 --timing) || die 'Failure during pattern bank analysis' $?
+(amsim -A -i stubs.stubcache -o attribs_cache.root -b bank.root -n 100 --timing) || die 'Failure during pattern bank analysis from stub cache' $?
 #WONTFIX# (python ${PYTHONTEST}/testBankAnalysis.py ${LOCAL_TOP_DIR}/attribs.root) || die 'Failure using testBankAnalysis.py' $?
 
 (amsim -U -i stubs.root -o tracks_test.root -m matrices.txt -n 100 --timing) || die 'Failure during matrix testing' $?
+(amsim -U -i stubs.stubcache -o tracks_test_cache.root -m matrices.txt -n 100 --timing) || die 'Failure during matrix testing from stub cache' $?
 #WONTFIX# (python ${PYTHONTEST}/testMatrixTesting.py ${LOCAL_TOP_DIR}/tracks_test.root) || die 'Failure using testMatrixTesting.py' $?
 
 (amsim -W -i test_ntuple.root -o results.root --roads roads.root --tracks tracks.root -n 100 --timing) || die 'Failure during ntuple writing' $?
@@ -15,6 +15,48 @@ typedef std::array<superstrip_type,8> pattern_type;
 typedef std::array<superstrip_bit_type,8> pattern_bit_type;
 
 
+// _____________________________________________________________________________
+// Don't care (DC) bits
+// A superstrip at full resolution is split into a coarse superstrip and its
+// nDCBits least significant bits. A pattern stores a coarse superstrip in each
+// layer, plus ternary DC bits (0, 1 or X for each low bit) that select which
+// full-resolution superstrips are accepted. The DC bits are encoded in a
+// superstrip_bit_type: bit values in the low byte, X mask in the high byte.
+
+// DC bits that accept only the given low bits
+inline superstrip_bit_type makeDCBits(unsigned lowBits) {
+    return lowBits & 0xff;
+}
+
+// Widen the DC bits so that they also accept the given low bits
+inline superstrip_bit_type mergeDCBits(superstrip_bit_type dcBits, unsigned lowBits) {
+    const unsigned xmask = (dcBits >> 8) | (((dcBits & 0xff) ^ lowBits) & 0xff);
+    return (xmask << 8) | (dcBits & 0xff & ~xmask);
+}
+
+// Widen the DC bits so that they accept everything accepted by either
+inline superstrip_bit_type combineDCBits(superstrip_bit_type lhs, superstrip_bit_type rhs) {
+    const unsigned xmask = (lhs >> 8) | (rhs >> 8) | ((lhs ^ rhs) & 0xff);
+    return (xmask << 8) | (lhs & 0xff & ~xmask);
+}
+
+// Check whether the low bits are accepted by the DC bits
+inline bool matchDCBits(superstrip_bit_type dcBits, unsigned lowBits) {
+    return (((dcBits ^ lowBits) & ~(dcBits >> 8)) & 0xff) == 0;
+}
+
+// Bitmask of the low bits accepted by the DC bits: bit i is set if low bits i
+// are accepted. Needs nDCBits <= 4.
+inline superstrip_bit_type expandDCBits(superstrip_bit_type dcBits, unsigned nDCBits) {
+    superstrip_bit_type mask = 0;
+    for (unsigned i=0; i<(1u << nDCBits); ++i) {
+        if (matchDCBits(dcBits, i))
+            mask |= (1u << i);
+    }
+    return mask;
+}
+
+
 // _____________________________________________________________________________
 // Output streams
 std::ostream& operator<<(std::ostream& o, const pattern_type& patt);
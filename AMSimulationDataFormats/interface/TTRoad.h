@@ -7,14 +7,42 @@
 
 namespace slhcl1tt {
 
+// Superstrips of the roads of an event, with their stubs. A superstrip that is
+// shared by several roads is stored once:
+//   superstrip i has the ID superstripIds[i] and the stubs stubRefs[k]
+//   with k in [stubRefOffsets[i], stubRefOffsets[i+1])
+struct TTSuperstripTable {
+    std::vector<unsigned> superstripIds;
+    std::vector<unsigned> stubRefOffsets;
+    std::vector<unsigned> stubRefs;
+
+    TTSuperstripTable() : stubRefOffsets(1, 0) {}
+
+    void clear() {
+        superstripIds.clear();
+        stubRefOffsets.assign(1, 0);
+        stubRefs.clear();
+    }
+
+    unsigned size() const { return superstripIds.size(); }
+
+    unsigned nstubs(unsigned i) const { return stubRefOffsets[i+1] - stubRefOffsets[i]; }
+
+    // Add a superstrip, whose stubs were appended to stubRefs, returns its index
+    unsigned add(unsigned superstripId) {
+        superstripIds.push_back(superstripId);
+        stubRefOffsets.push_back(stubRefs.size());
+        return superstripIds.size() - 1;
+    }
+};
+
 struct TTRoad {
     unsigned patternRef;
     unsigned tower;
     unsigned nstubs;
     float    patternInvPt;
 
-    std::vector<unsigned> superstripIds;  // necessary?
-    std::vector<std::vector<unsigned> > stubRefs;  // stubRefs[superstrip i][stub j]
+    std::vector<unsigned> superstripRefs;  // superstrip of layer i in the TTSuperstripTable of the event
 };
 
 
@@ -4,12 +4,9 @@
 namespace slhcl1tt {
 
 std::ostream& operator<<(std::ostream& o, const TTRoad& road) {
-    o << "patternRef: " << road.patternRef << " tower: " << road.tower << " # stubs: " << road.nstubs << " est invPt: " << road.patternInvPt << " superstripIds: (";
-    for (unsigned i=0; i<road.superstripIds.size(); ++i)
-        o << road.superstripIds.at(i) << ",";
-    o << ")" << " # stubs/layer: (";
-    for (unsigned i=0; i<road.stubRefs.size(); ++i)
-        o << road.stubRefs.at(i).size() << ",";
+    o << "patternRef: " << road.patternRef << " tower: " << road.tower << " # stubs: " << road.nstubs << " est invPt: " << road.patternInvPt << " superstripRefs: (";
+    for (unsigned i=0; i<road.superstripRefs.size(); ++i)
+        o << road.superstripRefs.at(i) << ",";
     o << ")" << std::endl;
     return o;
 }
@@ -1,6 +1,8 @@
 #ifndef AMSimulationIO_BasicReader_h_
 #define AMSimulationIO_BasicReader_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+
 #include "TChain.h"
 #include "TFile.h"
 #include "TFileCollection.h"
@@ -14,12 +16,36 @@
 namespace slhcl1tt {
 
 
+// _____________________________________________________________________________
+// Contents of the event buffers of a reader, used to keep more than one event
+// in memory at a time
+struct BasicEventBuffers {
+    std::vector<std::vector<float> >    floats;
+    std::vector<std::vector<int> >      ints;
+    std::vector<std::vector<unsigned> > uints;
+    std::vector<std::vector<bool> >     bools;
+    std::vector<std::vector<std::vector<unsigned> > >               uintVectors;
+    std::vector<std::vector<std::vector<std::vector<unsigned> > > > uintVectorVectors;
+};
+
+// An event buffer of a reader, with the name of its branch
+template <typename T>
+struct RegisteredEventBuffer {
+    TString           branch;
+    std::vector<T> ** buffer;
+};
+
+class BasicReadAhead;
+
+
 // _____________________________________________________________________________
 class BasicReader {
   public:
     BasicReader(int verbose=1);
     ~BasicReader();
 
+    // The source is either a ROOT file, a text file with a list of ROOT files,
+    // or a stub cache made by StubCacheWriter
     int init(TString src, bool full=true);
 
     template <typename T>
@@ -27,12 +53,35 @@ class BasicReader {
 
     void nullStubs(const std::vector<bool>& nulling, bool full=true);
 
-    Long64_t loadTree(Long64_t entry) { return tchain->LoadTree(entry); }
+    // Exchange the contents of the event buffers with the given ones. As output
+    // trees made with CloneTree() share the event buffers, this allows to fill
+    // an event after other events have been read.
+    void swapEventBuffers(BasicEventBuffers& buffers);
+
+    // Read the next nEvents entries in a background thread, into a ring of
+    // event buffers, so that getEntry() only has to swap the buffers. Call it
+    // after init() and before making any writer. The entries are best read in
+    // increasing order, going back restarts the read-ahead.
+    int enableReadAhead(unsigned nEvents);
+
+    Long64_t loadTree(Long64_t entry) {
+        if (cache_)  return (entry < cache_->getEntries()) ? entry : -2;
+        return readAhead_ ? loadTreeAhead(entry) : tchain->LoadTree(entry);
+    }
+
+    Int_t getEntry(Long64_t entry) {
+        if (cache_)  return getEntryCache(entry);
+        return readAhead_ ? getEntryAhead(entry) : tchain->GetEntry(entry);
+    }
 
-    Int_t getEntry(Long64_t entry) { return tchain->GetEntry(entry); }
+    // Number of entries. For a chain, this opens all the files
+    Long64_t getEntries() { return cache_ ? cache_->getEntries() : tchain->GetEntries(); }
 
+    // The chain is null if the source is a stub cache
     TChain* getChain() { return tchain; }
 
+    bool isStubCache() const { return cache_.get() != 0; }
+
     // genParticle information
     std::vector<float> *          vp_pt;
     std::vector<float> *          vp_eta;
@@ -59,9 +108,46 @@ class BasicReader {
     std::vector<int> *            vb_tpId;
 
   protected:
+    // Register the event buffer of a branch that is read, to be handled by
+    // swapEventBuffers() and by the read-ahead
+    void registerEventBuffer(TString branch, std::vector<float> ** buffer)    { floatBuffers_.push_back(makeRegistered(branch, buffer)); }
+    void registerEventBuffer(TString branch, std::vector<int> ** buffer)      { intBuffers_  .push_back(makeRegistered(branch, buffer)); }
+    void registerEventBuffer(TString branch, std::vector<unsigned> ** buffer) { uintBuffers_ .push_back(makeRegistered(branch, buffer)); }
+    void registerEventBuffer(TString branch, std::vector<bool> ** buffer)     { boolBuffers_ .push_back(makeRegistered(branch, buffer)); }
+    void registerEventBuffer(TString branch, std::vector<std::vector<unsigned> > ** buffer)               { uintVectorBuffers_      .push_back(makeRegistered(branch, buffer)); }
+    void registerEventBuffer(TString branch, std::vector<std::vector<std::vector<unsigned> > > ** buffer) { uintVectorVectorBuffers_.push_back(makeRegistered(branch, buffer)); }
+
     TChain* tchain;
     int treenumber;
     const int verbose_;
+
+  private:
+    Long64_t loadTreeAhead(Long64_t entry);
+    Int_t getEntryAhead(Long64_t entry);
+
+    int initStubCache(TString src);
+    Int_t getEntryCache(Long64_t entry);
+
+    template <typename T>
+    static RegisteredEventBuffer<T> makeRegistered(TString branch, std::vector<T> ** buffer) {
+        RegisteredEventBuffer<T> registered = {branch, buffer};
+        return registered;
+    }
+
+    std::vector<RegisteredEventBuffer<float> >    floatBuffers_;
+    std::vector<RegisteredEventBuffer<int> >      intBuffers_;
+    std::vector<RegisteredEventBuffer<unsigned> > uintBuffers_;
+    std::vector<RegisteredEventBuffer<bool> >     boolBuffers_;
+    std::vector<RegisteredEventBuffer<std::vector<unsigned> > >               uintVectorBuffers_;
+    std::vector<RegisteredEventBuffer<std::vector<std::vector<unsigned> > > > uintVectorVectorBuffers_;
+
+    std::unique_ptr<BasicReadAhead> readAhead_;
+
+    // Stub cache, and the columns read into the float, int and unsigned event buffers
+    std::unique_ptr<StubCacheReader> cache_;
+    std::vector<unsigned> floatColumns_;
+    std::vector<unsigned> intColumns_;
+    std::vector<unsigned> uintColumns_;
 };
 
 
@@ -93,6 +179,15 @@ void BasicReader::nullVectorElements(std::vector<T>* v, const std::vector<bool>&
     }
 }
 
+template <typename T>
+void swapEventBufferList(std::vector<RegisteredEventBuffer<T> >& registered, std::vector<std::vector<T> >& buffers) {
+    buffers.resize(registered.size());
+    for (unsigned i=0; i<registered.size(); ++i) {
+        if (*registered.at(i).buffer)  // skip if the branch is not read yet
+            (*registered.at(i).buffer)->swap(buffers.at(i));
+    }
+}
+
 }  // namespace slhcl1tt
 
 #endif
@@ -0,0 +1,113 @@
+#ifndef AMSimulationIO_PatternBankBinary_h_
+#define AMSimulationIO_PatternBankBinary_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
+
+#include "TString.h"
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace slhcl1tt {
+
+// Version of the binary pattern bank format
+static const uint32_t PATTERN_BANK_BINARY_VERSION = 1;
+
+// _____________________________________________________________________________
+// Binary pattern bank, meant to be memory-mapped
+//
+// The file starts with the header, followed by contiguous arrays of fixed-width
+// records, each array starting at a 64-byte boundary:
+//   superstripIds  : npatterns x pattern_type
+//   superstripBits : npatterns x pattern_bit_type  (only if nDCBits > 0)
+//   frequency      : npatterns x frequency_type
+//   invPt          : npatterns x float
+// The superstrips are stored hashed, as layer * nsuperstripsPerLayer + ssId, the way
+// the associative memory uses them. With DC bits, nsuperstripsPerLayer counts the
+// coarse superstrips. All numbers are in native byte order, checked via byteOrder.
+struct PatternBankBinaryHeader {
+    char     magic[8];              // "AMBANK" and two nulls
+    uint32_t version;
+    uint32_t byteOrder;             // 0x01020304
+    uint64_t npatterns;
+    uint32_t nLayers;
+    uint32_t nDCBits;
+    uint32_t nsuperstripsPerLayer;
+    uint32_t tower;
+    float    coverage;
+    uint32_t count;
+    char     superstrip[64];        // null-terminated
+    uint64_t superstripIdsOffset;   // offsets in bytes from the start of the file
+    uint64_t superstripBitsOffset;  // 0 if nDCBits = 0
+    uint64_t frequencyOffset;
+    uint64_t invPtOffset;
+    uint64_t fileSize;
+};
+
+// The header is read and written as raw bytes, its layout must not change
+static_assert(sizeof(PatternBankBinaryHeader) == 152, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, version)              ==   8, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, npatterns)            ==  16, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, nLayers)              ==  24, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, tower)                ==  36, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, coverage)             ==  40, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, count)                ==  44, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, superstrip)           ==  48, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, superstripIdsOffset)  == 112, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, superstripBitsOffset) == 120, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, frequencyOffset)      == 128, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, invPtOffset)          == 136, "PatternBankBinaryHeader layout changed");
+static_assert(offsetof(PatternBankBinaryHeader, fileSize)             == 144, "PatternBankBinaryHeader layout changed");
+
+
+// _____________________________________________________________________________
+class PatternBankBinaryReader {
+  public:
+    PatternBankBinaryReader(int verbose=1);
+    ~PatternBankBinaryReader();
+
+    int init(TString src);
+
+    const PatternBankBinaryHeader& getHeader() const { return *header_; }
+
+    Long64_t getPatterns() const { return header_->npatterns; }
+
+    // The arrays point into the mapped file, they are valid until the reader is destroyed
+    const pattern_type     * getSuperstripIds()  const { return (const pattern_type *)     (data_ + header_->superstripIdsOffset); }
+    const pattern_bit_type * getSuperstripBits() const { return header_->superstripBitsOffset ? (const pattern_bit_type *) (data_ + header_->superstripBitsOffset) : 0; }
+    const frequency_type   * getFrequencies()    const { return (const frequency_type *)   (data_ + header_->frequencyOffset); }
+    const float            * getInvPts()         const { return (const float *)            (data_ + header_->invPtOffset); }
+
+  protected:
+    const char * data_;
+    size_t size_;
+    const PatternBankBinaryHeader * header_;
+    const int verbose_;
+};
+
+
+// _____________________________________________________________________________
+class PatternBankBinaryWriter {
+  public:
+    PatternBankBinaryWriter(int verbose=1);
+    ~PatternBankBinaryWriter();
+
+    // The header must have npatterns, nLayers, nDCBits, nsuperstripsPerLayer and the
+    // bank statistics set. The rest is filled by the writer.
+    int init(TString out, const PatternBankBinaryHeader& header);
+
+    void fillPattern(Long64_t entry, const pattern_type& superstripIds, const pattern_bit_type& superstripBits,
+                     frequency_type frequency, float invPt);
+
+    Long64_t writeFile();
+
+  protected:
+    char * data_;
+    size_t size_;
+    PatternBankBinaryHeader * header_;
+    const int verbose_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
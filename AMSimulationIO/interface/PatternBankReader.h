@@ -24,9 +24,16 @@ class PatternBankReader {
 
     void getPatternBankInfo(float& coverage, unsigned& count, unsigned& tower, std::string& superstrip);
     void getPatternInvPt(Long64_t entry, float& invPt_mean);
+    void getPatternBankDCBits(unsigned& nDCBits);
+
+    void getPatternBankEvents(unsigned& events);
 
     Int_t getPattern(Long64_t entry) { return ttree->GetEntry(entry); }
 
+    // Read all the attributes of a pattern, not only invPt_mean. Returns 0 if
+    // the bank has no attributes
+    Int_t getPatternAttributes(Long64_t entry);
+
     Long64_t getPatterns() const { return ttree->GetEntries(); }
 
     // Pattern attributes
@@ -44,10 +51,13 @@ class PatternBankReader {
     unsigned                       pb_count;
     unsigned                       pb_tower;
     std::string *                  pb_superstrip;
+    unsigned                       pb_nDCBits;
+    unsigned                       pb_events;
 
     // Pattern bank
     frequency_type                 pb_frequency;
     std::vector<superstrip_type> * pb_superstripIds;
+    std::vector<superstrip_bit_type> * pb_superstripBits;  // empty if no DC bits
 
   protected:
     TFile* tfile;
@@ -89,10 +99,13 @@ class PatternBankWriter {
     std::auto_ptr<unsigned>                      pb_count;
     std::auto_ptr<unsigned>                      pb_tower;
     std::auto_ptr<std::string>                   pb_superstrip;
+    std::auto_ptr<unsigned>                      pb_nDCBits;
+    std::auto_ptr<unsigned>                      pb_events;
 
     // Pattern bank
     std::auto_ptr<frequency_type>                pb_frequency;
     std::auto_ptr<std::vector<superstrip_type> > pb_superstripIds;
+    std::auto_ptr<std::vector<superstrip_bit_type> > pb_superstripBits;  // empty if no DC bits
 
   protected:
     TFile* tfile;
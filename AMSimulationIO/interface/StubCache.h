@@ -0,0 +1,146 @@
+#ifndef AMSimulationIO_StubCache_h_
+#define AMSimulationIO_StubCache_h_
+
+#include "TString.h"
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace slhcl1tt {
+
+class BasicReader;
+
+// Version of the stub cache format
+static const uint32_t STUB_CACHE_VERSION = 1;
+
+// Type of the elements of a stub cache column
+enum StubCacheType { STUB_CACHE_FLOAT = 0, STUB_CACHE_INT = 1, STUB_CACHE_UINT = 2 };
+
+// Collection of a stub cache column, each has its own per-event offsets
+enum StubCacheCollection { STUB_CACHE_STUBS = 0, STUB_CACHE_PARTS = 1 };
+
+// _____________________________________________________________________________
+// Columnar stub cache, meant to be memory-mapped
+//
+// The file starts with the header and the column table, followed by 64-byte
+// aligned arrays:
+//   stubOffsets : (nevents+1) x uint64  event i has the stubs [stubOffsets[i], stubOffsets[i+1])
+//   partOffsets : (nevents+1) x uint64  same for the generated particles
+//   one array of 4-byte elements per column, with the elements of all the events
+// The columns are named after the ntuple branches they are made from. All
+// numbers are in native byte order, checked via byteOrder.
+struct StubCacheColumn {
+    char     name[32];              // null-terminated
+    uint32_t type;                  // StubCacheType
+    uint32_t collection;            // StubCacheCollection
+    uint64_t offset;                // offset in bytes from the start of the file
+};
+
+struct StubCacheHeader {
+    char     magic[8];              // "AMSTUBS" and a null
+    uint32_t version;
+    uint32_t byteOrder;             // 0x01020304
+    uint64_t nevents;
+    uint64_t nstubs;
+    uint64_t nparts;
+    uint32_t ncolumns;
+    uint32_t padding;
+    uint64_t stubOffsetsOffset;     // offsets in bytes from the start of the file
+    uint64_t partOffsetsOffset;
+    uint64_t fileSize;
+};
+
+// The header and the column table are read and written as raw bytes, their
+// layout must not change
+static_assert(sizeof(StubCacheColumn) == 48, "StubCacheColumn layout changed");
+static_assert(offsetof(StubCacheColumn, type)       == 32, "StubCacheColumn layout changed");
+static_assert(offsetof(StubCacheColumn, collection) == 36, "StubCacheColumn layout changed");
+static_assert(offsetof(StubCacheColumn, offset)     == 40, "StubCacheColumn layout changed");
+
+static_assert(sizeof(StubCacheHeader) == 72, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, version)           ==  8, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, nevents)           == 16, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, nstubs)            == 24, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, nparts)            == 32, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, ncolumns)          == 40, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, stubOffsetsOffset) == 48, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, partOffsetsOffset) == 56, "StubCacheHeader layout changed");
+static_assert(offsetof(StubCacheHeader, fileSize)          == 64, "StubCacheHeader layout changed");
+
+
+// _____________________________________________________________________________
+class StubCacheReader {
+  public:
+    StubCacheReader(int verbose=1);
+    ~StubCacheReader();
+
+    int init(TString src);
+
+    const StubCacheHeader& getHeader() const { return *header_; }
+
+    Long64_t getEntries() const { return header_->nevents; }
+
+    // Index of the column with the given name and type, or -1 if not found
+    int findColumn(const char* name, StubCacheType type) const;
+
+    // Elements of an event in a column. They point into the mapped file, they
+    // are valid until the reader is destroyed
+    template <typename T>
+    void getColumn(unsigned icol, Long64_t entry, const T*& begin, const T*& end) const {
+        const StubCacheColumn& column = columns_[icol];
+        const uint64_t* offsets = (const uint64_t *) (data_ + (column.collection == STUB_CACHE_STUBS ? header_->stubOffsetsOffset : header_->partOffsetsOffset));
+        const T* elements = (const T *) (data_ + column.offset);
+        begin = elements + offsets[entry];
+        end   = elements + offsets[entry+1];
+    }
+
+  protected:
+    const char * data_;
+    size_t size_;
+    const StubCacheHeader * header_;
+    const StubCacheColumn * columns_;
+    const int verbose_;
+};
+
+
+// _____________________________________________________________________________
+// The elements of each column are streamed to a temporary file next to the
+// output, <out>.<column index>.tmp, and only put together by writeFile(). The
+// per-event offsets are kept in memory.
+class StubCacheWriter {
+  public:
+    StubCacheWriter(int verbose=1);
+    ~StubCacheWriter();
+
+    int init(TString out);
+
+    // Append the stubs and the generated particles of the current event of a
+    // reader that reads at least the columns of the cache
+    void fill(const BasicReader& reader);
+
+    // Write the file and remove the temporary files, return the number of
+    // events, or -1 if anything failed
+    Long64_t writeFile();
+
+  protected:
+    template <typename T>
+    void appendColumn(unsigned icol, const std::vector<T>* v);
+
+    void closeColumnFiles();
+
+    TString out_;
+    std::vector<uint64_t> stubOffsets_;
+    std::vector<uint64_t> partOffsets_;
+    std::vector<StubCacheColumn> columns_;
+    std::vector<TString> columnPaths_;    // temporary file of each column
+    std::vector<std::FILE *> columnFiles_;
+    std::vector<uint64_t> columnSizes_;   // bytes written to each column
+    bool failed_;
+    const int verbose_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoad.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubPlusTPReader.h"
+#include <deque>
 
 
 namespace slhcl1tt {
@@ -15,13 +16,63 @@ class TTRoadReader : public TTStubPlusTPReader {
 
     int init(TString src, TString prefix, TString suffix);
 
+    // Is the input in the flat road layout? Is it also deduplicated?
+    bool isFlat() const { return flat_; }
+    bool isDedup() const { return dedup_; }
+
+    // Access the superstrips and the stubs of a road in any layout, without
+    // allocating
+    unsigned getNLayers(unsigned iroad) const {
+        return flat_ ? (vr_layerOffsets->at(iroad+1) - vr_layerOffsets->at(iroad)) : vr_stubRefs->at(iroad).size();
+    }
+
+    unsigned getSuperstripId(unsigned iroad, unsigned ilayer) const {
+        return flat_ ? vr_superstripIdsFlat->at(getSuperstripRef(iroad, ilayer)) : vr_superstripIds->at(iroad).at(ilayer);
+    }
+
+    unsigned getNStubs(unsigned iroad, unsigned ilayer) const {
+        if (!flat_)
+            return vr_stubRefs->at(iroad).at(ilayer).size();
+        const unsigned j = getSuperstripRef(iroad, ilayer);
+        return vr_stubRefOffsets->at(j+1) - vr_stubRefOffsets->at(j);
+    }
+
+    unsigned getStubRef(unsigned iroad, unsigned ilayer, unsigned istub) const {
+        if (!flat_)
+            return vr_stubRefs->at(iroad).at(ilayer).at(istub);
+        const unsigned j = getSuperstripRef(iroad, ilayer);
+        return vr_stubRefsFlat->at(vr_stubRefOffsets->at(j) + istub);
+    }
+
+    // Copy the stubs of a road into stubRefs[superstrip i][stub j], reusing its memory
+    void getStubRefs(unsigned iroad, std::vector<std::vector<unsigned> >& stubRefs) const;
+
     // Roads
     std::vector<unsigned> *                             vr_patternRef;
     std::vector<unsigned> *                             vr_tower;
     std::vector<unsigned> *                             vr_nstubs;
     std::vector<float> *                                vr_patternInvPt;
+
+    // Roads in the legacy layout
     std::vector<std::vector<unsigned> > *               vr_superstripIds;
     std::vector<std::vector<std::vector<unsigned> > > * vr_stubRefs;
+
+    // Roads in the flat layout, see TTRoadWriter
+    std::vector<unsigned> *                             vr_layerOffsets;
+    std::vector<unsigned> *                             vr_stubRefOffsets;
+    std::vector<unsigned> *                             vr_superstripIdsFlat;
+    std::vector<unsigned> *                             vr_stubRefsFlat;
+    std::vector<unsigned> *                             vr_superstripRefs;
+
+  protected:
+    // Position of a layer of a road in the superstrip table of the flat layout
+    unsigned getSuperstripRef(unsigned iroad, unsigned ilayer) const {
+        const unsigned j = vr_layerOffsets->at(iroad) + ilayer;
+        return dedup_ ? vr_superstripRefs->at(j) : j;
+    }
+
+    bool flat_;
+    bool dedup_;
 };
 
 
@@ -31,18 +82,47 @@ class TTRoadWriter : public BasicWriter {
     TTRoadWriter(int verbose=1);
     ~TTRoadWriter();
 
-    int init(TChain* tchain, TString out, TString prefix, TString suffix);
+    int init(TChain* tchain, TString out, TString prefix, TString suffix, bool flat=false, bool dedup=false);
+
+    // Make one set of road branches for each suffix
+    int init(TChain* tchain, TString out, TString prefix, const std::vector<TString>& suffixes, bool flat=false, bool dedup=false);
+
+    // The roads refer to the superstrips in the table
+    void fill(const std::vector<TTRoad>& roads, const TTSuperstripTable& table);
 
-    void fill(const std::vector<TTRoad>& roads);
+    // Fill every set of road branches, roadsPerSuffix and tablesPerSuffix are
+    // in the same order as the suffixes
+    void fill(const std::vector<std::vector<TTRoad> >& roadsPerSuffix, const std::vector<TTSuperstripTable>& tablesPerSuffix);
 
   protected:
-    // Roads
-    std::auto_ptr<std::vector<unsigned> >                             vr_patternRef;
-    std::auto_ptr<std::vector<unsigned> >                             vr_tower;
-    std::auto_ptr<std::vector<unsigned> >                             vr_nstubs;
-    std::auto_ptr<std::vector<float> >                                vr_patternInvPt;
-    std::auto_ptr<std::vector<std::vector<unsigned> > >               vr_superstripIds;
-    std::auto_ptr<std::vector<std::vector<std::vector<unsigned> > > > vr_stubRefs;
+    void setRoads(unsigned i, const std::vector<TTRoad>& roads, const TTSuperstripTable& table);
+
+    // Write the flat road layout instead of the legacy one.
+    // In the flat layout, the superstrips and the stubs of all the roads of an
+    // event are stored in contiguous arrays:
+    //   road i has the layers [layerOffsets[i], layerOffsets[i+1])
+    //   layer j has the superstrip superstripIdsFlat[j] and the stubs
+    //   stubRefsFlat[k] with k in [stubRefOffsets[j], stubRefOffsets[j+1])
+    bool flat_;
+
+    // Write the deduplicated flat road layout. The superstrips that are shared
+    // by several roads are written once, and layer j of the roads refers to
+    // the superstrip superstripRefs[j] instead of j. The superstrips are the
+    // TTSuperstripTable of the event
+    bool dedup_;
+
+    // Roads, one element per set of road branches
+    std::deque<std::vector<unsigned> >                             vr_patternRef;
+    std::deque<std::vector<unsigned> >                             vr_tower;
+    std::deque<std::vector<unsigned> >                             vr_nstubs;
+    std::deque<std::vector<float> >                                vr_patternInvPt;
+    std::deque<std::vector<std::vector<unsigned> > >               vr_superstripIds;
+    std::deque<std::vector<std::vector<std::vector<unsigned> > > > vr_stubRefs;
+    std::deque<std::vector<unsigned> >                             vr_layerOffsets;
+    std::deque<std::vector<unsigned> >                             vr_stubRefOffsets;
+    std::deque<std::vector<unsigned> >                             vr_superstripIdsFlat;
+    std::deque<std::vector<unsigned> >                             vr_stubRefsFlat;
+    std::deque<std::vector<unsigned> >                             vr_superstripRefs;
 };
 
 }  // namespace slhcl1tt
@@ -22,18 +22,31 @@ class TTTrackReader : public TTRoadReader {
 
 
 // _____________________________________________________________________________
-class TTTrackWriter : public BasicWriter {
+// The roads of the tracks are either copied from the input chain, or written
+// by this writer when the input has none
+class TTTrackWriter : public TTRoadWriter {
   public:
     TTTrackWriter(int verbose=1);
     ~TTTrackWriter();
 
     int init(TChain* tchain, TString out, TString prefix, TString suffix);
 
+    // Also make the road branches
+    int init(TChain* tchain, TString out, TString prefixRoad, TString prefixTrack, TString suffix, bool flat=false, bool dedup=false);
+
     void fill(const std::vector<TTTrack>& tracks);
 
     void fill(const std::vector<TTTrack2>& tracks);
 
+    // Fill the roads together with their tracks, the roadRef of a track is the
+    // index of its road
+    void fill(const std::vector<TTRoad>& roads, const TTSuperstripTable& table, const std::vector<TTTrack2>& tracks);
+
   protected:
+    void makeTrackBranches(TString prefix, TString suffix);
+
+    void setTracks(const std::vector<TTTrack2>& tracks);
+
     // Tracks
     std::auto_ptr<std::vector<float> >                  vt_px;
     std::auto_ptr<std::vector<float> >                  vt_py;
@@ -3,6 +3,242 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/Helper.h"
 using namespace slhcl1tt;
 
+#include "TThread.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+// _____________________________________________________________________________
+namespace {
+
+// Event buffers of the chain that is read ahead, in the same order as the
+// registered event buffers of the reader
+template <typename T>
+struct ReadAheadBufferList {
+    std::vector<std::vector<T> *> staging;  // read by the background chain
+    std::vector<std::vector<T> *> owned;    // allocated for the reader
+
+    ~ReadAheadBufferList() {
+        for (unsigned i=0; i<staging.size(); ++i)  delete staging.at(i);
+        for (unsigned i=0; i<owned.size(); ++i)    delete owned.at(i);
+    }
+
+    void setUp(std::vector<RegisteredEventBuffer<T> >& registered, TChain* chain, std::vector<TString>& branches) {
+        // The chain keeps the addresses of the pointers, so resize only once
+        staging.resize(registered.size());
+        for (unsigned i=0; i<registered.size(); ++i) {
+            // The entries are swapped into the reader, so its buffers must exist
+            if (!*registered.at(i).buffer) {
+                *registered.at(i).buffer = new std::vector<T>();
+                owned.push_back(*registered.at(i).buffer);
+            }
+            staging.at(i) = new std::vector<T>();
+            chain->SetBranchStatus(registered.at(i).branch, 1);
+            chain->SetBranchAddress(registered.at(i).branch, &(staging.at(i)));
+            branches.push_back(registered.at(i).branch);
+        }
+    }
+
+    void swap(std::vector<std::vector<T> >& buffers) {
+        buffers.resize(staging.size());
+        for (unsigned i=0; i<staging.size(); ++i)
+            staging.at(i)->swap(buffers.at(i));
+    }
+};
+
+// Find the stub cache columns of the registered event buffers
+template <typename T>
+int bindStubCacheColumns(const StubCacheReader& cache, StubCacheType type, std::vector<RegisteredEventBuffer<T> >& registered, std::vector<unsigned>& columns) {
+    columns.clear();
+    for (unsigned i=0; i<registered.size(); ++i) {
+        int icol = cache.findColumn(registered.at(i).branch, type);
+        if (icol < 0) {
+            std::cout << Error() << "Branch " << registered.at(i).branch << " is not in the stub cache." << std::endl;
+            return 1;
+        }
+        columns.push_back(icol);
+        *registered.at(i).buffer = new std::vector<T>();
+    }
+    return 0;
+}
+
+template <typename T>
+Int_t readStubCacheColumns(const StubCacheReader& cache, Long64_t entry, std::vector<RegisteredEventBuffer<T> >& registered, const std::vector<unsigned>& columns) {
+    Int_t nbytes = 0;
+    for (unsigned i=0; i<registered.size(); ++i) {
+        const T* begin = 0;
+        const T* end = 0;
+        cache.getColumn(columns.at(i), entry, begin, end);
+        (*registered.at(i).buffer)->assign(begin, end);
+        nbytes += (end - begin) * sizeof(T);
+    }
+    return nbytes;
+}
+
+template <typename T>
+void deleteEventBufferList(std::vector<RegisteredEventBuffer<T> >& registered) {
+    for (unsigned i=0; i<registered.size(); ++i) {
+        delete *registered.at(i).buffer;
+        *registered.at(i).buffer = 0;
+    }
+}
+
+}  // namespace
+
+
+// _____________________________________________________________________________
+// Reads a second chain with the same files and the same active branches in a
+// background thread, into a ring of event buffers. The ring holds the entries
+// [nextEntry_, nextEntry_ + count_), starting at slot head_.
+class slhcl1tt::BasicReadAhead {
+  public:
+    struct Slot {
+        BasicEventBuffers buffers;
+        Long64_t          localEntry;
+        Int_t             nbytes;
+    };
+
+    BasicReadAhead(unsigned nEvents)
+    : chain(0), slots_(nEvents), head_(0), count_(0), nextEntry_(0), endEntry_(-1), started_(false), stopping_(false) {}
+
+    ~BasicReadAhead() {
+        stop();
+        if (chain)  delete chain;
+    }
+
+    // Wait until the entry is read, return 0 if it is past the end of the chain
+    Slot* wait(Long64_t entry);
+
+    // Release the entry at the head of the ring
+    void pop();
+
+    TChain* chain;
+    ReadAheadBufferList<float>    floats;
+    ReadAheadBufferList<int>      ints;
+    ReadAheadBufferList<unsigned> uints;
+    ReadAheadBufferList<bool>     bools;
+    ReadAheadBufferList<std::vector<unsigned> >               uintVectors;
+    ReadAheadBufferList<std::vector<std::vector<unsigned> > > uintVectorVectors;
+
+  private:
+    void start(Long64_t entry);
+    void stop();
+    void run(Long64_t entry);
+
+    std::vector<Slot>       slots_;
+    unsigned                head_;
+    unsigned                count_;
+    Long64_t                nextEntry_;
+    Long64_t                endEntry_;  // first entry past the end, or -1 if not reached yet
+    bool                    started_;
+    bool                    stopping_;
+
+    std::thread             thread_;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+};
+
+void BasicReadAhead::start(Long64_t entry) {
+    head_      = 0;
+    count_     = 0;
+    nextEntry_ = entry;
+    endEntry_  = -1;
+    started_   = true;
+    stopping_  = false;
+    thread_    = std::thread(&BasicReadAhead::run, this, entry);
+}
+
+void BasicReadAhead::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+    started_ = false;
+}
+
+void BasicReadAhead::run(Long64_t entry) {
+    for (;; ++entry) {
+        Slot* slot = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]() { return stopping_ || count_ < slots_.size(); });
+            if (stopping_)
+                return;
+
+            // The slot after the ring is only used by this thread
+            slot = &slots_.at((head_ + count_) % slots_.size());
+        }
+
+        const Long64_t localEntry = chain->LoadTree(entry);
+        if (localEntry < 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                endEntry_ = entry;
+            }
+            cond_.notify_all();
+            return;
+        }
+
+        slot->nbytes     = chain->GetEntry(entry);
+        slot->localEntry = localEntry;
+        floats           .swap(slot->buffers.floats);
+        ints             .swap(slot->buffers.ints);
+        uints            .swap(slot->buffers.uints);
+        bools            .swap(slot->buffers.bools);
+        uintVectors      .swap(slot->buffers.uintVectors);
+        uintVectorVectors.swap(slot->buffers.uintVectorVectors);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++count_;
+        }
+        cond_.notify_all();
+    }
+}
+
+BasicReadAhead::Slot* BasicReadAhead::wait(Long64_t entry) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (started_ && endEntry_ >= 0 && entry >= endEntry_)
+        return 0;
+
+    // Restart if the entry is behind or beyond the ring
+    if (!started_ || entry < nextEntry_ || entry >= nextEntry_ + (Long64_t) slots_.size()) {
+        lock.unlock();
+        stop();
+        start(entry);
+        lock.lock();
+    }
+
+    for (;;) {
+        cond_.wait(lock, [this]() { return count_ > 0 || endEntry_ >= 0; });
+        if (count_ == 0)
+            return 0;
+        if (nextEntry_ == entry)
+            return &slots_.at(head_);
+
+        // Drop the entries that are skipped
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+        ++nextEntry_;
+        cond_.notify_all();
+    }
+}
+
+void BasicReadAhead::pop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+        ++nextEntry_;
+    }
+    cond_.notify_all();
+}
+
 
 // _____________________________________________________________________________
 BasicReader::BasicReader(int verbose)
@@ -29,18 +265,52 @@ BasicReader::BasicReader(int verbose)
   vb_modId            (0),
   vb_tpId             (0),
   //
+  tchain(0), treenumber(0),
   verbose_(verbose) {}
 
 BasicReader::~BasicReader() {
+    readAhead_.reset();  // stop reading first
     if (tchain)  delete tchain;
+
+    // The event buffers of a stub cache are not owned by a chain
+    if (cache_) {
+        deleteEventBufferList(floatBuffers_);
+        deleteEventBufferList(intBuffers_);
+        deleteEventBufferList(uintBuffers_);
+    }
 }
 
 int BasicReader::init(TString src, bool full) {
-    if (!src.EndsWith(".root") && !src.EndsWith(".txt")) {
-        std::cout << Error() << "Input source must be either .root or .txt" << std::endl;
+    if (!src.EndsWith(".root") && !src.EndsWith(".txt") && !src.EndsWith(".stubcache")) {
+        std::cout << Error() << "Input source must be either .root, .txt or .stubcache" << std::endl;
         return 1;
     }
 
+    registerEventBuffer("genParts_pt"       , &vp_pt);
+    registerEventBuffer("genParts_eta"      , &vp_eta);
+    registerEventBuffer("genParts_phi"      , &vp_phi);
+    registerEventBuffer("genParts_vx"       , &vp_vx);
+    registerEventBuffer("genParts_vy"       , &vp_vy);
+    registerEventBuffer("genParts_vz"       , &vp_vz);
+    registerEventBuffer("genParts_charge"   , &vp_charge);
+    if (full)  registerEventBuffer("TTStubs_x"         , &vb_x);
+    if (full)  registerEventBuffer("TTStubs_y"         , &vb_y);
+    registerEventBuffer("TTStubs_z"         , &vb_z);
+    registerEventBuffer("TTStubs_r"         , &vb_r);
+    registerEventBuffer("TTStubs_eta"       , &vb_eta);
+    registerEventBuffer("TTStubs_phi"       , &vb_phi);
+    registerEventBuffer("TTStubs_coordx"    , &vb_coordx);
+    registerEventBuffer("TTStubs_coordy"    , &vb_coordy);
+    registerEventBuffer("TTStubs_trigBend"  , &vb_trigBend);
+    if (full)  registerEventBuffer("TTStubs_roughPt"   , &vb_roughPt);
+    if (full)  registerEventBuffer("TTStubs_clusWidth0", &vb_clusWidth0);
+    if (full)  registerEventBuffer("TTStubs_clusWidth1", &vb_clusWidth1);
+    registerEventBuffer("TTStubs_modId"     , &vb_modId);
+    registerEventBuffer("TTStubs_tpId"      , &vb_tpId);
+
+    if (src.EndsWith(".stubcache"))
+        return initStubCache(src);
+
     if (verbose_)  std::cout << Info() << "Opening " << src << std::endl;
     tchain = new TChain("ntupler/tree");
 
@@ -109,6 +379,7 @@ int BasicReader::init(TString src, bool full) {
     if (full)  tchain->SetBranchStatus("TTStubs_clusWidth1", 1);
     tchain->SetBranchStatus("TTStubs_modId"     , 1);
     tchain->SetBranchStatus("TTStubs_tpId"      , 1);
+
     return 0;
 }
 
@@ -129,6 +400,125 @@ void BasicReader::nullStubs(const std::vector<bool>& nulling, bool full) {
     nullVectorElements(vb_tpId      , nulling);
 }
 
+void BasicReader::swapEventBuffers(BasicEventBuffers& buffers) {
+    swapEventBufferList(floatBuffers_, buffers.floats);
+    swapEventBufferList(intBuffers_  , buffers.ints);
+    swapEventBufferList(uintBuffers_ , buffers.uints);
+    swapEventBufferList(boolBuffers_ , buffers.bools);
+    swapEventBufferList(uintVectorBuffers_      , buffers.uintVectors);
+    swapEventBufferList(uintVectorVectorBuffers_, buffers.uintVectorVectors);
+}
+
+int BasicReader::enableReadAhead(unsigned nEvents) {
+    if (nEvents == 0 || cache_)  // a stub cache is already mapped in memory
+        return 0;
+
+    // Allow ROOT to be used from the background thread
+    TThread::Initialize();
+
+    readAhead_.reset(new BasicReadAhead(nEvents));
+    TChain* chain = readAhead_->chain = new TChain(tchain->GetName());
+
+    TObjArray* files = tchain->GetListOfFiles();
+    for (int i=0; i<files->GetEntriesFast(); ++i) {
+        if (!chain->Add(files->UncheckedAt(i)->GetTitle())) {
+            std::cout << Error() << "Failed to read " << files->UncheckedAt(i)->GetTitle() << std::endl;
+            readAhead_.reset();
+            return 1;
+        }
+    }
+
+    // Read the registered branches only
+    std::vector<TString> branches;
+    chain->SetBranchStatus("*", 0);
+    readAhead_->floats           .setUp(floatBuffers_           , chain, branches);
+    readAhead_->ints             .setUp(intBuffers_             , chain, branches);
+    readAhead_->uints            .setUp(uintBuffers_            , chain, branches);
+    readAhead_->bools            .setUp(boolBuffers_            , chain, branches);
+    readAhead_->uintVectors      .setUp(uintVectorBuffers_      , chain, branches);
+    readAhead_->uintVectorVectors.setUp(uintVectorVectorBuffers_, chain, branches);
+
+    // Size the TTreeCache to hold the active branches for one cluster of
+    // entries, or for the entries in the ring if there are more
+    Long64_t cacheSize = 1 << 20;
+    if (chain->LoadTree(0) >= 0) {
+        TTree* tree = chain->GetTree();
+        const Long64_t nentries = std::max(tree->GetEntries(), Long64_t(1));
+
+        Long64_t zipBytes = 0;
+        for (unsigned i=0; i<branches.size(); ++i) {
+            TBranch* branch = tree->GetBranch(branches.at(i));
+            if (branch)
+                zipBytes += branch->GetZipBytes("*");
+        }
+
+        Long64_t clusterEntries = tree->GetAutoFlush();
+        if (clusterEntries <= 0)  // flushed every -autoFlush bytes
+            clusterEntries = -clusterEntries / (tree->GetZipBytes() / nentries + 1) + 1;
+        clusterEntries = std::max(clusterEntries, Long64_t(nEvents));
+
+        cacheSize = std::max(cacheSize, (zipBytes / nentries + 1) * clusterEntries);
+        cacheSize = std::min(cacheSize, Long64_t(256) << 20);
+    }
+
+    chain->SetCacheSize(cacheSize);
+    for (unsigned i=0; i<branches.size(); ++i)
+        chain->AddBranchToCache(branches.at(i), true);
+    chain->StopCacheLearningPhase();
+
+    if (verbose_)  std::cout << Info() << "Reading ahead " << nEvents << " events, with a " << (cacheSize >> 10) << " kB cache for " << branches.size() << " branches." << std::endl;
+    return 0;
+}
+
+int BasicReader::initStubCache(TString src) {
+    tchain = 0;
+    treenumber = 0;
+
+    cache_.reset(new StubCacheReader(verbose_));
+    if (cache_->init(src))
+        return 1;
+
+    if (!boolBuffers_.empty() || !uintVectorBuffers_.empty() || !uintVectorVectorBuffers_.empty()) {
+        std::cout << Error() << "The stub cache only has float, int and unsigned branches." << std::endl;
+        return 1;
+    }
+
+    if (bindStubCacheColumns(*cache_, STUB_CACHE_FLOAT, floatBuffers_, floatColumns_) ||
+        bindStubCacheColumns(*cache_, STUB_CACHE_INT  , intBuffers_  , intColumns_  ) ||
+        bindStubCacheColumns(*cache_, STUB_CACHE_UINT , uintBuffers_ , uintColumns_ ))
+        return 1;
+    return 0;
+}
+
+Int_t BasicReader::getEntryCache(Long64_t entry) {
+    if (entry < 0 || entry >= cache_->getEntries())
+        return 0;
+
+    // One copy per column, nothing to decompress
+    Int_t nbytes = 0;
+    nbytes += readStubCacheColumns(*cache_, entry, floatBuffers_, floatColumns_);
+    nbytes += readStubCacheColumns(*cache_, entry, intBuffers_  , intColumns_  );
+    nbytes += readStubCacheColumns(*cache_, entry, uintBuffers_ , uintColumns_ );
+    return nbytes;
+}
+
+Long64_t BasicReader::loadTreeAhead(Long64_t entry) {
+    BasicReadAhead::Slot* slot = readAhead_->wait(entry);
+    return slot ? slot->localEntry : -2;  // -2 if the entry does not exist, as TChain::LoadTree()
+}
+
+Int_t BasicReader::getEntryAhead(Long64_t entry) {
+    BasicReadAhead::Slot* slot = readAhead_->wait(entry);
+    if (!slot)
+        return 0;
+
+    // Take the entry, and give back the buffers of the previous one to be reused
+    swapEventBuffers(slot->buffers);
+    const Int_t nbytes = slot->nbytes;
+    readAhead_->pop();
+    return nbytes;
+}
+
 
 // _____________________________________________________________________________
 BasicWriter::BasicWriter(int verbose)
@@ -147,6 +537,11 @@ int BasicWriter::init(TChain* tchain, TString out) {
         return 1;
     }
 
+    if (!tchain) {
+        std::cout << Error() << "Cannot write an ntuple from a stub cache." << std::endl;
+        return 1;
+    }
+
     if (verbose_)  std::cout << Info() << "Opening " << out << std::endl;
     tfile = TFile::Open(out, "RECREATE");
 
@@ -0,0 +1,179 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankBinary.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/Helper.h"
+using namespace slhcl1tt;
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char     PATTERN_BANK_BINARY_MAGIC[8] = {'A','M','B','A','N','K','\0','\0'};
+const uint32_t PATTERN_BANK_BINARY_BYTEORDER = 0x01020304;
+
+// Round up to a multiple of 64 bytes
+uint64_t align64(uint64_t n) {
+    return (n + 63) & ~uint64_t(63);
+}
+}
+
+
+// _____________________________________________________________________________
+PatternBankBinaryReader::PatternBankBinaryReader(int verbose)
+: data_(0), size_(0), header_(0), verbose_(verbose) {}
+
+PatternBankBinaryReader::~PatternBankBinaryReader() {
+    if (data_)  munmap((void *) data_, size_);
+}
+
+int PatternBankBinaryReader::init(TString src) {
+    if (!src.EndsWith(".bin")) {
+        std::cout << Error() << "Input source must be .bin" << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << "Opening " << src << std::endl;
+    int fd = open(src.Data(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cout << Error() << "Failed to open " << src << std::endl;
+        if (fd >= 0)  close(fd);
+        return 1;
+    }
+
+    if ((size_t) st.st_size < sizeof(PatternBankBinaryHeader)) {
+        std::cout << Error() << "File is too small to be a binary pattern bank: " << src << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    // The mapping stays valid after the file is closed, and the pages are shared
+    // with every other process that maps the same bank
+    size_ = st.st_size;
+    void * addr = mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cout << Error() << "Failed to map " << src << std::endl;
+        size_ = 0;
+        return 1;
+    }
+    data_ = (const char *) addr;
+    header_ = (const PatternBankBinaryHeader *) data_;
+
+    // Check the header
+    if (std::memcmp(header_->magic, PATTERN_BANK_BINARY_MAGIC, sizeof(PATTERN_BANK_BINARY_MAGIC)) != 0) {
+        std::cout << Error() << "Not a binary pattern bank: " << src << std::endl;
+        return 1;
+    }
+    if (header_->byteOrder != PATTERN_BANK_BINARY_BYTEORDER) {
+        std::cout << Error() << "Binary pattern bank was written with a different byte order: " << src << std::endl;
+        return 1;
+    }
+    if (header_->version != PATTERN_BANK_BINARY_VERSION) {
+        std::cout << Error() << "Binary pattern bank has version " << header_->version << ", expected " << PATTERN_BANK_BINARY_VERSION << std::endl;
+        return 1;
+    }
+    if (header_->fileSize != size_ ||
+        header_->invPtOffset + header_->npatterns * sizeof(float) > size_) {
+        std::cout << Error() << "Binary pattern bank is truncated: " << src << std::endl;
+        return 1;
+    }
+
+    // Read the patterns in ahead of the lookup
+    madvise(addr, size_, MADV_WILLNEED);
+
+    if (verbose_)  std::cout << Info() << "Successfully opened " << src << std::endl;
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+PatternBankBinaryWriter::PatternBankBinaryWriter(int verbose)
+: data_(0), size_(0), header_(0), verbose_(verbose) {}
+
+PatternBankBinaryWriter::~PatternBankBinaryWriter() {
+    if (data_)  munmap(data_, size_);
+}
+
+int PatternBankBinaryWriter::init(TString out, const PatternBankBinaryHeader& header) {
+    if (!out.EndsWith(".bin")) {
+        std::cout << Error() << "Output filename must be .bin" << std::endl;
+        return 1;
+    }
+
+    // Lay out the arrays
+    const uint64_t npatterns = header.npatterns;
+    uint64_t offset = align64(sizeof(PatternBankBinaryHeader));
+
+    const uint64_t superstripIdsOffset = offset;
+    offset = align64(offset + npatterns * sizeof(pattern_type));
+
+    uint64_t superstripBitsOffset = 0;
+    if (header.nDCBits > 0) {
+        superstripBitsOffset = offset;
+        offset = align64(offset + npatterns * sizeof(pattern_bit_type));
+    }
+
+    const uint64_t frequencyOffset = offset;
+    offset = align64(offset + npatterns * sizeof(frequency_type));
+
+    const uint64_t invPtOffset = offset;
+    offset = offset + npatterns * sizeof(float);
+
+    // Create the file with its final size, then fill it through a writable mapping
+    if (verbose_)  std::cout << Info() << "Opening " << out << std::endl;
+    int fd = open(out.Data(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, offset) != 0) {
+        std::cout << Error() << "Failed to open " << out << std::endl;
+        if (fd >= 0)  close(fd);
+        return 1;
+    }
+
+    size_ = offset;
+    void * addr = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cout << Error() << "Failed to map " << out << std::endl;
+        size_ = 0;
+        return 1;
+    }
+    data_ = (char *) addr;
+    header_ = (PatternBankBinaryHeader *) data_;
+
+    *header_ = header;
+    std::memcpy(header_->magic, PATTERN_BANK_BINARY_MAGIC, sizeof(PATTERN_BANK_BINARY_MAGIC));
+    header_->version              = PATTERN_BANK_BINARY_VERSION;
+    header_->byteOrder            = PATTERN_BANK_BINARY_BYTEORDER;
+    header_->superstrip[sizeof(header_->superstrip) - 1] = '\0';
+    header_->superstripIdsOffset  = superstripIdsOffset;
+    header_->superstripBitsOffset = superstripBitsOffset;
+    header_->frequencyOffset      = frequencyOffset;
+    header_->invPtOffset          = invPtOffset;
+    header_->fileSize             = size_;
+
+    if (verbose_)  std::cout << Info() << "Successfully opened " << out << std::endl;
+    return 0;
+}
+
+void PatternBankBinaryWriter::fillPattern(Long64_t entry, const pattern_type& superstripIds, const pattern_bit_type& superstripBits,
+                                          frequency_type frequency, float invPt) {
+    assert(data_ != 0 && (uint64_t) entry < header_->npatterns);
+
+    ((pattern_type *) (data_ + header_->superstripIdsOffset))[entry] = superstripIds;
+    if (header_->superstripBitsOffset)
+        ((pattern_bit_type *) (data_ + header_->superstripBitsOffset))[entry] = superstripBits;
+    ((frequency_type *) (data_ + header_->frequencyOffset))[entry] = frequency;
+    ((float *) (data_ + header_->invPtOffset))[entry] = invPt;
+}
+
+Long64_t PatternBankBinaryWriter::writeFile() {
+    Long64_t nentries = header_->npatterns;
+    msync(data_, size_, MS_SYNC);
+    munmap(data_, size_);
+    data_ = 0;
+    header_ = 0;
+    size_ = 0;
+    return nentries;
+}
@@ -19,9 +19,12 @@ PatternBankReader::PatternBankReader(int verbose)
   pb_count          (0),
   pb_tower          (0),
   pb_superstrip     (0),
+  pb_nDCBits        (0),
+  pb_events         (0),
   //
   pb_frequency      (0),
   pb_superstripIds  (0),
+  pb_superstripBits (0),
   //
   verbose_(verbose) {}
 
@@ -70,12 +73,18 @@ int PatternBankReader::init(TString src) {
     ttree2->SetBranchAddress("count"       , &pb_count);
     ttree2->SetBranchAddress("tower"       , &pb_tower);
     ttree2->SetBranchAddress("superstrip"  , &pb_superstrip);
+    if (ttree2->GetBranch("nDCBits"))  // not in older banks
+        ttree2->SetBranchAddress("nDCBits"     , &pb_nDCBits);
+    if (ttree2->GetBranch("events"))  // not in older banks
+        ttree2->SetBranchAddress("events"      , &pb_events);
 
     ttree = (TTree*) tfile->Get("patternBank");
     assert(ttree != 0);
 
     ttree->SetBranchAddress("frequency"    , &pb_frequency);
     ttree->SetBranchAddress("superstripIds", &pb_superstripIds);
+    if (ttree->GetBranch("superstripBits"))  // not in older banks
+        ttree->SetBranchAddress("superstripBits", &pb_superstripBits);
 
     return 0;
 }
@@ -95,6 +104,26 @@ void PatternBankReader::getPatternInvPt(Long64_t entry, float& invPt_mean) {
     invPt_mean = pb_invPt_mean;
 }
 
+Int_t PatternBankReader::getPatternAttributes(Long64_t entry) {
+    if (ttree3 == 0)
+        return 0;
+    if (!ttree3->GetBranchStatus("z0_sigma"))
+        ttree3->SetBranchStatus("*", 1);
+    return ttree3->GetEntry(entry);
+}
+
+void PatternBankReader::getPatternBankDCBits(unsigned& nDCBits) {
+    ttree2->GetEntry(0);
+
+    nDCBits    = pb_nDCBits;
+}
+
+void PatternBankReader::getPatternBankEvents(unsigned& events) {
+    ttree2->GetEntry(0);
+
+    events     = pb_events;
+}
+
 
 // _____________________________________________________________________________
 PatternBankWriter::PatternBankWriter(int verbose)
@@ -111,9 +140,12 @@ PatternBankWriter::PatternBankWriter(int verbose)
   pb_count          (new unsigned(0)),
   pb_tower          (new unsigned(0)),
   pb_superstrip     (new std::string("")),
+  pb_nDCBits        (new unsigned(0)),
+  pb_events         (new unsigned(0)),
   //
   pb_frequency      (new frequency_type(0)),
   pb_superstripIds  (new std::vector<superstrip_type>()),
+  pb_superstripBits (new std::vector<superstrip_bit_type>()),
   //
   verbose_(verbose) {}
 
@@ -159,11 +191,14 @@ int PatternBankWriter::init(TString out) {
     ttree2->Branch("count"         , &(*pb_count));
     ttree2->Branch("tower"         , &(*pb_tower));
     ttree2->Branch("superstrip"    , &(*pb_superstrip));
+    ttree2->Branch("nDCBits"       , &(*pb_nDCBits));
+    ttree2->Branch("events"        , &(*pb_events));
 
     // Pattern bank
     ttree = new TTree("patternBank", "");
     ttree->Branch("frequency"      , &(*pb_frequency));
     ttree->Branch("superstripIds"  , &(*pb_superstripIds));
+    ttree->Branch("superstripBits" , &(*pb_superstripBits));
 
     return 0;
 }
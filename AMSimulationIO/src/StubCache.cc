@@ -0,0 +1,332 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/BasicReader.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/Helper.h"
+using namespace slhcl1tt;
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char     STUB_CACHE_MAGIC[8] = {'A','M','S','T','U','B','S','\0'};
+const uint32_t STUB_CACHE_BYTEORDER = 0x01020304;
+
+// Round up to a multiple of 64 bytes
+uint64_t align64(uint64_t n) {
+    return (n + 63) & ~uint64_t(63);
+}
+
+StubCacheColumn makeColumn(const char* name, StubCacheType type, StubCacheCollection collection) {
+    StubCacheColumn column;
+    std::memset(&column, 0, sizeof(column));
+    std::strncpy(column.name, name, sizeof(column.name) - 1);
+    column.type       = type;
+    column.collection = collection;
+    return column;
+}
+
+// Per-event offsets start at 0, do not decrease and end at the number of objects
+bool checkOffsets(const uint64_t* offsets, uint64_t nevents, uint64_t n) {
+    if (offsets[0] != 0 || offsets[nevents] != n)
+        return false;
+    for (uint64_t i=0; i<nevents; ++i) {
+        if (offsets[i] > offsets[i+1])
+            return false;
+    }
+    return true;
+}
+
+// Write zeros up to the given position
+bool padTo(std::FILE* f, uint64_t pos) {
+    static const char zeros[64] = {};
+    long here = std::ftell(f);
+    if (here < 0 || (uint64_t) here > pos)
+        return false;
+    for (uint64_t n = pos - here; n > 0; ) {
+        const size_t m = std::min(n, (uint64_t) sizeof(zeros));
+        if (std::fwrite(zeros, 1, m, f) != m)
+            return false;
+        n -= m;
+    }
+    return true;
+}
+}
+
+
+// _____________________________________________________________________________
+StubCacheReader::StubCacheReader(int verbose)
+: data_(0), size_(0), header_(0), columns_(0), verbose_(verbose) {}
+
+StubCacheReader::~StubCacheReader() {
+    if (data_)  munmap((void *) data_, size_);
+}
+
+int StubCacheReader::init(TString src) {
+    if (!src.EndsWith(".stubcache")) {
+        std::cout << Error() << "Input source must be .stubcache" << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << "Opening " << src << std::endl;
+    int fd = open(src.Data(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cout << Error() << "Failed to open " << src << std::endl;
+        if (fd >= 0)  close(fd);
+        return 1;
+    }
+
+    if ((size_t) st.st_size < sizeof(StubCacheHeader)) {
+        std::cout << Error() << "File is too small to be a stub cache: " << src << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    // The mapping stays valid after the file is closed, and the pages are shared
+    // with every other process that maps the same cache
+    size_ = st.st_size;
+    void * addr = mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cout << Error() << "Failed to map " << src << std::endl;
+        size_ = 0;
+        return 1;
+    }
+    data_ = (const char *) addr;
+    header_ = (const StubCacheHeader *) data_;
+    columns_ = (const StubCacheColumn *) (data_ + sizeof(StubCacheHeader));
+
+    // Check the header
+    if (std::memcmp(header_->magic, STUB_CACHE_MAGIC, sizeof(STUB_CACHE_MAGIC)) != 0) {
+        std::cout << Error() << "Not a stub cache: " << src << std::endl;
+        return 1;
+    }
+    if (header_->byteOrder != STUB_CACHE_BYTEORDER) {
+        std::cout << Error() << "Stub cache was written with a different byte order: " << src << std::endl;
+        return 1;
+    }
+    if (header_->version != STUB_CACHE_VERSION) {
+        std::cout << Error() << "Stub cache has version " << header_->version << ", expected " << STUB_CACHE_VERSION << std::endl;
+        return 1;
+    }
+    bool truncated = (header_->fileSize != size_ ||
+                      sizeof(StubCacheHeader) + header_->ncolumns * sizeof(StubCacheColumn) > size_ ||
+                      header_->stubOffsetsOffset + (header_->nevents + 1) * sizeof(uint64_t) > size_ ||
+                      header_->partOffsetsOffset + (header_->nevents + 1) * sizeof(uint64_t) > size_);
+    for (unsigned icol=0; icol<header_->ncolumns && !truncated; ++icol) {
+        const uint64_t n = (columns_[icol].collection == STUB_CACHE_STUBS) ? header_->nstubs : header_->nparts;
+        truncated = (columns_[icol].offset + n * 4 > size_);
+    }
+    if (truncated) {
+        std::cout << Error() << "Stub cache is truncated: " << src << std::endl;
+        return 1;
+    }
+
+    // Check the per-event offsets, so that getColumn() stays within the columns
+    const uint64_t* stubOffsets = (const uint64_t *) (data_ + header_->stubOffsetsOffset);
+    const uint64_t* partOffsets = (const uint64_t *) (data_ + header_->partOffsetsOffset);
+    if (!checkOffsets(stubOffsets, header_->nevents, header_->nstubs) ||
+        !checkOffsets(partOffsets, header_->nevents, header_->nparts)) {
+        std::cout << Error() << "Stub cache has inconsistent event offsets: " << src << std::endl;
+        return 1;
+    }
+
+    // The events are read in order
+    madvise(addr, size_, MADV_SEQUENTIAL);
+
+    if (verbose_)  std::cout << Info() << "Successfully opened " << src << std::endl;
+    return 0;
+}
+
+int StubCacheReader::findColumn(const char* name, StubCacheType type) const {
+    for (unsigned icol=0; icol<header_->ncolumns; ++icol) {
+        if (columns_[icol].type == (uint32_t) type && std::strncmp(columns_[icol].name, name, sizeof(columns_[icol].name)) == 0)
+            return icol;
+    }
+    return -1;
+}
+
+
+// _____________________________________________________________________________
+StubCacheWriter::StubCacheWriter(int verbose)
+: failed_(false), verbose_(verbose) {}
+
+StubCacheWriter::~StubCacheWriter() {
+    // Clean up after a run that did not get to writeFile()
+    closeColumnFiles();
+    for (unsigned icol=0; icol<columnPaths_.size(); ++icol)
+        std::remove(columnPaths_.at(icol).Data());
+}
+
+int StubCacheWriter::init(TString out) {
+    if (!out.EndsWith(".stubcache")) {
+        std::cout << Error() << "Output filename must be .stubcache" << std::endl;
+        return 1;
+    }
+    out_ = out;
+
+    // The branches read by TTStubReader without the full stub information, in
+    // the order of fill()
+    columns_.clear();
+    columns_.push_back(makeColumn("genParts_pt"     , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_eta"    , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_phi"    , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_vx"     , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_vy"     , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_vz"     , STUB_CACHE_FLOAT, STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("genParts_charge" , STUB_CACHE_INT  , STUB_CACHE_PARTS));
+    columns_.push_back(makeColumn("TTStubs_z"       , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_r"       , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_eta"     , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_phi"     , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_coordx"  , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_coordy"  , STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_trigBend", STUB_CACHE_FLOAT, STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_modId"   , STUB_CACHE_UINT , STUB_CACHE_STUBS));
+    columns_.push_back(makeColumn("TTStubs_tpId"    , STUB_CACHE_INT  , STUB_CACHE_STUBS));
+
+    // Open the temporary files
+    closeColumnFiles();
+    columnPaths_.clear();
+    columnSizes_.assign(columns_.size(), 0);
+    for (unsigned icol=0; icol<columns_.size(); ++icol) {
+        columnPaths_.push_back(out_ + Form(".%u.tmp", icol));
+        std::FILE* f = std::fopen(columnPaths_.back().Data(), "w+b");
+        if (!f) {
+            std::cout << Error() << "Failed to open " << columnPaths_.back() << std::endl;
+            return 1;
+        }
+        columnFiles_.push_back(f);
+    }
+
+    stubOffsets_.assign(1, 0);
+    partOffsets_.assign(1, 0);
+    failed_ = false;
+    return 0;
+}
+
+template <typename T>
+void StubCacheWriter::appendColumn(unsigned icol, const std::vector<T>* v) {
+    assert(v != 0);
+    static_assert(sizeof(T) == 4, "stub cache elements have 4 bytes");
+    if (!v->empty() && std::fwrite(v->data(), sizeof(T), v->size(), columnFiles_.at(icol)) != v->size())
+        failed_ = true;
+    columnSizes_.at(icol) += v->size() * sizeof(T);
+}
+
+void StubCacheWriter::fill(const BasicReader& reader) {
+    stubOffsets_.push_back(stubOffsets_.back() + reader.vb_modId->size());
+    partOffsets_.push_back(partOffsets_.back() + reader.vp_pt->size());
+
+    appendColumn( 0, reader.vp_pt);
+    appendColumn( 1, reader.vp_eta);
+    appendColumn( 2, reader.vp_phi);
+    appendColumn( 3, reader.vp_vx);
+    appendColumn( 4, reader.vp_vy);
+    appendColumn( 5, reader.vp_vz);
+    appendColumn( 6, reader.vp_charge);
+    appendColumn( 7, reader.vb_z);
+    appendColumn( 8, reader.vb_r);
+    appendColumn( 9, reader.vb_eta);
+    appendColumn(10, reader.vb_phi);
+    appendColumn(11, reader.vb_coordx);
+    appendColumn(12, reader.vb_coordy);
+    appendColumn(13, reader.vb_trigBend);
+    appendColumn(14, reader.vb_modId);
+    appendColumn(15, reader.vb_tpId);
+
+    // Every column of a collection must have one element per object
+    for (unsigned icol=0; icol<columns_.size(); ++icol) {
+        const uint64_t n = (columns_.at(icol).collection == STUB_CACHE_STUBS) ? stubOffsets_.back() : partOffsets_.back();
+        assert(columnSizes_.at(icol) == n * 4);
+    }
+}
+
+void StubCacheWriter::closeColumnFiles() {
+    for (unsigned icol=0; icol<columnFiles_.size(); ++icol)
+        std::fclose(columnFiles_.at(icol));
+    columnFiles_.clear();
+}
+
+Long64_t StubCacheWriter::writeFile() {
+    if (failed_) {
+        std::cout << Error() << "Failed to write the temporary files of " << out_ << std::endl;
+        return -1;
+    }
+
+    const uint64_t nevents = stubOffsets_.size() - 1;
+
+    // Lay out the arrays
+    uint64_t offset = align64(sizeof(StubCacheHeader) + columns_.size() * sizeof(StubCacheColumn));
+
+    const uint64_t stubOffsetsOffset = offset;
+    offset = align64(offset + stubOffsets_.size() * sizeof(uint64_t));
+
+    const uint64_t partOffsetsOffset = offset;
+    offset = align64(offset + partOffsets_.size() * sizeof(uint64_t));
+
+    for (unsigned icol=0; icol<columns_.size(); ++icol) {
+        columns_.at(icol).offset = offset;
+        offset = align64(offset + columnSizes_.at(icol));
+    }
+    const uint64_t size = offset;
+
+    StubCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, STUB_CACHE_MAGIC, sizeof(STUB_CACHE_MAGIC));
+    header.version           = STUB_CACHE_VERSION;
+    header.byteOrder         = STUB_CACHE_BYTEORDER;
+    header.nevents           = nevents;
+    header.nstubs            = stubOffsets_.back();
+    header.nparts            = partOffsets_.back();
+    header.ncolumns          = columns_.size();
+    header.stubOffsetsOffset = stubOffsetsOffset;
+    header.partOffsetsOffset = partOffsetsOffset;
+    header.fileSize          = size;
+
+    // Write the file in order, copying the columns from the temporary files
+    std::FILE* f = std::fopen(out_.Data(), "wb");
+    if (!f) {
+        std::cout << Error() << "Failed to open " << out_ << std::endl;
+        return -1;
+    }
+
+    bool good = (std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+                 std::fwrite(columns_.data(), sizeof(StubCacheColumn), columns_.size(), f) == columns_.size() &&
+                 padTo(f, stubOffsetsOffset) &&
+                 std::fwrite(stubOffsets_.data(), sizeof(uint64_t), stubOffsets_.size(), f) == stubOffsets_.size() &&
+                 padTo(f, partOffsetsOffset) &&
+                 std::fwrite(partOffsets_.data(), sizeof(uint64_t), partOffsets_.size(), f) == partOffsets_.size());
+
+    std::vector<char> buffer(1 << 20);
+    for (unsigned icol=0; icol<columns_.size() && good; ++icol) {
+        std::FILE* in = columnFiles_.at(icol);
+        good = padTo(f, columns_.at(icol).offset) && std::fflush(in) == 0 && std::fseek(in, 0, SEEK_SET) == 0;
+
+        uint64_t remaining = columnSizes_.at(icol);
+        while (good && remaining > 0) {
+            const size_t n = std::min(remaining, (uint64_t) buffer.size());
+            good = (std::fread(buffer.data(), 1, n, in) == n && std::fwrite(buffer.data(), 1, n, f) == n);
+            remaining -= n;
+        }
+    }
+    good = good && padTo(f, size);
+    good = (std::fclose(f) == 0) && good;
+
+    closeColumnFiles();
+    for (unsigned icol=0; icol<columnPaths_.size(); ++icol)
+        std::remove(columnPaths_.at(icol).Data());
+    columnPaths_.clear();
+
+    if (!good) {
+        std::cout << Error() << "Failed to write " << out_ << std::endl;
+        std::remove(out_.Data());
+        return -1;
+    }
+    return nevents;
+}
@@ -13,7 +13,14 @@ TTRoadReader::TTRoadReader(int verbose)
   vr_nstubs       (0),
   vr_patternInvPt (0),
   vr_superstripIds(0),
-  vr_stubRefs     (0) {}
+  vr_stubRefs     (0),
+  vr_layerOffsets (0),
+  vr_stubRefOffsets(0),
+  vr_superstripIdsFlat(0),
+  vr_stubRefsFlat (0),
+  vr_superstripRefs(0),
+
+  flat_(false), dedup_(false) {}
 
 TTRoadReader::~TTRoadReader() {}
 
@@ -26,57 +33,197 @@ int TTRoadReader::init(TString src, TString prefix, TString suffix) {
     tchain->SetBranchAddress(prefix + "tower"         + suffix, &(vr_tower));
     tchain->SetBranchAddress(prefix + "nstubs"        + suffix, &(vr_nstubs));
     tchain->SetBranchAddress(prefix + "patternInvPt"  + suffix, &(vr_patternInvPt));
-    tchain->SetBranchAddress(prefix + "superstripIds" + suffix, &(vr_superstripIds));
-    tchain->SetBranchAddress(prefix + "stubRefs"      + suffix, &(vr_stubRefs));
+
+    // Use the flat road layout if the input has it
+    flat_  = (tchain->GetBranch(prefix + "stubRefsFlat"   + suffix) != 0);
+    dedup_ = (tchain->GetBranch(prefix + "superstripRefs" + suffix) != 0);
+
+    if (flat_) {
+        if (verbose_)  std::cout << Info() << "Reading the roads in the flat" << (dedup_ ? " deduplicated" : "") << " layout." << std::endl;
+        tchain->SetBranchAddress(prefix + "layerOffsets"      + suffix, &(vr_layerOffsets));
+        tchain->SetBranchAddress(prefix + "stubRefOffsets"    + suffix, &(vr_stubRefOffsets));
+        tchain->SetBranchAddress(prefix + "superstripIdsFlat" + suffix, &(vr_superstripIdsFlat));
+        tchain->SetBranchAddress(prefix + "stubRefsFlat"      + suffix, &(vr_stubRefsFlat));
+        if (dedup_)
+            tchain->SetBranchAddress(prefix + "superstripRefs" + suffix, &(vr_superstripRefs));
+    } else {
+        tchain->SetBranchAddress(prefix + "superstripIds" + suffix, &(vr_superstripIds));
+        tchain->SetBranchAddress(prefix + "stubRefs"      + suffix, &(vr_stubRefs));
+    }
+
+    registerEventBuffer(prefix + "patternRef"    + suffix, &vr_patternRef);
+    registerEventBuffer(prefix + "tower"         + suffix, &vr_tower);
+    registerEventBuffer(prefix + "nstubs"        + suffix, &vr_nstubs);
+    registerEventBuffer(prefix + "patternInvPt"  + suffix, &vr_patternInvPt);
+
+    if (flat_) {
+        registerEventBuffer(prefix + "layerOffsets"      + suffix, &vr_layerOffsets);
+        registerEventBuffer(prefix + "stubRefOffsets"    + suffix, &vr_stubRefOffsets);
+        registerEventBuffer(prefix + "superstripIdsFlat" + suffix, &vr_superstripIdsFlat);
+        registerEventBuffer(prefix + "stubRefsFlat"      + suffix, &vr_stubRefsFlat);
+        if (dedup_)
+            registerEventBuffer(prefix + "superstripRefs" + suffix, &vr_superstripRefs);
+    } else {
+        registerEventBuffer(prefix + "superstripIds" + suffix, &vr_superstripIds);
+        registerEventBuffer(prefix + "stubRefs"      + suffix, &vr_stubRefs);
+    }
     return 0;
 }
 
+void TTRoadReader::getStubRefs(unsigned iroad, std::vector<std::vector<unsigned> >& stubRefs) const {
+    if (!flat_) {
+        stubRefs = vr_stubRefs->at(iroad);
+        return;
+    }
+
+    const unsigned nlayers = getNLayers(iroad);
+    stubRefs.resize(nlayers);
+
+    for (unsigned ilayer=0; ilayer<nlayers; ++ilayer) {
+        const unsigned j     = getSuperstripRef(iroad, ilayer);
+        const unsigned begin = vr_stubRefOffsets->at(j);
+        const unsigned end   = vr_stubRefOffsets->at(j+1);
+        stubRefs[ilayer].assign(vr_stubRefsFlat->begin() + begin, vr_stubRefsFlat->begin() + end);
+    }
+}
+
 
 // _____________________________________________________________________________
 TTRoadWriter::TTRoadWriter(int verbose)
-: BasicWriter(verbose),
-
-  vr_patternRef     (new std::vector<unsigned>()),
-  vr_tower          (new std::vector<unsigned>()),
-  vr_nstubs         (new std::vector<unsigned>()),
-  vr_patternInvPt   (new std::vector<float>()),
-  vr_superstripIds  (new std::vector<std::vector<unsigned> >()),
-  vr_stubRefs       (new std::vector<std::vector<std::vector<unsigned> > >()) {}
+: BasicWriter(verbose), flat_(false), dedup_(false) {}
 
 TTRoadWriter::~TTRoadWriter() {}
 
-int TTRoadWriter::init(TChain* tchain, TString out, TString prefix, TString suffix) {
+int TTRoadWriter::init(TChain* tchain, TString out, TString prefix, TString suffix, bool flat, bool dedup) {
+    return init(tchain, out, prefix, std::vector<TString>(1, suffix), flat, dedup);
+}
+
+int TTRoadWriter::init(TChain* tchain, TString out, TString prefix, const std::vector<TString>& suffixes, bool flat, bool dedup) {
     if (BasicWriter::init(tchain, out))
         return 1;
 
-    ttree->Branch(prefix + "patternRef"    + suffix, &(*vr_patternRef));
-    ttree->Branch(prefix + "tower"         + suffix, &(*vr_tower));
-    ttree->Branch(prefix + "nstubs"        + suffix, &(*vr_nstubs));
-    ttree->Branch(prefix + "patternInvPt"  + suffix, &(*vr_patternInvPt));
-    ttree->Branch(prefix + "superstripIds" + suffix, &(*vr_superstripIds));
-    ttree->Branch(prefix + "stubRefs"      + suffix, &(*vr_stubRefs));
+    flat_  = flat || dedup;  // the deduplicated layout is a flat layout
+    dedup_ = dedup;
+
+    // The branches keep the addresses of the vectors, deque::resize() does not move them
+    const unsigned nsuffixes = suffixes.size();
+    vr_patternRef   .resize(nsuffixes);
+    vr_tower        .resize(nsuffixes);
+    vr_nstubs       .resize(nsuffixes);
+    vr_patternInvPt .resize(nsuffixes);
+    vr_superstripIds.resize(nsuffixes);
+    vr_stubRefs     .resize(nsuffixes);
+    vr_layerOffsets .resize(nsuffixes);
+    vr_stubRefOffsets.resize(nsuffixes);
+    vr_superstripIdsFlat.resize(nsuffixes);
+    vr_stubRefsFlat .resize(nsuffixes);
+    vr_superstripRefs.resize(nsuffixes);
+
+    for (unsigned i=0; i<nsuffixes; ++i) {
+        const TString& suffix = suffixes.at(i);
+        ttree->Branch(prefix + "patternRef"    + suffix, &(vr_patternRef   .at(i)));
+        ttree->Branch(prefix + "tower"         + suffix, &(vr_tower        .at(i)));
+        ttree->Branch(prefix + "nstubs"        + suffix, &(vr_nstubs       .at(i)));
+        ttree->Branch(prefix + "patternInvPt"  + suffix, &(vr_patternInvPt .at(i)));
+        if (flat_) {
+            ttree->Branch(prefix + "layerOffsets"      + suffix, &(vr_layerOffsets     .at(i)));
+            ttree->Branch(prefix + "stubRefOffsets"    + suffix, &(vr_stubRefOffsets   .at(i)));
+            ttree->Branch(prefix + "superstripIdsFlat" + suffix, &(vr_superstripIdsFlat.at(i)));
+            ttree->Branch(prefix + "stubRefsFlat"      + suffix, &(vr_stubRefsFlat     .at(i)));
+            if (dedup_)
+                ttree->Branch(prefix + "superstripRefs" + suffix, &(vr_superstripRefs.at(i)));
+        } else {
+            ttree->Branch(prefix + "superstripIds" + suffix, &(vr_superstripIds.at(i)));
+            ttree->Branch(prefix + "stubRefs"      + suffix, &(vr_stubRefs     .at(i)));
+        }
+    }
     return 0;
 }
 
-void TTRoadWriter::fill(const std::vector<TTRoad>& roads) {
-    vr_patternRef   ->clear();
-    vr_tower        ->clear();
-    vr_nstubs       ->clear();
-    vr_patternInvPt ->clear();
-    vr_superstripIds->clear();
-    vr_stubRefs     ->clear();
+void TTRoadWriter::setRoads(unsigned i, const std::vector<TTRoad>& roads, const TTSuperstripTable& table) {
+    vr_patternRef   .at(i).clear();
+    vr_tower        .at(i).clear();
+    vr_nstubs       .at(i).clear();
+    vr_patternInvPt .at(i).clear();
+    vr_superstripIds.at(i).clear();
+    vr_stubRefs     .at(i).clear();
+    vr_layerOffsets .at(i).clear();
+    vr_stubRefOffsets.at(i).clear();
+    vr_superstripIdsFlat.at(i).clear();
+    vr_stubRefsFlat .at(i).clear();
+    vr_superstripRefs.at(i).clear();
+
+    // The superstrip table is already deduplicated, write it as it is
+    if (dedup_) {
+        vr_superstripIdsFlat.at(i) = table.superstripIds;
+        vr_stubRefOffsets   .at(i) = table.stubRefOffsets;
+        vr_stubRefsFlat     .at(i) = table.stubRefs;
+    }
 
     const unsigned nroads = roads.size();
-    for (unsigned i=0; i<nroads; ++i) {
-        const TTRoad& road = roads.at(i);
-        vr_patternRef   ->push_back(road.patternRef);
-        vr_tower        ->push_back(road.tower);
-        vr_nstubs       ->push_back(road.nstubs);
-        vr_patternInvPt ->push_back(road.patternInvPt);
-        vr_superstripIds->push_back(road.superstripIds);
-        vr_stubRefs     ->push_back(road.stubRefs);
+    for (unsigned j=0; j<nroads; ++j) {
+        const TTRoad& road = roads.at(j);
+        vr_patternRef   .at(i).push_back(road.patternRef);
+        vr_tower        .at(i).push_back(road.tower);
+        vr_nstubs       .at(i).push_back(road.nstubs);
+        vr_patternInvPt .at(i).push_back(road.patternInvPt);
+
+        if (dedup_) {
+            std::vector<unsigned>& superstripRefs = vr_superstripRefs.at(i);
+            vr_layerOffsets.at(i).push_back(superstripRefs.size());
+            superstripRefs.insert(superstripRefs.end(), road.superstripRefs.begin(), road.superstripRefs.end());
+
+        } else if (flat_) {
+            std::vector<unsigned>& stubRefOffsets    = vr_stubRefOffsets   .at(i);
+            std::vector<unsigned>& superstripIdsFlat = vr_superstripIdsFlat.at(i);
+            std::vector<unsigned>& stubRefsFlat      = vr_stubRefsFlat     .at(i);
+
+            vr_layerOffsets.at(i).push_back(superstripIdsFlat.size());
+            for (unsigned k=0; k<road.superstripRefs.size(); ++k) {
+                const unsigned ref = road.superstripRefs.at(k);
+                stubRefOffsets   .push_back(stubRefsFlat.size());
+                superstripIdsFlat.push_back(table.superstripIds.at(ref));
+                stubRefsFlat     .insert(stubRefsFlat.end(), table.stubRefs.begin() + table.stubRefOffsets.at(ref),
+                                         table.stubRefs.begin() + table.stubRefOffsets.at(ref+1));
+            }
+
+        } else {
+            vr_superstripIds.at(i).push_back(std::vector<unsigned>());
+            vr_stubRefs     .at(i).push_back(std::vector<std::vector<unsigned> >());
+            std::vector<unsigned>& superstripIds = vr_superstripIds.at(i).back();
+            std::vector<std::vector<unsigned> >& stubRefs = vr_stubRefs.at(i).back();
+
+            for (unsigned k=0; k<road.superstripRefs.size(); ++k) {
+                const unsigned ref = road.superstripRefs.at(k);
+                superstripIds.push_back(table.superstripIds.at(ref));
+                stubRefs.push_back(std::vector<unsigned>(table.stubRefs.begin() + table.stubRefOffsets.at(ref),
+                                                         table.stubRefs.begin() + table.stubRefOffsets.at(ref+1)));
+            }
+        }
+    }
+
+    // Close the offset arrays
+    if (dedup_) {
+        vr_layerOffsets  .at(i).push_back(vr_superstripRefs.at(i).size());
+    } else if (flat_) {
+        vr_layerOffsets  .at(i).push_back(vr_superstripIdsFlat.at(i).size());
+        vr_stubRefOffsets.at(i).push_back(vr_stubRefsFlat     .at(i).size());
     }
+    assert(vr_patternRef.at(i).size() == nroads);
+}
+
+void TTRoadWriter::fill(const std::vector<TTRoad>& roads, const TTSuperstripTable& table) {
+    assert(vr_patternRef.size() == 1);
+    setRoads(0, roads, table);
+
+    ttree->Fill();
+}
+
+void TTRoadWriter::fill(const std::vector<std::vector<TTRoad> >& roadsPerSuffix, const std::vector<TTSuperstripTable>& tablesPerSuffix) {
+    assert(vr_patternRef.size() == roadsPerSuffix.size());
+    assert(tablesPerSuffix.size() == roadsPerSuffix.size());
+    for (unsigned i=0; i<roadsPerSuffix.size(); ++i)
+        setRoads(i, roadsPerSuffix.at(i), tablesPerSuffix.at(i));
 
     ttree->Fill();
-    assert(vr_patternRef->size() == nroads);
 }
@@ -26,6 +26,11 @@ int TTStubPlusTPReader::init(TString src, bool full) {
     if (BasicReader::init(src, full))
         return 1;
 
+    if (isStubCache()) {
+        std::cout << Error() << "The stub cache has no tracking particles." << std::endl;
+        return 1;
+    }
+
     tchain->SetBranchAddress("trkParts_pt"       , &(vp2_pt));
     tchain->SetBranchAddress("trkParts_eta"      , &(vp2_eta));
     tchain->SetBranchAddress("trkParts_phi"      , &(vp2_phi));
@@ -49,6 +54,18 @@ int TTStubPlusTPReader::init(TString src, bool full) {
     tchain->SetBranchStatus("trkParts_signal"   , 1);
     tchain->SetBranchStatus("trkParts_intime"   , 1);
     tchain->SetBranchStatus("trkParts_primary"  , 1);
+
+    registerEventBuffer("trkParts_pt"       , &vp2_pt);
+    registerEventBuffer("trkParts_eta"      , &vp2_eta);
+    registerEventBuffer("trkParts_phi"      , &vp2_phi);
+    registerEventBuffer("trkParts_vx"       , &vp2_vx);
+    registerEventBuffer("trkParts_vy"       , &vp2_vy);
+    registerEventBuffer("trkParts_vz"       , &vp2_vz);
+    registerEventBuffer("trkParts_charge"   , &vp2_charge);
+    registerEventBuffer("trkParts_pdgId"    , &vp2_pdgId);
+    registerEventBuffer("trkParts_signal"   , &vp2_signal);
+    registerEventBuffer("trkParts_intime"   , &vp2_intime);
+    registerEventBuffer("trkParts_primary"  , &vp2_primary);
     return 0;
 }
 
@@ -20,7 +20,7 @@ int TTTrackReader::init(TString src, TString prefixRoad, TString prefixTrack, TS
 
 // _____________________________________________________________________________
 TTTrackWriter::TTTrackWriter(int verbose)
-: BasicWriter(verbose),
+: TTRoadWriter(verbose),
 
   vt_px           (new std::vector<float>()),
   vt_py           (new std::vector<float>()),
@@ -60,6 +60,19 @@ int TTTrackWriter::init(TChain* tchain, TString out, TString prefix, TString suf
     if (BasicWriter::init(tchain, out))
         return 1;
 
+    makeTrackBranches(prefix, suffix);
+    return 0;
+}
+
+int TTTrackWriter::init(TChain* tchain, TString out, TString prefixRoad, TString prefixTrack, TString suffix, bool flat, bool dedup) {
+    if (TTRoadWriter::init(tchain, out, prefixRoad, suffix, flat, dedup))
+        return 1;
+
+    makeTrackBranches(prefixTrack, suffix);
+    return 0;
+}
+
+void TTTrackWriter::makeTrackBranches(TString prefix, TString suffix) {
   //ttree->Branch(prefix + "px"             + suffix, &(*vt_px));
   //ttree->Branch(prefix + "py"             + suffix, &(*vt_py));
   //ttree->Branch(prefix + "pz"             + suffix, &(*vt_pz));
@@ -90,7 +103,6 @@ int TTTrackWriter::init(TChain* tchain, TString out, TString prefix, TString suf
     ttree->Branch(prefix + "patternRef"     + suffix, &(*vt_patternRef));
     ttree->Branch(prefix + "stubRefs"       + suffix, &(*vt_stubRefs));
     ttree->Branch(prefix + "principals"     + suffix, &(*vt_principals));
-    return 0;
 }
 
 void TTTrackWriter::fill(const std::vector<TTTrack>& tracks) {
@@ -153,6 +165,19 @@ void TTTrackWriter::fill(const std::vector<TTTrack>& tracks) {
 }
 
 void TTTrackWriter::fill(const std::vector<TTTrack2>& tracks) {
+    setTracks(tracks);
+
+    ttree->Fill();
+}
+
+void TTTrackWriter::fill(const std::vector<TTRoad>& roads, const TTSuperstripTable& table, const std::vector<TTTrack2>& tracks) {
+    setRoads(0, roads, table);
+    setTracks(tracks);
+
+    ttree->Fill();
+}
+
+void TTTrackWriter::setTracks(const std::vector<TTTrack2>& tracks) {
     vt_px              ->clear();
     vt_py              ->clear();
     vt_pz              ->clear();
@@ -219,7 +244,5 @@ void TTTrackWriter::fill(const std::vector<TTTrack2>& tracks) {
         vt_stubRefs        ->push_back(track.stubRefs());
         vt_principals      ->push_back(track.principals());
     }
-
-    ttree->Fill();
     assert(vt_pt->size() == ntracks);
 }